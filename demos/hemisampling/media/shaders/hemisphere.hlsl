@@ -36,9 +36,13 @@ PS_INPUT VS(VS_INPUT input)
     PS_INPUT output = (PS_INPUT)0;
    
     output.Pos = mul(float4(input.Pos, 1.0f), MVP);
+#if LIGHTING
     float3 n = normalize(input.Normal);
     float nDotL = max(dot(normalize(-LightDirection), n), 0);
     output.Color =nDotL * Diffuse + Ambient;
+#else
+    output.Color = Ambient;
+#endif
     output.Clip = input.Pos.y;
     return output;
 }
@@ -8,6 +8,8 @@
 
 #include "renderer.h"
 
+#include <dxf/util/sampling.h>
+
 #include <directxmath.h>
 #include <directxcolors.h>
 
@@ -15,7 +17,8 @@
 Renderer::Renderer()
     : AbstractRenderer()
 {
-    m_sphereShader = NULL;
+    m_sphereShaders = NULL;
+    m_lightingKeyword = 0;
     m_pointsShader = NULL;
     m_sphere = NULL;
     m_points = NULL;
@@ -23,6 +26,9 @@ Renderer::Renderer()
     m_cbEveryFrame = NULL;
     m_cbEveryFrame2 = NULL;
     m_showPoints = true;
+    m_lighting = true;
+    m_kernel = KERNEL_FILE;
+    m_numKernelSamples = 128;
 }
 
 Renderer::~Renderer()
@@ -41,38 +47,51 @@ HRESULT Renderer::initialize(ID3D11Device* device,
     // shaders
     //
 #define SHADER_ROOT L"../demos/hemisampling/media/shaders"
-    m_sphereShader = new dxf::Shader(m_device);
-    V_RETURN(m_sphereShader->addVSShader(SHADER_ROOT L"/hemisphere.hlsl", "VS"));
-    V_RETURN(m_sphereShader->addPSShader(SHADER_ROOT L"/hemisphere.hlsl", "PS"));
+    dxf::ShaderBatch shaderBatch;
+
+    m_sphereShaders = new dxf::ShaderVariants(m_device);
+    m_lightingKeyword = m_sphereShaders->addKeyword("LIGHTING");
+    m_sphereShaders->addStage(VERTEX_SHADER_BIT, SHADER_ROOT L"/hemisphere.hlsl", "VS");
+    m_sphereShaders->addStage(PIXEL_SHADER_BIT, SHADER_ROOT L"/hemisphere.hlsl", "PS");
+    m_sphereShaders->enqueue(&shaderBatch);
 
     m_pointsShader = new dxf::Shader(m_device);
-    V_RETURN(m_pointsShader->addVSShader(SHADER_ROOT L"/points.hlsl", "VS"));
-    V_RETURN(m_pointsShader->addGSShader(SHADER_ROOT L"/points.hlsl", "GS"));
-    V_RETURN(m_pointsShader->addPSShader(SHADER_ROOT L"/points.hlsl", "PS"));
+    shaderBatch.addVSShader(m_pointsShader, SHADER_ROOT L"/points.hlsl", "VS");
+    shaderBatch.addGSShader(m_pointsShader, SHADER_ROOT L"/points.hlsl", "GS");
+    shaderBatch.addPSShader(m_pointsShader, SHADER_ROOT L"/points.hlsl", "PS");
+
+    V_RETURN(shaderBatch.compile());
 #undef SHADER_ROOT 
 
     //
     // Models
     //
-#define MODEL_ROOT "../demos/hemisampling/media/models"
     m_sphere = new dxf::Model(m_device);
-    V_RETURN(m_sphere->loadSphere(64, 32, m_sphereShader));
+    // All the variants share the same input signature.
+    V_RETURN(m_sphere->loadSphere(64, 32, m_sphereShaders->shader(0)));
 
-    m_points = new dxf::Model(m_device);
-    V_RETURN(m_points->loadXYZ(MODEL_ROOT"/points.xyz", m_pointsShader));
-#undef MODEL_ROOT
+    V_RETURN(loadKernel());
 
     //
     // Constant buffers
     //
+    // The stages and slots come from the shaders.
+    const dxf::Shader* sphereShader = m_sphereShaders->shader(m_sphereShaders->key(m_lightingKeyword, 1));
+
     m_cbEveryFrame = new dxf::CBuffer<CbEveryFrameStruct>(m_device);
-    V_RETURN(m_cbEveryFrame->create(m_context, "cb-everyframe", "vs", 0));
+    V_RETURN(m_cbEveryFrame->create(m_context, sphereShader, "cbChangesEveryFrame"));
 
     m_cbEveryFrame2 = new dxf::CBuffer<CbEveryFrameStruct2>(m_device);
-    V_RETURN(m_cbEveryFrame2->create(m_context, "cb-everyframe2", "gs", 0));
+    V_RETURN(m_cbEveryFrame2->create(m_context, m_pointsShader, "cbChangesEveryFrame"));
     
     m_cbInit = new dxf::CBuffer<CbInitStruct>(m_device);
-    V_RETURN(m_cbInit->create(m_context, "cb-init", "vs", 1));
+    V_RETURN(m_cbInit->create(m_context, sphereShader, "cbInit"));
+    if (!DXF_CBUFFER_CHECK(m_cbInit, CbInitStruct, light.ambient, "Ambient") ||
+        !DXF_CBUFFER_CHECK(m_cbInit, CbInitStruct, light.diffuse, "Diffuse") ||
+        !DXF_CBUFFER_CHECK(m_cbInit, CbInitStruct, light.position, "LightDirection"))
+    {
+        return E_FAIL;
+    }
 
     m_cbInit->data().light.position = DirectX::XMFLOAT3(0.5f, -1.0f, -0.3f);
     m_cbInit->data().light.ambient  = DirectX::XMFLOAT4(245.0f / 255.0f, 127.0f / 255.0f, 128.0f / 255.0f, 1.0f);
@@ -112,11 +131,34 @@ HRESULT Renderer::initialize(ID3D11Device* device,
     return S_OK;
 }
 
+HRESULT Renderer::loadKernel()
+{
+    HRESULT hr;
+
+    SAFE_DELETE(m_points);
+    m_points = new dxf::Model(m_device);
+
+    if (m_kernel == KERNEL_FILE)
+    {
+#define MODEL_ROOT "../demos/hemisampling/media/models"
+        V_RETURN(m_points->loadXYZ(MODEL_ROOT"/points.xyz", m_pointsShader));
+#undef MODEL_ROOT
+        return S_OK;
+    }
+
+    // The power cosine of the exponent 8 is a narrow lobe around +y.
+    std::vector<float> points;
+    samplingHemisphere(m_kernel - KERNEL_UNIFORM, 8.0f, m_numKernelSamples, 1, &points);
+    V_RETURN(m_points->loadPoints(&points[0], m_numKernelSamples, m_pointsShader));
+
+    return S_OK;
+}
+
 void Renderer::uninitialize()
 {
     SAFE_DELETE(m_sphere);
     SAFE_DELETE(m_points);
-    SAFE_DELETE(m_sphereShader);
+    SAFE_DELETE(m_sphereShaders);
     SAFE_DELETE(m_pointsShader);
     SAFE_RELEASE(m_dsState);
     SAFE_RELEASE(m_blendState);
@@ -137,7 +179,7 @@ void Renderer::render(double fTime,
     ID3D11DepthStencilView* pDSV = DXUTGetD3D11DepthStencilView();
     m_context->ClearDepthStencilView(pDSV, D3D11_CLEAR_DEPTH, 1.0, 0);
 
-    m_sphereShader->bind(m_context);
+    m_sphereShaders->shader(m_sphereShaders->key(m_lightingKeyword, m_lighting? 1 : 0))->bind(m_context);
 
     m_context->OMSetDepthStencilState(m_dsState, 0);
     m_context->OMSetBlendState(0, 0, 0xffffffff);
@@ -148,7 +190,7 @@ void Renderer::render(double fTime,
     m_cbEveryFrame->sync(m_context);
     m_sphere->render(m_context);
 
-    if (m_showPoints)
+    if (m_showPoints && m_points != NULL)
     {
         m_pointsShader->bind(m_context);
 
@@ -164,6 +206,28 @@ void Renderer::renderText(double fTime,
                           float fElapsedTime)
 {
     AbstractRenderer::renderText(fTime, fElapsedTime);
+
+    static const WCHAR* kernelNames[NUM_KERNELS] =
+    {
+        L"points.xyz",
+        L"uniform",
+        L"cosine",
+        L"power cosine",
+    };
+
+    m_txtHelper->Begin();
+    m_txtHelper->SetInsertionPos(5, 45);
+    m_txtHelper->SetForegroundColor(DirectX::XMFLOAT4(1.0f, 1.0f, 0.0f, 1.0f));
+    if (m_kernel == KERNEL_FILE)
+    {
+        m_txtHelper->DrawFormattedTextLine(L"Kernel (K): %s", kernelNames[m_kernel]);
+    }
+    else
+    {
+        m_txtHelper->DrawFormattedTextLine(L"Kernel (K): %s, the first %u samples (N)", kernelNames[m_kernel],
+            m_numKernelSamples);
+    }
+    m_txtHelper->End();
 }
 
 void Renderer::update(double fTime, float fElapsedTime)
@@ -185,10 +249,35 @@ void Renderer::keyboard(UINT c,
                         bool bKeyDown, 
                         bool bAltDown)
 {
-    if (c == 80 && bKeyDown)
+    if (c == 'P' && bKeyDown)
     {
         m_showPoints = !m_showPoints;
     }
+    if (c == 'L' && bKeyDown)
+    {
+        m_lighting = !m_lighting;
+    }
+    if (c == 'K' && bKeyDown)
+    {
+        m_kernel = (m_kernel + 1) % NUM_KERNELS;
+        reloadKernel();
+    }
+    // Any prefix of a generated kernel is a kernel.
+    if (c == 'N' && bKeyDown)
+    {
+        m_numKernelSamples = m_numKernelSamples >= 128? 16 : m_numKernelSamples * 2;
+        reloadKernel();
+    }
+}
+
+void Renderer::reloadKernel()
+{
+    HRESULT hr = loadKernel();
+    if (FAILED(hr))
+    {
+        DXF_LOGERROR("Failed to load kernel %u of %u samples (0x%08x)", m_kernel, m_numKernelSamples, (unsigned)hr);
+        SAFE_DELETE(m_points);
+    }
 }
     
 LRESULT Renderer::msgproc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
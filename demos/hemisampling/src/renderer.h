@@ -27,12 +27,20 @@ public:
     virtual void keyboard(UINT c, bool bKeyDown, bool bAltDown);
     virtual LRESULT msgproc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
+private:
+    // Load the points of the current kernel.
+    HRESULT loadKernel();
+    // loadKernel() from the keyboard. A kernel that fails to load is logged
+    // and not drawn until another one loads.
+    void reloadKernel();
+
 private:
     ID3D11DepthStencilState*           m_dsState;
     ID3D11BlendState*                  m_blendState;
     dxf::Model*                        m_sphere;
     dxf::Model*                        m_points;
-    dxf::Shader*                       m_sphereShader;
+    dxf::ShaderVariants*               m_sphereShaders;
+    UINT                               m_lightingKeyword;
     dxf::Shader*                       m_pointsShader;
     struct CbEveryFrameStruct   
     {
@@ -52,6 +60,21 @@ private:
     dxf::CBuffer<CbInitStruct>*        m_cbInit;
     CModelViewerCamera                 m_camera; 
     bool                               m_showPoints;
+    bool                               m_lighting;
+    // KERNEL_FILE is points.xyz, the others are generated by
+    // samplingHemisphere().
+    enum
+    {
+        KERNEL_FILE,
+        KERNEL_UNIFORM,
+        KERNEL_COSINE,
+        KERNEL_POWER_COSINE,
+
+        NUM_KERNELS,
+    };
+    UINT                               m_kernel;
+    // The first samples of the generated kernels.
+    UINT                               m_numKernelSamples;
 };
 
 
@@ -1,14 +1,21 @@
 cbuffer cbChangesEveryFrame : register(b0)
 {
-    matrix MVP[128];
-    matrix WorldView[128];
-    int4   Tiling[128];
+    matrix ViewProj;
 };
 cbuffer cbInitial : register(b1)
 {
     float4 TileUV[64];
 };
 
+struct BlockInstance
+{
+    float2 Translation; // x, z
+    int    Tile;
+    int    Padding;
+};
+StructuredBuffer<BlockInstance> Blocks : register(t2);
+StructuredBuffer<uint>          Visible : register(t3); // The slots of the drawn blocks
+
 struct VS_INPUT
 {
     float3 Pos    : POSITION;
@@ -30,10 +37,15 @@ PS_INPUT VS(VS_INPUT input, uint instanceID : SV_InstanceID)
 {
     PS_INPUT output = (PS_INPUT)0;
    
-    output.Pos = mul(float4(input.Pos, 1.0f), MVP[instanceID]);
-    float4 uv = TileUV[Tiling[instanceID].x];
+    // The blocks are cached in a toroidal grid; see BlockCache. Only the
+    // ones overlapping the spotlight cone are drawn.
+    BlockInstance block = Blocks[Visible[instanceID]];
+    float4 worldPos = float4(input.Pos + float3(block.Translation.x, 0, block.Translation.y), 1.0f);
+   
+    output.Pos = mul(worldPos, ViewProj);
+    float4 uv = TileUV[block.Tile];
     output.UV = float4(float2(1-input.Tex.y, 1-input.Tex.x) * uv.xy + uv.zw, 0, 1);
-    output.WorldPos = mul(float4(input.Pos, 1.0f), WorldView[instanceID]);
+    output.WorldPos = worldPos;
     //output.UV = float4(1 - input.Tex.y, 1 - input.Tex.x, 0, 1);
     return output;
 }
@@ -0,0 +1,45 @@
+cbuffer cbChangesEveryFrame
+{
+    matrix MVP;
+};
+
+struct VS_INPUT
+{
+    float3 Pos    : POSITION;
+    float3 Normal : NORMAL;
+};
+
+struct PS_INPUT
+{
+    float4 Pos    : SV_POSITION;
+    float3 Normal : NORMAL;
+    float  Height : TEXCOORD0;
+};
+
+//--------------------------------------------------------------------------------------
+// Vertex Shader
+//--------------------------------------------------------------------------------------
+PS_INPUT VS(VS_INPUT input)
+{
+    PS_INPUT output = (PS_INPUT)0;
+
+    output.Pos = mul(float4(input.Pos, 1.0f), MVP);
+    output.Normal = input.Normal;
+    output.Height = input.Pos.y;
+    return output;
+}
+
+//--------------------------------------------------------------------------------------
+// Pixel Shader
+//--------------------------------------------------------------------------------------
+float4 PS(PS_INPUT input) : SV_TARGET
+{
+    // Green valleys and gray peaks lit by a low sun, so that the LODs
+    // show in the shading. The heights go up to the heightScale of the
+    // walking demo's terrain.
+    float3 light = normalize(float3(-0.5f, 0.6f, 0.4f));
+    float diffuse = saturate(dot(normalize(input.Normal), light)) * 0.8f + 0.2f;
+    float3 color = lerp(float3(0.25f, 0.45f, 0.2f), float3(0.6f, 0.6f, 0.6f),
+        saturate(input.Height / 64.0f));
+    return float4(color * diffuse, 1.0f);
+}
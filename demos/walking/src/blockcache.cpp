@@ -0,0 +1,219 @@
+// blockcache.cpp
+//
+// Created at 2014/04/12
+//
+// Hongwei Li hongwei.li@amd.com
+// All rights reserved
+
+#include "blockcache.h"
+
+#include <dxf/dxf.h>
+#include <dxf/util/timer.h>
+
+#include <algorithm>
+#include <math.h>
+
+#include "walking.h"
+#include "wangtiling.h"
+
+static unsigned int nextPowerOfTwo(unsigned int n)
+{
+    unsigned int p = 1;
+    while (p < n)
+    {
+        p <<= 1;
+    }
+    return p;
+}
+
+BlockCache::BlockCache(unsigned int seed)
+{
+    m_seed = seed;
+    m_rows = 0;
+    m_cols = 0;
+    memset(m_window, 0, sizeof(m_window));
+    m_valid = false;
+    m_numFilled = 0;
+}
+
+BlockCache::~BlockCache()
+{
+}
+
+void BlockCache::update(int xmin, int zmin, int xmax, int zmax)
+{
+    DXF_ASSERT(xmin <= xmax && zmin <= zmax);
+
+    m_numFilled = 0;
+
+    unsigned int h = (unsigned int)(xmax - xmin + 1);
+    unsigned int w = (unsigned int)(zmax - zmin + 1);
+
+    if (!m_valid || h > m_rows || w > m_cols)
+    {
+        // Only grow so that a window changing its shape with the heading
+        // settles down quickly.
+        m_rows = std::max(m_rows, nextPowerOfTwo(h));
+        m_cols = std::max(m_cols, nextPowerOfTwo(w));
+        m_slots.assign(m_rows * m_cols, BlockInstance());
+
+        m_window[0] = xmin;
+        m_window[1] = zmin;
+        m_window[2] = xmax;
+        m_window[3] = zmax;
+        m_valid = true;
+
+        for (int x = xmin; x <= xmax; ++x)
+        {
+            fillRow(x, zmin, zmax);
+        }
+        markAllDirty();
+        return;
+    }
+
+    if (xmin == m_window[0] && zmin == m_window[1] && xmax == m_window[2] && zmax == m_window[3])
+    {
+        return;
+    }
+
+    // The blocks in both windows are still in their slots since two blocks
+    // of a window never share a slot.
+    for (int x = xmin; x <= xmax; ++x)
+    {
+        if (x < m_window[0] || x > m_window[2])
+        {
+            fillRow(x, zmin, zmax);
+        }
+        else
+        {
+            if (zmin < m_window[1])
+            {
+                fillRow(x, zmin, std::min(zmax, m_window[1] - 1));
+            }
+            if (zmax > m_window[3])
+            {
+                fillRow(x, std::max(zmin, m_window[3] + 1), zmax);
+            }
+        }
+    }
+
+    m_window[0] = xmin;
+    m_window[1] = zmin;
+    m_window[2] = xmax;
+    m_window[3] = zmax;
+}
+
+void BlockCache::fillRow(int x, int z0, int z1)
+{
+    if (z0 > z1)
+    {
+        return;
+    }
+
+    for (int z = z0; z <= z1; ++z)
+    {
+        unsigned int s = slot(x, z);
+
+        BlockInstance& instance = m_slots[s];
+        instance.x = (float)x * BLOCK_SIZE;
+        instance.z = (float)z * BLOCK_SIZE;
+        instance.tile = wangBlockTile(m_seed, x, z);
+        instance.padding = 0;
+
+        // The slots of a row are consecutive until z wraps around.
+        if (!m_dirty.empty() && m_dirty.back().first + m_dirty.back().count == s)
+        {
+            m_dirty.back().count++;
+        }
+        else
+        {
+            BlockSpan span = { s, 1 };
+            m_dirty.push_back(span);
+        }
+    }
+
+    m_numFilled += (unsigned int)(z1 - z0 + 1);
+}
+
+void BlockCache::markAllDirty()
+{
+    m_dirty.clear();
+    if (!m_slots.empty())
+    {
+        BlockSpan span = { 0, (unsigned int)m_slots.size() };
+        m_dirty.push_back(span);
+    }
+}
+
+void blockCacheBenchmark(unsigned int seed, BlockBoundsFunc bounds)
+{
+    const int numFrames = 2000;
+    const float speeds[] = { 0.0f, 0.05f, 0.1f, 0.5f, 1.0f, 3.0f, BLOCK_SIZE };
+    const int numSpeeds = sizeof(speeds) / sizeof(speeds[0]);
+
+    std::vector<BlockInstance> full;
+
+    for (int i = 0; i < numSpeeds; ++i)
+    {
+        double fullSeconds = 0.0;
+        double cacheSeconds = 0.0;
+        double fullBytes = 0.0;
+        double cacheBytes = 0.0;
+        int numIdleFrames = 0;
+
+        BlockCache cache(seed);
+
+        float x = 0.0f;
+        float z = 0.0f;
+        float angle = 0.0f;
+        for (int f = 0; f < numFrames; ++f)
+        {
+            // Walk as Renderer::walk() and turn() do.
+            x += sinf(angle) * speeds[i];
+            z += cosf(angle) * speeds[i];
+            angle += 0.002f;
+
+            int bb[4];
+            bounds(x, z, angle, bb);
+
+            uint64_t t0 = timerNow();
+
+            // The rebuild of the whole window every frame.
+            full.resize((bb[2] - bb[0] + 1) * (bb[3] - bb[1] + 1));
+            size_t n = 0;
+            for (int bx = bb[0]; bx <= bb[2]; ++bx)
+            {
+                for (int bz = bb[1]; bz <= bb[3]; ++bz)
+                {
+                    BlockInstance& instance = full[n++];
+                    instance.x = (float)bx * BLOCK_SIZE;
+                    instance.z = (float)bz * BLOCK_SIZE;
+                    instance.tile = wangBlockTile(seed, bx, bz);
+                    instance.padding = 0;
+                }
+            }
+
+            uint64_t t1 = timerNow();
+
+            cache.update(bb[0], bb[1], bb[2], bb[3]);
+
+            uint64_t t2 = timerNow();
+
+            fullSeconds += timerSecondsBetween(t0, t1);
+            cacheSeconds += timerSecondsBetween(t1, t2);
+            fullBytes += (double)(n * sizeof(BlockInstance));
+            for (size_t s = 0; s < cache.dirtySpans().size(); ++s)
+            {
+                cacheBytes += (double)(cache.dirtySpans()[s].count * sizeof(BlockInstance));
+            }
+            numIdleFrames += cache.dirtySpans().empty()? 1 : 0;
+            cache.clearDirty();
+        }
+
+        DXF_LOGINFO("Ground at %.2f/frame: rebuild %.2f us %.0f B, cache %.2f us %.0f B per frame, %d%% frames idle",
+            speeds[i],
+            fullSeconds * 1e6 / numFrames, fullBytes / numFrames,
+            cacheSeconds * 1e6 / numFrames, cacheBytes / numFrames,
+            numIdleFrames * 100 / numFrames);
+    }
+}
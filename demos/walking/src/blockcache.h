@@ -0,0 +1,94 @@
+// blockcache.h
+//
+// Created at 2014/04/12
+//
+// Hongwei Li hongwei.li@amd.com
+// All rights reserved
+
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <vector>
+
+// The per-block data read by the ground vertex shader.
+struct BlockInstance
+{
+    float x;       // The translation of the block
+    float z;
+    int   tile;    // The index of the tile in the tile image
+    int   padding;
+};
+
+// A run of consecutive slots of the cache.
+struct BlockSpan
+{
+    unsigned int first;
+    unsigned int count;
+};
+
+//
+// A toroidal 2D cache of the blocks in a moving window. The block (x, z)
+// always lives in the slot (x mod rows, z mod cols), so when the window
+// moves only the rows and the columns that enter it are filled, and a
+// window that does not move costs nothing. The slots filled since the
+// last clearDirty() are listed as spans for a partial upload.
+class BlockCache
+{
+public:
+    BlockCache(unsigned int seed);
+    ~BlockCache();
+
+    // Move the window to the blocks [xmin, xmax] * [zmin, zmax]. The
+    // storage grows, and is refilled, when the window does not fit.
+    void update(int xmin, int zmin, int xmax, int zmax);
+
+    const std::vector<BlockSpan>& dirtySpans() const { return m_dirty; }
+    void clearDirty() { m_dirty.clear(); }
+    // Mark all the blocks of the window dirty, e.g., after the GPU copy
+    // was recreated.
+    void markAllDirty();
+
+    const BlockInstance* slots() const { return &m_slots[0]; }
+    unsigned int numSlots() const { return (unsigned int)m_slots.size(); }
+    // The storage is rows * cols slots, both powers of two.
+    unsigned int rows() const { return m_rows; }
+    unsigned int cols() const { return m_cols; }
+    unsigned int slot(int x, int z) const 
+    { 
+        return ((unsigned int)x & (m_rows - 1)) * m_cols + ((unsigned int)z & (m_cols - 1)); 
+    }
+
+    int xmin() const { return m_window[0]; }
+    int zmin() const { return m_window[1]; }
+    int xmax() const { return m_window[2]; }
+    int zmax() const { return m_window[3]; }
+    unsigned int numBlocks() const 
+    { 
+        return m_valid? (unsigned int)((m_window[2] - m_window[0] + 1) * (m_window[3] - m_window[1] + 1)) : 0; 
+    }
+
+    // The blocks filled by the last update().
+    unsigned int numFilled() const { return m_numFilled; }
+
+private:
+    // Fill the blocks (x, [z0, z1]) and record their slots.
+    void fillRow(int x, int z0, int z1);
+
+private:
+    unsigned int              m_seed;
+    std::vector<BlockInstance> m_slots;
+    unsigned int              m_rows;
+    unsigned int              m_cols;
+    int                       m_window[4]; // xmin, zmin, xmax, zmax
+    bool                      m_valid;
+    std::vector<BlockSpan>    m_dirty;
+    unsigned int              m_numFilled;
+};
+
+// Walk along a turning path at a few speeds and log the CPU time and the
+// upload bytes per frame of the cache against rebuilding the whole window
+// every frame. bounds() gives the window at a position and a heading.
+typedef void (*BlockBoundsFunc)(float x, float z, float angle, int bounds[4]);
+void blockCacheBenchmark(unsigned int seed, BlockBoundsFunc bounds);
+
+#endif // !BLOCKCACHE_H
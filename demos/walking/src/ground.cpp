@@ -7,16 +7,22 @@
 
 #include "ground.h"
 
+#include <dxf/util/timer.h>
+
 #include <algorithm>
 #include <float.h>
+#include <vector>
 
 #include "walking.h"
 #include "sampler.h"
+#include "wangtiling.h"
+#include "spotlight.h"
 
-#define NUM_HCOLORS 3
-#define NUM_VCOLORS 2
+// The seed of the Wang tiling.
+#define GROUND_SEED 1001
 
 Ground::Ground()
+    : m_cache(GROUND_SEED)
 {
     m_block = NULL;
     m_numActiveBlocks = 0;
@@ -27,6 +33,9 @@ Ground::Ground()
     m_tileSampler = NULL;
     m_cbEveryFrame = NULL;
     m_cbInitial = NULL;
+    m_instances = NULL;
+    m_visible = NULL;
+    m_visibleChanged = false;
 }
 
 Ground::~Ground()
@@ -35,6 +44,8 @@ Ground::~Ground()
     SAFE_DELETE(m_block);
 	SAFE_DELETE(m_cbEveryFrame);
     SAFE_DELETE(m_cbInitial);
+    SAFE_DELETE(m_instances);
+    SAFE_DELETE(m_visible);
 	SAFE_DELETE(m_tileTexture);
     SAFE_DELETE(m_tileSampler);
     SAFE_DELETE(m_gradientTexture);
@@ -56,30 +67,32 @@ HRESULT Ground::initialize(ID3D11Device* device, ID3D11DeviceContext* context,
     V_RETURN(m_block->loadPlane(BLOCK_SIZE, BLOCK_SIZE, m_shader));
 
 	m_cbEveryFrame = new dxf::CBuffer<CbEveryFrameStruct>(device);
-    V_RETURN(m_cbEveryFrame->create(context, "cb-everyframe", "vs", 0));
+    V_RETURN(m_cbEveryFrame->create(context, m_shader, "cbChangesEveryFrame"));
 
     m_cbInitial = new dxf::CBuffer<CbInitialStruct>(device);
-    V_RETURN(m_cbInitial->create(context, "cb-initial", "vs", 1));
+    V_RETURN(m_cbInitial->create(context, m_shader, "cbInitial"));
+
+    m_instances = new dxf::StructuredBuffer<BlockInstance>(device, D3D11_USAGE_DEFAULT);
+    V_RETURN(m_instances->create("ground-instances", 256));
+
+    m_visible = new dxf::StructuredBuffer<UINT>(device);
+    V_RETURN(m_visible->create("ground-visible", 64));
     
 #define TEXTURE_ROOT "../demos/walking/media/textures"
     loadTiles(device, context, TEXTURE_ROOT"/tileconf.txt", TEXTURE_ROOT"/block.bmp");
 #undef TEXTURE_ROOT
 
     //
-    // The gradient texture initialization.
-    RingSampler sampler(128);
-    sampler.sample();
-    float* gradientTextureData = new float [128 * 2];
-    for (int i = 0; i < 128; ++i)
-    {
-        gradientTextureData[i * 2 + 0] = sampler.sample(i).x;
-        gradientTextureData[i * 2 + 1] = sampler.sample(i).y;
-    }
+    // The gradient texture initialization. The gradients are the ones of
+    // RingSampler(128), read from the sample set cache when it is there.
+    SampleSetKey gradientKey = { SAMPLESET_RING, 128, 0, 1001 };
+    std::vector<float> gradients;
+    cachedSamples(gradientKey, "../demos/walking/media/samples", &gradients);
 
     m_gradientTexture = new dxf::Texture(device);
-    m_gradientTexture->create1DTexture(128, DXGI_FORMAT_R32G32_FLOAT, gradientTextureData);
+    m_gradientTexture->create1DTexture(128, DXGI_FORMAT_R32G32_FLOAT, &gradients[0]);
 
-    delete [] gradientTextureData;
+    noiseInitialize(&m_noise, &gradients[0]);
 	
     m_gradientSampler = new dxf::Sampler(device);
     m_gradientSampler->create(D3D11_FILTER_COMPARISON_MIN_MAG_MIP_POINT, 
@@ -87,244 +100,202 @@ HRESULT Ground::initialize(ID3D11Device* device, ID3D11DeviceContext* context,
         D3D11_TEXTURE_ADDRESS_WRAP,
         D3D11_TEXTURE_ADDRESS_WRAP);
 
-    // Initialize the original tiling.
-    // Compute the bounding box of the spotlight area
-    float px = direction.x * SPOTLIGHT_RADIUS;
-    float pz = direction.z * SPOTLIGHT_RADIUS;
-
-    DirectX::XMFLOAT3 p0, p1;
-	
-    float s, c;
-    DirectX::XMScalarSinCos(&s, &c, DirectX::XMConvertToRadians(SPOTLIGHT_FOV * 0.5f));
-
-    p0.z = pz * c - px * s + position.z;
-    p0.x = pz * s + px * c + position.x;
+#if defined(DEBUG) | defined(_DEBUG)
+    DXF_ASSERT(wangValidate(GROUND_SEED, -64, -64, 128, 128));
+#endif
     
-    p1.z = pz * c + px * s + position.z;
-    p1.x = -pz * s + px * c + position.x;
-
-	float triangle[][2] = 
-	{
-		{position.x, position.z},
-		{p0.x, p0.z},
-		{p1.x, p1.z},
-	};
+	return S_OK;
+}
 
-    float xmin, xmax, zmin, zmax;
+// The blocks in the bounding box of the spotlight area. The heading as
+// Renderer::turn() sets it.
+static void spotlightBoundsAt(float x, float z, float angle, int bb[4])
+{
+    float triangle[3][2];
+    spotlightTriangle(x, z, sinf(angle), cosf(angle), triangle);
 
-    xmin = std::min(position.x, std::min(p0.x, p1.x));
-    xmax = std::max(position.x, std::max(p0.x, p1.x));
-    zmin = std::min(position.z, std::min(p0.z, p1.z));
-    zmax = std::max(position.z, std::max(p0.z, p1.z));
+    std::vector<BlockRow> rows;
+    spotlightRows(triangle, &rows, bb);
+}
 
-    int xmini = (int)floor(xmin / BLOCK_SIZE);
-    int zmini = (int)floor(zmin / BLOCK_SIZE);
-    int xmaxi = (int)ceil(xmax / BLOCK_SIZE);
-    int zmaxi = (int)ceil(zmax / BLOCK_SIZE);
+void Ground::update(const DirectX::XMFLOAT3& position,
+        const DirectX::XMFLOAT3& direction, CModelViewerCamera* camera)
+{
+    DirectX::XMMATRIX mProj = camera->GetProjMatrix();
+    DirectX::XMMATRIX mView = camera->GetViewMatrix();
+    DirectX::XMMATRIX viewProj = mView * mProj;
 
-    m_bb[0] = xmini;
-    m_bb[1] = zmini;
-    m_bb[2] = xmaxi;
-    m_bb[3] = zmaxi;
+    m_cbEveryFrame->data().viewProj = XMMatrixTranspose(viewProj);
 
-	int h = xmaxi - xmini + 1; // The number of rows
-	int w = zmaxi - zmini + 1; // The number of columns
+    float triangle[3][2];
+    spotlightTriangle(position.x, position.z, direction.x, direction.z, triangle);
 
-    m_numActiveBlocks = h * w;
+    // Only the blocks entering the bounding box are filled.
+    int bb[4];
+    spotlightRows(triangle, &m_rows, bb);
+    if (m_rows.empty())
+    {
+        m_numActiveBlocks = 0;
+        return;
+    }
+    m_cache.update(bb[0], bb[1], bb[2], bb[3]);
 
-    // Fill the tiles in a scanline order
-    for (int x = 0; x < h; ++x)
+    // Only the blocks overlapping the cone are drawn. The list is uploaded
+    // again only when it changes, i.e., when a block enters or leaves.
+    size_t n = 0;
+    for (size_t i = 0; i < m_rows.size(); ++i)
     {
-        for (int z = 0; z < w; ++z)
+        const BlockRow& row = m_rows[i];
+        for (int z = row.zmin; z <= row.zmax; ++z, ++n)
         {
-            int nColor = -1; 
-            if (x > 0)
-            {
-                int index = m_tiling[(x - 1) * w + z];
-                nColor = m_tiles[index].colors[2];
-            }
-            int wColor = -1;
-            if (z > 0)
+            UINT s = m_cache.slot(row.x, z);
+            if (n < m_visibleSlots.size())
             {
-                int index = m_tiling[x * w + z - 1];
-                wColor = m_tiles[index].colors[1];
+                m_visibleChanged |= (m_visibleSlots[n] != s);
+                m_visibleSlots[n] = s;
             }
-            
-            if (nColor == -1)
+            else
             {
-                nColor = rand() % NUM_VCOLORS;
+                m_visibleSlots.push_back(s);
+                m_visibleChanged = true;
             }
-            if (wColor == -1)
-            {
-                wColor = rand() % NUM_HCOLORS;
-            }
-
-            m_tiling[x * w + z] = getTileIndex(nColor, rand() % NUM_HCOLORS, rand() % NUM_VCOLORS, wColor);
         }
     }
+    m_visibleChanged |= (n != m_visibleSlots.size());
+    m_visibleSlots.resize(n);
 
-    //validateTiling(w, h);
-    
-	return S_OK;
+    m_numActiveBlocks = (UINT)n;
 }
 
-void Ground::update(const DirectX::XMFLOAT3& position,
-        const DirectX::XMFLOAT3& direction, CModelViewerCamera* camera)
+// The samples per second of the scalar and the SSE2 noise and of the
+// heightfield fill on 1 and all the hardware threads. The SSE2 results
+// must be identical to the scalar ones.
+static void noiseBenchmark(const Noise* noise)
 {
-    // Compute the bounding box of the spotlight area
-    float px = direction.x * SPOTLIGHT_RADIUS;
-    float pz = direction.z * SPOTLIGHT_RADIUS;
-
-    DirectX::XMFLOAT3 p0, p1;
-	
-    float s, c;
-    DirectX::XMScalarSinCos(&s, &c, DirectX::XMConvertToRadians(SPOTLIGHT_FOV * 0.5f));
-
-    p0.z = pz * c - px * s + position.z;
-    p0.x = pz * s + px * c + position.x;
-    
-    p1.z = pz * c + px * s + position.z;
-    p1.x = -pz * s + px * c + position.x;
-
-	float triangle[][2] = 
-	{
-		{position.x, position.z},
-		{p0.x, p0.z},
-		{p1.x, p1.z},
-	};
-
-    float xmin, xmax, zmin, zmax;
-
-    xmin = std::min(position.x, std::min(p0.x, p1.x));
-    xmax = std::max(position.x, std::max(p0.x, p1.x));
-    zmin = std::min(position.z, std::min(p0.z, p1.z));
-    zmax = std::max(position.z, std::max(p0.z, p1.z));
-
-    int xmini = (int)floor(xmin / BLOCK_SIZE);
-    int zmini = (int)floor(zmin / BLOCK_SIZE);
-    int xmaxi = (int)ceil(xmax/ BLOCK_SIZE);
-    int zmaxi = (int)ceil(zmax / BLOCK_SIZE);
-
-    int h = xmaxi - xmini + 1;
-    int w = zmaxi - zmini + 1;
-
-    int tiling[100];
-    memset(tiling, 0xff, 100 * sizeof(int));
-
-    //
-    // Intersect with the previous bounding box
-    //
-    int interBB[4];
-    interBB[0] = std::max(m_bb[0], xmini);
-    interBB[1] = std::max(m_bb[1], zmini);
-    interBB[2] = std::min(m_bb[2], xmaxi);
-    interBB[3] = std::min(m_bb[3], zmaxi);
-    
-    // Fill the tiling plane with intersected tiles
-    for (int x = interBB[0]; x <= interBB[2]; ++x)
+    const int numPoints = 1 << 20;
+
+    std::vector<float> x(numPoints);
+    std::vector<float> y(numPoints);
+    std::vector<float> z(numPoints);
+    std::vector<float> scalar(numPoints);
+    std::vector<float> simd(numPoints);
+    for (int i = 0; i < numPoints; ++i)
     {
-        for (int z = interBB[1]; z <= interBB[3]; ++z)
-        {
-            int oldj = z - m_bb[1];
-            int oldi = x - m_bb[0];
-            int newj = z - zmini; 
-            int newi = x - xmini; 
-
-            int oldTileIndex = oldi * (m_bb[3] - m_bb[1] + 1) + oldj;
-            int tileIndex = newi * w + newj;
-
-            tiling[tileIndex] = m_tiling[oldTileIndex];
-        }
+        x[i] = (float)(i % 1024) * 0.173f - 88.0f;
+        y[i] = (float)(i / 1024) * 0.131f - 67.0f;
+        z[i] = (float)(i % 77) * 0.37f;
     }
 
-    // Filing the rest
-    int hedge[200];
-    int vedge[200];
-
-    memset(hedge, 0xff, 200 * sizeof(int));
-    memset(vedge, 0xff, 200 * sizeof(int));
-    
-    // Color the edges
-    for (int x = 0; x < h; ++x)
+    const char* names[] = { "perlin 2D", "perlin 3D", "simplex 2D", "simplex 3D" };
+    for (int n = 0; n < 4; ++n)
     {
-        for (int z = 0; z < w; ++z)
+        const float* pz = (n & 1)? &z[0] : NULL;
+
+        uint64_t t0 = timerNow();
+        for (int i = 0; i < numPoints; ++i)
         {
-            int tileIndex = tiling[x * w + z];
-            if (tileIndex != -1)
+            switch (n)
             {
-                hedge[x * (w + 1) + z]     = m_tiles[tileIndex].colors[3];
-                hedge[x * (w + 1) + z + 1] = m_tiles[tileIndex].colors[1];
-                
-                vedge[z * (h + 1) + x]     = m_tiles[tileIndex].colors[0];
-                vedge[z * (h + 1) + x + 1] = m_tiles[tileIndex].colors[2];
+                case 0: scalar[i] = noisePerlin2D(noise, x[i], y[i]); break;
+                case 1: scalar[i] = noisePerlin3D(noise, x[i], y[i], z[i]); break;
+                case 2: scalar[i] = noiseSimplex2D(noise, x[i], y[i]); break;
+                case 3: scalar[i] = noiseSimplex3D(noise, x[i], y[i], z[i]); break;
             }
         }
-    }
-
-    for (int x = 0; x < h; ++x)
-    {
-        for (int z = 0; z <= w; ++z)
+        uint64_t t1 = timerNow();
+        for (int i = 0; i < numPoints; i += 8)
         {
-            if (hedge[x * (w + 1) + z] == -1)
+            if (n < 2)
             {
-                hedge[x * (w + 1) + z] = (x + z + w + h) % NUM_HCOLORS;
+                noisePerlin8(noise, &x[i], &y[i], pz != NULL? pz + i : NULL, &simd[i]);
             }
-        }
-    }
-
-	for (int z = 0; z < w; ++z)
-	{
-		for (int x = 0; x <= h; ++x)
-		{
-			if (vedge[z * (h + 1) + x] == -1)
+            else
             {
-                vedge[z * (h + 1) + x] = (x + z + w + h) % NUM_VCOLORS;
+                noiseSimplex8(noise, &x[i], &y[i], pz != NULL? pz + i : NULL, &simd[i]);
             }
-		}
-	}
-    
-    // Fill the tiles.
-    DirectX::XMMATRIX mProj = camera->GetProjMatrix();
-    DirectX::XMMATRIX mView = camera->GetViewMatrix();
-    DirectX::XMMATRIX viewProj = mView * mProj;
+        }
+        uint64_t t2 = timerNow();
 
-    m_numActiveBlocks = 0;
-    for (int x = 0; x < h; ++x)
-    {
-        for (int z = 0; z < w; ++z)
+        int numMismatches = 0;
+        for (int i = 0; i < numPoints; ++i)
         {
-            int ww = hedge[x * (w + 1) + z];
-            int e = hedge[x * (w + 1) + z + 1];
-            int n = vedge[z * (h + 1) + x];
-            int s = vedge[z * (h + 1) + x + 1];
-            
-            int tileIndex = getTileIndex(n, e, s, ww);
-			DXF_ASSERT(tileIndex >= 0);
-            m_tiling[x * w + z] = tileIndex;
-
-            float xx = (float)(x + xmini) * BLOCK_SIZE;
-            float zz = (float)(z + zmini) * BLOCK_SIZE;
-
-            DirectX::XMMATRIX translation = DirectX::XMMatrixTranslation(xx, 0, zz);
-            int i = m_numActiveBlocks++;
-			m_cbEveryFrame->data().tiling[i].x = tileIndex;
-			m_cbEveryFrame->data().worldView[i] = XMMatrixTranspose(translation); 
-            m_cbEveryFrame->data().mvp[i] = XMMatrixTranspose(translation * viewProj); 
+            numMismatches += (memcmp(&scalar[i], &simd[i], sizeof(float)) != 0)? 1 : 0;
         }
+
+        DXF_LOGINFO("Noise %s: scalar %.1f M samples/s, 8-wide %.1f M samples/s, %d mismatches", names[n],
+            numPoints / timerSecondsBetween(t0, t1) / 1e6, numPoints / timerSecondsBetween(t1, t2) / 1e6, numMismatches);
     }
 
-    //validateTiling(w, h);
+    // A 1024 x 1024 heightfield of 6 octaves.
+    NoiseFbm fbm;
+    fbm.type = NOISE_PERLIN;
+    fbm.numOctaves = 6;
+    fbm.frequency = 1.0f / 64.0f;
+    fbm.amplitude = 1.0f;
+    fbm.lacunarity = 2.0f;
+    fbm.gain = 0.5f;
+
+    UINT threads[] = { 1, 0 };
+    for (int t = 0; t < 2; ++t)
+    {
+        uint64_t t0 = timerNow();
+        noiseHeightfield(noise, &fbm, 0.0f, 0.0f, 1.0f, 1024, 1024, &simd[0], threads[t]);
+        uint64_t t1 = timerNow();
 
-    m_bb[0] = xmini;
-    m_bb[1] = zmini;
-    m_bb[2] = xmaxi;
-    m_bb[3] = zmaxi;
+        DXF_LOGINFO("Noise heightfield 1024x1024x%u octaves, %s: %.1f M samples/s", fbm.numOctaves,
+            threads[t] == 1? "1 thread" : "all threads", 
+            1024.0 * 1024.0 * fbm.numOctaves / timerSecondsBetween(t0, t1) / 1e6);
+    }
+}
+
+void Ground::benchmark()
+{
+    spotlightBenchmark();
+    blockCacheBenchmark(GROUND_SEED, spotlightBoundsAt);
+    noiseBenchmark(&m_noise);
 }
 
 void Ground::render(ID3D11DeviceContext* context)
 {
+    if (m_numActiveBlocks == 0)
+    {
+        return;
+    }
+
+    // Upload the slots filled since the last frame, 16 bytes a block.
+    HRESULT hr = m_instances->reserve(m_cache.numSlots());
+    if (FAILED(hr))
+    {
+        return;
+    }
+    if (hr == S_FALSE)
+    {
+        m_cache.markAllDirty();
+    }
+    const std::vector<BlockSpan>& spans = m_cache.dirtySpans();
+    for (size_t i = 0; i < spans.size(); ++i)
+    {
+        m_instances->update(context, spans[i].first, spans[i].count, m_cache.slots() + spans[i].first);
+    }
+    m_cache.clearDirty();
+
+    // The vertex shader reads the slot of the instance from the list.
+    if (m_visibleChanged)
+    {
+        UINT* visible = m_visible->map(context, m_numActiveBlocks);
+        if (visible == NULL)
+        {
+            return;
+        }
+        memcpy(visible, &m_visibleSlots[0], sizeof(UINT) * m_numActiveBlocks);
+        m_visible->unmap(context);
+        m_visibleChanged = false;
+    }
+
 	m_cbInitial->sync(context);
 	m_cbEveryFrame->sync(context);
+    m_instances->bind(context, 2, VERTEX_SHADER_BIT);
+    m_visible->bind(context, 3, VERTEX_SHADER_BIT);
     m_tileTexture->bind(context, 0, PIXEL_SHADER_BIT);
     m_tileSampler->bind(context, 0, PIXEL_SHADER_BIT);
     m_gradientTexture->bind(context, 1, PIXEL_SHADER_BIT);
@@ -333,51 +304,11 @@ void Ground::render(ID3D11DeviceContext* context)
 	m_block->render(context, m_numActiveBlocks);
 }
     
-bool Ground::isInsideTriangle(const float triangle[][2], float x, float z)
-{
-    float y1 = triangle[0][0];
-    float y2 = triangle[1][0];
-    float y3 = triangle[2][0];
-    
-    float x1 = triangle[0][1];
-    float x2 = triangle[1][1];
-    float x3 = triangle[2][1];
-
-    float y = x;
-    x = z;
-
-    return (x1 - x2) * (y - y1) - (y1 - y2) * (x - x1) > 0 &&
-           (x2 - x3) * (y - y2) - (y2 - y3) * (x - x2) > 0 &&
-           (x3 - x1) * (y - y3) - (y3 - y1) * (x - x3) > 0;    
-}
-    
 HRESULT Ground::loadTiles(ID3D11Device* device,
                        ID3D11DeviceContext* context,
                        const char* tileConfiguration,
                        const char* tileImage)
 {
-    // Load the configuration.
-	int numTiles = 0;
-	for (int n = 0; n < NUM_VCOLORS; ++n)
-	{
-		for (int e = 0; e < NUM_HCOLORS; ++e)
-        {
-            for (int s = 0; s < NUM_VCOLORS; ++s)
-            {
-                for (int w = 0; w < NUM_HCOLORS; ++w)
-                {
-                    Block b;
-                    b.colors[0] = n;
-                    b.colors[1] = e;
-                    b.colors[2] = s;
-                    b.colors[3] = w;
-
-                    m_tiles[numTiles++] = b;
-                }
-            }
-        }
-    }
-
     // Load the image.
 	HRESULT hr;
     m_tileTexture = new dxf::Texture(device);
@@ -403,47 +334,3 @@ HRESULT Ground::loadTiles(ID3D11Device* device,
 	return S_OK;
 
 }
-    
-void Ground::validateTiling(int w, int h)
-{
-    for (int x = 0; x < h; ++x)
-    {
-        for (int z = 0; z < w; ++z)
-        {
-            int nColor = -1; 
-            if (x > 0)
-            {
-                int index = m_tiling[(x - 1) * w + z];
-                nColor = m_tiles[index].colors[2];
-            }
-            int wColor = -1;
-            if (z > 0)
-            {
-                int index = m_tiling[x * w + z - 1];
-                wColor = m_tiles[index].colors[1];
-            }
-            
-            if (nColor != -1) 
-            {
-                DXF_ASSERT(nColor == m_tiles[m_tiling[x * w + z]].colors[0]);
-            }
-            if (wColor != -1)
-            {
-                DXF_ASSERT(wColor == m_tiles[m_tiling[x * w + z]].colors[3]);
-            }
-        }
-    }
-}
-        
-int Ground::getTileIndex(int n, int e, int s, int w)
-{
-	int nIndex = n;
-	int eIndex = e;
-	int sIndex = s;
-	int wIndex = w;
-
-	return nIndex * (NUM_HCOLORS * NUM_HCOLORS * NUM_VCOLORS) + 
-		   eIndex * (NUM_HCOLORS * NUM_VCOLORS) + 
-		   sIndex * (NUM_HCOLORS) + 
-		   wIndex;
-}
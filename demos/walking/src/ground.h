@@ -9,14 +9,11 @@
 #define GROUND_H
 
 #include <dxf/dxf.h>
+#include <dxf/util/noise.h>
 
+#include "blockcache.h"
+#include "spotlight.h"
 
-struct Block
-{
-    UINT colors[4]; // NESW
-    UINT row; // The row index of the block in the tile image
-    UINT col; // The row index of the block in the tile image
-};
 
 class Ground 
 {
@@ -33,18 +30,19 @@ public:
 
     void render(ID3D11DeviceContext* context);
 
+    // The noise the pixel shader shades the ground (x, z) with, in [0, 1].
+    float noise(float x, float z) const { return noisePerlin2D(&m_noise, z, x) * 0.5f + 0.5f; }
+
+    // Log the CPU time of the ground update at several walking speeds and
+    // the throughput of the CPU noise.
+    void benchmark();
+
 private:
     HRESULT loadTiles(ID3D11Device* device,
                    ID3D11DeviceContext* context,
                    const char* tileConfiguration,
                    const char* tileImage);
 
-    bool isInsideTriangle(const float triangle[][2], float x, float z);
-
-    void validateTiling(int w, int h);
-
-	int getTileIndex(int n, int e, int s, int w);
-
 private:
     dxf::Model* m_block;
     UINT m_numActiveBlocks;
@@ -54,20 +52,22 @@ private:
     };
     struct CbEveryFrameStruct   
     {
-        DirectX::XMMATRIX mvp[128];
-		DirectX::XMMATRIX worldView[128];
-		DirectX::XMINT4   tiling[128];
+        DirectX::XMMATRIX viewProj;
     };
-    dxf::CBuffer<CbInitialStruct>*     m_cbInitial;
-    dxf::CBuffer<CbEveryFrameStruct>*  m_cbEveryFrame;
+    dxf::CBuffer<CbInitialStruct>*         m_cbInitial;
+    dxf::CBuffer<CbEveryFrameStruct>*      m_cbEveryFrame;
+    dxf::StructuredBuffer<BlockInstance>*  m_instances;
+    dxf::StructuredBuffer<UINT>*           m_visible; // The slots of the blocks in the cone
+    BlockCache                             m_cache;   // The blocks in the bounding box
+    std::vector<BlockRow>                  m_rows;
+    std::vector<UINT>                      m_visibleSlots;
+    bool                                   m_visibleChanged;
     dxf::Shader*                       m_shader;
     dxf::Texture*                      m_tileTexture;
     dxf::Texture*                      m_gradientTexture; // for perlin noise
     dxf::Sampler*                      m_gradientSampler; // for perlin noise
+    Noise                              m_noise;           // The CPU copy of the shader noise
     dxf::Sampler*                      m_tileSampler;
-    int                                m_bb[4]; //
-    int                                m_tiling[100];
-    Block                              m_tiles[36];
 };
 
 #endif // !GROUND_H
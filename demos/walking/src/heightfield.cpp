@@ -0,0 +1,89 @@
+// heightfield.cpp
+//
+// Created at 2014/04/16
+//
+// Hongwei Li hongwei.li@amd.com
+// All rights reserved
+
+#include "heightfield.h"
+
+#include <dxf/dxf.h>
+#include <dxf/util/timer.h>
+
+#include <vector>
+
+void heightfieldBenchmark(const char* heightmap)
+{
+    std::vector<float> heights;
+    UINT width;
+    UINT height;
+    if (FAILED(dxf::terrainLoadHeightmap(heightmap, &heights, &width, &height)))
+    {
+        return;
+    }
+
+    TerrainDesc desc;
+    desc.width = width;
+    desc.height = height;
+    desc.spacing = 1.0f;
+    desc.heightScale = 64.0f;
+    desc.chunkSize = 64;
+    desc.numLods = 5;
+    desc.skirtDepth = 4.0f;
+
+    std::vector<TerrainChunk> chunks;
+    UINT threads[] = { 1, 0 };
+    for (int t = 0; t < 2; ++t)
+    {
+        uint64_t t0 = timerNow();
+        terrainBuildChunks(&desc, &heights[0], &chunks, threads[t]);
+        uint64_t t1 = timerNow();
+
+        double seconds = timerSecondsBetween(t0, t1);
+        DXF_LOGINFO("Terrain %ux%u, %u chunks on %s: %.2f ms, %.1f M vertices/s", width, height, 
+            (UINT)chunks.size(), threads[t] == 1? "1 thread" : "all threads", seconds * 1000.0,
+            (double)chunks.size() * terrainNumChunkVertices(&desc) / seconds / 1e6);
+    }
+
+    std::vector<UINT> numIndices(desc.numLods);
+    std::vector<uint16_t> indices;
+    for (UINT lod = 0; lod < desc.numLods; ++lod)
+    {
+        terrainBuildIndices(&desc, lod, &indices);
+        numIndices[lod] = (UINT)indices.size();
+    }
+
+    TerrainQuadtree quadtree;
+    quadtree.build(&desc, chunks);
+
+    // Walk across the terrain at the eye height of the walking camera.
+    const int numFrames = 1000;
+    const float lodDistance = 64.0f;
+    std::vector<TerrainSelection> selection;
+    double seconds = 0.0;
+    double numTriangles = 0.0;
+    double numFullTriangles = 0.0;
+    for (int f = 0; f < numFrames; ++f)
+    {
+        float eye[3] = 
+        { 
+            (float)width * desc.spacing * (float)f / (float)numFrames, 
+            80.0f,
+            (float)height * desc.spacing * 0.5f 
+        };
+
+        uint64_t t0 = timerNow();
+        quadtree.select(eye, lodDistance, NULL, &selection);
+        uint64_t t1 = timerNow();
+        seconds += timerSecondsBetween(t0, t1);
+
+        for (size_t i = 0; i < selection.size(); ++i)
+        {
+            numTriangles += numIndices[selection[i].lod] / 3;
+        }
+        numFullTriangles += (double)selection.size() * numIndices[0] / 3;
+    }
+
+    DXF_LOGINFO("Terrain selection: %.2f us over %u nodes, %.0f triangles vs %.0f at full detail",
+        seconds * 1e6 / numFrames, quadtree.numNodes(), numTriangles / numFrames, numFullTriangles / numFrames);
+}
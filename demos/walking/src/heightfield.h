@@ -0,0 +1,16 @@
+// heightfield.h
+//
+// Created at 2014/04/16
+//
+// Hongwei Li hongwei.li@amd.com
+// All rights reserved
+
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+// Build the terrain chunks of the heightmap on 1 and on all the hardware
+// threads and select them from a few eye positions, and log the timings.
+// Only the CPU side is measured; no device is needed.
+void heightfieldBenchmark(const char* heightmap);
+
+#endif // !HEIGHTFIELD_H
@@ -9,9 +9,13 @@
 #include "renderer.h"
 
 #include "walking.h"
+#include "wangtiling.h"
+#include "heightfield.h"
+#include "sampler.h"
 
 #include <directxmath.h>
 #include <directxcolors.h>
+#include <vector>
 
 
 Renderer::Renderer()
@@ -30,6 +34,12 @@ Renderer::Renderer()
     m_direction = DirectX::XMFLOAT3(0, 0, -1.0f);
 
 	m_mode = THIRD_PERSON;
+
+    m_terrain = NULL;
+    m_terrainShader = NULL;
+    m_terrainDsState = NULL;
+    m_terrainOffset = DirectX::XMFLOAT3(0, 0, 0);
+    m_showTerrain = false;
 }
 
 Renderer::~Renderer()
@@ -40,8 +50,6 @@ HRESULT Renderer::initialize(ID3D11Device* device,
                              ID3D11DeviceContext* context,
                              CDXUTTextHelper *txtHelper)
 {
-	srand(1001);
-
     HRESULT hr;
 
     AbstractRenderer::initialize(device, context, txtHelper);
@@ -50,13 +58,21 @@ HRESULT Renderer::initialize(ID3D11Device* device,
     // shaders
     //
 #define SHADER_ROOT L"../demos/walking/media/shaders"
+    dxf::ShaderBatch shaderBatch;
+
     m_groundShader = new dxf::Shader(m_device);
-    V_RETURN(m_groundShader->addVSShader(SHADER_ROOT L"/ground.hlsl", "VS"));
-    V_RETURN(m_groundShader->addPSShader(SHADER_ROOT L"/ground.hlsl", "PS"));
+    shaderBatch.addVSShader(m_groundShader, SHADER_ROOT L"/ground.hlsl", "VS");
+    shaderBatch.addPSShader(m_groundShader, SHADER_ROOT L"/ground.hlsl", "PS");
     
     m_spotlightShader = new dxf::Shader(m_device);
-    V_RETURN(m_spotlightShader->addVSShader(SHADER_ROOT L"/legend.hlsl", "VS"));
-    V_RETURN(m_spotlightShader->addPSShader(SHADER_ROOT L"/legend.hlsl", "PS"));
+    shaderBatch.addVSShader(m_spotlightShader, SHADER_ROOT L"/legend.hlsl", "VS");
+    shaderBatch.addPSShader(m_spotlightShader, SHADER_ROOT L"/legend.hlsl", "PS");
+
+    m_terrainShader = new dxf::Shader(m_device);
+    shaderBatch.addVSShader(m_terrainShader, SHADER_ROOT L"/terrain.hlsl", "VS");
+    shaderBatch.addPSShader(m_terrainShader, SHADER_ROOT L"/terrain.hlsl", "PS");
+
+    V_RETURN(shaderBatch.compile());
 #undef SHADER_ROOT 
 
     //
@@ -85,8 +101,9 @@ HRESULT Renderer::initialize(ID3D11Device* device,
 	//
     // Constant buffers
     //
-    m_cbEveryFrame = new dxf::CBuffer<CbEveryFrameStruct>(m_device);
-    V_RETURN(m_cbEveryFrame->create(m_context, "cb-everyframe", "vs", 0));
+    // Rewritten before every draw.
+    m_cbEveryFrame = new dxf::CBuffer<CbEveryFrameStruct>(m_device, D3D11_USAGE_DYNAMIC);
+    V_RETURN(m_cbEveryFrame->create(m_context, "cb-everyframe", VERTEX_SHADER_BIT, 0));
     
     //
     // Camera
@@ -105,6 +122,10 @@ HRESULT Renderer::initialize(ID3D11Device* device,
 
     m_device->CreateDepthStencilState(&dsDesc, &m_dsState);
 
+    // The ground is flat, but the terrain needs the depth test.
+    dsDesc.DepthEnable = true;
+    m_device->CreateDepthStencilState(&dsDesc, &m_terrainDsState);
+
 	D3D11_BLEND_DESC blendDesc;
 	ZeroMemory(&blendDesc, sizeof(blendDesc));
 
@@ -128,8 +149,44 @@ HRESULT Renderer::initialize(ID3D11Device* device,
     return S_OK;
 }
 
+HRESULT Renderer::createTerrain()
+{
+    HRESULT hr;
+
+    std::vector<float> heights;
+    UINT width;
+    UINT height;
+    V_RETURN(dxf::terrainLoadHeightmap("../demos/walking/media/textures/HeightMap.jpg", &heights, &width, &height));
+
+    // As heightfieldBenchmark().
+    TerrainDesc desc;
+    desc.width = width;
+    desc.height = height;
+    desc.spacing = 1.0f;
+    desc.heightScale = 64.0f;
+    desc.chunkSize = 64;
+    desc.numLods = 5;
+    desc.skirtDepth = 4.0f;
+
+    m_terrain = new dxf::Terrain(m_device);
+    hr = m_terrain->create(&heights[0], desc, m_terrainShader);
+    if (FAILED(hr))
+    {
+        SAFE_DELETE(m_terrain);
+        return hr;
+    }
+
+    m_terrainOffset = DirectX::XMFLOAT3(-(float)(width - 1) * desc.spacing * 0.5f, 0.0f,
+                                        -(float)(height - 1) * desc.spacing * 0.5f);
+
+    return S_OK;
+}
+
 void Renderer::uninitialize()
 {
+    SAFE_DELETE(m_terrain);
+    SAFE_DELETE(m_terrainShader);
+    SAFE_RELEASE(m_terrainDsState);
     SAFE_DELETE(m_ground);
     SAFE_DELETE(m_spotlight);
     SAFE_DELETE(m_groundShader);
@@ -156,6 +213,27 @@ void Renderer::render(double fTime,
 
     DirectX::XMMATRIX mProj = m_camera.GetProjMatrix();
     DirectX::XMMATRIX mView = m_camera.GetViewMatrix();
+
+    if (m_showTerrain)
+    {
+        // The chunks are selected in the space of the terrain.
+        DirectX::XMMATRIX world = DirectX::XMMatrixTranslation(m_terrainOffset.x, 0.0f, m_terrainOffset.z);
+        DirectX::XMMATRIX worldViewProj = world * mView * mProj;
+        DirectX::XMFLOAT3 eye;
+        DirectX::XMStoreFloat3(&eye, m_camera.GetEyePt());
+        eye.x -= m_terrainOffset.x;
+        eye.z -= m_terrainOffset.z;
+        m_terrain->update(eye, worldViewProj, 64.0f);
+
+        m_context->OMSetDepthStencilState(m_terrainDsState, 0);
+        m_terrainShader->bind(m_context);
+        m_cbEveryFrame->data().m_mvp = XMMatrixTranspose(worldViewProj);
+        m_cbEveryFrame->sync(m_context);
+
+        m_terrain->render(m_context);
+        return;
+    }
+
     //m_cbEveryFrame->data().m_mvp = XMMatrixTranspose(mView * mProj);     // convert row order to column as by default matrix in shader is column order.
     //m_cbEveryFrame->sync(m_context);
     
@@ -184,6 +262,16 @@ void Renderer::renderText(double fTime,
                           float fElapsedTime)
 {
     AbstractRenderer::renderText(fTime, fElapsedTime);
+
+    if (m_showTerrain)
+    {
+        m_txtHelper->Begin();
+        m_txtHelper->SetInsertionPos(5, 45);
+        m_txtHelper->SetForegroundColor(DirectX::XMFLOAT4(1.0f, 1.0f, 0.0f, 1.0f));
+        m_txtHelper->DrawFormattedTextLine(L"Terrain (H): %u/%u chunks, %u triangles", 
+            m_terrain->numSelectedChunks(), m_terrain->numChunks(), m_terrain->numTriangles());
+        m_txtHelper->End();
+    }
 }
 
 void Renderer::update(double fTime, float fElapsedTime)
@@ -216,6 +304,27 @@ void Renderer::keyboard(UINT c,
 			case 'M': 
 				m_mode = (m_mode == FIRST_PERSON)? THIRD_PERSON : FIRST_PERSON;
 				break;
+            case 'T':
+                // Validate the ground tiling far from the origin and time
+                // the tiling and the ground update.
+                wangValidate(1001, 1 << 20, -(1 << 20), 256, 256);
+                wangBenchmark(1001, 1024, 1024);
+                m_ground->benchmark();
+                heightfieldBenchmark("../demos/walking/media/textures/HeightMap.jpg");
+                break;
+            case 'H':
+                if (m_terrain == NULL && FAILED(createTerrain()))
+                {
+                    DXF_LOGERROR("Failed to create the terrain");
+                    break;
+                }
+                m_showTerrain = !m_showTerrain;
+                break;
+            case 'P':
+                // Takes minutes, so not with the other benchmarks.
+                sphereSamplerBenchmark();
+                sphereSamplerParallelBenchmark();
+                break;
 		}
 
 		updateCamera();
@@ -266,6 +375,11 @@ void Renderer::updateCamera()
 	{
 		DirectX::XMFLOAT3 eye(-50.0f, 50.0f, 50.0f);
 		DirectX::XMFLOAT3 at(0.0f, 0.0f, 0.0f);
+		if (m_showTerrain)
+		{
+			// High enough to see the LODs drop with the distance.
+			eye = DirectX::XMFLOAT3(-300.0f, 200.0f, 300.0f);
+		}
 
 		//DirectX::XMFLOAT3 eye(-24.0f, 20.0f, -48.0f);
 		//DirectX::XMFLOAT3 at(-24.0f, 0.0f, -48.0f);
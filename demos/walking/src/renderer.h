@@ -33,6 +33,7 @@ private:
     void walk(float distance);
     void turn(float angle);
     void updateCamera();
+    HRESULT createTerrain();
 
 private:
     ID3D11DepthStencilState*           m_dsState;
@@ -60,6 +61,14 @@ private:
 	} m_mode;
 
     Ground* m_ground;
+
+    // The heightmap terrain replaces the ground while 'H' is on. It is
+    // created on the first 'H' as the heightmap takes a while to load.
+    dxf::Terrain*                      m_terrain;
+    dxf::Shader*                       m_terrainShader;
+    ID3D11DepthStencilState*           m_terrainDsState;
+    DirectX::XMFLOAT3                  m_terrainOffset; // Centers it at the origin
+    bool                               m_showTerrain;
 };
 
 
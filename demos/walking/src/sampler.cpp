@@ -5,10 +5,19 @@
 
 #include "sampler.h"
 
+#include <dxf/util/random.h>
+#include <dxf/util/timer.h>
+
 #include <stdint.h>
 #include <float.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <emmintrin.h>
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
 
 const static uint32_t capacity = 256;
@@ -21,124 +30,381 @@ const static float PI = 3.1415926535898f;
 //
 // Helper functions 
 //
-static float dot(const Sample &sample, const Point &point)
+static float dot(const Sample &sample1, const Sample &sample2)
 {
-    float d = sample.x * point.x + sample.y * point.y + sample.z * point.z;
+    float d = sample1.x * sample2.x + sample1.y * sample2.y + sample1.z * sample2.z;
     d = std::min(d, 1.0f);
     return acosf(d);
 }
 
-static float dot(const Sample &sample1, const Sample &sample2)
+
+//
+// Help structs
+//
+struct SwapElem 
 {
-    float d = sample1.x * sample2.x + sample1.y * sample2.y + sample1.z * sample2.z;
-    d = std::min(d, 1.0f);
-    return acosf(d);
+    float energy;
+    int   pindex;
+};
+
+// Ascending energies; the ties in point order.
+static bool operator<(const SwapElem &a, const SwapElem &b)
+{
+    if (a.energy != b.energy)
+    {
+        return a.energy < b.energy;
+    }
+    return a.pindex < b.pindex;
 }
 
+//
+// The buffers of SphereSampler::swap(), reused from one pair to the next.
+// Side 0 holds the points of i seen from the center of j and side 1 the
+// points of j seen from i.
+//
+struct SphereSwapScratch
+{
+    float    cosines[2][capacity];
+    float    lower[2][capacity];   // A lower bound of the energy
+    SwapElem elems[2][capacity];
+    size_t   numElems[2];
+};
+
+//
+// SIMD helpers
+//
 
-static uint32_t randomUint32()
+// The dot products of the center c and 4 points.
+static inline __m128 dot4(const Sample &c, const float *x, const float *y, const float *z)
 {
-    return rand(); 
+    __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(c.x), _mm_loadu_ps(x)),
+                          _mm_mul_ps(_mm_set1_ps(c.y), _mm_loadu_ps(y)));
+    return _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(c.z), _mm_loadu_ps(z)));
 }
 
-static float randomFloat()
+// acos(d) for d in [-1, 1] within 1e-5, after Abramowitz and Stegun
+// 4.4.46, which is 2e-8 before the float rounding.
+static inline __m128 acos4(__m128 d)
 {
-    return (float)rand() / (float)RAND_MAX;
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 negative = _mm_cmplt_ps(d, _mm_setzero_ps());
+    __m128 x = _mm_andnot_ps(sign, d);
+
+    __m128 p = _mm_set1_ps(-0.0012624911f);
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(0.0066700901f));
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(-0.0170881256f));
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(0.0308918810f));
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(-0.0501743046f));
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(0.0889789874f));
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(-0.2145988016f));
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(1.5707963050f));
+    __m128 a = _mm_mul_ps(_mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(1.0f), x), _mm_setzero_ps())), p);
+
+    // acos(-x) = pi - acos(x)
+    __m128 flipped = _mm_sub_ps(_mm_set1_ps(PI), a);
+    return _mm_or_ps(_mm_and_ps(negative, flipped), _mm_andnot_ps(negative, a));
 }
 
 //
-// Help structs
+// A uniform grid over the directions of the sample centers. The cells
+// cover [-1, 1]^3; only the ones along the sphere are occupied. A
+// sample moves to its new cell whenever its center changes.
 //
-struct HeapElem 
+class SphereGrid
 {
-    float energy;
-    int   pindex;
-    
-    // The smallest energy element goes to the root
-    bool operator<(const HeapElem& other) 
+public:
+    void build(const std::vector<Sample> &samples, float angle)
     {
-        return energy > other.energy; 
-    };
-};
+        // About one cap of the given angle per cell.
+        float chord = 2.0f * sinf(std::min(angle, PI * 0.5f) * 0.5f);
+        m_resolution = std::max(1, std::min(64, (int)(2.0f / std::max(chord, 1e-6f))));
+        m_cellSize = 2.0f / (float)m_resolution;
 
+        m_cells.assign(m_resolution * m_resolution * m_resolution, std::vector<int>());
+        m_cellOf.resize(samples.size());
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            m_cellOf[i] = cellOf(samples[i]);
+            m_cells[m_cellOf[i]].push_back((int)i);
+        }
+    }
+
+    void move(size_t i, const Sample &sample)
+    {
+        int cell = cellOf(sample);
+        if (cell == m_cellOf[i])
+        {
+            return;
+        }
 
+        std::vector<int> &old = m_cells[m_cellOf[i]];
+        *std::find(old.begin(), old.end(), (int)i) = old.back();
+        old.pop_back();
+
+        m_cells[cell].push_back((int)i);
+        m_cellOf[i] = cell;
+    }
+
+    // Append the samples whose center direction is within the chord of
+    // the direction d.
+    void query(float x, float y, float z, float chord, std::vector<int> &out) const
+    {
+        int lo[3];
+        int hi[3];
+        float d[3] = { x, y, z };
+        for (int a = 0; a < 3; ++a)
+        {
+            lo[a] = coordinate(d[a] - chord);
+            hi[a] = coordinate(d[a] + chord);
+        }
+
+        for (int cx = lo[0]; cx <= hi[0]; ++cx)
+        {
+            for (int cy = lo[1]; cy <= hi[1]; ++cy)
+            {
+                for (int cz = lo[2]; cz <= hi[2]; ++cz)
+                {
+                    const std::vector<int> &cell = m_cells[(cx * m_resolution + cy) * m_resolution + cz];
+                    out.insert(out.end(), cell.begin(), cell.end());
+                }
+            }
+        }
+    }
+
+    // The direction of the center; an arbitrary one for the origin.
+    static void direction(const Sample &sample, float &x, float &y, float &z)
+    {
+        float l = sqrtf(sample.x * sample.x + sample.y * sample.y + sample.z * sample.z);
+        if (l > 0.0f)
+        {
+            x = sample.x / l;
+            y = sample.y / l;
+            z = sample.z / l;
+        }
+        else
+        {
+            x = 0.0f;
+            y = 0.0f;
+            z = 1.0f;
+        }
+    }
+
+private:
+    int coordinate(float c) const
+    {
+        return std::max(0, std::min(m_resolution - 1, (int)floorf((c + 1.0f) / m_cellSize)));
+    }
+
+    int cellOf(const Sample &sample) const
+    {
+        float x, y, z;
+        direction(sample, x, y, z);
+        return (coordinate(x) * m_resolution + coordinate(y)) * m_resolution + coordinate(z);
+    }
+
+private:
+    int                           m_resolution;
+    float                         m_cellSize;
+    std::vector<std::vector<int> > m_cells;
+    std::vector<int>              m_cellOf;
+};
 
 //
 // class SphereSampler
 //
-SphereSampler::SphereSampler(int num)
+SphereSampler::SphereSampler(int num, bool hemisphere, uint32_t seed)
 {
     m_points.resize(num * capacity);
+    m_x.resize(num * capacity);
+    m_y.resize(num * capacity);
+    m_z.resize(num * capacity);
+    m_cosines.resize(num * capacity);
     m_samples.resize(num);
+    m_hemisphere = hemisphere;
+    m_seed = seed;
+    m_verbose = true;
+    m_accelerated = true;
+    m_parallel = false;
+    m_numThreads = 0;
+    m_grid = NULL;
+    m_callback = NULL;
+    m_callbackData = NULL;
+    m_timeBudget = 0;
+    m_maxIterations = 0;
+    m_energyThreshold = 0;
+    m_initialized = false;
+    m_iteration = 0;
+    m_energy = 0;
+    m_seconds = 0;
 }
 
 SphereSampler::~SphereSampler()
 {
+    delete m_grid;
+    for (size_t t = 0; t < m_scratches.size(); ++t)
+    {
+        delete m_scratches[t];
+    }
+}
+
+void SphereSampler::reserveScratches(size_t numScratches)
+{
+    while (m_scratches.size() < numScratches)
+    {
+        m_scratches.push_back(new SphereSwapScratch());
+    }
 }
 
-void SphereSampler::sample()
+uint32_t SphereSampler::pointsPerSample()
 {
-    float energy;
+    return capacity;
+}
+
+SphereSamplerStop SphereSampler::sample()
+{
+    uint64_t start = timerNow();
+    m_energy = initialize();
+    m_initialized = true;
+    m_iteration = 0;
+    m_seconds = timerSecondsSince(start);
 
-    float bestEnergy = initialize();
+    return run();
+}
 
-    int iter = 0;
-    while (!optimize(energy)) 
+SphereSamplerStop SphereSampler::resume()
+{
+    if (!m_initialized)
     {
-        if (bestEnergy == energy) 
-            break;
+        return sample();
+    }
+    return run();
+}
+
+SphereSamplerStop SphereSampler::run()
+{
+    uint64_t start = timerNow();
+    int numIterations = 0;
+
+    for (;;)
+    {
+        uint64_t iterationStart = timerNow();
+
+        SphereSamplerProgress progress;
+        bool stable = optimize(progress.energy, progress.numSwaps, progress.numActivePairs);
+
+        uint64_t now = timerNow();
+        progress.iteration = m_iteration;
+        progress.seconds = timerSecondsBetween(iterationStart, now);
+        m_seconds += progress.seconds;
+        progress.totalSeconds = m_seconds;
+
+        float lastEnergy = m_energy;
+        m_energy = progress.energy;
+        m_iteration++;
+        numIterations++;
+
+        if (m_verbose)
+        {
+            fprintf(stderr, "Iterations: %d, energy: %f, swaps: %u, active pairs: %u, %.3f s\n",
+                progress.iteration, progress.energy, progress.numSwaps, progress.numActivePairs, progress.seconds);
+            fflush(stderr);
+        }
+
+        if (m_callback != NULL && !m_callback(progress, m_callbackData))
+        {
+            return SPHERE_SAMPLER_CALLBACK;
+        }
+        if (stable)
+        {
+            return SPHERE_SAMPLER_CONVERGED;
+        }
+        if (progress.energy == lastEnergy)
+        {
+            return SPHERE_SAMPLER_STALLED;
+        }
+        if (m_energyThreshold > 0 && lastEnergy - progress.energy < m_energyThreshold * lastEnergy)
+        {
+            return SPHERE_SAMPLER_ENERGY_THRESHOLD;
+        }
+        if (m_maxIterations > 0 && numIterations >= m_maxIterations)
+        {
+            return SPHERE_SAMPLER_MAX_ITERATIONS;
+        }
+        if (m_timeBudget > 0 && timerSecondsBetween(start, now) >= m_timeBudget)
+        {
+            return SPHERE_SAMPLER_TIME_BUDGET;
+        }
+    }
+}
+
+double SphereSampler::benchmark(int numWarmups, int numIterations)
+{
+    float energy;
+    uint32_t numSwaps;
+    uint32_t numActivePairs;
+
+    initialize();
 
-        fprintf(stderr, "Iterations: %d, energy: %f\n", iter++, energy);
-        fflush(stderr);
+    for (int iter = 0; iter < numWarmups; ++iter)
+    {
+        optimize(energy, numSwaps, numActivePairs);
+    }
 
-        bestEnergy = energy;
+    // The wall time, as the iterations may run on several threads.
+    uint64_t start = timerNow();
+    for (int iter = 0; iter < numIterations; ++iter)
+    {
+        optimize(energy, numSwaps, numActivePairs);
     }
+    return timerSecondsSince(start);
 }
 
 float SphereSampler::initialize()
 {
-    srand(10001);
-
-    // Distribute points on the sphere uniformly
+    // Distribute points on the sphere uniformly; the height is uniform on
+    // the sphere, so the hemisphere mirrors the negative ones.
     size_t numPoints = m_points.size();
+    RandomBatch random;
+    randomBatchSeed(&random, m_seed);
+    randomBatchUnitVectors(&random, &m_points[0].x, (uint32_t)numPoints);
+
     for (size_t i = 0; i < numPoints; ++i)
     {
-        m_points[i].y = randomFloat() * 2.0f - 1.0f;
-        float l = sqrtf(1.0f - m_points[i].y * m_points[i].y);
-        float phi = randomFloat() * 2.0f * PI;
-        m_points[i].z = l * cosf(phi);
-        m_points[i].x = l * sinf(phi);
+        if (m_hemisphere)
+        {
+            m_points[i].y = fabsf(m_points[i].y);
+        }
 
-        // Assign point to a sample
-        size_t s = i / capacity;
-        m_samples[s].points.push_back(m_points[i]);
+        // Assign point to a sample, the points of sample s are the range
+        // [s * capacity, (s + 1) * capacity).
+        m_x[i] = m_points[i].x;
+        m_y[i] = m_points[i].y;
+        m_z[i] = m_points[i].z;
     }
 
     float energy = 0;
     // Compute the energy and maxRadius of each sample.
+    RandomPCG32 picker;
+    randomPCG32Seed(&picker, m_seed, 0);
     size_t numSamples = m_samples.size();
     for (size_t i = 0; i < numSamples; ++i)
     {
-        uint32_t j = randomUint32() % capacity;
+        size_t first = i * capacity;
+        uint32_t j = randomPCG32Bounded(&picker, capacity);
 
-        m_samples[i].x = m_samples[i].points[j].x;
-        m_samples[i].y = m_samples[i].points[j].y;
-        m_samples[i].z = m_samples[i].points[j].z;
+        m_samples[i].x = m_x[first + j];
+        m_samples[i].y = m_y[first + j];
+        m_samples[i].z = m_z[first + j];
 
-        m_samples[i].energy = 0;
-        m_samples[i].maxRadius = 0;
         m_samples[i].stable = false;
 
-        for (size_t j = 0; j < capacity; ++j)
-        {
-            float r = dot(m_samples[i], m_samples[i].points[j]);
-            m_samples[i].energy += r * r;
-            m_samples[i].maxRadius = std::max(m_samples[i].maxRadius, r);
-        }
-
+        measure(i);
+        m_samples[i].energy = sampleEnergy(i);
         energy += m_samples[i].energy;
     }
 
+    storePoints();
+
     return energy;
 }
 
@@ -147,13 +413,13 @@ void SphereSampler::update(size_t i)
     float x = 0;
     float y = 0;
     float z = 0;
-    m_samples[i].energy = 0;
 
-    for (int p = 0; p < capacity; p++) 
+    size_t first = i * capacity;
+    for (size_t p = first; p < first + capacity; p++) 
     {
-        x += m_samples[i].points[p].x;
-        y += m_samples[i].points[p].y;
-        z += m_samples[i].points[p].z;
+        x += m_x[p];
+        y += m_y[p];
+        z += m_z[p];
     }
 
     x /= (float)capacity;
@@ -163,26 +429,298 @@ void SphereSampler::update(size_t i)
     m_samples[i].x = x;
     m_samples[i].y = y;
     m_samples[i].z = z;
-    
-    for (int p = 0; p < capacity; p++) 
+
+    // A sample is often updated by several swaps of an iteration, so its
+    // energy is left to the end of the iteration.
+    measure(i);
+}
+
+// The points moved, so the bounding cap is recomputed from scratch
+// instead of growing from the stale one. acosf() is decreasing, so the
+// largest angle is the one of the smallest cosine.
+void SphereSampler::measure(size_t i)
+{
+    size_t first = i * capacity;
+    float *cosines = &m_cosines[first];
+
+    __m128 lowest = _mm_set1_ps(1.0f);
+    for (size_t p = 0; p < capacity; p += 4)
     {
-        float r = dot(m_samples[i], m_samples[i].points[p]);
-        m_samples[i].energy += r * r;
-        m_samples[i].maxRadius = std::max(m_samples[i].maxRadius, r);
+        __m128 d = dot4(m_samples[i], &m_x[first + p], &m_y[first + p], &m_z[first + p]);
+        d = _mm_min_ps(d, _mm_set1_ps(1.0f));
+        _mm_storeu_ps(cosines + p, d);
+        lowest = _mm_min_ps(lowest, d);
     }
+
+    float l[4];
+    _mm_storeu_ps(l, lowest);
+    float cosine = std::min(std::min(l[0], l[1]), std::min(l[2], l[3]));
+    m_samples[i].maxRadius = acosf(std::max(cosine, -1.0f));
 }
 
+float SphereSampler::sampleEnergy(size_t i) const
+{
+    const float *cosines = &m_cosines[i * capacity];
 
-bool SphereSampler::optimize(float &energy)
+    float energy = 0;
+    for (size_t p = 0; p < capacity; ++p)
+    {
+        float r = acosf(cosines[p]);
+        energy += r * r;
+    }
+    return energy;
+}
+
+void SphereSampler::storePoints()
 {
+    size_t numSamples = m_samples.size();
+    for (size_t i = 0; i < numSamples; ++i)
+    {
+        m_samples[i].points.resize(capacity);
+        for (size_t p = 0; p < capacity; ++p)
+        {
+            m_samples[i].points[p].x = m_x[i * capacity + p];
+            m_samples[i].points[p].y = m_y[i * capacity + p];
+            m_samples[i].points[p].z = m_z[i * capacity + p];
+        }
+    }
+}
+
+//
+// Moving a point from its sample to the other one changes the energy by
+// the square of its angle to the other center minus the square of its
+// angle to its own one. The pairs of points, one from each side, in
+// increasing energy are swapped as long as the sum is not positive.
+//
+// Only the side's minimum energy and the points at most the negated
+// minimum of the other side can matter: any other point would make a
+// positive sum with every point of the other side. A polynomial acos
+// bounds the energies of all the points with SIMD, and the exact ones
+// with acosf() are only computed for the points whose bounds may meet
+// those limits. So the swaps are the ones of exact energies everywhere,
+// with much fewer acosf(). The angles of the points to their own center
+// are bounded the same way from the cosines of update().
+//
+bool SphereSampler::swap(size_t i, size_t j, SphereSwapScratch &scratch)
+{
+    // Larger than the error of acos4() plus the rounding of the energies.
+    const float angleMargin = 1e-4f;
+    const float energyMargin = 1e-5f;
+
+    size_t first[2] = { i * capacity, j * capacity };
+    const Sample *other[2] = { &m_samples[j], &m_samples[i] };
+
+    float lowest[2];   // The minimum of the lower bounds of a side
+    float highest[2];  // The minimum of the upper bounds
+    for (int side = 0; side < 2; ++side)
+    {
+        const float *x = &m_x[first[side]];
+        const float *y = &m_y[first[side]];
+        const float *z = &m_z[first[side]];
+        const float *c = &m_cosines[first[side]];
+
+        __m128 lo = _mm_set1_ps(FLT_MAX);
+        __m128 hi = _mm_set1_ps(FLT_MAX);
+        for (size_t p = 0; p < capacity; p += 4)
+        {
+            __m128 d = dot4(*other[side], x + p, y + p, z + p);
+            d = _mm_min_ps(_mm_max_ps(d, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+            _mm_storeu_ps(&scratch.cosines[side][p], d);
+
+            __m128 a = acos4(d);
+            __m128 a0 = _mm_max_ps(_mm_sub_ps(a, _mm_set1_ps(angleMargin)), _mm_setzero_ps());
+            __m128 a1 = _mm_add_ps(a, _mm_set1_ps(angleMargin));
+            __m128 r = acos4(_mm_loadu_ps(c + p));
+            __m128 r0 = _mm_max_ps(_mm_sub_ps(r, _mm_set1_ps(angleMargin)), _mm_setzero_ps());
+            __m128 r1 = _mm_add_ps(r, _mm_set1_ps(angleMargin));
+            __m128 e0 = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(a0, a0), _mm_mul_ps(r1, r1)), _mm_set1_ps(energyMargin));
+            __m128 e1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(a1, a1), _mm_mul_ps(r0, r0)), _mm_set1_ps(energyMargin));
+            _mm_storeu_ps(&scratch.lower[side][p], e0);
+            lo = _mm_min_ps(lo, e0);
+            hi = _mm_min_ps(hi, e1);
+        }
+
+        float l[4];
+        float h[4];
+        _mm_storeu_ps(l, lo);
+        _mm_storeu_ps(h, hi);
+        lowest[side] = std::min(std::min(l[0], l[1]), std::min(l[2], l[3]));
+        highest[side] = std::min(std::min(h[0], h[1]), std::min(h[2], h[3]));
+    }
+
+    // The exact energies of the points that may be the minimum of their
+    // side or swapped.
+    float minimum[2];
+    for (int side = 0; side < 2; ++side)
+    {
+        float limit = std::max(highest[side], -lowest[1 - side]);
+        const float *c = &m_cosines[first[side]];
+
+        size_t n = 0;
+        minimum[side] = FLT_MAX;
+        for (size_t p = 0; p < capacity; ++p)
+        {
+            if (scratch.lower[side][p] > limit)
+            {
+                continue;
+            }
+            float d1 = acosf(scratch.cosines[side][p]);
+            float d2 = acosf(c[p]);
+
+            SwapElem &elem = scratch.elems[side][n++];
+            elem.energy = d1 * d1 - d2 * d2;
+            elem.pindex = (int)p;
+            minimum[side] = std::min(minimum[side], elem.energy);
+        }
+        scratch.numElems[side] = n;
+    }
+
+    // Keep the points at most the negated minimum of the other side and
+    // sort them.
+    for (int side = 0; side < 2; ++side)
+    {
+        SwapElem *elems = scratch.elems[side];
+        size_t n = 0;
+        for (size_t e = 0; e < scratch.numElems[side]; ++e)
+        {
+            if (elems[e].energy <= -minimum[1 - side])
+            {
+                elems[n++] = elems[e];
+            }
+        }
+        if (n == 0)
+        {
+            return false;
+        }
+        std::sort(elems, elems + n);
+        scratch.numElems[side] = n;
+    }
+
+    size_t maxSwaps = std::min(scratch.numElems[0], scratch.numElems[1]);
+    size_t swap;
+    for (swap = 0; swap < maxSwaps; swap++) 
+    {
+        const SwapElem &ei = scratch.elems[0][swap];
+        const SwapElem &ej = scratch.elems[1][swap];
+
+        if (ei.energy + ej.energy > 0)
+        {
+            break;
+        }
+
+        size_t pi = first[0] + ei.pindex;
+        size_t pj = first[1] + ej.pindex;
+        std::swap(m_x[pi], m_x[pj]);
+        std::swap(m_y[pi], m_y[pj]);
+        std::swap(m_z[pi], m_z[pj]);
+    }
+
+    return swap > 0;
+}
+
+// The candidates j > after of the sample i, in increasing order. Only the
+// pairs whose bounding caps can overlap are listed.
+//
+// dot() is the arc cosine of the dot product of the centers, which are
+// not unit vectors, but for a, b in the unit ball and r < pi / 2,
+// acos(a.b) <= r implies that the angle between a and b is not larger
+// than r. So the samples within maxRadius[i] + the largest maxRadius of
+// the direction of i are a superset of the overlapping ones. Also list
+// the nearly opposite samples, whose dot product may round below -1 and
+// make dot() NaN, which never rejects a pair.
+static void findCandidates(const SphereGrid &grid,
+                           const std::vector<Sample> &samples,
+                           size_t i,
+                           size_t after,
+                           float maxRadius,
+                           std::vector<int> &candidates)
+{
+    const float margin = 1e-3f;
+
+    candidates.clear();
+
+    float angle = samples[i].maxRadius + maxRadius + margin;
+    if (angle >= PI * 0.5f)
+    {
+        for (size_t j = after + 1; j < samples.size(); ++j)
+        {
+            candidates.push_back((int)j);
+        }
+        return;
+    }
+
+    float x, y, z;
+    SphereGrid::direction(samples[i], x, y, z);
+    grid.query(x, y, z, 2.0f * sinf(angle * 0.5f), candidates);
+    grid.query(-x, -y, -z, 2.0f * sinf(margin * 0.5f), candidates);
+
+    size_t n = 0;
+    for (size_t k = 0; k < candidates.size(); ++k)
+    {
+        if ((size_t)candidates[k] > after)
+        {
+            candidates[n++] = candidates[k];
+        }
+    }
+    candidates.resize(n);
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+}
+
+bool SphereSampler::optimize(float &energy, uint32_t &numSwaps, uint32_t &numActivePairs)
+{
+    if (m_parallel)
+    {
+        return optimizeParallel(energy, numSwaps, numActivePairs);
+    }
+
+    numSwaps = 0;
+    numActivePairs = 0;
+
     size_t numSamples = m_samples.size();
 
     std::vector<bool> stable(numSamples, true);
 
+    // An upper bound of the maxRadius of all the samples. It is raised by
+    // the radii of the updated samples, so it stays an upper bound during
+    // the iteration.
+    float maxRadius = 0;
+    for (size_t s = 0; s < numSamples; s++) 
+    {
+        maxRadius = std::max(maxRadius, m_samples[s].maxRadius);
+    }
+
+    if (m_accelerated)
+    {
+        if (m_grid == NULL)
+        {
+            m_grid = new SphereGrid();
+        }
+        m_grid->build(m_samples, 2.0f * maxRadius);
+    }
+
+    std::vector<int> candidates;
+    reserveScratches(1);
+
     for (size_t i = 0; i < numSamples - 1; i++) 
     {
-        for (size_t j = i + 1; j < numSamples; j++) 
+        if (m_accelerated)
+        {
+            findCandidates(*m_grid, m_samples, i, i, maxRadius, candidates);
+        }
+        else
         {
+            candidates.clear();
+            for (size_t j = i + 1; j < numSamples; j++) 
+            {
+                candidates.push_back((int)j);
+            }
+        }
+
+        for (size_t c = 0; c < candidates.size(); c++) 
+        {
+            size_t j = candidates[c];
+
             // when either of two site is stable, it
             // is no need to do point swapping
             if (m_samples[i].stable && m_samples[j].stable)
@@ -198,104 +736,395 @@ bool SphereSampler::optimize(float &energy)
                 continue;
             }
 
-            std::vector<HeapElem> heapi;
-            std::vector<HeapElem> heapj;
-
-            for (size_t p = 0; p < capacity; ++p) 
+            numActivePairs++;
+            if (swap(i, j, *m_scratches[0])) 
             {
-                // Distance to paired site
-                float d1 = dot(m_samples[j], m_samples[i].points[p]);
-                float d2 = dot(m_samples[i], m_samples[i].points[p]);
+                numSwaps++;
+                update(i);
+                update(j);
 
-                float energy = d1 * d1 - d2 * d2;
-                
-                HeapElem elem;
-                elem.energy = energy;
-                elem.pindex = p;
+                stable[i] = false;
+                stable[j] = false;
+
+                maxRadius = std::max(maxRadius, std::max(m_samples[i].maxRadius, m_samples[j].maxRadius));
 
-                heapi.push_back(elem);
+                if (m_accelerated)
+                {
+                    // The center of i moved, so the rest of the candidates
+                    // are looked up again.
+                    m_grid->move(i, m_samples[i]);
+                    m_grid->move(j, m_samples[j]);
+                    findCandidates(*m_grid, m_samples, i, j, maxRadius, candidates);
+                    c = (size_t)-1;
+                }
             }
+        }
+    }
+    
+    bool ret = true;
+    energy = 0;
+    for (size_t s = 0; s < numSamples; s++) 
+    {
+        m_samples[s].stable = stable[s];
+        ret &= stable[s];
+
+        // The energies of the samples updated in the iteration.
+        if (!stable[s])
+        {
+            m_samples[s].energy = sampleEnergy(s);
+        }
+        energy += m_samples[s].energy;
+    }
+
+    storePoints();
+
+    return ret;
+}
+
+//
+// The threads wait for each other at the end of every round. The rounds
+// are short, so they spin instead of sleeping.
+//
+class SpinBarrier
+{
+public:
+    SpinBarrier(unsigned numThreads)
+        : m_numThreads(numThreads)
+        , m_count(0)
+        , m_generation(0)
+    {
+    }
+
+    void wait()
+    {
+        unsigned generation = m_generation.load();
+        if (++m_count == m_numThreads)
+        {
+            m_count = 0;
+            ++m_generation;
+            return;
+        }
+        while (m_generation.load() == generation)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    unsigned              m_numThreads;
+    std::atomic<unsigned> m_count;
+    std::atomic<unsigned> m_generation;
+};
+
+struct SwapPair
+{
+    int i;
+    int j;
+};
+
+// Schedule the pairs in rounds of pairs sharing no sample. A pair goes in
+// the round after the last one of either of its samples, so every sample
+// sees its pairs in the order of the list and swapping the rounds one
+// after another gives the same points as swapping the list in order.
+// rounds[r] .. rounds[r + 1] are the pairs of round r in scheduled.
+static void schedulePairs(const std::vector<SwapPair> &pairs,
+                          size_t numSamples,
+                          std::vector<SwapPair> &scheduled,
+                          std::vector<size_t> &rounds)
+{
+    std::vector<uint32_t> next(numSamples, 0);
+    std::vector<uint32_t> roundOf(pairs.size());
+    uint32_t numRounds = 0;
+    for (size_t p = 0; p < pairs.size(); ++p)
+    {
+        uint32_t r = std::max(next[pairs[p].i], next[pairs[p].j]);
+        next[pairs[p].i] = r + 1;
+        next[pairs[p].j] = r + 1;
+        roundOf[p] = r;
+        numRounds = std::max(numRounds, r + 1);
+    }
+
+    // Counting sort by round, keeping the order of the list in a round.
+    rounds.assign(numRounds + 1, 0);
+    for (size_t p = 0; p < pairs.size(); ++p)
+    {
+        rounds[roundOf[p] + 1]++;
+    }
+    for (uint32_t r = 0; r < numRounds; ++r)
+    {
+        rounds[r + 1] += rounds[r];
+    }
+    std::vector<size_t> fill(rounds.begin(), rounds.end() - 1);
+    scheduled.resize(pairs.size());
+    for (size_t p = 0; p < pairs.size(); ++p)
+    {
+        scheduled[fill[roundOf[p]]++] = pairs[p];
+    }
+}
+
+// The serial iteration finds the candidates of a sample again after each
+// of its swaps, which chains every swap to the previous one. Here the
+// pairs of a batch of samples are listed up front from the caps at the
+// start of the batch, and swapped in rounds of independent pairs. The
+// list and the schedule only depend on the samples, so the points do
+// not depend on the number of threads.
+bool SphereSampler::optimizeParallel(float &energy, uint32_t &numSwaps, uint32_t &numActivePairs)
+{
+    // Bound the memory of the pair list; the first iterations start from
+    // random points and list almost all the pairs.
+    const size_t maxBatchPairs = 1 << 20;
+
+    size_t numSamples = m_samples.size();
+
+    unsigned numThreads = m_numThreads;
+    if (numThreads == 0)
+    {
+        numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // Written by the threads, so not a vector<bool>.
+    std::vector<char> stable(numSamples, 1);
+
+    float maxRadius = 0;
+    for (size_t s = 0; s < numSamples; s++) 
+    {
+        maxRadius = std::max(maxRadius, m_samples[s].maxRadius);
+    }
+
+    if (m_accelerated)
+    {
+        if (m_grid == NULL)
+        {
+            m_grid = new SphereGrid();
+        }
+        m_grid->build(m_samples, 2.0f * maxRadius);
+    }
+
+    std::vector<int> candidates;
+    std::vector<SwapPair> pairs;
+    std::vector<SwapPair> scheduled;
+    std::vector<size_t> rounds;
+    std::vector<char> swapped;
+
+    numSwaps = 0;
+    numActivePairs = 0;
 
-            if (heapi.empty())
+    size_t i = 0;
+    while (i < numSamples - 1)
+    {
+        // List the pairs of the batch.
+        pairs.clear();
+        for (; i < numSamples - 1 && pairs.size() < maxBatchPairs; ++i)
+        {
+            if (m_accelerated)
             {
-                continue;
+                findCandidates(*m_grid, m_samples, i, i, maxRadius, candidates);
             }
-            std::make_heap(heapi.begin(), heapi.end());
-
-            for (size_t p = 0; p < capacity; p++) 
+            else
             {
-                float d1 = dot(m_samples[i], m_samples[j].points[p]);
-                float d2 = dot(m_samples[j], m_samples[j].points[p]);
+                candidates.clear();
+                for (size_t j = i + 1; j < numSamples; j++) 
+                {
+                    candidates.push_back((int)j);
+                }
+            }
 
-                float energy = d1 * d1 - d2 * d2;
-                if (energy > -heapi.front().energy) 
+            for (size_t c = 0; c < candidates.size(); c++) 
+            {
+                size_t j = candidates[c];
+                if (m_samples[i].stable && m_samples[j].stable)
+                {
+                    continue;
+                }
+                if (dot(m_samples[i], m_samples[j]) > m_samples[i].maxRadius + m_samples[j].maxRadius)
                 {
                     continue;
                 }
-                
-                HeapElem elem;
-                elem.energy = energy;
-                elem.pindex = p;
 
-                heapj.push_back(elem);
+                SwapPair pair;
+                pair.i = (int)i;
+                pair.j = (int)j;
+                pairs.push_back(pair);
             }
+        }
 
-            if (heapj.empty())
-            {
-                continue;
-            }
-            std::make_heap(heapj.begin(), heapj.end());
+        numActivePairs += (uint32_t)pairs.size();
+        schedulePairs(pairs, numSamples, scheduled, rounds);
+        swapped.assign(scheduled.size(), 0);
 
-            size_t maxHeapSize = std::min(heapi.size(), heapj.size());
-            size_t swap;
-            for (swap = 0; swap < maxHeapSize; swap++) 
+        // Swap the rounds. The caps are tested again, as earlier rounds
+        // may have moved the samples apart.
+        size_t numRounds = rounds.size() - 1;
+        unsigned numWorkers = (unsigned)std::max((size_t)1, std::min((size_t)numThreads, scheduled.size()));
+        SpinBarrier barrier(numWorkers);
+        reserveScratches(numWorkers);
+        auto work = [&](unsigned t)
+        {
+            SphereSwapScratch &scratch = *m_scratches[t];
+            for (size_t r = 0; r < numRounds; ++r)
             {
-                HeapElem &hei = heapi.front();
-                HeapElem &hej = heapj.front();
-
-                if (hei.energy + hej.energy > 0)
+                for (size_t p = rounds[r] + t; p < rounds[r + 1]; p += numWorkers)
                 {
-                    break;
+                    size_t pi = scheduled[p].i;
+                    size_t pj = scheduled[p].j;
+                    if (dot(m_samples[pi], m_samples[pj]) > m_samples[pi].maxRadius + m_samples[pj].maxRadius)
+                    {
+                        continue;
+                    }
+                    if (swap(pi, pj, scratch))
+                    {
+                        update(pi);
+                        update(pj);
+                        stable[pi] = 0;
+                        stable[pj] = 0;
+                        swapped[p] = 1;
+                    }
                 }
-        
-                std::swap(m_samples[i].points[hei.pindex], 
-                          m_samples[j].points[hej.pindex]);
-        
-                std::pop_heap(heapi.begin(), heapi.end() - swap);
-                std::pop_heap(heapj.begin(), heapj.end() - swap);
+                barrier.wait();
             }
-            
-            if (swap > 0) 
-            {
-                update(i);
-                update(j);
+        };
 
-                stable[i] = false;
-                stable[j] = false;
+        std::vector<std::thread> threads;
+        for (unsigned t = 1; t < numWorkers; ++t)
+        {
+            threads.push_back(std::thread(work, t));
+        }
+        work(0);
+        for (size_t t = 0; t < threads.size(); ++t)
+        {
+            threads[t].join();
+        }
+
+        // Move the swapped samples in the grid for the next batch.
+        for (size_t p = 0; p < scheduled.size(); ++p)
+        {
+            if (swapped[p])
+            {
+                numSwaps++;
+                size_t pi = scheduled[p].i;
+                size_t pj = scheduled[p].j;
+                maxRadius = std::max(maxRadius, std::max(m_samples[pi].maxRadius, m_samples[pj].maxRadius));
+                if (m_accelerated)
+                {
+                    m_grid->move(pi, m_samples[pi]);
+                    m_grid->move(pj, m_samples[pj]);
+                }
             }
         }
     }
-    
+
     bool ret = true;
     energy = 0;
     for (size_t s = 0; s < numSamples; s++) 
     {
-        m_samples[s].stable = stable[s];
-        ret &= stable[s];
-        
+        m_samples[s].stable = stable[s] != 0;
+        ret &= m_samples[s].stable;
+
+        if (!m_samples[s].stable)
+        {
+            m_samples[s].energy = sampleEnergy(s);
+        }
         energy += m_samples[s].energy;
     }
 
+    storePoints();
+
     return ret;
 }
 
+void sphereSamplerBenchmark()
+{
+    // The first iterations start from random points and swap between
+    // almost all the pairs either way, so they are not timed.
+    const int numWarmups = 3;
+    const int numIterations = 3;
+
+    for (int num = 128; num <= 16384; num *= 2)
+    {
+        SphereSampler accelerated(num);
+        double seconds = accelerated.benchmark(numWarmups, numIterations);
+
+        // The pairwise loop is quadratic, so only up to 4k samples.
+        if (num <= 4096)
+        {
+            SphereSampler reference(num);
+            reference.setAccelerated(false);
+            double referenceSeconds = reference.benchmark(numWarmups, numIterations);
+
+            int numMismatches = 0;
+            for (int i = 0; i < num; ++i)
+            {
+                const std::vector<Point> &a = accelerated.points(i);
+                const std::vector<Point> &b = reference.points(i);
+                numMismatches += memcmp(&a[0], &b[0], sizeof(Point) * a.size()) != 0? 1 : 0;
+            }
+
+            fprintf(stderr, "SphereSampler %5d samples: %8.1f ms/iteration with the grid, %8.1f ms without, %d samples differ\n",
+                num, seconds * 1000.0 / numIterations, referenceSeconds * 1000.0 / numIterations, numMismatches);
+        }
+        else
+        {
+            fprintf(stderr, "SphereSampler %5d samples: %8.1f ms/iteration with the grid\n",
+                num, seconds * 1000.0 / numIterations);
+        }
+    }
+}
+
+void sphereSamplerParallelBenchmark()
+{
+    const int numWarmups = 3;
+    const int numIterations = 3;
+
+    // Without several hardware threads there is no speedup to measure, but
+    // the points are still checked on 2 and 4 threads that share the core.
+    unsigned maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    if (maxThreads < 2)
+    {
+        fprintf(stderr, "SphereSampler: 1 hardware thread, the times of 2 and 4 threads are not speedups\n");
+        maxThreads = 4;
+    }
+
+    for (int num = 1024; num <= 16384; num *= 2)
+    {
+        SphereSampler serial(num);
+        double serialSeconds = serial.benchmark(numWarmups, numIterations);
+        fprintf(stderr, "SphereSampler %5d samples: %8.1f ms/iteration serial\n",
+            num, serialSeconds * 1000.0 / numIterations);
+
+        SphereSampler reference(num);
+        reference.setParallel(true, 1);
+        double referenceSeconds = reference.benchmark(numWarmups, numIterations);
+        fprintf(stderr, "SphereSampler %5d samples: %8.1f ms/iteration on  1 thread\n",
+            num, referenceSeconds * 1000.0 / numIterations);
+
+        for (unsigned numThreads = 2; numThreads <= maxThreads; numThreads *= 2)
+        {
+            SphereSampler parallel(num);
+            parallel.setParallel(true, numThreads);
+            double seconds = parallel.benchmark(numWarmups, numIterations);
+
+            int numMismatches = 0;
+            for (int i = 0; i < num; ++i)
+            {
+                const std::vector<Point> &a = parallel.points(i);
+                const std::vector<Point> &b = reference.points(i);
+                numMismatches += memcmp(&a[0], &b[0], sizeof(Point) * a.size()) != 0? 1 : 0;
+            }
+
+            fprintf(stderr, "SphereSampler %5d samples: %8.1f ms/iteration on %2u threads, %.2fx, %d samples differ\n",
+                num, seconds * 1000.0 / numIterations, numThreads, referenceSeconds / seconds, numMismatches);
+        }
+    }
+}
+
 //
 // Ring sampler
 //
 
-RingSampler::RingSampler(int num)
+RingSampler::RingSampler(int num, uint32_t seed)
 {
     m_samples.resize(num);
+    m_seed = seed;
 }
 
 RingSampler::~RingSampler()
@@ -304,17 +1133,18 @@ RingSampler::~RingSampler()
 
 void RingSampler::sample()
 {
-    srand(1001);
+    RandomPCG32 random;
+    randomPCG32Seed(&random, m_seed, 0);
 
     // First distribute the samples on the ring evenly.
     float deltaAngle = 2.0f * PI / (float)m_samples.size();
     float angleNoiseRange = deltaAngle * 0.1f;
 
-    float angle = randomFloat() * 2.0f * PI;
+    float angle = randomPCG32Float(&random) * 2.0f * PI;
     
     for (int i = 0; i < m_samples.size(); ++i)
     {
-        float thisAngle = angle + angleNoiseRange * (randomFloat() * 2.0f - 1.0f);
+        float thisAngle = angle + angleNoiseRange * (randomPCG32Float(&random) * 2.0f - 1.0f);
 
         Sample sample;
         sample.x = cosf(thisAngle);
@@ -326,3 +1156,73 @@ void RingSampler::sample()
     }
 }
 
+//
+// Sample sets
+//
+// Pass the progress on but never stop the sampler.
+struct ProgressForward
+{
+    SphereSamplerCallback callback;
+    void*                 userData;
+};
+
+static bool forwardProgress(const SphereSamplerProgress &progress, void *userData)
+{
+    ProgressForward *forward = (ProgressForward *)userData;
+    forward->callback(progress, forward->userData);
+    return true;
+}
+
+void generateSamples(const SampleSetKey &key,
+                     bool verbose,
+                     std::vector<float> *samples,
+                     SphereSamplerCallback callback,
+                     void *userData)
+{
+    uint32_t numComponents = sampleSetNumComponents(key.type);
+    samples->resize(key.numSamples * numComponents);
+
+    if (key.type == SAMPLESET_RING)
+    {
+        RingSampler sampler(key.numSamples, key.seed);
+        sampler.sample();
+        for (uint32_t i = 0; i < key.numSamples; ++i)
+        {
+            (*samples)[i * 2 + 0] = sampler.sample(i).x;
+            (*samples)[i * 2 + 1] = sampler.sample(i).y;
+        }
+    }
+    else
+    {
+        SphereSampler sampler(key.numSamples, key.type == SAMPLESET_HEMISPHERE, key.seed);
+        sampler.setVerbose(verbose);
+        ProgressForward forward = { callback, userData };
+        if (callback != NULL)
+        {
+            sampler.setCallback(forwardProgress, &forward);
+        }
+        sampler.sample();
+        for (uint32_t i = 0; i < key.numSamples; ++i)
+        {
+            (*samples)[i * 3 + 0] = sampler.sample(i).x;
+            (*samples)[i * 3 + 1] = sampler.sample(i).y;
+            (*samples)[i * 3 + 2] = sampler.sample(i).z;
+        }
+    }
+}
+
+void cachedSamples(const SampleSetKey &key, const char *cacheDirectory, std::vector<float> *samples)
+{
+    char path[1024];
+    sampleSetPath(cacheDirectory, &key, path, sizeof(path));
+    if (sampleSetRead(path, &key, samples))
+    {
+        return;
+    }
+
+    generateSamples(key, false, samples);
+    if (!sampleSetWrite(path, &key, &(*samples)[0]))
+    {
+        fprintf(stderr, "Failed to write the sample set %s.\n", path);
+    }
+}
@@ -6,8 +6,12 @@
 #ifndef SAMPLER_H
 #define SAMPLER_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include <vector>
 
+#include <dxf/util/sampleset.h>
+
 struct Point
 {
     float x;
@@ -26,31 +30,158 @@ struct Sample
     std::vector<Point> points;
 };
 
+class SphereGrid;
+struct SphereSwapScratch;
+
+// The state of SphereSampler after an optimization iteration.
+struct SphereSamplerProgress
+{
+    int      iteration;          // From 0, counted on over resume()
+    float    energy;
+    uint32_t numSwaps;           // The pairs of samples that swapped points
+    uint32_t numActivePairs;     // The pairs of overlapping caps tested
+    double   seconds;            // Of the iteration
+    double   totalSeconds;       // Since sample(), with the initialization
+};
+
+// Called after every iteration; return false to stop there.
+typedef bool (*SphereSamplerCallback)(const SphereSamplerProgress &progress, void *userData);
+
+enum SphereSamplerStop
+{
+    SPHERE_SAMPLER_CONVERGED,            // No sample swapped any point
+    SPHERE_SAMPLER_STALLED,              // The energy did not change
+    SPHERE_SAMPLER_ENERGY_THRESHOLD,
+    SPHERE_SAMPLER_MAX_ITERATIONS,
+    SPHERE_SAMPLER_TIME_BUDGET,
+    SPHERE_SAMPLER_CALLBACK,
+};
+
 // Sphere sampling
 class SphereSampler
 {
 public:
-    SphereSampler(int num);
+    // On the upper hemisphere (y >= 0) instead of the whole sphere when
+    // hemisphere is set.
+    SphereSampler(int num, bool hemisphere = false, uint32_t seed = 10001);
     ~SphereSampler();
 
-    void sample();
+    // The points per sample.
+    static uint32_t pointsPerSample();
+
+    // Log the energy of every iteration of sample() to stderr. On by
+    // default.
+    void setVerbose(bool verbose) { m_verbose = verbose; }
+
+    // Only test the pairs of samples found in a grid over the sample
+    // centers. The result is the same as testing all the pairs. On by
+    // default.
+    void setAccelerated(bool accelerated) { m_accelerated = accelerated; }
+    // Swap the pairs of an iteration in rounds of pairs that share no
+    // sample, each round on numThreads threads; 0 means one per hardware
+    // thread. The result does not depend on the number of threads, but
+    // differs from the serial iteration, which looks at the pairs of a
+    // sample again as soon as its center moves. Off by default.
+    void setParallel(bool parallel, unsigned numThreads = 0)
+    {
+        m_parallel = parallel;
+        m_numThreads = numThreads;
+    }
+
+    // Called after every iteration of sample() and resume().
+    void setCallback(SphereSamplerCallback callback, void *userData)
+    {
+        m_callback = callback;
+        m_callbackData = userData;
+    }
+    // Stop sample() and resume() early: after the seconds of the call, which
+    // are checked between the iterations, after the iterations of the call,
+    // or when an iteration lowers the energy by less than the fraction of
+    // it. 0 turns a limit off, which they all are by default.
+    void setTimeBudget(double seconds) { m_timeBudget = seconds; }
+    void setMaxIterations(int maxIterations) { m_maxIterations = maxIterations; }
+    void setEnergyThreshold(float threshold) { m_energyThreshold = threshold; }
+
+    // Initialize the points and optimize them until they converge or a
+    // limit stops them.
+    SphereSamplerStop sample();
+    // Optimize on from where sample() or resume() stopped, with the limits
+    // of now. The points are the same as running to the same iteration in
+    // one go.
+    SphereSamplerStop resume();
     const Sample &sample(int i) { return m_samples[i]; }
 
+    // Run the initialization and numWarmups optimization iterations, then
+    // return the seconds of numIterations more. For the benchmarks.
+    double benchmark(int numWarmups, int numIterations);
+    const std::vector<Point> &points(int i) { return m_samples[i].points; }
+
 private:
     float initialize();
-    bool optimize(float &energy);
+    SphereSamplerStop run();
+    // Return whether every sample is stable. The counts are of the
+    // iteration.
+    bool optimize(float &energy, uint32_t &numSwaps, uint32_t &numActivePairs);
+    bool optimizeParallel(float &energy, uint32_t &numSwaps, uint32_t &numActivePairs);
+    // Move the center of the sample i to the mean of its points.
     void update(size_t i);
+    // The cosines of the points of the sample i to its center, clamped to
+    // 1, and its maxRadius.
+    void measure(size_t i);
+    // The energy of the sample i from its cosines.
+    float sampleEnergy(size_t i) const;
+    // Copy the points to the samples.
+    void storePoints();
+    // Swap the points of the two samples that lower the energy. Return
+    // whether any was swapped.
+    bool swap(size_t i, size_t j, SphereSwapScratch &scratch);
+    // At least one scratch per thread of the iteration.
+    void reserveScratches(size_t numScratches);
 
 private:
     std::vector<Point>  m_points;
     std::vector<Sample> m_samples;
+    // The points of the sample s are [s * capacity, (s + 1) * capacity),
+    // with the cosines of their angles to the center of the sample.
+    std::vector<float>  m_x;
+    std::vector<float>  m_y;
+    std::vector<float>  m_z;
+    std::vector<float>  m_cosines;
+    bool                m_hemisphere;
+    uint32_t            m_seed;
+    bool                m_verbose;
+    bool                m_accelerated;
+    bool                m_parallel;
+    unsigned            m_numThreads;
+    SphereGrid*         m_grid;
+    std::vector<SphereSwapScratch*> m_scratches;
+    SphereSamplerCallback m_callback;
+    void*               m_callbackData;
+    double              m_timeBudget;
+    int                 m_maxIterations;
+    float               m_energyThreshold;
+    // Where sample() or resume() stopped
+    bool                m_initialized;
+    int                 m_iteration;
+    float               m_energy;
+    double              m_seconds;
 };
 
+// Log the seconds of an optimization iteration of SphereSampler for 128
+// to 16k samples with the grid, and up to 4k without it, and check that
+// both give the same points.
+void sphereSamplerBenchmark();
+// Log the seconds of a parallel optimization iteration of SphereSampler
+// for 1024 to 16k samples and 1 to all the hardware threads (up to 4 on a
+// single core), and check that the points do not depend on the number of
+// threads.
+void sphereSamplerParallelBenchmark();
+
 // Jittered sampling (stochastic sampling) on a ring
 class RingSampler
 {
 public:
-    RingSampler(int num);
+    RingSampler(int num, uint32_t seed = 1001);
     ~RingSampler();
 
     void sample();
@@ -59,8 +190,22 @@ public:
 private:
     std::vector<Point>  m_points;
     std::vector<Sample> m_samples;
+    uint32_t            m_seed;
 };
 
+// The sample centers of SphereSampler or RingSampler for the key, whose
+// capacity is SphereSampler::pointsPerSample(), or 0 for the ring. The
+// callback, if any, gets the progress of SphereSampler, but can not stop
+// it, as the samples would not be the ones of the key anymore.
+void generateSamples(const SampleSetKey &key,
+                     bool verbose,
+                     std::vector<float> *samples,
+                     SphereSamplerCallback callback = NULL,
+                     void *userData = NULL);
 
+// The same as generateSamples(), but read from the file of the key in
+// cacheDirectory when it is there. Otherwise the samples are generated
+// and written to the directory for the next time.
+void cachedSamples(const SampleSetKey &key, const char *cacheDirectory, std::vector<float> *samples);
 
 #endif // !SAMPLER_H
@@ -0,0 +1,223 @@
+// spotlight.cpp
+//
+// Created at 2014/04/14
+//
+// Hongwei Li hongwei.li@amd.com
+// All rights reserved
+
+#include "spotlight.h"
+
+#include <dxf/dxf.h>
+#include <dxf/util/timer.h>
+
+#include <algorithm>
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+
+#include "walking.h"
+
+void spotlightTriangle(float x, float z, float dx, float dz, float triangle[3][2])
+{
+    float px = dx * SPOTLIGHT_RADIUS;
+    float pz = dz * SPOTLIGHT_RADIUS;
+
+    float half = SPOTLIGHT_FOV * 0.5f * 3.14159265f / 180.0f;
+    float s = sinf(half);
+    float c = cosf(half);
+
+    triangle[0][0] = x;
+    triangle[0][1] = z;
+    triangle[1][0] = pz * s + px * c + x;
+    triangle[1][1] = pz * c - px * s + z;
+    triangle[2][0] = -pz * s + px * c + x;
+    triangle[2][1] = pz * c + px * s + z;
+}
+
+void spotlightRows(const float triangle[3][2], std::vector<BlockRow>* rows, int bb[4])
+{
+    const float half = BLOCK_SIZE * 0.5f;
+
+    float xmin = std::min(triangle[0][0], std::min(triangle[1][0], triangle[2][0]));
+    float xmax = std::max(triangle[0][0], std::max(triangle[1][0], triangle[2][0]));
+
+    rows->clear();
+    bb[0] = (int)ceil(xmin / BLOCK_SIZE - 0.5f);
+    bb[2] = (int)floor(xmax / BLOCK_SIZE + 0.5f);
+    bb[1] = INT_MAX;
+    bb[3] = INT_MIN;
+
+    for (int x = bb[0]; x <= bb[2]; ++x)
+    {
+        float x0 = (float)x * BLOCK_SIZE - half;
+        float x1 = (float)x * BLOCK_SIZE + half;
+
+        // The z extent of the triangle clipped to [x0, x1]: the vertices
+        // inside the strip and where the edges cross its sides.
+        float zlo = FLT_MAX;
+        float zhi = -FLT_MAX;
+        for (int i = 0; i < 3; ++i)
+        {
+            const float* a = triangle[i];
+            const float* b = triangle[(i + 1) % 3];
+
+            if (a[0] >= x0 && a[0] <= x1)
+            {
+                zlo = std::min(zlo, a[1]);
+                zhi = std::max(zhi, a[1]);
+            }
+
+            if (a[0] != b[0])
+            {
+                float sides[2] = { x0, x1 };
+                for (int j = 0; j < 2; ++j)
+                {
+                    float t = (sides[j] - a[0]) / (b[0] - a[0]);
+                    if (t >= 0.0f && t <= 1.0f)
+                    {
+                        float z = a[1] + t * (b[1] - a[1]);
+                        zlo = std::min(zlo, z);
+                        zhi = std::max(zhi, z);
+                    }
+                }
+            }
+        }
+
+        if (zlo > zhi)
+        {
+            continue;
+        }
+
+        BlockRow row;
+        row.x = x;
+        row.zmin = (int)ceil(zlo / BLOCK_SIZE - 0.5f);
+        row.zmax = (int)floor(zhi / BLOCK_SIZE + 0.5f);
+        rows->push_back(row);
+
+        bb[1] = std::min(bb[1], row.zmin);
+        bb[3] = std::max(bb[3], row.zmax);
+    }
+}
+
+bool spotlightOverlapsBlock(const float triangle[3][2], int x, int z)
+{
+    const float half = BLOCK_SIZE * 0.5f;
+    float cx = (float)x * BLOCK_SIZE;
+    float cz = (float)z * BLOCK_SIZE;
+
+    // The axes of the square.
+    if (std::max(triangle[0][0], std::max(triangle[1][0], triangle[2][0])) < cx - half ||
+        std::min(triangle[0][0], std::min(triangle[1][0], triangle[2][0])) > cx + half ||
+        std::max(triangle[0][1], std::max(triangle[1][1], triangle[2][1])) < cz - half ||
+        std::min(triangle[0][1], std::min(triangle[1][1], triangle[2][1])) > cz + half)
+    {
+        return false;
+    }
+
+    // The normals of the edges.
+    for (int i = 0; i < 3; ++i)
+    {
+        const float* a = triangle[i];
+        const float* b = triangle[(i + 1) % 3];
+        const float* c = triangle[(i + 2) % 3];
+
+        float nx = b[1] - a[1];
+        float nz = a[0] - b[0];
+
+        // The triangle projects to [min(0, dc), max(0, dc)] around a.
+        float dc = nx * (c[0] - a[0]) + nz * (c[1] - a[1]);
+        float center = nx * (cx - a[0]) + nz * (cz - a[1]);
+        float radius = half * (fabsf(nx) + fabsf(nz));
+
+        if (center - radius > std::max(0.0f, dc) || center + radius < std::min(0.0f, dc))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void spotlightBenchmark()
+{
+    const int numHeadings = 72;
+    const float positions[][2] = { { 0.0f, 0.0f }, { 1.3f, 2.9f }, { -2.6f, 0.7f }, { 100.5f, -33.3f } };
+    const int numPositions = sizeof(positions) / sizeof(positions[0]);
+
+    std::vector<BlockRow> rows;
+
+    double boxTotal = 0.0;
+    double coneTotal = 0.0;
+    double minRatio = 1.0;
+    double maxRatio = 0.0;
+    double spanSeconds = 0.0;
+    double blockSeconds = 0.0;
+    int numMismatches = 0;
+
+    for (int p = 0; p < numPositions; ++p)
+    {
+        for (int h = 0; h < numHeadings; ++h)
+        {
+            // The heading as Renderer::turn() sets it.
+            float angle = (float)h * 2.0f * 3.14159265f / (float)numHeadings;
+            float triangle[3][2];
+            spotlightTriangle(positions[p][0], positions[p][1], sinf(angle), cosf(angle), triangle);
+
+            // The bounding box the ground used to draw.
+            float xmin = std::min(triangle[0][0], std::min(triangle[1][0], triangle[2][0]));
+            float xmax = std::max(triangle[0][0], std::max(triangle[1][0], triangle[2][0]));
+            float zmin = std::min(triangle[0][1], std::min(triangle[1][1], triangle[2][1]));
+            float zmax = std::max(triangle[0][1], std::max(triangle[1][1], triangle[2][1]));
+            int box[4] = 
+            {
+                (int)floor(xmin / BLOCK_SIZE), (int)floor(zmin / BLOCK_SIZE),
+                (int)ceil(xmax / BLOCK_SIZE), (int)ceil(zmax / BLOCK_SIZE)
+            };
+            int numBoxBlocks = (box[2] - box[0] + 1) * (box[3] - box[1] + 1);
+
+            uint64_t t0 = timerNow();
+
+            int bb[4];
+            spotlightRows(triangle, &rows, bb);
+
+            uint64_t t1 = timerNow();
+
+            int numReference = 0;
+            for (int x = box[0]; x <= box[2]; ++x)
+            {
+                for (int z = box[1]; z <= box[3]; ++z)
+                {
+                    numReference += spotlightOverlapsBlock(triangle, x, z)? 1 : 0;
+                }
+            }
+
+            uint64_t t2 = timerNow();
+
+            int numConeBlocks = 0;
+            for (size_t r = 0; r < rows.size(); ++r)
+            {
+                for (int z = rows[r].zmin; z <= rows[r].zmax; ++z)
+                {
+                    numMismatches += spotlightOverlapsBlock(triangle, rows[r].x, z)? 0 : 1;
+                }
+                numConeBlocks += rows[r].zmax - rows[r].zmin + 1;
+            }
+            numMismatches += (numConeBlocks != numReference)? 1 : 0;
+
+            boxTotal += numBoxBlocks;
+            coneTotal += numConeBlocks;
+            double ratio = (double)numConeBlocks / (double)numBoxBlocks;
+            minRatio = std::min(minRatio, ratio);
+            maxRatio = std::max(maxRatio, ratio);
+            spanSeconds += timerSecondsBetween(t0, t1);
+            blockSeconds += timerSecondsBetween(t1, t2);
+        }
+    }
+
+    int numTests = numPositions * numHeadings;
+    DXF_LOGINFO("Spotlight culling: %.1f blocks in the cone vs %.1f in the box on average (%.0f%%, from %.0f%% to %.0f%%), %d mismatches",
+        coneTotal / numTests, boxTotal / numTests, coneTotal * 100.0 / boxTotal, 
+        minRatio * 100.0, maxRatio * 100.0, numMismatches);
+    DXF_LOGINFO("Spotlight culling: spans %.2f us, per-block test %.2f us",
+        spanSeconds * 1e6 / numTests, blockSeconds * 1e6 / numTests);
+}
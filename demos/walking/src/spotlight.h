@@ -0,0 +1,44 @@
+// spotlight.h
+//
+// Created at 2014/04/14
+//
+// Hongwei Li hongwei.li@amd.com
+// All rights reserved
+
+#ifndef SPOTLIGHT_H
+#define SPOTLIGHT_H
+
+#include <vector>
+
+// The lit area on the ground is the triangle of the spotlight cone at
+// (x, z) heading to the unit (dx, dz). The vertices are (x, z) pairs: the
+// position and the two far corners.
+//
+// The block (x, z) is the square of BLOCK_SIZE centered at
+// (x * BLOCK_SIZE, z * BLOCK_SIZE).
+void spotlightTriangle(float x, float z, float dx, float dz, float triangle[3][2]);
+
+// The blocks [zmin, zmax] of the row x.
+struct BlockRow
+{
+    int x;
+    int zmin;
+    int zmax;
+};
+
+// The blocks that overlap the triangle, touching included, as one span
+// per row. The span of a row is where the triangle clipped to the strip
+// of the row projects on z, so the result is exact and costs O(1) a row.
+// Return the bounding box of the blocks in bb (xmin, zmin, xmax, zmax).
+void spotlightRows(const float triangle[3][2], std::vector<BlockRow>* rows, int bb[4]);
+
+// Whether the triangle overlaps the block, touching included, by the
+// separating axis test. The per-block reference of spotlightRows().
+bool spotlightOverlapsBlock(const float triangle[3][2], int x, int z);
+
+// For headings all around and a few positions, compare the blocks of the
+// cone with the blocks of its axis-aligned bounding box, check the spans
+// against the per-block test and log the counts and the timings.
+void spotlightBenchmark();
+
+#endif // !SPOTLIGHT_H
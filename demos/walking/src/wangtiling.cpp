@@ -0,0 +1,159 @@
+// wangtiling.cpp
+//
+// Created at 2014/04/10
+//
+// Hongwei Li hongwei.li@amd.com
+// All rights reserved
+
+#include "wangtiling.h"
+
+#include <dxf/dxf.h>
+#include <dxf/util/timer.h>
+
+#include <algorithm>
+#include <vector>
+
+// The finalizer of MurmurHash3.
+static uint32_t mix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static uint32_t hashEdge(uint32_t seed, int x, int z)
+{
+    return mix(seed ^ mix((uint32_t)x * 0x8da6b343u ^ (uint32_t)z * 0xd8163841u));
+}
+
+int wangHorizontalEdgeColor(uint32_t seed, int x, int z)
+{
+    return (int)(hashEdge(seed, x, z) % WANG_NUM_VCOLORS);
+}
+
+int wangVerticalEdgeColor(uint32_t seed, int x, int z)
+{
+    // A different seed so that the two kinds of edges are independent.
+    return (int)(hashEdge(seed ^ 0x9e3779b9u, x, z) % WANG_NUM_HCOLORS);
+}
+
+int wangTileIndex(int n, int e, int s, int w)
+{
+	return n * (WANG_NUM_HCOLORS * WANG_NUM_HCOLORS * WANG_NUM_VCOLORS) + 
+		   e * (WANG_NUM_HCOLORS * WANG_NUM_VCOLORS) + 
+		   s * (WANG_NUM_HCOLORS) + 
+		   w;
+}
+
+void wangTileColors(int tile, int colors[4])
+{
+    colors[3] = tile % WANG_NUM_HCOLORS;
+    tile /= WANG_NUM_HCOLORS;
+    colors[2] = tile % WANG_NUM_VCOLORS;
+    tile /= WANG_NUM_VCOLORS;
+    colors[1] = tile % WANG_NUM_HCOLORS;
+    colors[0] = tile / WANG_NUM_HCOLORS;
+}
+
+int wangBlockTile(uint32_t seed, int x, int z)
+{
+    return wangTileIndex(wangHorizontalEdgeColor(seed, x, z),
+                         wangVerticalEdgeColor(seed, x, z + 1),
+                         wangHorizontalEdgeColor(seed, x + 1, z),
+                         wangVerticalEdgeColor(seed, x, z));
+}
+
+bool wangValidate(uint32_t seed, int x0, int z0, int w, int h)
+{
+    std::vector<int> tiling(w * h);
+    for (int x = 0; x < h; ++x)
+    {
+        for (int z = 0; z < w; ++z)
+        {
+            tiling[x * w + z] = wangBlockTile(seed, x0 + x, z0 + z);
+        }
+    }
+
+    int histogram[WANG_NUM_TILES] = { 0 };
+    int numErrors = 0;
+    for (int x = 0; x < h; ++x)
+    {
+        for (int z = 0; z < w; ++z)
+        {
+            int tile = tiling[x * w + z];
+            if (tile < 0 || tile >= WANG_NUM_TILES)
+            {
+                numErrors++;
+                continue;
+            }
+            histogram[tile]++;
+
+            int colors[4];
+            wangTileColors(tile, colors);
+            if (x > 0)
+            {
+                int north[4];
+                wangTileColors(tiling[(x - 1) * w + z], north);
+                numErrors += (north[2] != colors[0]);
+            }
+            if (z > 0)
+            {
+                int west[4];
+                wangTileColors(tiling[x * w + z - 1], west);
+                numErrors += (west[1] != colors[3]);
+            }
+
+            // Stateless: the same block always gets the same tile.
+            numErrors += (wangBlockTile(seed, x0 + x, z0 + z) != tile);
+        }
+    }
+
+    int minCount = w * h;
+    int maxCount = 0;
+    for (int i = 0; i < WANG_NUM_TILES; ++i)
+    {
+        minCount = std::min(minCount, histogram[i]);
+        maxCount = std::max(maxCount, histogram[i]);
+    }
+
+    DXF_LOGINFO("Wang tiling of %dx%d blocks at (%d, %d): %d errors, tile usage %d to %d (mean %.1f)",
+        w, h, x0, z0, numErrors, minCount, maxCount, (float)(w * h) / (float)WANG_NUM_TILES);
+
+    // Every tile shows up in a large enough window.
+    return numErrors == 0 && (w * h < 64 * WANG_NUM_TILES || minCount > 0);
+}
+
+double wangBenchmark(uint32_t seed, int w, int h)
+{
+    double best = 0.0;
+    volatile int sink = 0;
+    for (int run = 0; run < 5; ++run)
+    {
+        uint64_t start = timerNow();
+
+        // Walk the window away from the origin each run.
+        int x0 = run * h;
+        int sum = 0;
+        for (int x = 0; x < h; ++x)
+        {
+            for (int z = 0; z < w; ++z)
+            {
+                sum += wangBlockTile(seed, x0 + x, z);
+            }
+        }
+        sink += sum;
+
+        double seconds = timerSecondsSince(start);
+        if (seconds > 0.0)
+        {
+            best = std::max(best, (double)(w * h) / seconds);
+        }
+    }
+
+    DXF_LOGINFO("Wang tiling: %.1f M blocks/s", best / 1000000.0);
+
+    return best;
+}
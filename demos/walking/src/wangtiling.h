@@ -0,0 +1,53 @@
+// wangtiling.h
+//
+// Created at 2014/04/10
+//
+// Hongwei Li hongwei.li@amd.com
+// All rights reserved
+
+#ifndef WANGTILING_H
+#define WANGTILING_H
+
+#include <stdint.h>
+
+// The edges along x (north and south) have 2 colors and the edges along
+// z (west and east) have 3, so the tile image holds all 2 * 3 * 2 * 3 = 36
+// combinations and any coloring of the edges can be tiled.
+#define WANG_NUM_HCOLORS 3
+#define WANG_NUM_VCOLORS 2
+#define WANG_NUM_TILES   (WANG_NUM_HCOLORS * WANG_NUM_HCOLORS * WANG_NUM_VCOLORS * WANG_NUM_VCOLORS)
+
+//
+// The color of every edge is a hash of the coordinates of the edge, so the
+// tile of any block is found in O(1) without any history of the blocks
+// around it and is the same on every run with the same seed. Only 32-bit
+// integer multiplications, xors and shifts are used so that the same
+// function can run in a shader.
+//
+// The edges are indexed on the lattice of the blocks, whose block (x, z) is
+// centered at (x, z) * BLOCK_SIZE. The horizontal edge (x, z) lies between
+// the blocks (x - 1, z) and (x, z), and the vertical edge (x, z) between the
+// blocks (x, z - 1) and (x, z). So the north edge of the block (x, z) is the
+// horizontal edge (x, z) and its south edge is (x + 1, z); its west edge is
+// the vertical edge (x, z) and its east edge is (x, z + 1).
+int wangHorizontalEdgeColor(uint32_t seed, int x, int z);
+int wangVerticalEdgeColor(uint32_t seed, int x, int z);
+
+// The index of the tile with the given edge colors in the tile image.
+int wangTileIndex(int n, int e, int s, int w);
+// The edge colors (NESW) of a tile.
+void wangTileColors(int tile, int colors[4]);
+
+// The tile of the block (x, z).
+int wangBlockTile(uint32_t seed, int x, int z);
+
+// Check that every pair of neighboring blocks in the window agrees on the
+// color of the shared edge and that all the tiles are used. The statistics
+// are logged. It generalizes the old Ground::validateTiling to any window.
+bool wangValidate(uint32_t seed, int x0, int z0, int w, int h);
+
+// The number of blocks tiled per second over a w * h window, the best of
+// a few runs.
+double wangBenchmark(uint32_t seed, int w, int h);
+
+#endif // !WANGTILING_H
@@ -0,0 +1 @@
+#include "../../../src/util/bvh.h"
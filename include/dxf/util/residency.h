@@ -0,0 +1 @@
+#include "../../../src/util/residency.h"
@@ -0,0 +1 @@
+#include "../../../src/util/sampling.h"
@@ -11,9 +11,15 @@
 #include "dxf_main.h"
 #include "dxf_model.h"
 #include "dxf_shader.h"
+#include "dxf_shader_cache.h"
+#include "dxf_shader_variants.h"
 #include "dxf_framebuffer.h"
 #include "dxf_cbuffer.h"
+#include "dxf_constant_allocator.h"
+#include "dxf_structured_buffer.h"
+#include "dxf_terrain.h"
 #include "dxf_light.h"
 #include "dxf_texture.h"
+#include "dxf_texture_streamer.h"
 #include "dxf_abstract_renderer.h"
 #include "dxf_abstract_control.h"
@@ -12,6 +12,7 @@
 #include "dxf_abstract_renderer.h"
 
 #include "dxf_assert.h"
+#include "dxf_cbuffer.h"
 
 #include <directxmath.h>
 #include <directxcolors.h>
@@ -64,6 +65,11 @@ void AbstractRenderer::renderText(double fTime,
     m_txtHelper->SetForegroundColor(DirectX::XMFLOAT4(1.0f, 1.0f, 0.0f, 1.0f));
     m_txtHelper->DrawTextLine(DXUTGetFrameStats(DXUTIsVsyncEnabled()));
     m_txtHelper->DrawTextLine(DXUTGetDeviceStats());
+
+    CBufferStatistics cbuffers;
+    cbufferGetStatistics(&cbuffers);
+    m_txtHelper->DrawFormattedTextLine(L"CBuffer: %u/%u syncs uploaded, %.1f KB", 
+        cbuffers.numUploads, cbuffers.numSyncs, (float)cbuffers.numBytes / 1024.0f);
     m_txtHelper->End();
 }
 
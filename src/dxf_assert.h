@@ -73,7 +73,7 @@ DXF_EXTERN void DXF_APIENTRY assertSetStyle(AssertStyleEnum style);
 #else
 
 #define DXF_ASSERT(condition)
-#define DXF_ASSERT_INFO(condition, text)
+#define DXF_ASSERT_INFO(condition, fmt, ...)
 #define DXF_ASSERT_NOT_REACHABLE() 
 #define DXF_ASSERT_NOT_IMPLEMENTED() 
 
@@ -16,4 +16,29 @@
 
 DXF_NAMESPACE_BEGIN
 
+// The constant buffers are only synced on the rendering thread.
+static CBufferStatistics g_frameStatistics = { 0, 0, 0 };
+static CBufferStatistics g_lastFrameStatistics = { 0, 0, 0 };
+
+void cbufferBeginFrame()
+{
+    g_lastFrameStatistics = g_frameStatistics;
+    memset(&g_frameStatistics, 0, sizeof(CBufferStatistics));
+}
+
+void cbufferGetStatistics(CBufferStatistics* statistics)
+{
+    *statistics = g_lastFrameStatistics;
+}
+
+void cbufferCountSync(UINT bytes)
+{
+    g_frameStatistics.numSyncs++;
+    if (bytes > 0)
+    {
+        g_frameStatistics.numUploads++;
+        g_frameStatistics.numBytes += bytes;
+    }
+}
+
 DXF_NAMESPACE_END
@@ -13,54 +13,133 @@
 #define DXF_CBUFFER_H
 
 #include "dxf_common.h"
+#include "dxf_assert.h"
+#include "dxf_shader.h"
+#include "dxf_log.h"
+
+#include <stddef.h>
+#include <algorithm>
+#include <string>
+#include <vector>
 
 DXF_NAMESPACE_BEGIN
 
+// The upload traffic of all the constant buffers. Counted from the
+// beginning of the frame.
+struct CBufferStatistics
+{
+    UINT numSyncs;
+    UINT numUploads;   // the syncs that found dirty data
+    UINT numBytes;     // uploaded
+};
+
+// Called by the main loop before the renderer draws a frame. The counters
+// of the frame just finished become the statistics.
+void cbufferBeginFrame();
+// The counters of the last complete frame.
+void cbufferGetStatistics(CBufferStatistics* statistics);
+// Used by CBuffer::sync(). bytes is 0 when nothing is uploaded.
+void cbufferCountSync(UINT bytes);
+
+// The number of disjoint dirty ranges a buffer keeps before it merges them
+// into one.
+#define DXF_CBUFFER_MAX_DIRTY_RANGES 4
+
+//
+// The CPU copy of a constant buffer. Only the bytes written since the last
+// sync are uploaded, and a clean buffer is only bound.
+//
+// A D3D11_USAGE_DEFAULT buffer uploads just the dirty ranges with
+// UpdateSubresource1 when the driver supports partial constant buffer
+// updates, and the whole buffer otherwise. A D3D11_USAGE_DYNAMIC buffer is
+// mapped with D3D11_MAP_WRITE_DISCARD and always rewritten as a whole,
+// which suits small buffers that change on every draw.
 template<typename T>
 class CBuffer
 {
 public:
-    CBuffer(ID3D11Device* device);
+    // usage is D3D11_USAGE_DEFAULT or D3D11_USAGE_DYNAMIC.
+    CBuffer(ID3D11Device* device, D3D11_USAGE usage = D3D11_USAGE_DEFAULT);
     ~CBuffer();
 
+    // Bind to one stage ("vs", "ps", "hs", "ds" or "gs") at the given slot.
     HRESULT create(ID3D11DeviceContext* context,
                    LPCSTR name,
                    LPCSTR shader,
                    UINT   slot);
+    // Bind to the stages of a mask of ShaderBit, all at the given slot.
+    HRESULT create(ID3D11DeviceContext* context,
+                   LPCSTR name,
+                   UINT   stages,
+                   UINT   slot);
+    // Bind to every stage of the shader that uses the cbuffer of the given
+    // name, at the slots found by reflection. Fail when no stage uses it
+    // or when its size differs from T.
+    HRESULT create(ID3D11DeviceContext* context,
+                   const Shader* shader,
+                   LPCSTR name);
+    // Upload the dirty bytes, if any, and bind.
     void sync(ID3D11DeviceContext* context);
-    T& data() { return m_data; };
+    void bind(ID3D11DeviceContext* context);
 
-private:
-    void uploadVS(ID3D11DeviceContext* context);
-    void uploadPS(ID3D11DeviceContext* context);
-    void uploadHS(ID3D11DeviceContext* context);
-    void uploadDS(ID3D11DeviceContext* context);
-    void uploadGS(ID3D11DeviceContext* context);
+    // The whole data is marked dirty.
+    T& data() { markDirty(0, sizeof(T)); return m_data; };
+    // Nothing is marked dirty; call markDirty() with the bytes written.
+    T& dataUntracked() { return m_data; }
+    void markDirty(size_t offset, size_t size);
 
-    typedef void (CBuffer<T>::*UploadFunction)(ID3D11DeviceContext* context);
+    // Check a member of T against the reflected variable of the same
+    // meaning. Only for the buffers created from a shader. See
+    // DXF_CBUFFER_CHECK.
+    bool checkVariable(LPCSTR variable, size_t offset, size_t size) const;
 
 private:
-    ID3D11Device*   m_device;
-    ID3D11Buffer*   m_buffer;
-    T               m_data;
-    UploadFunction  m_function;
-    UINT            m_slot;
+    HRESULT createBuffer(ID3D11DeviceContext* context, LPCSTR name);
+
+private:
+    struct Range
+    {
+        UINT begin;
+        UINT end;
+    };
+
+    ID3D11Device*                     m_device;
+    ID3D11DeviceContext1*             m_context1;  // NULL without partial updates
+    ID3D11Buffer*                     m_buffer;
+    D3D11_USAGE                       m_usage;
+    T                                 m_data;
+    Range                             m_dirty[DXF_CBUFFER_MAX_DIRTY_RANGES];
+    UINT                              m_numDirty;
+    UINT                              m_stages;
+    UINT                              m_slots[DXF_NUM_SHADER_STAGES];
+    std::string                       m_name;
+    std::vector<ShaderVariableLayout> m_variables;
 };
 
+// e.g., DXF_CBUFFER_CHECK(m_cbInit, CbInitStruct, light.ambient, "Ambient")
+#define DXF_CBUFFER_CHECK(cbuffer, type, member, variable) \
+    (cbuffer)->checkVariable(variable, offsetof(type, member), sizeof(((type*)0)->member))
+
 template<typename T>
-CBuffer<T>::CBuffer(ID3D11Device* device)
+CBuffer<T>::CBuffer(ID3D11Device* device, D3D11_USAGE usage)
 {
     DXF_ASSERT(device != NULL);
+    DXF_ASSERT(usage == D3D11_USAGE_DEFAULT || usage == D3D11_USAGE_DYNAMIC);
     m_device = device;
+    m_context1 = NULL;
     m_buffer = NULL;
+    m_usage = usage;
     // The constant buffer data must be 64-bit aligned.
     DXF_ASSERT(sizeof(T) % 16 == 0);
-    m_slot = 0;
+    m_numDirty = 0;
+    m_stages = 0;
+    memset(m_slots, 0, sizeof(m_slots));
 }
 
 template<typename T>
 CBuffer<T>::~CBuffer()
 {
+    SAFE_RELEASE(m_context1);
     SAFE_RELEASE(m_buffer);
 }
 
@@ -70,48 +149,165 @@ HRESULT CBuffer<T>::create(ID3D11DeviceContext* context,
                            LPCSTR shader,
                            UINT   slot)
 {
-    m_slot = slot;
+    static const char* stageNames[DXF_NUM_SHADER_STAGES] = { "vs", "ps", "hs", "ds", "gs", "cs" };
 
+    UINT stages = 0;
+    for (UINT i = 0; i < DXF_NUM_SHADER_STAGES; ++i)
+    {
+        if (strcmp(shader, stageNames[i]) == 0)
+        {
+            stages = 1u << i;
+        }
+    }
+    if (stages == 0 || stages == COMPUTE_SHADER_BIT)
+    {
+        OutputDebugString(L"Invalid shader to bind this constant buffer.\n");
+        return S_FALSE;
+    }
+
+    return create(context, name, stages, slot);
+}
+
+template<typename T>
+HRESULT CBuffer<T>::create(ID3D11DeviceContext* context,
+                           LPCSTR name,
+                           UINT   stages,
+                           UINT   slot)
+{
+    DXF_ASSERT(stages != 0 && (stages & COMPUTE_SHADER_BIT) == 0);
+
+    m_stages = stages;
+    for (UINT i = 0; i < DXF_NUM_SHADER_STAGES; ++i)
+    {
+        m_slots[i] = slot;
+    }
+
+    return createBuffer(context, name);
+}
+
+template<typename T>
+HRESULT CBuffer<T>::create(ID3D11DeviceContext* context,
+                           const Shader* shader,
+                           LPCSTR name)
+{
+    DXF_ASSERT(shader != NULL);
+
+    const ShaderCBufferLayout* layout = shader->findCBuffer(name);
+    if (layout == NULL)
+    {
+        DXF_LOGERROR("cbuffer %s is not used by the shader", name);
+        return E_INVALIDARG;
+    }
+    if (layout->size != sizeof(T))
+    {
+        DXF_LOGERROR("cbuffer %s is %u bytes in the shader but %u bytes in C++", 
+            name, layout->size, (UINT)sizeof(T));
+        return E_INVALIDARG;
+    }
+
+    m_stages = layout->stages & ~COMPUTE_SHADER_BIT;
+    memcpy(m_slots, layout->slots, sizeof(m_slots));
+    m_variables = layout->variables;
+
+    return createBuffer(context, name);
+}
+
+template<typename T>
+HRESULT CBuffer<T>::createBuffer(ID3D11DeviceContext* context, LPCSTR name)
+{
     HRESULT hr;
     D3D11_BUFFER_DESC bd;
     ZeroMemory(&bd, sizeof(bd));
 
-    bd.Usage          = D3D11_USAGE_DEFAULT;
+    bd.Usage          = m_usage;
     bd.BindFlags      = D3D11_BIND_CONSTANT_BUFFER;
-    bd.CPUAccessFlags = 0;
+    bd.CPUAccessFlags = (m_usage == D3D11_USAGE_DYNAMIC)? D3D11_CPU_ACCESS_WRITE : 0;
     bd.ByteWidth      = sizeof(T);
 
     V_RETURN(m_device->CreateBuffer(&bd, NULL, &m_buffer));
     DXUT_SetDebugName(m_buffer, name);
 
-    if (strcmp(shader, "vs") == 0)
-    {
-        m_function = &CBuffer<T>::uploadVS;
-    }
-    else if (strcmp(shader, "ps") == 0)
+    m_name = name;
+
+    // Partial updates need a D3D11.1 runtime and driver support.
+    if (m_usage == D3D11_USAGE_DEFAULT && context != NULL)
     {
-        m_function = &CBuffer<T>::uploadPS;
+        D3D11_FEATURE_DATA_D3D11_OPTIONS options;
+        if (SUCCEEDED(m_device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) &&
+            options.ConstantBufferPartialUpdate)
+        {
+            context->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&m_context1);
+        }
     }
-    else if (strcmp(shader, "hs") == 0)
+
+    // The buffer has no content yet.
+    markDirty(0, sizeof(T));
+
+    return S_OK;
+}
+
+template<typename T>
+void CBuffer<T>::markDirty(size_t offset, size_t size)
+{
+    DXF_ASSERT(offset + size <= sizeof(T));
+    if (size == 0)
     {
-        m_function = &CBuffer<T>::uploadHS;
+        return;
     }
-    else if (strcmp(shader, "ds") == 0)
+
+    // Partial updates are in whole constants.
+    Range range;
+    range.begin = (UINT)(offset & ~(size_t)15);
+    range.end = (UINT)((offset + size + 15) & ~(size_t)15);
+
+    // Absorb the ranges it overlaps or touches.
+    UINT n = 0;
+    for (UINT i = 0; i < m_numDirty; ++i)
     {
-        m_function = &CBuffer<T>::uploadDS;
+        if (m_dirty[i].end >= range.begin && m_dirty[i].begin <= range.end)
+        {
+            range.begin = std::min(range.begin, m_dirty[i].begin);
+            range.end = std::max(range.end, m_dirty[i].end);
+        }
+        else
+        {
+            m_dirty[n++] = m_dirty[i];
+        }
     }
-    else if (strcmp(shader, "gs") == 0)
+
+    if (n == DXF_CBUFFER_MAX_DIRTY_RANGES)
     {
-        m_function = &CBuffer<T>::uploadGS;
+        for (UINT i = 0; i < n; ++i)
+        {
+            range.begin = std::min(range.begin, m_dirty[i].begin);
+            range.end = std::max(range.end, m_dirty[i].end);
+        }
+        n = 0;
     }
-    else
+    m_dirty[n++] = range;
+    m_numDirty = n;
+}
+
+template<typename T>
+bool CBuffer<T>::checkVariable(LPCSTR variable, size_t offset, size_t size) const
+{
+    for (size_t i = 0; i < m_variables.size(); ++i)
     {
-        OutputDebugString(L"Invalid shader to bind this constant buffer.\n");
-        SAFE_RELEASE(m_buffer);
-        return S_FALSE;
+        if (m_variables[i].name == variable)
+        {
+            if (m_variables[i].offset != offset || m_variables[i].size != size)
+            {
+                DXF_LOGERROR("cbuffer %s: %s is at %u (%u bytes) in the shader but at %u (%u bytes) in C++", 
+                    m_name.c_str(), variable, m_variables[i].offset, m_variables[i].size, 
+                    (UINT)offset, (UINT)size);
+                return false;
+            }
+            return true;
+        }
     }
-    
-    return S_OK;
+
+    DXF_LOGERROR("cbuffer %s has no variable %s", m_name.c_str(), variable);
+    return false;
 }
     
 template<typename T>
@@ -119,39 +315,69 @@ void CBuffer<T>::sync(ID3D11DeviceContext* context)
 {
     DXF_ASSERT(context != NULL);
     DXF_ASSERT(m_buffer != NULL);
-    context->UpdateSubresource(m_buffer, 0, NULL, &m_data, 0, 0);
-
-    (this->*m_function)(context);
-}
 
-template<typename T>
-void CBuffer<T>::uploadVS(ID3D11DeviceContext* context)
-{
-    context->VSSetConstantBuffers(m_slot, 1, &m_buffer);
-}
-
-template<typename T>
-void CBuffer<T>::uploadPS(ID3D11DeviceContext* context)
-{
-    context->PSSetConstantBuffers(m_slot, 1, &m_buffer);
-}
+    UINT bytes = 0;
+    if (m_numDirty > 0)
+    {
+        if (m_usage == D3D11_USAGE_DYNAMIC)
+        {
+            // The discarded buffer has no defined content, so rewrite all.
+            D3D11_MAPPED_SUBRESOURCE mapped;
+            if (SUCCEEDED(context->Map(m_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+            {
+                memcpy(mapped.pData, &m_data, sizeof(T));
+                context->Unmap(m_buffer, 0);
+                bytes = sizeof(T);
+            }
+        }
+        else if (m_context1 != NULL && 
+                 (m_numDirty > 1 || m_dirty[0].begin > 0 || m_dirty[0].end < sizeof(T)))
+        {
+            for (UINT i = 0; i < m_numDirty; ++i)
+            {
+                D3D11_BOX box = { m_dirty[i].begin, 0, 0, m_dirty[i].end, 1, 1 };
+                m_context1->UpdateSubresource1(m_buffer, 0, &box, (const BYTE*)&m_data + box.left, 0, 0, 0);
+                bytes += box.right - box.left;
+            }
+        }
+        else
+        {
+            context->UpdateSubresource(m_buffer, 0, NULL, &m_data, 0, 0);
+            bytes = sizeof(T);
+        }
+        if (bytes > 0)
+        {
+            m_numDirty = 0;
+        }
+    }
+    cbufferCountSync(bytes);
 
-template<typename T>
-void CBuffer<T>::uploadGS(ID3D11DeviceContext* context)
-{
-    context->GSSetConstantBuffers(m_slot, 1, &m_buffer);
+    bind(context);
 }
 
 template<typename T>
-void CBuffer<T>::uploadHS(ID3D11DeviceContext* context)
+void CBuffer<T>::bind(ID3D11DeviceContext* context)
 {
-    context->HSSetConstantBuffers(m_slot, 1, &m_buffer);
-}
-
-template<typename T>
-void CBuffer<T>::uploadDS(ID3D11DeviceContext* context)
-{
-    context->DSSetConstantBuffers(m_slot, 1, &m_buffer);
+    if (m_stages & VERTEX_SHADER_BIT)
+    {
+        context->VSSetConstantBuffers(m_slots[0], 1, &m_buffer);
+    }
+    if (m_stages & PIXEL_SHADER_BIT)
+    {
+        context->PSSetConstantBuffers(m_slots[1], 1, &m_buffer);
+    }
+    if (m_stages & HULL_SHADER_BIT)
+    {
+        context->HSSetConstantBuffers(m_slots[2], 1, &m_buffer);
+    }
+    if (m_stages & DOMAIN_SHADER_BIT)
+    {
+        context->DSSetConstantBuffers(m_slots[3], 1, &m_buffer);
+    }
+    if (m_stages & GEOMETRY_SHADER_BIT)
+    {
+        context->GSSetConstantBuffers(m_slots[4], 1, &m_buffer);
+    }
 }
 
 DXF_NAMESPACE_END
@@ -24,6 +24,10 @@
 
 #define DXF_UNUSED_ARGUMENT(p) ((void)p)
 
+// DXUT uses std::min/max and so do we.
+#ifndef NOMINMAX
+# define NOMINMAX
+#endif
 # include <Windows.h>
 
 
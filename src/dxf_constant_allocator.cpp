@@ -0,0 +1,267 @@
+// --------------------------------------------------------------
+// dxf_constant_allocator.cpp
+// Per-draw constants bump-allocated in one large buffer
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "dxf_constant_allocator.h"
+
+#include "dxf_assert.h"
+#include "dxf_log.h"
+
+#include "DXUT/Core/DXUT.h"
+
+DXF_NAMESPACE_BEGIN
+
+ConstantAllocator::ConstantAllocator(ID3D11Device* device)
+{
+    DXF_ASSERT(device != NULL);
+    m_device = device;
+    m_context = NULL;
+    m_buffer = NULL;
+    m_ring = NULL;
+    m_nextFence = 1;
+    m_mapped = false;
+    m_numMaps = 0;
+    m_lastFrameBytes = 0;
+    m_lastNumMaps = 0;
+    m_numStalls = 0;
+}
+
+ConstantAllocator::~ConstantAllocator()
+{
+    for (size_t i = 0; i < m_fences.size(); ++i)
+    {
+        SAFE_RELEASE(m_fences[i].query);
+    }
+    for (size_t i = 0; i < m_freeQueries.size(); ++i)
+    {
+        SAFE_RELEASE(m_freeQueries[i]);
+    }
+    SAFE_DELETE(m_ring);
+    SAFE_RELEASE(m_buffer);
+    SAFE_RELEASE(m_context);
+}
+
+HRESULT ConstantAllocator::create(ID3D11DeviceContext* context, UINT size, LPCSTR name)
+{
+    DXF_ASSERT(context != NULL);
+    DXF_ASSERT(m_buffer == NULL);
+
+    HRESULT hr;
+
+    D3D11_FEATURE_DATA_D3D11_OPTIONS options;
+    if (FAILED(m_device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) ||
+        !options.ConstantBufferOffsetting ||
+        !options.MapNoOverwriteOnDynamicConstantBuffer)
+    {
+        DXF_LOGWARNING("The device does not support constant buffer offsetting");
+        return E_NOTIMPL;
+    }
+    V_RETURN(context->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&m_context));
+
+    size = (size + DXF_CONSTANT_BLOCK_SIZE - 1) & ~(DXF_CONSTANT_BLOCK_SIZE - 1);
+
+    D3D11_BUFFER_DESC bd;
+    ZeroMemory(&bd, sizeof(bd));
+
+    bd.Usage          = D3D11_USAGE_DYNAMIC;
+    bd.BindFlags      = D3D11_BIND_CONSTANT_BUFFER;
+    bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    bd.ByteWidth      = size;
+
+    V_RETURN(m_device->CreateBuffer(&bd, NULL, &m_buffer));
+    DXUT_SetDebugName(m_buffer, name);
+
+    m_ring = new RingAllocator(size);
+    m_shadow.resize(size);
+
+    return S_OK;
+}
+
+void ConstantAllocator::beginFrame()
+{
+    DXF_ASSERT(m_ring != NULL);
+
+    // Retire the finished frames in order without stalling.
+    while (!m_fences.empty() && 
+           m_context->GetData(m_fences.front().query, NULL, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+    {
+        m_ring->retire(m_fences.front().value);
+        m_freeQueries.push_back(m_fences.front().query);
+        m_fences.pop_front();
+    }
+
+    m_numMaps = 0;
+}
+
+bool ConstantAllocator::waitOldestFrame()
+{
+    if (m_fences.empty())
+    {
+        return false;
+    }
+
+    m_numStalls++;
+
+    // A removed device returns an error rather than S_FALSE; treat it as
+    // done too.
+    while (m_context->GetData(m_fences.front().query, NULL, 0, 0) == S_FALSE)
+    {
+        Sleep(0);
+    }
+    m_ring->retire(m_fences.front().value);
+    m_freeQueries.push_back(m_fences.front().query);
+    m_fences.pop_front();
+
+    return true;
+}
+
+void* ConstantAllocator::allocate(UINT size, ConstantAllocation* allocation)
+{
+    DXF_ASSERT(m_ring != NULL);
+    DXF_ASSERT(allocation != NULL);
+    DXF_ASSERT(size > 0 && size <= D3D11_REQ_CONSTANT_BUFFER_ELEMENT_COUNT * 16);
+
+    size = (size + DXF_CONSTANT_BLOCK_SIZE - 1) & ~(DXF_CONSTANT_BLOCK_SIZE - 1);
+
+    UINT64 offset;
+    while ((offset = m_ring->allocate(size, DXF_CONSTANT_BLOCK_SIZE)) == RING_ALLOCATOR_FULL)
+    {
+        if (!waitOldestFrame())
+        {
+            DXF_LOGERROR("The constants of the frame exceed %u bytes", (UINT)m_ring->capacity());
+            return NULL;
+        }
+    }
+
+    Region region;
+    region.offset = (UINT)offset;
+    region.size = size;
+    if (!m_pending.empty() && m_pending.back().offset + m_pending.back().size == region.offset)
+    {
+        m_pending.back().size += size;
+    }
+    else
+    {
+        m_pending.push_back(region);
+    }
+
+    allocation->firstConstant = (UINT)offset / 16;
+    allocation->numConstants = size / 16;
+
+    return &m_shadow[(size_t)offset];
+}
+
+void ConstantAllocator::flush()
+{
+    if (m_pending.empty())
+    {
+        return;
+    }
+
+    // The regions written since the last flush are not in use by the GPU,
+    // so no-overwrite is safe. The very first map must discard.
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    D3D11_MAP mapType = m_mapped? D3D11_MAP_WRITE_NO_OVERWRITE : D3D11_MAP_WRITE_DISCARD;
+    if (FAILED(m_context->Map(m_buffer, 0, mapType, 0, &mapped)))
+    {
+        DXF_LOGERROR("Failed to map the constant buffer");
+        return;
+    }
+
+    if (!m_mapped)
+    {
+        // Nothing else was ever written.
+        memcpy(mapped.pData, &m_shadow[0], m_shadow.size());
+        m_mapped = true;
+    }
+    else
+    {
+        for (size_t i = 0; i < m_pending.size(); ++i)
+        {
+            memcpy((BYTE*)mapped.pData + m_pending[i].offset, 
+                   &m_shadow[m_pending[i].offset], 
+                   m_pending[i].size);
+        }
+    }
+
+    m_context->Unmap(m_buffer, 0);
+    m_pending.clear();
+    m_numMaps++;
+}
+
+void ConstantAllocator::bind(UINT stages, UINT slot, const ConstantAllocation& allocation)
+{
+    if (stages & VERTEX_SHADER_BIT)
+    {
+        m_context->VSSetConstantBuffers1(slot, 1, &m_buffer, &allocation.firstConstant, &allocation.numConstants);
+    }
+    if (stages & PIXEL_SHADER_BIT)
+    {
+        m_context->PSSetConstantBuffers1(slot, 1, &m_buffer, &allocation.firstConstant, &allocation.numConstants);
+    }
+    if (stages & HULL_SHADER_BIT)
+    {
+        m_context->HSSetConstantBuffers1(slot, 1, &m_buffer, &allocation.firstConstant, &allocation.numConstants);
+    }
+    if (stages & DOMAIN_SHADER_BIT)
+    {
+        m_context->DSSetConstantBuffers1(slot, 1, &m_buffer, &allocation.firstConstant, &allocation.numConstants);
+    }
+    if (stages & GEOMETRY_SHADER_BIT)
+    {
+        m_context->GSSetConstantBuffers1(slot, 1, &m_buffer, &allocation.firstConstant, &allocation.numConstants);
+    }
+    if (stages & COMPUTE_SHADER_BIT)
+    {
+        m_context->CSSetConstantBuffers1(slot, 1, &m_buffer, &allocation.firstConstant, &allocation.numConstants);
+    }
+}
+
+void ConstantAllocator::endFrame()
+{
+    DXF_ASSERT(m_pending.empty());
+
+    m_lastFrameBytes = (UINT)m_ring->frameBytes();
+    m_lastNumMaps = m_numMaps;
+
+    if (m_ring->frameBytes() == 0)
+    {
+        return;
+    }
+
+    ID3D11Query* query = NULL;
+    if (!m_freeQueries.empty())
+    {
+        query = m_freeQueries.back();
+        m_freeQueries.pop_back();
+    }
+    else
+    {
+        D3D11_QUERY_DESC desc;
+        desc.Query = D3D11_QUERY_EVENT;
+        desc.MiscFlags = 0;
+        if (FAILED(m_device->CreateQuery(&desc, &query)))
+        {
+            // Leave the frame open; the next fence covers it too.
+            DXF_LOGWARNING("Failed to create the event query");
+            return;
+        }
+    }
+
+    m_context->End(query);
+
+    Fence fence;
+    fence.query = query;
+    fence.value = m_nextFence++;
+    m_fences.push_back(fence);
+    m_ring->endFrame(fence.value);
+}
+
+DXF_NAMESPACE_END
@@ -0,0 +1,127 @@
+// --------------------------------------------------------------
+// dxf_constant_allocator.h
+// Per-draw constants bump-allocated in one large buffer
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef DXF_CONSTANT_ALLOCATOR_H
+#define DXF_CONSTANT_ALLOCATOR_H
+
+#include "dxf_common.h"
+
+#include "util/ringallocator.h"
+
+#include <vector>
+#include <deque>
+
+DXF_NAMESPACE_BEGIN
+
+// The *SetConstantBuffers1 offsets and sizes are in whole blocks of 16
+// constants.
+#define DXF_CONSTANT_BLOCK_SIZE 256
+
+// Where the constants of one draw are in the buffer, in constants.
+struct ConstantAllocation
+{
+    UINT firstConstant;
+    UINT numConstants;
+};
+
+//
+// The constants of the draws are bump-allocated from a ring over one
+// dynamic constant buffer and bound with an offset, so the buffer is
+// mapped once per flush rather than once per draw. The space of a frame
+// is reused when an event query issued at the end of the frame tells
+// that the GPU is done with it.
+//
+//   allocator.beginFrame();
+//   for each object
+//       ObjectConstants* c = allocator.allocate<ObjectConstants>(&object.constants);
+//       ...
+//   allocator.flush();
+//   for each object
+//       allocator.bind(VERTEX_SHADER_BIT, 0, object.constants);
+//       draw
+//   allocator.endFrame();
+//
+// It needs a D3D11.1 runtime and a driver that supports constant buffer
+// offsetting and D3D11_MAP_WRITE_NO_OVERWRITE on constant buffers;
+// create() fails with E_NOTIMPL otherwise, and the caller falls back to
+// CBuffer.
+class ConstantAllocator
+{
+public:
+    ConstantAllocator(ID3D11Device* device);
+    ~ConstantAllocator();
+
+    // size is rounded up to DXF_CONSTANT_BLOCK_SIZE. At most 
+    // D3D11_REQ_CONSTANT_BUFFER_ELEMENT_COUNT constants are visible to a
+    // draw, but the buffer itself can be much larger.
+    HRESULT create(ID3D11DeviceContext* context, UINT size, LPCSTR name);
+
+    // Reuse the space of the frames the GPU has finished.
+    void beginFrame();
+    // The CPU memory of the constants of a draw. It is written to the
+    // buffer by the next flush(). Return NULL when the frame alone does
+    // not fit in the buffer.
+    void* allocate(UINT size, ConstantAllocation* allocation);
+    template<typename T>
+    T* allocate(ConstantAllocation* allocation)
+    {
+        return (T*)allocate(sizeof(T), allocation);
+    }
+    // Copy the constants allocated since the last flush to the buffer. 
+    void flush();
+    // Bind the constants of a draw to the stages of a mask of ShaderBit.
+    // They must have been flushed.
+    void bind(UINT stages, UINT slot, const ConstantAllocation& allocation);
+    // Close the frame under an event query.
+    void endFrame();
+
+    // The bytes allocated in the last complete frame, the number of maps
+    // and the number of times the CPU waited for the GPU to free space.
+    UINT frameBytes() const { return m_lastFrameBytes; }
+    UINT numMaps() const { return m_lastNumMaps; }
+    UINT numStalls() const { return m_numStalls; }
+
+private:
+    struct Region
+    {
+        UINT offset;
+        UINT size;
+    };
+
+    struct Fence
+    {
+        ID3D11Query* query;
+        UINT64       value;
+    };
+
+    // Block until the oldest frame in flight is finished.
+    bool waitOldestFrame();
+
+private:
+    ID3D11Device*             m_device;
+    ID3D11DeviceContext1*     m_context;
+    ID3D11Buffer*             m_buffer;
+    RingAllocator*            m_ring;
+    std::vector<BYTE>         m_shadow;     // the CPU copy of the buffer
+    std::vector<Region>       m_pending;    // allocated since the last flush
+    std::deque<Fence>         m_fences;     // the frames in flight
+    std::vector<ID3D11Query*> m_freeQueries;
+    UINT64                    m_nextFence;
+    bool                      m_mapped;     // the first map discards
+    UINT                      m_numMaps;
+    UINT                      m_lastFrameBytes;
+    UINT                      m_lastNumMaps;
+    UINT                      m_numStalls;
+};
+
+DXF_NAMESPACE_END
+
+#endif // !DXF_CONSTANT_ALLOCATOR_H
@@ -20,6 +20,9 @@
 #include "DXUT/Optional/DXUTgui.h"
 
 #include "dxf_assert.h"
+#include "dxf_log.h"
+#include "dxf_shader_cache.h"
+#include "dxf_cbuffer.h"
 
 static dxf::AbstractRenderer*              g_renderer = NULL;
 static dxf::AbstractControl*               g_control = NULL;
@@ -84,8 +87,23 @@ HRESULT CALLBACK OnD3D11CreateDevice(ID3D11Device* pd3dDevice,
     g_txtHelper = new CDXUTTextHelper(pd3dDevice, pd3dImmediateContext, &g_dialogResourceManager, 15);
     
     V_RETURN(dxf::getControl()->initialize(pd3dDevice, &g_sampleUI));
+    dxf::shaderCacheResetStatistics();
     V_RETURN(dxf::getRenderer()->initialize(pd3dDevice, pd3dImmediateContext, g_txtHelper));
 
+    // The first run after a shader change is cold; the later ones load
+    // everything from the cache. The batches compile on several threads,
+    // so the time they took is the wall clock, not the sum of the CPU time.
+    dxf::ShaderCacheStatistics statistics;
+    dxf::shaderCacheGetStatistics(&statistics);
+    DXF_LOGINFO("Shaders: %u from cache in %.1f ms CPU, %u compiled in %.1f ms CPU", 
+        statistics.numHits, statistics.hitSeconds * 1000.0,
+        statistics.numMisses, statistics.missSeconds * 1000.0);
+    if (statistics.numBatches > 0)
+    {
+        DXF_LOGINFO("Shaders: %u batches in %.1f ms wall clock", 
+            statistics.numBatches, statistics.batchSeconds * 1000.0);
+    }
+
     return S_OK;
 }
 
@@ -146,6 +164,7 @@ void CALLBACK OnD3D11FrameRender(ID3D11Device* pd3dDevice, ID3D11DeviceContext*
         return;
     }
     
+    dxf::cbufferBeginFrame();
     dxf::getRenderer()->render(fTime, fElapsedTime);
     
     g_HUD.OnRender(fElapsedTime);
@@ -18,6 +18,8 @@
 #include "dxf_assert.h"
 #include "dxf_log.h"
 
+#include <string.h>
+
 //#include <assimp/importer.hpp>
 //#include <assimp/scene.h>
 //#include <assimp/postprocess.h>
@@ -260,6 +262,48 @@ HRESULT Model::loadXYZ(const char* filename, Shader* shader)
     return S_OK;
 }
 
+HRESULT Model::loadPoints(const float* points, UINT numPoints, Shader* shader)
+{
+    m_topology = D3D11_PRIMITIVE_TOPOLOGY_POINTLIST;
+
+    m_numVertices = numPoints;
+    m_numIndices  = 0;
+
+    m_vertices = new float [numPoints * 3];
+    m_indices = NULL;
+    memcpy(m_vertices, points, sizeof(float) * 3 * numPoints);
+
+    D3D11_INPUT_ELEMENT_DESC vertexElements[1]; 
+    vertexElements[0].SemanticName         = "POSITION";
+    vertexElements[0].SemanticIndex        = 0;
+    vertexElements[0].Format               = DXGI_FORMAT_R32G32B32_FLOAT;
+    vertexElements[0].InputSlot            = 0;
+    vertexElements[0].AlignedByteOffset    = 0;
+    vertexElements[0].InputSlotClass       = D3D11_INPUT_PER_VERTEX_DATA;
+    vertexElements[0].InstanceDataStepRate = 0;
+
+    m_stride = 12;
+
+    if (!createVertexBuffer(m_device))
+    {
+        return E_FAIL;
+    }
+
+    HRESULT hr = m_device->CreateInputLayout(vertexElements, 
+                    1,
+                    shader->vertexShaderBlob()->GetBufferPointer(), 
+                    shader->vertexShaderBlob()->GetBufferSize(), 
+                    &m_vertexLayout);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    DXUT_SetDebugName(m_vertexLayout, "points");
+
+    return S_OK;
+}
+
 HRESULT Model::loadSphere(UINT numSegments, UINT numRings, Shader* shader)
 {
     m_topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
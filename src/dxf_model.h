@@ -26,6 +26,8 @@ public:
 
     HRESULT loadObj(const char* filename, Shader* shader);
     HRESULT loadXYZ(const char* filename, Shader* shader);
+    // A point list of numPoints xyz positions.
+    HRESULT loadPoints(const float* points, UINT numPoints, Shader* shader);
     HRESULT loadSphere(UINT numSegments, UINT numRings, Shader* shader);
     HRESULT loadPlane(float w, float h, Shader* shader);
     // A convex polgyon on the xz plane
@@ -13,10 +13,60 @@
 
 #include "dxf_assert.h"
 #include "dxf_log.h"
+#include "dxf_shader_cache.h"
 #include "dxut/core/dxut.h"
 
+#include <d3d11shader.h>
+#include <algorithm>
+
 DXF_NAMESPACE_BEGIN
 
+// The macros point into the strings, which are name/definition pairs.
+static void buildMacros(const std::vector<std::string>& strings, std::vector<D3D_SHADER_MACRO>* macros)
+{
+    macros->clear();
+    for (size_t i = 0; i < strings.size(); i += 2)
+    {
+        D3D_SHADER_MACRO macro = { strings[i].c_str(), strings[i + 1].c_str() };
+        macros->push_back(macro);
+    }
+    D3D_SHADER_MACRO end = { NULL, NULL };
+    macros->push_back(end);
+}
+
+static LPCSTR stageProfile(UINT stage)
+{
+    switch (stage)
+    {
+        case VERTEX_SHADER_BIT:   return "vs_5_0";
+        case PIXEL_SHADER_BIT:    return "ps_5_0";
+        case HULL_SHADER_BIT:     return "hs_5_0";
+        case DOMAIN_SHADER_BIT:   return "ds_5_0";
+        case GEOMETRY_SHADER_BIT: return "gs_5_0";
+        default:
+            DXF_ASSERT_NOT_REACHABLE();
+            return NULL;
+    }
+}
+
+static void reportError(LPCWSTR shaderFile, LPCSTR mainEntry, HRESULT hr, ID3DBlob* errorBlob)
+{
+    if (hr == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND) || hr == HRESULT_FROM_WIN32(ERROR_PATH_NOT_FOUND))
+    {
+        DXF_LOGERROR("%S not found", shaderFile);
+        DXF_ASSERT_INFO(0, "Source file (%S) not found!", shaderFile);
+    }
+    else if (errorBlob != NULL)
+    {
+        DXF_LOGERROR("%S(%s): %s", shaderFile, mainEntry, (char*)errorBlob->GetBufferPointer());
+        OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+    }
+    else
+    {
+        DXF_LOGERROR("%S(%s): failed to compile (0x%08x)", shaderFile, mainEntry, hr);
+    }
+}
+
 Shader::Shader(ID3D11Device *device)
 {
     DXF_ASSERT(device != NULL);
@@ -27,6 +77,14 @@ Shader::Shader(ID3D11Device *device)
     m_hsShader = NULL;
     m_dsShader = NULL;
     m_gsShader = NULL;
+    m_vsShaderBlob = NULL;
+
+    m_flags = D3DCOMPILE_ENABLE_STRICTNESS;
+#if defined DXF_DEBUG 
+    m_flags |= D3DCOMPILE_DEBUG;
+#endif
+
+    buildMacros(m_macroStrings, &m_macros);
 }
 
 Shader::~Shader()
@@ -41,206 +99,240 @@ Shader::~Shader()
 
 void Shader::setMacros(const D3D_SHADER_MACRO *defines)
 {
+    m_macroStrings.clear();
+    for (const D3D_SHADER_MACRO* m = defines; m != NULL && m->Name != NULL; ++m)
+    {
+        m_macroStrings.push_back(m->Name);
+        m_macroStrings.push_back(m->Definition != NULL? m->Definition : "");
+    }
+
+    // Point into the copies only after all of them are in place.
+    buildMacros(m_macroStrings, &m_macros);
 }
 
 void Shader::setFlags(UINT flags)
 {
+    m_flags = flags;
 }
 
-HRESULT Shader::addVSShader(LPCWSTR vsShaderFile, LPCSTR mainEntry)
+HRESULT Shader::compile(LPCWSTR shaderFile, LPCSTR mainEntry, LPCSTR profile, ID3DBlob** shaderBlob)
 {
-    HRESULT   hr = S_OK;
-    ID3DBlob* pShaderBlob = NULL;
     ID3DBlob* pErrorBlob = NULL;
-    
-    DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
-#if defined DXF_DEBUG 
-    dwShaderFlags |= D3DCOMPILE_DEBUG;
-#endif
 
-    hr = D3DCompileFromFile(vsShaderFile, 
-                            NULL, 
-                            NULL, 
-                            mainEntry, 
-                            "vs_5_0", 
-                            dwShaderFlags, 
-                            0, 
-                            &pShaderBlob, 
-                            &pErrorBlob);
-    if (hr == 0x80070002)
-    {
-        DXF_LOGERROR("%s not found", vsShaderFile);
-        DXF_ASSERT_INFO(0, "Source file (%s) not found!", vsShaderFile);
-    }
-    else if (FAILED(hr))
+    HRESULT hr = shaderCacheCompile(shaderFile, 
+                                    &m_macros[0], 
+                                    mainEntry, 
+                                    profile, 
+                                    m_flags, 
+                                    shaderBlob, 
+                                    &pErrorBlob);
+    if (FAILED(hr))
     {
-        DXF_ASSERT_INFO(0, (char*)pErrorBlob->GetBufferPointer());
-        OutputDebugStringA((char*)pErrorBlob->GetBufferPointer());
+        reportError(shaderFile, mainEntry, hr, pErrorBlob);
         SAFE_RELEASE(pErrorBlob);
-        return hr;
     }
-            
-    hr = m_device->CreateVertexShader(pShaderBlob->GetBufferPointer(), 
-                                      pShaderBlob->GetBufferSize(), 
-                                      NULL, 
-                                      &m_vsShader);
-
-    m_vsShaderBlob = pShaderBlob;
-    DXUT_SetDebugName(m_vsShader, mainEntry);
 
     return hr;
 }
 
-HRESULT Shader::addPSShader(LPCWSTR psShaderFile, LPCSTR mainEntry)
+static UINT stageIndex(UINT stage)
 {
-    HRESULT   hr = S_OK;
-    ID3DBlob* pShaderBlob = NULL;
-    ID3DBlob* pErrorBlob = NULL;
-    
-    DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
-#if defined DXF_DEBUG 
-    dwShaderFlags |= D3DCOMPILE_DEBUG;
-#endif
-
-    hr = D3DCompileFromFile(psShaderFile, 
-                            NULL, 
-                            NULL, 
-                            mainEntry, 
-                            "ps_5_0", 
-                            dwShaderFlags, 
-                            0, 
-                            &pShaderBlob, 
-                            &pErrorBlob);
-    if (FAILED(hr))
+    UINT index = 0;
+    while ((1u << index) != stage)
     {
-        OutputDebugStringA((char*)pErrorBlob->GetBufferPointer());
-        SAFE_RELEASE(pErrorBlob);
-        return hr;
+        index++;
     }
-            
-    hr = m_device->CreatePixelShader(pShaderBlob->GetBufferPointer(), 
-                                     pShaderBlob->GetBufferSize(), 
-                                     NULL, 
-                                     &m_psShader);
-
-    pShaderBlob->Release();
-    DXUT_SetDebugName(m_psShader, mainEntry);
+    DXF_ASSERT(index < DXF_NUM_SHADER_STAGES);
+    return index;
+}
 
-    return hr;
+const ShaderCBufferLayout* Shader::findCBuffer(LPCSTR name) const
+{
+    for (size_t i = 0; i < m_cbuffers.size(); ++i)
+    {
+        if (m_cbuffers[i].name == name)
+        {
+            return &m_cbuffers[i];
+        }
+    }
+    return NULL;
 }
 
-HRESULT Shader::addHSShader(LPCWSTR hsShaderFile, LPCSTR mainEntry)
+HRESULT Shader::reflect(UINT stage, ID3DBlob* shaderBlob, LPCSTR mainEntry)
 {
-    HRESULT   hr = S_OK;
-    ID3DBlob* pShaderBlob = NULL;
-    ID3DBlob* pErrorBlob = NULL;
-    
-    DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
-#if defined DXF_DEBUG 
-    dwShaderFlags |= D3DCOMPILE_DEBUG;
-#endif
+    HRESULT hr;
 
-    hr = D3DCompileFromFile(hsShaderFile, 
-                            NULL, 
-                            NULL, 
-                            mainEntry, 
-                            "hs_5_0", 
-                            dwShaderFlags, 
-                            0, 
-                            &pShaderBlob, 
-                            &pErrorBlob);
-    if (FAILED(hr))
+    // Forget what the previous code of this stage used.
+    for (size_t i = 0; i < m_cbuffers.size(); )
     {
-        OutputDebugStringA((char*)pErrorBlob->GetBufferPointer());
-        SAFE_RELEASE(pErrorBlob);
-        return hr;
+        m_cbuffers[i].stages &= ~stage;
+        if (m_cbuffers[i].stages == 0)
+        {
+            m_cbuffers.erase(m_cbuffers.begin() + i);
+        }
+        else
+        {
+            ++i;
+        }
     }
-            
-    hr = m_device->CreateHullShader(pShaderBlob->GetBufferPointer(), 
-                                    pShaderBlob->GetBufferSize(), 
-                                    NULL, 
-                                    &m_hsShader);
 
-    pShaderBlob->Release();
-    DXUT_SetDebugName(m_hsShader, mainEntry);
+    ID3D11ShaderReflection* reflector = NULL;
+    V_RETURN(D3DReflect(shaderBlob->GetBufferPointer(), 
+                        shaderBlob->GetBufferSize(), 
+                        __uuidof(ID3D11ShaderReflection), 
+                        (void**)&reflector));
+
+    D3D11_SHADER_DESC desc;
+    reflector->GetDesc(&desc);
+
+    for (UINT i = 0; i < desc.BoundResources && SUCCEEDED(hr); ++i)
+    {
+        D3D11_SHADER_INPUT_BIND_DESC bindDesc;
+        reflector->GetResourceBindingDesc(i, &bindDesc);
+        if (bindDesc.Type != D3D_SIT_CBUFFER)
+        {
+            continue;
+        }
+
+        ID3D11ShaderReflectionConstantBuffer* cb = reflector->GetConstantBufferByName(bindDesc.Name);
+        D3D11_SHADER_BUFFER_DESC cbDesc;
+        cb->GetDesc(&cbDesc);
+
+        ShaderCBufferLayout layout;
+        layout.name   = cbDesc.Name;
+        layout.size   = cbDesc.Size;
+        layout.stages = stage;
+        memset(layout.slots, 0, sizeof(layout.slots));
+        layout.slots[stageIndex(stage)] = bindDesc.BindPoint;
+        for (UINT v = 0; v < cbDesc.Variables; ++v)
+        {
+            D3D11_SHADER_VARIABLE_DESC varDesc;
+            cb->GetVariableByIndex(v)->GetDesc(&varDesc);
+
+            ShaderVariableLayout variable;
+            variable.name   = varDesc.Name;
+            variable.offset = varDesc.StartOffset;
+            variable.size   = varDesc.Size;
+            layout.variables.push_back(variable);
+        }
+
+        ShaderCBufferLayout* existing = const_cast<ShaderCBufferLayout*>(findCBuffer(cbDesc.Name));
+        if (existing == NULL)
+        {
+            m_cbuffers.push_back(layout);
+            continue;
+        }
+
+        bool same = existing->size == layout.size && existing->variables.size() == layout.variables.size();
+        for (size_t v = 0; same && v < layout.variables.size(); ++v)
+        {
+            same = existing->variables[v].name   == layout.variables[v].name &&
+                   existing->variables[v].offset == layout.variables[v].offset &&
+                   existing->variables[v].size   == layout.variables[v].size;
+        }
+        if (!same)
+        {
+            DXF_LOGERROR("%s: cbuffer %s has a different layout than in the other stages", 
+                mainEntry, cbDesc.Name);
+            hr = E_FAIL;
+            break;
+        }
+
+        existing->stages |= stage;
+        existing->slots[stageIndex(stage)] = bindDesc.BindPoint;
+    }
+
+    reflector->Release();
 
     return hr;
 }
 
-HRESULT Shader::addDSShader(LPCWSTR dsShaderFile, LPCSTR mainEntry)
+HRESULT Shader::createStage(UINT stage, ID3DBlob* shaderBlob, LPCSTR mainEntry)
 {
-    HRESULT   hr = S_OK;
-    ID3DBlob* pShaderBlob = NULL;
-    ID3DBlob* pErrorBlob = NULL;
-
-    DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
-#if defined DXF_DEBUG 
-    dwShaderFlags |= D3DCOMPILE_DEBUG;
-#endif
-
-    hr = D3DCompileFromFile(dsShaderFile, 
-                            NULL, 
-                            NULL, 
-                            mainEntry, 
-                            "ds_5_0", 
-                            dwShaderFlags, 
-                            0, 
-                            &pShaderBlob, 
-                            &pErrorBlob);
+    HRESULT hr = reflect(stage, shaderBlob, mainEntry);
     if (FAILED(hr))
     {
-        OutputDebugStringA((char*)pErrorBlob->GetBufferPointer());
-        SAFE_RELEASE(pErrorBlob);
+        shaderBlob->Release();
         return hr;
     }
-            
-    hr = m_device->CreateDomainShader(pShaderBlob->GetBufferPointer(), 
-                                      pShaderBlob->GetBufferSize(), 
-                                      NULL, 
-                                      &m_dsShader);
 
-    pShaderBlob->Release();
-    DXUT_SetDebugName(m_dsShader, mainEntry);
+    const void* code = shaderBlob->GetBufferPointer();
+    SIZE_T size = shaderBlob->GetBufferSize();
+
+    switch (stage)
+    {
+        case VERTEX_SHADER_BIT:
+            SAFE_RELEASE(m_vsShader);
+            SAFE_RELEASE(m_vsShaderBlob);
+            hr = m_device->CreateVertexShader(code, size, NULL, &m_vsShader);
+            DXUT_SetDebugName(m_vsShader, mainEntry);
+            // Kept for creating the input layouts.
+            m_vsShaderBlob = shaderBlob;
+            return hr;
+        case PIXEL_SHADER_BIT:
+            SAFE_RELEASE(m_psShader);
+            hr = m_device->CreatePixelShader(code, size, NULL, &m_psShader);
+            DXUT_SetDebugName(m_psShader, mainEntry);
+            break;
+        case HULL_SHADER_BIT:
+            SAFE_RELEASE(m_hsShader);
+            hr = m_device->CreateHullShader(code, size, NULL, &m_hsShader);
+            DXUT_SetDebugName(m_hsShader, mainEntry);
+            break;
+        case DOMAIN_SHADER_BIT:
+            SAFE_RELEASE(m_dsShader);
+            hr = m_device->CreateDomainShader(code, size, NULL, &m_dsShader);
+            DXUT_SetDebugName(m_dsShader, mainEntry);
+            break;
+        case GEOMETRY_SHADER_BIT:
+            SAFE_RELEASE(m_gsShader);
+            hr = m_device->CreateGeometryShader(code, size, NULL, &m_gsShader);
+            DXUT_SetDebugName(m_gsShader, mainEntry);
+            break;
+        default:
+            DXF_ASSERT_NOT_REACHABLE();
+            hr = E_INVALIDARG;
+            break;
+    }
+
+    shaderBlob->Release();
 
     return hr;
 }
 
-HRESULT Shader::addGSShader(LPCWSTR gsShaderFile, LPCSTR mainEntry)
+HRESULT Shader::addStage(UINT stage, LPCWSTR shaderFile, LPCSTR mainEntry)
 {
     HRESULT   hr = S_OK;
     ID3DBlob* pShaderBlob = NULL;
-    ID3DBlob* pErrorBlob = NULL;
-    
-    DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
-#if defined DXF_DEBUG 
-    dwShaderFlags |= D3DCOMPILE_DEBUG;
-#endif
 
-    hr = D3DCompileFromFile(gsShaderFile, 
-                            NULL, 
-                            NULL, 
-                            mainEntry, 
-                            "gs_5_0", 
-                            dwShaderFlags, 
-                            0, 
-                            &pShaderBlob, 
-                            &pErrorBlob);
-    if (FAILED(hr))
-    {
-        OutputDebugStringA((char*)pErrorBlob->GetBufferPointer());
-        SAFE_RELEASE(pErrorBlob);
-        return hr;
-    }
-            
-    hr = m_device->CreateGeometryShader(pShaderBlob->GetBufferPointer(), 
-                                        pShaderBlob->GetBufferSize(), 
-                                        NULL, 
-                                        &m_gsShader);
+    V_RETURN(compile(shaderFile, mainEntry, stageProfile(stage), &pShaderBlob));
 
-    pShaderBlob->Release();
-    DXUT_SetDebugName(m_gsShader, mainEntry);
+    return createStage(stage, pShaderBlob, mainEntry);
+}
 
-    return hr;
+HRESULT Shader::addVSShader(LPCWSTR vsShaderFile, LPCSTR mainEntry)
+{
+    return addStage(VERTEX_SHADER_BIT, vsShaderFile, mainEntry);
+}
+
+HRESULT Shader::addPSShader(LPCWSTR psShaderFile, LPCSTR mainEntry)
+{
+    return addStage(PIXEL_SHADER_BIT, psShaderFile, mainEntry);
+}
+
+HRESULT Shader::addHSShader(LPCWSTR hsShaderFile, LPCSTR mainEntry)
+{
+    return addStage(HULL_SHADER_BIT, hsShaderFile, mainEntry);
+}
+
+HRESULT Shader::addDSShader(LPCWSTR dsShaderFile, LPCSTR mainEntry)
+{
+    return addStage(DOMAIN_SHADER_BIT, dsShaderFile, mainEntry);
+}
+
+HRESULT Shader::addGSShader(LPCWSTR gsShaderFile, LPCSTR mainEntry)
+{
+    return addStage(GEOMETRY_SHADER_BIT, gsShaderFile, mainEntry);
 }
     
 void Shader::bind(ID3D11DeviceContext *context)
@@ -254,5 +346,147 @@ void Shader::bind(ID3D11DeviceContext *context)
     context->GSSetShader(m_gsShader, NULL, 0);
 }
 
+//
+// ShaderBatch
+//
+ShaderBatch::ShaderBatch(UINT numThreads)
+{
+    if (numThreads == 0)
+    {
+        numThreads = std::thread::hardware_concurrency();
+    }
+    m_numThreads = numThreads > 0? numThreads : 1;
+}
+
+ShaderBatch::~ShaderBatch()
+{
+    for (size_t i = 0; i < m_jobs.size(); ++i)
+    {
+        SAFE_RELEASE(m_jobs[i].shaderBlob);
+        SAFE_RELEASE(m_jobs[i].errorBlob);
+    }
+}
+
+void ShaderBatch::add(Shader* shader, UINT stage, LPCWSTR shaderFile, LPCSTR mainEntry)
+{
+    DXF_ASSERT(shader != NULL);
+
+    Job job;
+    job.shader       = shader;
+    job.stage        = stage;
+    job.shaderFile   = shaderFile;
+    job.mainEntry    = mainEntry;
+    job.macroStrings = shader->m_macroStrings;
+    job.flags        = shader->m_flags;
+    job.shaderBlob   = NULL;
+    job.errorBlob    = NULL;
+    job.hr           = E_PENDING;
+    m_jobs.push_back(job);
+}
+
+void ShaderBatch::addVSShader(Shader* shader, LPCWSTR vsShaderFile, LPCSTR mainEntry)
+{
+    add(shader, VERTEX_SHADER_BIT, vsShaderFile, mainEntry);
+}
+
+void ShaderBatch::addPSShader(Shader* shader, LPCWSTR psShaderFile, LPCSTR mainEntry)
+{
+    add(shader, PIXEL_SHADER_BIT, psShaderFile, mainEntry);
+}
+
+void ShaderBatch::addHSShader(Shader* shader, LPCWSTR hsShaderFile, LPCSTR mainEntry)
+{
+    add(shader, HULL_SHADER_BIT, hsShaderFile, mainEntry);
+}
+
+void ShaderBatch::addDSShader(Shader* shader, LPCWSTR dsShaderFile, LPCSTR mainEntry)
+{
+    add(shader, DOMAIN_SHADER_BIT, dsShaderFile, mainEntry);
+}
+
+void ShaderBatch::addGSShader(Shader* shader, LPCWSTR gsShaderFile, LPCSTR mainEntry)
+{
+    add(shader, GEOMETRY_SHADER_BIT, gsShaderFile, mainEntry);
+}
+
+void ShaderBatch::work()
+{
+    std::vector<D3D_SHADER_MACRO> macros;
+
+    for (;;)
+    {
+        size_t index = m_next++;
+        if (index >= m_jobs.size())
+        {
+            break;
+        }
+
+        Job& job = m_jobs[index];
+        buildMacros(job.macroStrings, &macros);
+        job.hr = shaderCacheCompile(job.shaderFile.c_str(), 
+                                    &macros[0], 
+                                    job.mainEntry.c_str(), 
+                                    stageProfile(job.stage), 
+                                    job.flags, 
+                                    &job.shaderBlob, 
+                                    &job.errorBlob);
+    }
+}
+
+HRESULT ShaderBatch::compile()
+{
+    LARGE_INTEGER start;
+    QueryPerformanceCounter(&start);
+
+    m_next = 0;
+
+    // The calling thread works too.
+    size_t numThreads = std::min((size_t)m_numThreads, m_jobs.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < numThreads; ++i)
+    {
+        threads.push_back(std::thread(&ShaderBatch::work, this));
+    }
+    work();
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+
+    // Report and create in the order of the enqueueing so that the log
+    // doesn't depend on the scheduling.
+    HRESULT ret = S_OK;
+    for (size_t i = 0; i < m_jobs.size(); ++i)
+    {
+        Job& job = m_jobs[i];
+        HRESULT hr = job.hr;
+        if (FAILED(hr))
+        {
+            reportError(job.shaderFile.c_str(), job.mainEntry.c_str(), hr, job.errorBlob);
+        }
+        else
+        {
+            // The shader takes the blob.
+            hr = job.shader->createStage(job.stage, job.shaderBlob, job.mainEntry.c_str());
+            job.shaderBlob = NULL;
+        }
+        SAFE_RELEASE(job.errorBlob);
+
+        if (FAILED(hr) && SUCCEEDED(ret))
+        {
+            ret = hr;
+        }
+    }
+    m_jobs.clear();
+
+    LARGE_INTEGER end;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&end);
+    QueryPerformanceFrequency(&frequency);
+    shaderCacheAddBatch((double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart);
+
+    return ret;
+}
+
 
 DXF_NAMESPACE_END
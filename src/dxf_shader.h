@@ -14,14 +14,43 @@
 
 #include "dxf_common.h"
 
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+
 DXF_NAMESPACE_BEGIN
 
+// One for each ShaderBit.
+#define DXF_NUM_SHADER_STAGES 6
+
+struct ShaderVariableLayout
+{
+    std::string name;
+    UINT        offset;
+    UINT        size;
+};
+
+// A constant buffer as the compiled shaders see it. stages is a mask of
+// ShaderBit and slots[i] is the slot in the stage (1 << i).
+struct ShaderCBufferLayout
+{
+    std::string                       name;
+    UINT                              size;
+    UINT                              stages;
+    UINT                              slots[DXF_NUM_SHADER_STAGES];
+    std::vector<ShaderVariableLayout> variables;
+};
+
 class Shader
 {
 public:
     Shader(ID3D11Device* device);
     ~Shader();
 
+    // The macros and the D3DCOMPILE_* flags of the stages added after the
+    // call. The macros are copied. The default flags are
+    // D3DCOMPILE_ENABLE_STRICTNESS, plus D3DCOMPILE_DEBUG in debug builds.
     void setMacros(const D3D_SHADER_MACRO* defines);
     void setFlags(UINT flags); 
     // TODO: set row major and column major.
@@ -38,9 +67,24 @@ public:
     ID3D11GeometryShader* geometryShader() { return m_gsShader; }
     ID3DBlob* vertexShaderBlob() { return m_vsShaderBlob; }
 
+    // The constant buffers reflected from the bytecode of all the stages.
+    // A buffer declared by several stages must have the same layout in
+    // all of them, or the stage fails to load.
+    UINT numCBuffers() const { return (UINT)m_cbuffers.size(); }
+    const ShaderCBufferLayout& cbuffer(UINT index) const { return m_cbuffers[index]; }
+    // Return NULL when no stage uses the buffer.
+    const ShaderCBufferLayout* findCBuffer(LPCSTR name) const;
+
     void bind(ID3D11DeviceContext* context);
 
 private:
+    friend class ShaderBatch;
+
+    HRESULT compile(LPCWSTR shaderFile, LPCSTR mainEntry, LPCSTR profile, ID3DBlob** shaderBlob);
+    // Create the device object of the stage (a ShaderBit) and take the blob.
+    HRESULT createStage(UINT stage, ID3DBlob* shaderBlob, LPCSTR mainEntry);
+    HRESULT addStage(UINT stage, LPCWSTR shaderFile, LPCSTR mainEntry);
+    HRESULT reflect(UINT stage, ID3DBlob* shaderBlob, LPCSTR mainEntry);
 
 private:
     ID3D11Device*           m_device;
@@ -50,6 +94,57 @@ private:
     ID3D11DomainShader*     m_dsShader;
     ID3D11GeometryShader*   m_gsShader;
     ID3DBlob*               m_vsShaderBlob;
+    UINT                    m_flags;
+    std::vector<std::string>      m_macroStrings; // name, definition, ...
+    std::vector<D3D_SHADER_MACRO> m_macros;       // NULL terminated
+    std::vector<ShaderCBufferLayout> m_cbuffers;
+};
+
+//
+// Compile the stages of many shaders at once. Enqueue the stages of all
+// the shaders, then compile() runs the compiler on a pool of threads,
+// waits for all of them and creates the device objects on the calling
+// thread. The macros and flags a shader has when its stage is enqueued
+// are used.
+class ShaderBatch
+{
+public:
+    // 0 means one thread per hardware thread.
+    ShaderBatch(UINT numThreads = 0);
+    ~ShaderBatch();
+
+    void addVSShader(Shader* shader, LPCWSTR vsShaderFile, LPCSTR mainEntry);
+    void addPSShader(Shader* shader, LPCWSTR psShaderFile, LPCSTR mainEntry);
+    void addHSShader(Shader* shader, LPCWSTR hsShaderFile, LPCSTR mainEntry);
+    void addDSShader(Shader* shader, LPCWSTR dsShaderFile, LPCSTR mainEntry);
+    void addGSShader(Shader* shader, LPCWSTR gsShaderFile, LPCSTR mainEntry);
+    // The stage is one of ShaderBit.
+    void add(Shader* shader, UINT stage, LPCWSTR shaderFile, LPCSTR mainEntry);
+
+    // Each failed stage is reported as addXXShader() does; the first
+    // failure is returned. The batch is empty afterwards.
+    HRESULT compile();
+
+private:
+    struct Job
+    {
+        Shader*                  shader;
+        UINT                     stage;
+        std::wstring             shaderFile;
+        std::string              mainEntry;
+        std::vector<std::string> macroStrings;
+        UINT                     flags;
+        ID3DBlob*                shaderBlob;
+        ID3DBlob*                errorBlob;
+        HRESULT                  hr;
+    };
+
+    void work();
+
+private:
+    UINT                m_numThreads;
+    std::vector<Job>    m_jobs;
+    std::atomic<size_t> m_next;
 };
 
 
@@ -0,0 +1,278 @@
+// --------------------------------------------------------------
+// dxf_shader_cache.cpp
+// The on-disk cache of compiled shader bytecode
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "dxf_shader_cache.h"
+
+#include "dxf_assert.h"
+#include "dxf_log.h"
+#include "DXUT/Core/DXUT.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <mutex>
+
+DXF_NAMESPACE_BEGIN
+
+// Bump it when the key or the file layout changes.
+#define DXF_SHADER_CACHE_VERSION 1
+
+static std::wstring          g_directory = L"shadercache";
+static bool                  g_enabled = true;
+static ShaderCacheStatistics g_statistics = { 0, 0, 0.0, 0.0, 0, 0.0 };
+static std::mutex            g_statisticsMutex; // ShaderBatch compiles concurrently.
+
+void shaderCacheSetDirectory(LPCWSTR directory)
+{
+    g_enabled = (directory != NULL);
+    g_directory = g_enabled? directory : L"";
+}
+
+LPCWSTR shaderCacheGetDirectory()
+{
+    return g_enabled? g_directory.c_str() : NULL;
+}
+
+void shaderCacheGetStatistics(ShaderCacheStatistics* statistics)
+{
+    std::lock_guard<std::mutex> lock(g_statisticsMutex);
+    *statistics = g_statistics;
+}
+
+void shaderCacheResetStatistics()
+{
+    std::lock_guard<std::mutex> lock(g_statisticsMutex);
+    memset(&g_statistics, 0, sizeof(ShaderCacheStatistics));
+}
+
+void shaderCacheAddBatch(double seconds)
+{
+    std::lock_guard<std::mutex> lock(g_statisticsMutex);
+    g_statistics.numBatches++;
+    g_statistics.batchSeconds += seconds;
+}
+
+// 64-bit FNV-1a
+static void hashBytes(UINT64* hash, const void* data, size_t size)
+{
+    const BYTE* p = (const BYTE*)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        *hash ^= p[i];
+        *hash *= 0x100000001b3ULL;
+    }
+}
+
+static void hashString(UINT64* hash, const char* str)
+{
+    // Hash the terminator too so that ("ab", "c") != ("a", "bc").
+    hashBytes(hash, str, str != NULL? strlen(str) + 1 : 0);
+}
+
+static bool readFile(const std::wstring& path, std::string* content)
+{
+    FILE* fp = _wfopen(path.c_str(), L"rb");
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    char buffer[4096];
+    size_t n;
+    content->clear();
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    {
+        content->append(buffer, n);
+    }
+    fclose(fp);
+
+    return true;
+}
+
+// Hash the content of the file and of the files it includes, in the
+// order the preprocessor meets them. The includes are resolved against
+// the directory of the including file as D3D_COMPILE_STANDARD_FILE_INCLUDE
+// does. A missing file is hashed by its name only.
+static void hashSourceFile(UINT64* hash, const std::wstring& path, std::vector<std::wstring>* visited)
+{
+    for (size_t i = 0; i < visited->size(); ++i)
+    {
+        if (_wcsicmp((*visited)[i].c_str(), path.c_str()) == 0)
+        {
+            return;
+        }
+    }
+    visited->push_back(path);
+
+    std::string content;
+    if (!readFile(path, &content))
+    {
+        return;
+    }
+    hashBytes(hash, content.data(), content.size());
+
+    std::wstring directory;
+    size_t slash = path.find_last_of(L"/\\");
+    if (slash != std::wstring::npos)
+    {
+        directory = path.substr(0, slash + 1);
+    }
+
+    size_t pos = 0;
+    while ((pos = content.find("include", pos)) != std::string::npos)
+    {
+        // Only the directives: '#', optional blanks, then "include".
+        size_t hashPos = pos;
+        while (hashPos > 0 && (content[hashPos - 1] == ' ' || content[hashPos - 1] == '\t'))
+        {
+            hashPos--;
+        }
+        pos += 7;
+        if (hashPos == 0 || content[hashPos - 1] != '#')
+        {
+            continue;
+        }
+
+        size_t open = content.find_first_of("\"<\n", pos);
+        if (open == std::string::npos || content[open] == '\n')
+        {
+            continue;
+        }
+        size_t close = content.find_first_of(content[open] == '"'? "\"\n" : ">\n", open + 1);
+        if (close == std::string::npos || content[close] == '\n')
+        {
+            continue;
+        }
+
+        std::string name = content.substr(open + 1, close - open - 1);
+        hashString(hash, name.c_str());
+
+        WCHAR wname[MAX_PATH];
+        if (MultiByteToWideChar(CP_ACP, 0, name.c_str(), -1, wname, MAX_PATH) > 0)
+        {
+            hashSourceFile(hash, directory + wname, visited);
+        }
+        pos = close + 1;
+    }
+}
+
+static UINT64 computeKey(LPCWSTR file,
+                         const D3D_SHADER_MACRO* macros,
+                         LPCSTR entry,
+                         LPCSTR profile,
+                         UINT flags)
+{
+    UINT64 hash = 0xcbf29ce484222325ULL;
+
+    UINT version = DXF_SHADER_CACHE_VERSION;
+    hashBytes(&hash, &version, sizeof(version));
+
+    std::vector<std::wstring> visited;
+    hashSourceFile(&hash, file, &visited);
+
+    hashString(&hash, entry);
+    hashString(&hash, profile);
+    for (const D3D_SHADER_MACRO* m = macros; m != NULL && m->Name != NULL; ++m)
+    {
+        hashString(&hash, m->Name);
+        hashString(&hash, m->Definition != NULL? m->Definition : "");
+    }
+    hashBytes(&hash, &flags, sizeof(flags));
+
+    return hash;
+}
+
+static double secondsSince(const LARGE_INTEGER& start)
+{
+    LARGE_INTEGER now;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)(now.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+}
+
+HRESULT shaderCacheCompile(LPCWSTR file,
+                           const D3D_SHADER_MACRO* macros,
+                           LPCSTR entry,
+                           LPCSTR profile,
+                           UINT flags,
+                           ID3DBlob** code,
+                           ID3DBlob** errors)
+{
+    DXF_ASSERT(code != NULL && errors != NULL);
+
+    LARGE_INTEGER start;
+    QueryPerformanceCounter(&start);
+
+    *code = NULL;
+    *errors = NULL;
+
+    std::wstring path;
+    if (g_enabled)
+    {
+        WCHAR name[32];
+        swprintf_s(name, 32, L"/%016llx.cso", computeKey(file, macros, entry, profile, flags));
+        path = g_directory + name;
+
+        if (SUCCEEDED(D3DReadFileToBlob(path.c_str(), code)))
+        {
+            // A truncated or foreign file is not DXBC; just recompile.
+            if ((*code)->GetBufferSize() > 4 && memcmp((*code)->GetBufferPointer(), "DXBC", 4) == 0)
+            {
+                std::lock_guard<std::mutex> lock(g_statisticsMutex);
+                g_statistics.numHits++;
+                g_statistics.hitSeconds += secondsSince(start);
+                return S_OK;
+            }
+            SAFE_RELEASE(*code);
+        }
+    }
+
+    HRESULT hr = D3DCompileFromFile(file,
+                                    macros,
+                                    D3D_COMPILE_STANDARD_FILE_INCLUDE,
+                                    entry,
+                                    profile,
+                                    flags,
+                                    0,
+                                    code,
+                                    errors);
+    if (SUCCEEDED(hr))
+    {
+        // Drop the warnings.
+        SAFE_RELEASE(*errors);
+
+        if (g_enabled)
+        {
+            CreateDirectoryW(g_directory.c_str(), NULL);
+
+            // Write aside and rename so that a reader never sees a
+            // partially written blob.
+            WCHAR suffix[32];
+            swprintf_s(suffix, 32, L".%u.tmp", GetCurrentThreadId());
+            std::wstring temp = path + suffix;
+            if (FAILED(D3DWriteBlobToFile(*code, temp.c_str(), TRUE)) ||
+                !MoveFileExW(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+            {
+                DeleteFileW(temp.c_str());
+                DXF_LOGWARNING("Failed to write the shader cache %S", path.c_str());
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(g_statisticsMutex);
+    g_statistics.numMisses++;
+    g_statistics.missSeconds += secondsSince(start);
+
+    return hr;
+}
+
+DXF_NAMESPACE_END
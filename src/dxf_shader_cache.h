@@ -0,0 +1,60 @@
+// --------------------------------------------------------------
+// dxf_shader_cache.h
+// The on-disk cache of compiled shader bytecode
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef DXF_SHADER_CACHE_H
+#define DXF_SHADER_CACHE_H
+
+#include "dxf_common.h"
+
+DXF_NAMESPACE_BEGIN
+
+// The blobs are stored as <hash>.cso in the cache directory. The hash
+// covers the source file and all the files it includes transitively,
+// the entry, the profile, the macros and the compile flags, so a stale
+// blob is never loaded and the directory can be wiped at any time.
+//
+// The default directory is "shadercache" under the working directory.
+// NULL disables the cache.
+void shaderCacheSetDirectory(LPCWSTR directory);
+LPCWSTR shaderCacheGetDirectory();
+
+// Load the bytecode from the cache or compile the file and store the
+// result. errors is set only when the compilation fails. It may be
+// called from several threads at once.
+HRESULT shaderCacheCompile(LPCWSTR file,
+                           const D3D_SHADER_MACRO* macros,
+                           LPCSTR entry,
+                           LPCSTR profile,
+                           UINT flags,
+                           ID3DBlob** code,
+                           ID3DBlob** errors);
+
+// hitSeconds and missSeconds are CPU time: ShaderBatch runs several
+// compiles at once, so they are summed over its threads and can exceed
+// the wall clock, which is batchSeconds.
+struct ShaderCacheStatistics
+{
+    UINT   numHits;
+    UINT   numMisses;
+    double hitSeconds;   // Hashing and loading of the hits.
+    double missSeconds;  // Hashing, compiling and storing of the misses.
+    UINT   numBatches;
+    double batchSeconds; // ShaderBatch::compile() from start to end.
+};
+
+void shaderCacheGetStatistics(ShaderCacheStatistics* statistics);
+void shaderCacheResetStatistics();
+// Called by ShaderBatch::compile() with its wall clock time.
+void shaderCacheAddBatch(double seconds);
+
+DXF_NAMESPACE_END
+
+#endif // !DXF_SHADER_CACHE_H
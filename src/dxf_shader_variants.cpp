@@ -0,0 +1,182 @@
+// --------------------------------------------------------------
+// dxf_shader_variants.cpp
+// Precompiled shader permutations selected by keywords
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "dxf_shader_variants.h"
+
+#include "dxf_shader.h"
+#include "dxf_log.h"
+
+#include "DXUT/Core/DXUT.h"
+
+DXF_NAMESPACE_BEGIN
+
+ShaderVariants::ShaderVariants(ID3D11Device* device)
+{
+    DXF_ASSERT(device != NULL);
+    m_device = device;
+    m_numBits = 0;
+    m_numVariants = 0;
+    m_flags = 0;
+    m_hasFlags = false;
+}
+
+ShaderVariants::~ShaderVariants()
+{
+    destroy();
+}
+
+void ShaderVariants::destroy()
+{
+    for (size_t i = 0; i < m_table.size(); ++i)
+    {
+        SAFE_DELETE(m_table[i]);
+    }
+    m_table.clear();
+    m_numVariants = 0;
+}
+
+UINT ShaderVariants::addKeyword(const LPCSTR* names, UINT numNames, UINT numValues)
+{
+    DXF_ASSERT(m_table.empty());
+    DXF_ASSERT(numValues >= 2);
+
+    Keyword keyword;
+    for (UINT i = 0; i < numNames; ++i)
+    {
+        keyword.names.push_back(names[i]);
+    }
+    keyword.numValues = numValues;
+    keyword.shift = m_numBits;
+    keyword.bits = 0;
+    while ((1u << keyword.bits) < numValues)
+    {
+        keyword.bits++;
+    }
+
+    m_numBits += keyword.bits;
+    DXF_ASSERT_INFO(m_numBits <= DXF_MAX_SHADER_KEY_BITS, "Too many shader keywords (%u bits)", m_numBits);
+
+    m_keywords.push_back(keyword);
+    return (UINT)m_keywords.size() - 1;
+}
+
+UINT ShaderVariants::addKeyword(LPCSTR name)
+{
+    return addKeyword(&name, 1, 2);
+}
+
+UINT ShaderVariants::addKeyword(const LPCSTR* values, UINT numValues)
+{
+    return addKeyword(values, numValues, numValues);
+}
+
+void ShaderVariants::addStage(UINT stage, LPCWSTR shaderFile, LPCSTR mainEntry)
+{
+    Stage s;
+    s.stage = stage;
+    s.shaderFile = shaderFile;
+    s.mainEntry = mainEntry;
+    m_stages.push_back(s);
+}
+
+void ShaderVariants::setFlags(UINT flags)
+{
+    m_flags = flags;
+    m_hasFlags = true;
+}
+
+void ShaderVariants::addVariant(UINT key)
+{
+    DXF_ASSERT(isValid(key));
+    m_variants.push_back(key);
+}
+
+bool ShaderVariants::isValid(UINT key) const
+{
+    if (key >= (1u << m_numBits))
+    {
+        return false;
+    }
+    for (size_t i = 0; i < m_keywords.size(); ++i)
+    {
+        const Keyword& k = m_keywords[i];
+        if (((key >> k.shift) & ((1u << k.bits) - 1)) >= k.numValues)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ShaderVariants::enqueue(ShaderBatch* batch)
+{
+    DXF_ASSERT(batch != NULL);
+
+    destroy();
+    m_table.resize(1u << m_numBits, NULL);
+
+    std::vector<UINT> variants = m_variants;
+    if (variants.empty())
+    {
+        for (UINT key = 0; key < (1u << m_numBits); ++key)
+        {
+            if (isValid(key))
+            {
+                variants.push_back(key);
+            }
+        }
+    }
+
+    std::vector<D3D_SHADER_MACRO> macros;
+    for (size_t v = 0; v < variants.size(); ++v)
+    {
+        UINT key = variants[v];
+        if (m_table[key] != NULL)
+        {
+            continue;
+        }
+
+        macros.clear();
+        for (size_t i = 0; i < m_keywords.size(); ++i)
+        {
+            const Keyword& k = m_keywords[i];
+            UINT value = (key >> k.shift) & ((1u << k.bits) - 1);
+            if (k.names.size() == 1)
+            {
+                D3D_SHADER_MACRO macro = { k.names[0].c_str(), value? "1" : "0" };
+                macros.push_back(macro);
+            }
+            else
+            {
+                D3D_SHADER_MACRO macro = { k.names[value].c_str(), "1" };
+                macros.push_back(macro);
+            }
+        }
+        D3D_SHADER_MACRO end = { NULL, NULL };
+        macros.push_back(end);
+
+        Shader* shader = new Shader(m_device);
+        shader->setMacros(&macros[0]);
+        if (m_hasFlags)
+        {
+            shader->setFlags(m_flags);
+        }
+        for (size_t s = 0; s < m_stages.size(); ++s)
+        {
+            batch->add(shader, m_stages[s].stage, m_stages[s].shaderFile.c_str(), m_stages[s].mainEntry.c_str());
+        }
+
+        m_table[key] = shader;
+        m_numVariants++;
+    }
+}
+
+DXF_NAMESPACE_END
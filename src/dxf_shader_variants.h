@@ -0,0 +1,115 @@
+// --------------------------------------------------------------
+// dxf_shader_variants.h
+// Precompiled shader permutations selected by keywords
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef DXF_SHADER_VARIANTS_H
+#define DXF_SHADER_VARIANTS_H
+
+#include "dxf_common.h"
+#include "dxf_assert.h"
+
+#include <string>
+#include <vector>
+
+DXF_NAMESPACE_BEGIN
+
+class Shader;
+class ShaderBatch;
+
+// The key of a variant packs the value of every keyword into a few bits,
+// so the table of the variants is indexed by the key directly.
+#define DXF_MAX_SHADER_KEY_BITS 12
+
+//
+// A set of variants of the same stages that differ in the keyword macros.
+// All the reachable variants are compiled at load time; picking one at
+// draw time is a table lookup.
+//
+//   ShaderVariants variants(device);
+//   UINT lighting = variants.addKeyword("LIGHTING");
+//   variants.addStage(VERTEX_SHADER_BIT, L"hemisphere.hlsl", "VS");
+//   variants.addStage(PIXEL_SHADER_BIT, L"hemisphere.hlsl", "PS");
+//   variants.enqueue(&batch);
+//   batch.compile();
+//   ...
+//   variants.shader(variants.key(lighting, 1))->bind(context);
+class ShaderVariants
+{
+public:
+    ShaderVariants(ID3D11Device* device);
+    ~ShaderVariants();
+
+    // A boolean keyword is defined to 0 or 1. Return the keyword index.
+    UINT addKeyword(LPCSTR name);
+    // An enum keyword defines the name of the chosen value to 1 and leaves
+    // the other values undefined. Return the keyword index.
+    UINT addKeyword(const LPCSTR* values, UINT numValues);
+
+    // The stage is one of ShaderBit.
+    void addStage(UINT stage, LPCWSTR shaderFile, LPCSTR mainEntry);
+    // The D3DCOMPILE_* flags of all the variants.
+    void setFlags(UINT flags);
+    // Only compile the given variants. All the combinations of the keyword
+    // values are compiled when none is given.
+    void addVariant(UINT key);
+
+    // Create the variants and add their stages to the batch. The shaders
+    // are ready after the batch is compiled.
+    void enqueue(ShaderBatch* batch);
+
+    // The key bits of a keyword value. OR them to form a key.
+    UINT key(UINT keyword, UINT value) const
+    {
+        DXF_ASSERT(keyword < m_keywords.size() && value < m_keywords[keyword].numValues);
+        return value << m_keywords[keyword].shift;
+    }
+    // The variant of a key. It must be one of the compiled ones.
+    Shader* shader(UINT key) const
+    {
+        DXF_ASSERT(key < m_table.size() && m_table[key] != NULL);
+        return m_table[key];
+    }
+    UINT numVariants() const { return m_numVariants; }
+
+private:
+    struct Keyword
+    {
+        std::vector<std::string> names; // one for a boolean
+        UINT                     numValues;
+        UINT                     shift;
+        UINT                     bits;
+    };
+
+    struct Stage
+    {
+        UINT         stage;
+        std::wstring shaderFile;
+        std::string  mainEntry;
+    };
+
+    UINT addKeyword(const LPCSTR* names, UINT numNames, UINT numValues);
+    bool isValid(UINT key) const;
+    void destroy();
+
+private:
+    ID3D11Device*        m_device;
+    std::vector<Keyword> m_keywords;
+    std::vector<Stage>   m_stages;
+    std::vector<UINT>    m_variants;
+    std::vector<Shader*> m_table;
+    UINT                 m_numBits;
+    UINT                 m_numVariants;
+    UINT                 m_flags;
+    bool                 m_hasFlags;
+};
+
+DXF_NAMESPACE_END
+
+#endif // !DXF_SHADER_VARIANTS_H
@@ -0,0 +1,210 @@
+// -------------------------------------------------------------- 
+// dxf_structured_buffer.h
+// Structured buffer rewritten by the CPU every frame
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// -------------------------------------------------------------- 
+
+#ifndef DXF_STRUCTURED_BUFFER_H
+#define DXF_STRUCTURED_BUFFER_H
+
+#include "dxf_common.h"
+#include "dxf_assert.h"
+#include "dxf_log.h"
+
+#include <algorithm>
+#include <string>
+
+DXF_NAMESPACE_BEGIN
+
+//
+// A StructuredBuffer<T> for per-instance data whose count changes from
+// frame to frame. The buffer grows as needed, so the number of elements
+// is only limited by memory.
+//
+// A D3D11_USAGE_DYNAMIC buffer is rewritten as a whole with map():
+//
+//   BlockInstance* instances = buffer.map(context, numBlocks);
+//   ...
+//   buffer.unmap(context);
+//   buffer.bind(context, 2, VERTEX_SHADER_BIT);
+//
+// A D3D11_USAGE_DEFAULT buffer keeps its content and is patched with
+// update(), which suits data that changes a little at a time.
+template<typename T>
+class StructuredBuffer
+{
+public:
+    // usage is D3D11_USAGE_DYNAMIC or D3D11_USAGE_DEFAULT.
+    StructuredBuffer(ID3D11Device* device, D3D11_USAGE usage = D3D11_USAGE_DYNAMIC);
+    ~StructuredBuffer();
+
+    HRESULT create(LPCSTR name, UINT capacity);
+
+    // Grow the buffer to hold count elements. Return S_FALSE when it was
+    // recreated, which loses the content.
+    HRESULT reserve(UINT count);
+
+    // Dynamic buffers: discard the content and return the memory of count
+    // elements. Return NULL when the buffer fails to grow or to map.
+    T* map(ID3D11DeviceContext* context, UINT count);
+    void unmap(ID3D11DeviceContext* context);
+    // Default buffers: overwrite the elements [first, first + count).
+    void update(ID3D11DeviceContext* context, UINT first, UINT count, const T* data);
+    void bind(ID3D11DeviceContext* context, UINT slot, UINT shaders);
+
+    UINT capacity() const { return m_capacity; }
+
+private:
+    HRESULT createBuffer(UINT capacity);
+
+private:
+    ID3D11Device*             m_device;
+    ID3D11Buffer*             m_buffer;
+    ID3D11ShaderResourceView* m_bufferSRV;
+    D3D11_USAGE               m_usage;
+    UINT                      m_capacity;
+    std::string               m_name;
+};
+
+template<typename T>
+StructuredBuffer<T>::StructuredBuffer(ID3D11Device* device, D3D11_USAGE usage)
+{
+    DXF_ASSERT(device != NULL);
+    DXF_ASSERT(usage == D3D11_USAGE_DYNAMIC || usage == D3D11_USAGE_DEFAULT);
+    m_device = device;
+    m_buffer = NULL;
+    m_bufferSRV = NULL;
+    m_usage = usage;
+    m_capacity = 0;
+    // HLSL packs the structured buffer elements by 4 bytes.
+    DXF_ASSERT(sizeof(T) % 4 == 0);
+}
+
+template<typename T>
+StructuredBuffer<T>::~StructuredBuffer()
+{
+    SAFE_RELEASE(m_bufferSRV);
+    SAFE_RELEASE(m_buffer);
+}
+
+template<typename T>
+HRESULT StructuredBuffer<T>::create(LPCSTR name, UINT capacity)
+{
+    m_name = name;
+    return createBuffer(capacity > 0? capacity : 1);
+}
+
+template<typename T>
+HRESULT StructuredBuffer<T>::createBuffer(UINT capacity)
+{
+    SAFE_RELEASE(m_bufferSRV);
+    SAFE_RELEASE(m_buffer);
+    m_capacity = 0;
+
+    HRESULT hr;
+    D3D11_BUFFER_DESC bd;
+    ZeroMemory(&bd, sizeof(bd));
+
+    bd.Usage               = m_usage;
+    bd.BindFlags           = D3D11_BIND_SHADER_RESOURCE;
+    bd.CPUAccessFlags      = (m_usage == D3D11_USAGE_DYNAMIC)? D3D11_CPU_ACCESS_WRITE : 0;
+    bd.MiscFlags           = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    bd.ByteWidth           = sizeof(T) * capacity;
+    bd.StructureByteStride = sizeof(T);
+
+    V_RETURN(m_device->CreateBuffer(&bd, NULL, &m_buffer));
+    DXUT_SetDebugName(m_buffer, m_name.c_str());
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+    ZeroMemory(&srvDesc, sizeof(srvDesc));
+    srvDesc.Format               = DXGI_FORMAT_UNKNOWN;
+    srvDesc.ViewDimension        = D3D11_SRV_DIMENSION_BUFFER;
+    srvDesc.Buffer.FirstElement  = 0;
+    srvDesc.Buffer.NumElements   = capacity;
+
+    V_RETURN(m_device->CreateShaderResourceView(m_buffer, &srvDesc, &m_bufferSRV));
+
+    m_capacity = capacity;
+
+    return S_OK;
+}
+
+template<typename T>
+HRESULT StructuredBuffer<T>::reserve(UINT count)
+{
+    if (count <= m_capacity)
+    {
+        return S_OK;
+    }
+
+    // Grow geometrically so that a slowly rising count does not recreate
+    // the buffer every frame.
+    HRESULT hr = createBuffer(std::max(count, m_capacity * 2));
+    if (FAILED(hr))
+    {
+        DXF_LOGERROR("Failed to grow %s to %u elements", m_name.c_str(), count);
+        return hr;
+    }
+    return S_FALSE;
+}
+
+template<typename T>
+T* StructuredBuffer<T>::map(ID3D11DeviceContext* context, UINT count)
+{
+    DXF_ASSERT(context != NULL);
+    DXF_ASSERT(m_usage == D3D11_USAGE_DYNAMIC);
+
+    if (FAILED(reserve(count)))
+    {
+        return NULL;
+    }
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (FAILED(context->Map(m_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+    {
+        return NULL;
+    }
+    return (T*)mapped.pData;
+}
+
+template<typename T>
+void StructuredBuffer<T>::unmap(ID3D11DeviceContext* context)
+{
+    context->Unmap(m_buffer, 0);
+}
+
+template<typename T>
+void StructuredBuffer<T>::update(ID3D11DeviceContext* context, UINT first, UINT count, const T* data)
+{
+    DXF_ASSERT(context != NULL);
+    DXF_ASSERT(m_usage == D3D11_USAGE_DEFAULT);
+    DXF_ASSERT(first + count <= m_capacity);
+
+    D3D11_BOX box = { first * (UINT)sizeof(T), 0, 0, (first + count) * (UINT)sizeof(T), 1, 1 };
+    context->UpdateSubresource(m_buffer, 0, &box, data, 0, 0);
+}
+
+template<typename T>
+void StructuredBuffer<T>::bind(ID3D11DeviceContext* context, UINT slot, UINT shaders)
+{
+    DXF_ASSERT(context != NULL);
+    DXF_ASSERT(m_bufferSRV != NULL);
+
+    if (shaders & VERTEX_SHADER_BIT)
+    {
+        context->VSSetShaderResources(slot, 1, &m_bufferSRV);
+    }
+    if (shaders & PIXEL_SHADER_BIT)
+    {
+        context->PSSetShaderResources(slot, 1, &m_bufferSRV);
+    }
+}
+
+DXF_NAMESPACE_END
+
+#endif // !DXF_STRUCTURED_BUFFER_H
@@ -0,0 +1,202 @@
+// --------------------------------------------------------------
+// dxf_terrain.cpp
+// Chunked LOD terrain from a heightmap
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "dxf_terrain.h"
+
+#include "dxf_shader.h"
+#include "dxf_assert.h"
+#include "dxf_log.h"
+
+#include "DXUT/Core/DXUT.h"
+#include "DirectXTex.h"
+
+DXF_NAMESPACE_BEGIN
+
+HRESULT terrainLoadHeightmap(const char* path, std::vector<float>* heights, UINT* width, UINT* height)
+{
+    DXF_ASSERT(path != NULL && heights != NULL);
+
+    wchar_t wpath[256];
+    swprintf(wpath, L"%hs", path);
+
+    HRESULT hr;
+    DirectX::ScratchImage image;
+    DirectX::ScratchImage converted;
+    hr = DirectX::LoadFromWICFile(wpath, DirectX::WIC_FLAGS_NONE, NULL, image);
+    if (FAILED(hr))
+    {
+        DXF_LOGERROR("Failed to load the heightmap %s.", path);
+        return hr;
+    }
+    V_RETURN(DirectX::Convert(*image.GetImage(0, 0, 0), DXGI_FORMAT_R32_FLOAT, DirectX::TEX_FILTER_DEFAULT, 0.5f, converted));
+
+    const DirectX::Image* pixels = converted.GetImage(0, 0, 0);
+    *width = (UINT)pixels->width;
+    *height = (UINT)pixels->height;
+    heights->resize(pixels->width * pixels->height);
+    for (size_t y = 0; y < pixels->height; ++y)
+    {
+        memcpy(&(*heights)[y * pixels->width], pixels->pixels + y * pixels->rowPitch, pixels->width * sizeof(float));
+    }
+
+    return S_OK;
+}
+
+Terrain::Terrain(ID3D11Device* device)
+{
+    DXF_ASSERT(device != NULL);
+    m_device = device;
+    m_vertexLayout = NULL;
+    for (UINT i = 0; i < TERRAIN_MAX_LODS; ++i)
+    {
+        m_indexBuffers[i] = NULL;
+        m_numIndices[i] = 0;
+    }
+    memset(&m_desc, 0, sizeof(m_desc));
+    m_numTriangles = 0;
+}
+
+Terrain::~Terrain()
+{
+    destroy();
+}
+
+void Terrain::destroy()
+{
+    SAFE_RELEASE(m_vertexLayout);
+    for (size_t i = 0; i < m_vertexBuffers.size(); ++i)
+    {
+        SAFE_RELEASE(m_vertexBuffers[i]);
+    }
+    m_vertexBuffers.clear();
+    for (UINT i = 0; i < TERRAIN_MAX_LODS; ++i)
+    {
+        SAFE_RELEASE(m_indexBuffers[i]);
+        m_numIndices[i] = 0;
+    }
+    m_selection.clear();
+}
+
+HRESULT Terrain::create(const float* heights, const TerrainDesc& desc, Shader* shader, UINT numThreads)
+{
+    DXF_ASSERT(heights != NULL && shader != NULL);
+    DXF_ASSERT(desc.numLods > 0 && desc.numLods <= TERRAIN_MAX_LODS);
+
+    destroy();
+    m_desc = desc;
+
+    HRESULT hr;
+
+    std::vector<TerrainChunk> chunks;
+    terrainBuildChunks(&m_desc, heights, &chunks, numThreads);
+
+    D3D11_BUFFER_DESC bd;
+    D3D11_SUBRESOURCE_DATA initData;
+    ZeroMemory(&initData, sizeof(initData));
+
+    m_vertexBuffers.resize(chunks.size(), NULL);
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        ZeroMemory(&bd, sizeof(bd));
+        bd.Usage     = D3D11_USAGE_IMMUTABLE;
+        bd.ByteWidth = (UINT)(sizeof(TerrainVertex) * chunks[i].vertices.size());
+        bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+        initData.pSysMem = &chunks[i].vertices[0];
+        V_RETURN(m_device->CreateBuffer(&bd, &initData, &m_vertexBuffers[i]));
+        DXUT_SetDebugName(m_vertexBuffers[i], "terrain-chunk");
+    }
+
+    std::vector<uint16_t> indices;
+    for (UINT lod = 0; lod < m_desc.numLods; ++lod)
+    {
+        terrainBuildIndices(&m_desc, lod, &indices);
+        m_numIndices[lod] = (UINT)indices.size();
+
+        ZeroMemory(&bd, sizeof(bd));
+        bd.Usage     = D3D11_USAGE_IMMUTABLE;
+        bd.ByteWidth = (UINT)(sizeof(uint16_t) * indices.size());
+        bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+        initData.pSysMem = &indices[0];
+        V_RETURN(m_device->CreateBuffer(&bd, &initData, &m_indexBuffers[lod]));
+        DXUT_SetDebugName(m_indexBuffers[lod], "terrain-lod");
+    }
+
+    m_quadtree.build(&m_desc, chunks);
+
+    D3D11_INPUT_ELEMENT_DESC vertexElements[] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0,  D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,    0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+    };
+    V_RETURN(m_device->CreateInputLayout(vertexElements,
+                3,
+                shader->vertexShaderBlob()->GetBufferPointer(),
+                shader->vertexShaderBlob()->GetBufferSize(),
+                &m_vertexLayout));
+    DXUT_SetDebugName(m_vertexLayout, "terrain");
+
+    return S_OK;
+}
+
+void Terrain::update(const DirectX::XMFLOAT3& eye, const DirectX::XMMATRIX& viewProj, float lodDistance)
+{
+    // The frustum planes of clip = v * viewProj: left, right, bottom, top,
+    // near (z >= 0) and far.
+    DirectX::XMFLOAT4X4 m;
+    DirectX::XMStoreFloat4x4(&m, viewProj);
+
+    float planes[6][4];
+    for (int i = 0; i < 4; ++i)
+    {
+        planes[0][i] = m.m[i][3] + m.m[i][0];
+        planes[1][i] = m.m[i][3] - m.m[i][0];
+        planes[2][i] = m.m[i][3] + m.m[i][1];
+        planes[3][i] = m.m[i][3] - m.m[i][1];
+        planes[4][i] = m.m[i][2];
+        planes[5][i] = m.m[i][3] - m.m[i][2];
+    }
+
+    float e[3] = { eye.x, eye.y, eye.z };
+    m_quadtree.select(e, lodDistance, planes, &m_selection);
+}
+
+void Terrain::render(ID3D11DeviceContext* context)
+{
+    m_numTriangles = 0;
+    if (m_selection.empty())
+    {
+        return;
+    }
+
+    context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    context->IASetInputLayout(m_vertexLayout);
+
+    // The selection comes grouped by quadtree node, so consecutive chunks
+    // often share the LOD and the index buffer stays bound.
+    UINT stride = sizeof(TerrainVertex);
+    UINT offset = 0;
+    UINT boundLod = TERRAIN_MAX_LODS;
+    for (size_t i = 0; i < m_selection.size(); ++i)
+    {
+        const TerrainSelection& s = m_selection[i];
+        if (s.lod != boundLod)
+        {
+            context->IASetIndexBuffer(m_indexBuffers[s.lod], DXGI_FORMAT_R16_UINT, 0);
+            boundLod = s.lod;
+        }
+        context->IASetVertexBuffers(0, 1, &m_vertexBuffers[s.chunk], &stride, &offset);
+        context->DrawIndexed(m_numIndices[s.lod], 0, 0);
+        m_numTriangles += m_numIndices[s.lod] / 3;
+    }
+}
+
+DXF_NAMESPACE_END
@@ -0,0 +1,77 @@
+// --------------------------------------------------------------
+// dxf_terrain.h
+// Chunked LOD terrain from a heightmap
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef DXF_TERRAIN_H
+#define DXF_TERRAIN_H
+
+#include "dxf_common.h"
+
+#include "util/terrain.h"
+
+#include <directxmath.h>
+#include <vector>
+
+DXF_NAMESPACE_BEGIN
+
+class Shader;
+
+// Load the first channel of an image as heights in [0, 1].
+HRESULT terrainLoadHeightmap(const char* path, std::vector<float>* heights, UINT* width, UINT* height);
+
+//
+// The terrain is cut in chunks that all share the index buffers of the
+// LODs; a chunk has one vertex buffer and picks its LOD by the index
+// buffer it is drawn with. The skirts hide the cracks between chunks of
+// different LODs. The vertices have the layout of Model.
+//
+//   Terrain terrain(device);
+//   terrain.create(heights, desc, shader);
+//   ...
+//   terrain.update(eye, viewProj, 64.0f);
+//   terrain.render(context);
+class Terrain
+{
+public:
+    Terrain(ID3D11Device* device);
+    ~Terrain();
+
+    // desc.width * desc.height heights. The chunk meshes are generated by
+    // terrainBuildChunks() on numThreads threads.
+    HRESULT create(const float* heights, const TerrainDesc& desc, Shader* shader, UINT numThreads = 0);
+
+    // Select the chunks in the frustum of viewProj (row vectors, as the
+    // shaders multiply them) and their LODs. See TerrainQuadtree.
+    void update(const DirectX::XMFLOAT3& eye, const DirectX::XMMATRIX& viewProj, float lodDistance);
+    void render(ID3D11DeviceContext* context);
+
+    UINT numChunks() const { return (UINT)m_vertexBuffers.size(); }
+    UINT numSelectedChunks() const { return (UINT)m_selection.size(); }
+    // The triangles drawn by the last render().
+    UINT numTriangles() const { return m_numTriangles; }
+
+private:
+    void destroy();
+
+private:
+    ID3D11Device*                 m_device;
+    ID3D11InputLayout*            m_vertexLayout;
+    std::vector<ID3D11Buffer*>    m_vertexBuffers;
+    ID3D11Buffer*                 m_indexBuffers[TERRAIN_MAX_LODS];
+    UINT                          m_numIndices[TERRAIN_MAX_LODS];
+    TerrainDesc                   m_desc;
+    TerrainQuadtree               m_quadtree;
+    std::vector<TerrainSelection> m_selection;
+    UINT                          m_numTriangles;
+};
+
+DXF_NAMESPACE_END
+
+#endif // !DXF_TERRAIN_H
@@ -12,12 +12,16 @@
 #include "dxf_texture.h"
 
 #include "dxf_assert.h"
+#include "dxf_texture_streamer.h"
 #include "util\image.h"
+#include "util\dds.h"
 
 #include "DXUT/Core/DXUT.h"
 #include "DirectXTex.h"
 #include "WICTextureLoader.h"
 
+#include <algorithm>
+
 #pragma comment(lib, "DirectXTex_vs2012_win32.lib")
 #pragma comment(lib, "WICTextureLoader_vs2012_win32.lib")
 
@@ -90,10 +94,15 @@ Texture::Texture(ID3D11Device* device)
     m_texture2D = NULL;
 	m_textureResource = NULL;
     m_textureSRV = NULL;
+    m_streamer = NULL;
 }
 
 Texture::~Texture()
 {
+    if (m_streamer != NULL)
+    {
+        m_streamer->remove(this);
+    }
     SAFE_RELEASE(m_texture1D);
     SAFE_RELEASE(m_texture2D);
 	SAFE_RELEASE(m_textureResource);
@@ -147,6 +156,70 @@ HRESULT Texture::create1DTexture(UINT width, UINT format, void* data)
 	return S_OK;
 }
 
+HRESULT Texture::create2DTexture(UINT width, UINT height, UINT format, UINT numMips, void* const* data)
+{
+    DXF_ASSERT(numMips > 0 && numMips <= D3D11_REQ_MIP_LEVELS);
+
+	HRESULT hr;
+
+    D3D11_TEXTURE2D_DESC td;
+    td.Width = width;
+    td.Height = height;
+    td.MipLevels = numMips;
+    td.ArraySize = 1;
+    td.Format = (DXGI_FORMAT)format;
+    td.SampleDesc.Count = 1;
+    td.SampleDesc.Quality = 0;
+    td.Usage = D3D11_USAGE_IMMUTABLE;
+    td.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    td.CPUAccessFlags = 0;
+    td.MiscFlags = 0;
+
+    D3D11_SUBRESOURCE_DATA srd[D3D11_REQ_MIP_LEVELS];
+    for (UINT i = 0; i < numMips; ++i)
+    {
+        size_t numBytes;
+        size_t rowBytes;
+        size_t numRows;
+        ddsGetSurfaceInfo(std::max(width >> i, 1u), std::max(height >> i, 1u), format,
+            &numBytes, &rowBytes, &numRows);
+
+        srd[i].pSysMem = data[i];
+        srd[i].SysMemPitch = (UINT)rowBytes;
+        srd[i].SysMemSlicePitch = (UINT)numBytes;
+    }
+
+    V_RETURN(m_device->CreateTexture2D(&td, srd, &m_texture2D));
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+
+    srvDesc.Format = (DXGI_FORMAT)format;
+    srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+    srvDesc.Texture2D.MostDetailedMip = 0;
+    srvDesc.Texture2D.MipLevels = numMips;
+
+    V_RETURN(m_device->CreateShaderResourceView(m_texture2D, &srvDesc, &m_textureSRV));
+
+	return S_OK;
+}
+
+HRESULT Texture::loadStreamedTexture(TextureStreamer* streamer, const char* path)
+{
+    DXF_ASSERT(streamer != NULL && m_streamer == NULL);
+
+    HRESULT hr;
+    V_RETURN(streamer->add(this, path));
+    m_streamer = streamer;
+
+    return S_OK;
+}
+
+void Texture::setRequestedMip(UINT mip, float priority)
+{
+    DXF_ASSERT(m_streamer != NULL);
+    m_streamer->setRequestedMip(this, mip, priority);
+}
+
 void Texture::bind(ID3D11DeviceContext* context, UINT slot, UINT shaders)
 {
     DXF_ASSERT(context != NULL);
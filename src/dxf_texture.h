@@ -16,6 +16,8 @@
 
 DXF_NAMESPACE_BEGIN
 
+class TextureStreamer;
+
 class Sampler
 {
 public:
@@ -42,15 +44,27 @@ public:
 
     HRESULT load2DTexture(ID3D11DeviceContext* context, const char* path);
     HRESULT create1DTexture(UINT width, UINT numChannels, void* data);
+    // Create an immutable 2D texture from a tightly packed mip chain,
+    // e.g., the mips of an Atlas.
+    HRESULT create2DTexture(UINT width, UINT height, UINT format, UINT numMips, void* const* data);
+    // Load the mip tail of a DDS texture now and let the streamer refine
+    // the rest. The streamer must outlive the texture.
+    HRESULT loadStreamedTexture(TextureStreamer* streamer, const char* path);
+    // The most detailed mip wanted and the priority of this texture when
+    // the streaming budget is short.
+    void setRequestedMip(UINT mip, float priority = 1.0f);
 
     void bind(ID3D11DeviceContext* context, UINT slot, UINT shaders);
 
 protected:
+    friend class TextureStreamer;
+
     ID3D11Device*             m_device;
     ID3D11Texture1D*          m_texture1D;
     ID3D11Texture2D*          m_texture2D;
 	ID3D11Resource*           m_textureResource;
     ID3D11ShaderResourceView* m_textureSRV;
+    TextureStreamer*          m_streamer;
 };
 
 
@@ -0,0 +1,446 @@
+// --------------------------------------------------------------
+// dxf_texture_streamer.cpp
+// Progressive mipmap streaming of DDS textures
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "dxf_texture_streamer.h"
+
+#include "dxf_texture.h"
+#include "dxf_assert.h"
+#include "dxf_log.h"
+
+#include "DXUT/Core/DXUT.h"
+
+#include <algorithm>
+
+DXF_NAMESPACE_BEGIN
+
+TextureStreamer::TextureStreamer(ID3D11Device* device, UINT64 budget, UINT numThreads)
+    : m_residency(budget)
+{
+    DXF_ASSERT(device != NULL);
+    m_device = device;
+    m_quit = false;
+
+    numThreads = std::max(numThreads, 1u);
+    for (UINT i = 0; i < numThreads; ++i)
+    {
+        m_threads.push_back(std::thread(&TextureStreamer::work, this));
+    }
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_condition.notify_all();
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+        m_threads[i].join();
+    }
+
+    // A job refers to a removed texture only when nobody else does.
+    for (size_t i = 0; i < m_jobs.size(); ++i)
+    {
+        if (m_jobs[i].entry->removed)
+        {
+            destroy(m_jobs[i].entry);
+        }
+    }
+    for (size_t i = 0; i < m_finished.size(); ++i)
+    {
+        delete [] m_finished[i].data;
+        if (m_finished[i].entry->removed)
+        {
+            destroy(m_finished[i].entry);
+        }
+    }
+
+    for (size_t i = 0; i < m_textures.size(); ++i)
+    {
+        if (m_textures[i] != NULL)
+        {
+            // The texture keeps its current mips.
+            m_textures[i]->texture->m_streamer = NULL;
+            destroy(m_textures[i]);
+        }
+    }
+}
+
+HRESULT TextureStreamer::add(Texture* texture, const char* path)
+{
+    DXF_ASSERT(texture != NULL && find(texture) == NULL);
+
+    StreamedTexture* entry = new StreamedTexture;
+    entry->texture = texture;
+    entry->id      = -1;
+    entry->loading = false;
+    entry->removed = false;
+
+    DDSFile dds;
+    if (!ddsMapFile(path, &entry->file) ||
+        ddsParse(entry->file.data, entry->file.size, &dds) != DDS_OK)
+    {
+        DXF_LOGERROR("Failed to open DDS texture %s", path);
+        destroy(entry);
+        return E_FAIL;
+    }
+
+    entry->format    = (DXGI_FORMAT)ddsGetFormat(&dds);
+    entry->width     = dds.header->width;
+    entry->height    = dds.header->height;
+    entry->numMips   = std::max(dds.header->mipMapCount, 1u);
+    entry->arraySize = dds.header10 != NULL? dds.header10->arraySize : 1;
+
+    // Only 2D textures and texture arrays are streamed.
+    bool is2D = dds.header10 != NULL?
+        (dds.header10->resourceDimension == D3D11_RESOURCE_DIMENSION_TEXTURE2D &&
+         !(dds.header10->miscFlag & D3D11_RESOURCE_MISC_TEXTURECUBE)) :
+        !(dds.header->flags & DDS_HEADER_FLAGS_VOLUME) && !(dds.header->caps2 & DDS_CUBEMAP);
+    if (entry->format == DXGI_FORMAT_UNKNOWN || !is2D || entry->arraySize == 0 ||
+        entry->numMips > RESIDENCY_MAX_MIPS)
+    {
+        DXF_LOGERROR("%s is not a streamable 2D texture", path);
+        destroy(entry);
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    entry->subresources.resize(entry->numMips * entry->arraySize);
+    DDSLayout layout;
+    if (ddsFillSubresources(entry->width, entry->height, 1, entry->numMips, entry->arraySize,
+                            entry->format, 0, dds.bitData, dds.bitSize, &layout,
+                            &entry->subresources[0]) != DDS_OK)
+    {
+        DXF_LOGERROR("%s is corrupted", path);
+        destroy(entry);
+        return E_FAIL;
+    }
+
+    uint64_t mipBytes[RESIDENCY_MAX_MIPS];
+    for (UINT m = 0; m < entry->numMips; ++m)
+    {
+        mipBytes[m] = 0;
+        for (UINT j = 0; j < entry->arraySize; ++j)
+        {
+            mipBytes[m] += entry->subresources[j * entry->numMips + m].slicePitch;
+        }
+    }
+
+    UINT tailMip = 0;
+    while (tailMip + 1 < entry->numMips &&
+           std::max(entry->width >> tailMip, entry->height >> tailMip) > DXF_STREAMING_TAIL_SIZE)
+    {
+        tailMip++;
+    }
+
+    // The most detailed mip of a block-compressed texture must be a
+    // multiple of 4, so such textures only stream when every mip above
+    // the tail is.
+    if (ddsIsBlockCompressed(entry->format))
+    {
+        for (UINT m = 0; m <= tailMip; ++m)
+        {
+            if (((entry->width >> m) & 3) != 0 || ((entry->height >> m) & 3) != 0)
+            {
+                tailMip = 0;
+                break;
+            }
+        }
+    }
+
+    entry->residentMip = entry->numMips;
+    HRESULT hr = recreate(NULL, entry, tailMip, NULL);
+    if (FAILED(hr))
+    {
+        destroy(entry);
+        return hr;
+    }
+
+    entry->id = m_residency.add(entry->numMips, mipBytes, tailMip);
+    if (entry->id >= (int)m_textures.size())
+    {
+        m_textures.resize(entry->id + 1, NULL);
+    }
+    m_textures[entry->id] = entry;
+
+    const char* name = strrchr(path, '/');
+    DXUT_SetDebugName(texture->m_textureSRV, name != NULL? name + 1 : path);
+
+    return S_OK;
+}
+
+void TextureStreamer::remove(Texture* texture)
+{
+    StreamedTexture* entry = find(texture);
+    if (entry == NULL)
+    {
+        return;
+    }
+
+    m_residency.remove(entry->id);
+    m_textures[entry->id] = NULL;
+
+    // Wait for the worker to return the job before freeing the mapping.
+    if (entry->loading)
+    {
+        entry->removed = true;
+    }
+    else
+    {
+        destroy(entry);
+    }
+}
+
+void TextureStreamer::setRequestedMip(Texture* texture, UINT mip, float priority)
+{
+    StreamedTexture* entry = find(texture);
+    DXF_ASSERT(entry != NULL);
+    m_residency.setRequestedMip(entry->id, mip, priority);
+}
+
+void TextureStreamer::update(ID3D11DeviceContext* context)
+{
+    DXF_ASSERT(context != NULL);
+
+    std::deque<Job> finished;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        finished.swap(m_finished);
+    }
+
+    for (size_t i = 0; i < finished.size(); ++i)
+    {
+        Job& job = finished[i];
+        StreamedTexture* entry = job.entry;
+        entry->loading = false;
+
+        if (entry->removed)
+        {
+            destroy(entry);
+        }
+        else if (SUCCEEDED(recreate(context, entry, job.mip, job.data)))
+        {
+            m_residency.onLoaded(entry->id, job.mip);
+        }
+        else
+        {
+            m_residency.onCancelled(entry->id);
+        }
+
+        delete [] job.data;
+    }
+
+    m_residency.update(&m_requests);
+
+    UINT numJobs = 0;
+    for (size_t i = 0; i < m_requests.size(); ++i)
+    {
+        const ResidencyRequest& request = m_requests[i];
+        StreamedTexture* entry = m_textures[request.id];
+
+        if (request.action == RESIDENCY_EVICT)
+        {
+            // The eviction is requested again next frame.
+            if (!entry->loading && SUCCEEDED(recreate(context, entry, request.mip, NULL)))
+            {
+                m_residency.onEvicted(entry->id, request.mip);
+            }
+        }
+        else
+        {
+            Job job;
+            job.entry = entry;
+            job.mip   = request.mip;
+            job.data  = NULL;
+            entry->loading = true;
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(job);
+            numJobs++;
+        }
+    }
+
+    if (numJobs > 0)
+    {
+        m_condition.notify_all();
+    }
+}
+
+TextureStreamer::StreamedTexture* TextureStreamer::find(Texture* texture)
+{
+    for (size_t i = 0; i < m_textures.size(); ++i)
+    {
+        if (m_textures[i] != NULL && m_textures[i]->texture == texture)
+        {
+            return m_textures[i];
+        }
+    }
+    return NULL;
+}
+
+void TextureStreamer::destroy(StreamedTexture* entry)
+{
+    ddsUnmapFile(&entry->file);
+    delete entry;
+}
+
+HRESULT TextureStreamer::recreate(ID3D11DeviceContext* context,
+                                  StreamedTexture* entry,
+                                  UINT mip,
+                                  const BYTE* data)
+{
+    HRESULT hr;
+
+    Texture* texture = entry->texture;
+    UINT numMips = entry->numMips - mip;
+
+    D3D11_TEXTURE2D_DESC desc;
+    desc.Width              = std::max(entry->width >> mip, 1u);
+    desc.Height             = std::max(entry->height >> mip, 1u);
+    desc.MipLevels          = numMips;
+    desc.ArraySize          = entry->arraySize;
+    desc.Format             = entry->format;
+    desc.SampleDesc.Count   = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Usage              = D3D11_USAGE_DEFAULT;
+    desc.BindFlags          = D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags     = 0;
+    desc.MiscFlags          = 0;
+
+    ID3D11Texture2D* newTexture = NULL;
+    if (texture->m_texture2D == NULL)
+    {
+        // The first load points straight into the mapped file.
+        std::vector<D3D11_SUBRESOURCE_DATA> initData(numMips * entry->arraySize);
+        for (UINT j = 0; j < entry->arraySize; ++j)
+        {
+            for (UINT m = 0; m < numMips; ++m)
+            {
+                const DDSSubresource& src = entry->subresources[j * entry->numMips + mip + m];
+                D3D11_SUBRESOURCE_DATA& dst = initData[j * numMips + m];
+                dst.pSysMem          = src.data;
+                dst.SysMemPitch      = (UINT)src.rowPitch;
+                dst.SysMemSlicePitch = (UINT)src.slicePitch;
+            }
+        }
+        V_RETURN(m_device->CreateTexture2D(&desc, &initData[0], &newTexture));
+    }
+    else
+    {
+        DXF_ASSERT(context != NULL);
+        V_RETURN(m_device->CreateTexture2D(&desc, NULL, &newTexture));
+
+        // Keep the mips both textures have on the GPU.
+        UINT oldNumMips = entry->numMips - entry->residentMip;
+        UINT first = std::max(mip, entry->residentMip);
+        for (UINT j = 0; j < entry->arraySize; ++j)
+        {
+            for (UINT m = first; m < entry->numMips; ++m)
+            {
+                context->CopySubresourceRegion(newTexture,
+                    D3D11CalcSubresource(m - mip, j, numMips), 0, 0, 0,
+                    texture->m_texture2D,
+                    D3D11CalcSubresource(m - entry->residentMip, j, oldNumMips), NULL);
+            }
+        }
+
+        // The new most detailed mip of all slices.
+        if (data != NULL)
+        {
+            DXF_ASSERT(mip + 1 == entry->residentMip);
+            for (UINT j = 0; j < entry->arraySize; ++j)
+            {
+                const DDSSubresource& src = entry->subresources[j * entry->numMips + mip];
+                context->UpdateSubresource(newTexture, D3D11CalcSubresource(0, j, numMips), NULL,
+                    data, (UINT)src.rowPitch, (UINT)src.slicePitch);
+                data += src.slicePitch;
+            }
+        }
+    }
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+    srvDesc.Format = entry->format;
+    if (entry->arraySize > 1)
+    {
+        srvDesc.ViewDimension                  = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+        srvDesc.Texture2DArray.MostDetailedMip = 0;
+        srvDesc.Texture2DArray.MipLevels       = numMips;
+        srvDesc.Texture2DArray.FirstArraySlice = 0;
+        srvDesc.Texture2DArray.ArraySize       = entry->arraySize;
+    }
+    else
+    {
+        srvDesc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MostDetailedMip = 0;
+        srvDesc.Texture2D.MipLevels       = numMips;
+    }
+
+    ID3D11ShaderResourceView* newSRV = NULL;
+    hr = m_device->CreateShaderResourceView(newTexture, &srvDesc, &newSRV);
+    if (FAILED(hr))
+    {
+        SAFE_RELEASE(newTexture);
+        return hr;
+    }
+
+    SAFE_RELEASE(texture->m_texture2D);
+    SAFE_RELEASE(texture->m_textureSRV);
+    texture->m_texture2D = newTexture;
+    texture->m_textureSRV = newSRV;
+
+    entry->residentMip = mip;
+
+    return S_OK;
+}
+
+void TextureStreamer::work()
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (!m_quit && m_jobs.empty())
+            {
+                m_condition.wait(lock);
+            }
+            if (m_quit)
+            {
+                return;
+            }
+            job = m_jobs.front();
+            m_jobs.pop_front();
+        }
+
+        // Read the mip of all slices out of the mapped file. This is
+        // where the page faults, i.e., the disk reads, happen.
+        StreamedTexture* entry = job.entry;
+        size_t size = 0;
+        for (UINT j = 0; j < entry->arraySize; ++j)
+        {
+            size += entry->subresources[j * entry->numMips + job.mip].slicePitch;
+        }
+
+        job.data = new BYTE [size];
+        BYTE* dst = job.data;
+        for (UINT j = 0; j < entry->arraySize; ++j)
+        {
+            const DDSSubresource& src = entry->subresources[j * entry->numMips + job.mip];
+            memcpy(dst, src.data, src.slicePitch);
+            dst += src.slicePitch;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finished.push_back(job);
+    }
+}
+
+DXF_NAMESPACE_END
@@ -0,0 +1,106 @@
+// --------------------------------------------------------------
+// dxf_texture_streamer.h
+// Progressive mipmap streaming of DDS textures
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef DXF_TEXTURE_STREAMER_H
+#define DXF_TEXTURE_STREAMER_H
+
+#include "dxf_common.h"
+
+#include "util/dds.h"
+#include "util/residency.h"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+DXF_NAMESPACE_BEGIN
+
+class Texture;
+
+// The mips not larger than this are loaded when the texture is added
+// and never evicted.
+#define DXF_STREAMING_TAIL_SIZE 64
+
+//
+// The streamer loads the mip tail of a texture first and then refines
+// toward the requested mip on the worker threads while the total size
+// of the resident mips stays within the budget. The mips no longer
+// requested are evicted.
+//
+// The GPU resource of a texture is recreated with the new mip range
+// each time its residency changes, so only the resident mips occupy
+// video memory.
+class TextureStreamer
+{
+public:
+    TextureStreamer(ID3D11Device* device, UINT64 budget, UINT numThreads = 2);
+    ~TextureStreamer();
+
+    // Called by Texture::loadStreamedTexture() and Texture::~Texture().
+    HRESULT add(Texture* texture, const char* path);
+    void remove(Texture* texture);
+    void setRequestedMip(Texture* texture, UINT mip, float priority);
+
+    // Upload the finished mips, evict the unneeded ones and issue new
+    // loads. Call it once a frame from the render thread.
+    void update(ID3D11DeviceContext* context);
+
+    void setBudget(UINT64 budget) { m_residency.setBudget(budget); }
+    UINT64 budget() const { return m_residency.budget(); }
+    UINT64 residentBytes() const { return m_residency.residentBytes(); }
+
+private:
+    struct StreamedTexture
+    {
+        Texture*                    texture;
+        int                         id;
+        DDSMappedFile               file;
+        DXGI_FORMAT                 format;
+        UINT                        width;
+        UINT                        height;
+        UINT                        numMips;
+        UINT                        arraySize;
+        UINT                        residentMip;
+        std::vector<DDSSubresource> subresources; // slice-major as in the file
+        bool                        loading;
+        bool                        removed;
+    };
+
+    struct Job
+    {
+        StreamedTexture* entry;
+        UINT             mip;
+        BYTE*            data; // The mip of all slices, filled by the worker.
+    };
+
+    StreamedTexture* find(Texture* texture);
+    void destroy(StreamedTexture* entry);
+    HRESULT recreate(ID3D11DeviceContext* context, StreamedTexture* entry, UINT mip, const BYTE* data);
+    void work();
+
+private:
+    ID3D11Device*                 m_device;
+    ResidencyManager              m_residency;
+    std::vector<StreamedTexture*> m_textures;
+    std::vector<ResidencyRequest> m_requests;
+    std::vector<std::thread>      m_threads;
+    std::mutex                    m_mutex;
+    std::condition_variable       m_condition;
+    std::deque<Job>               m_jobs;
+    std::deque<Job>               m_finished;
+    bool                          m_quit;
+};
+
+DXF_NAMESPACE_END
+
+#endif // !DXF_TEXTURE_STREAMER_H
@@ -0,0 +1,313 @@
+// --------------------------------------------------------------
+// aobake.cpp
+// Bake the ambient occlusion of a mesh into its vertices or into
+// a texture by casting rays into its BVH on the CPU.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "aobake.h"
+
+#include "parallel.h"
+#include "random.h"
+#include "raytrace.h"
+#include "sampling.h"
+#include "timer.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+
+void aoBakeDefaultSettings(AoBakeSettings* settings)
+{
+    settings->numRays = 64;
+    settings->maxDistance = 0.0f;
+    settings->bias = 1e-4f;
+    settings->seed = 1;
+    settings->numThreads = 0;
+}
+
+void aoVertexNormals(const float* positions,
+                     uint32_t numVertices,
+                     const uint32_t* indices,
+                     uint32_t numTriangles,
+                     float* normals)
+{
+    for (uint32_t i = 0; i < numVertices * 3; ++i)
+    {
+        normals[i] = 0.0f;
+    }
+
+    // The cross product is twice the area along the normal.
+    for (uint32_t t = 0; t < numTriangles; ++t)
+    {
+        const float* p0 = &positions[indices[t * 3 + 0] * 3];
+        const float* p1 = &positions[indices[t * 3 + 1] * 3];
+        const float* p2 = &positions[indices[t * 3 + 2] * 3];
+        float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        float n[3] = { e1[1] * e2[2] - e1[2] * e2[1],
+                       e1[2] * e2[0] - e1[0] * e2[2],
+                       e1[0] * e2[1] - e1[1] * e2[0] };
+        for (int k = 0; k < 3; ++k)
+        {
+            float* normal = &normals[indices[t * 3 + k] * 3];
+            normal[0] += n[0];
+            normal[1] += n[1];
+            normal[2] += n[2];
+        }
+    }
+
+    for (uint32_t i = 0; i < numVertices; ++i)
+    {
+        float* n = &normals[i * 3];
+        float l = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (l > 0.0f)
+        {
+            n[0] /= l;
+            n[1] /= l;
+            n[2] /= l;
+        }
+        else
+        {
+            n[0] = 0.0f;
+            n[1] = 1.0f;
+            n[2] = 0.0f;
+        }
+    }
+}
+
+//
+// Baking
+//
+struct AoBaker
+{
+    // The incoherent rays of the occlusion go one by one through the BVH4,
+    // which is the fastest for them with SSE and with AVX.
+    RaytraceBvh4          bvh;
+    const AoBakeSettings* settings;
+    std::vector<float>    kernel;    // The directions around +y
+
+    void initialize(const Bvh* bvh, const AoBakeSettings* settings)
+    {
+        raytraceCollapse4(&this->bvh, bvh);
+        this->settings = settings;
+        samplingHemisphere(SAMPLING_HEMISPHERE_COSINE, 1.0f, settings->numRays, settings->seed, &kernel);
+    }
+
+    // The value of the point p of the unit normal n, the index-th point baked.
+    float bake(const float* p, const float* n, uint32_t index) const
+    {
+        // The tangent frame of n (Duff et al., "Building an Orthonormal
+        // Basis, Revisited"), turned about n by the angle of the point.
+        // With y for their z.
+        float sign = n[1] >= 0.0f? 1.0f : -1.0f;
+        float a = -1.0f / (sign + n[1]);
+        float b = n[2] * n[0] * a;
+        float t[3] = { sign * b, -sign * n[2], 1.0f + sign * n[2] * n[2] * a };
+        float s[3] = { sign + n[0] * n[0] * a, -n[0], b };
+
+        RandomPCG32 random;
+        randomPCG32Seed(&random, settings->seed, index);
+        float phi = randomPCG32Float(&random) * 6.28318530717959f;
+        float c = cosf(phi);
+        float si = sinf(phi);
+        float x[3];
+        float z[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            x[k] = c * t[k] - si * s[k];
+            z[k] = si * t[k] + c * s[k];
+        }
+
+        BvhRay ray;
+        for (int k = 0; k < 3; ++k)
+        {
+            ray.origin[k] = p[k] + n[k] * settings->bias;
+        }
+        ray.tmin = 0.0f;
+        ray.tmax = settings->maxDistance > 0.0f? settings->maxDistance : FLT_MAX;
+
+        uint32_t numHits = 0;
+        for (uint32_t r = 0; r < settings->numRays; ++r)
+        {
+            const float* d = &kernel[r * 3];
+            for (int k = 0; k < 3; ++k)
+            {
+                ray.direction[k] = d[0] * x[k] + d[1] * n[k] + d[2] * z[k];
+            }
+            if (raytraceOccluded4(&bvh, &ray))
+            {
+                numHits++;
+            }
+        }
+        return 1.0f - (float)numHits / (float)settings->numRays;
+    }
+};
+
+// The vertices are handed out in chunks so that the counter is not
+// contended.
+#define AO_BAKE_CHUNK_SIZE 64
+
+void aoBakeVertices(const Bvh* bvh,
+                    const float* positions,
+                    const float* normals,
+                    uint32_t numVertices,
+                    const AoBakeSettings* settings,
+                    float* ao,
+                    AoBakeStatistics* statistics)
+{
+    assert(bvh != NULL && positions != NULL && normals != NULL && ao != NULL);
+    assert(settings->numRays > 0);
+
+    uint64_t start = timerNow();
+
+    AoBaker baker;
+    baker.initialize(bvh, settings);
+
+    uint32_t numChunks = (numVertices + AO_BAKE_CHUNK_SIZE - 1) / AO_BAKE_CHUNK_SIZE;
+    parallelFor(numChunks, settings->numThreads, [&](uint32_t chunk)
+    {
+        uint32_t end = std::min((chunk + 1) * AO_BAKE_CHUNK_SIZE, numVertices);
+        for (uint32_t i = chunk * AO_BAKE_CHUNK_SIZE; i < end; ++i)
+        {
+            ao[i] = baker.bake(&positions[i * 3], &normals[i * 3], i);
+        }
+    });
+
+    if (statistics != NULL)
+    {
+        statistics->numRays = (uint64_t)numVertices * settings->numRays;
+        statistics->seconds = timerSecondsSince(start);
+    }
+}
+
+// The triangle of a texel and the barycentrics of its center.
+struct AoTexel
+{
+    uint32_t triangle;
+    float    u;
+    float    v;
+};
+
+void aoBakeTexels(const Bvh* bvh,
+                  const float* positions,
+                  const float* normals,
+                  const uint32_t* indices,
+                  const float* texcoords,
+                  uint32_t numTriangles,
+                  uint32_t width,
+                  uint32_t height,
+                  const AoBakeSettings* settings,
+                  float* ao,
+                  AoBakeStatistics* statistics)
+{
+    assert(bvh != NULL && positions != NULL && normals != NULL && indices != NULL);
+    assert(texcoords != NULL && ao != NULL);
+    assert(settings->numRays > 0);
+
+    uint64_t start = timerNow();
+
+    // Rasterize the triangles in the texture space. A texel covered by
+    // several triangles goes to the last one.
+    std::vector<AoTexel> texels((size_t)width * height);
+    for (size_t i = 0; i < texels.size(); ++i)
+    {
+        texels[i].triangle = UINT32_MAX;
+    }
+    for (uint32_t t = 0; t < numTriangles; ++t)
+    {
+        const float* uv = &texcoords[t * 6];
+        float x[3];
+        float y[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            x[k] = uv[k * 2 + 0] * (float)width;
+            y[k] = uv[k * 2 + 1] * (float)height;
+        }
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (area == 0.0f)
+        {
+            continue;
+        }
+
+        int i0 = std::max((int)floorf(std::min(x[0], std::min(x[1], x[2]))), 0);
+        int i1 = std::min((int)ceilf(std::max(x[0], std::max(x[1], x[2]))), (int)width - 1);
+        int j0 = std::max((int)floorf(std::min(y[0], std::min(y[1], y[2]))), 0);
+        int j1 = std::min((int)ceilf(std::max(y[0], std::max(y[1], y[2]))), (int)height - 1);
+        for (int j = j0; j <= j1; ++j)
+        {
+            for (int i = i0; i <= i1; ++i)
+            {
+                float px = (float)i + 0.5f;
+                float py = (float)j + 0.5f;
+                float u = ((px - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (py - y[0])) / area;
+                float v = ((x[1] - x[0]) * (py - y[0]) - (px - x[0]) * (y[1] - y[0])) / area;
+                if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f)
+                {
+                    AoTexel& texel = texels[(size_t)j * width + i];
+                    texel.triangle = t;
+                    texel.u = u;
+                    texel.v = v;
+                }
+            }
+        }
+    }
+
+    AoBaker baker;
+    baker.initialize(bvh, settings);
+
+    std::atomic<uint64_t> numRays(0);
+    parallelFor(height, settings->numThreads, [&](uint32_t j)
+    {
+        uint64_t rowRays = 0;
+        for (uint32_t i = 0; i < width; ++i)
+        {
+            uint32_t index = j * width + i;
+            const AoTexel& texel = texels[index];
+            if (texel.triangle == UINT32_MAX)
+            {
+                ao[index] = -1.0f;
+                continue;
+            }
+
+            const uint32_t* corners = &indices[texel.triangle * 3];
+            float w[3] = { 1.0f - texel.u - texel.v, texel.u, texel.v };
+            float p[3] = { 0.0f, 0.0f, 0.0f };
+            float n[3] = { 0.0f, 0.0f, 0.0f };
+            for (int k = 0; k < 3; ++k)
+            {
+                for (int a = 0; a < 3; ++a)
+                {
+                    p[a] += w[k] * positions[corners[k] * 3 + a];
+                    n[a] += w[k] * normals[corners[k] * 3 + a];
+                }
+            }
+            float l = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (l == 0.0f)
+            {
+                ao[index] = -1.0f;
+                continue;
+            }
+            n[0] /= l;
+            n[1] /= l;
+            n[2] /= l;
+
+            ao[index] = baker.bake(p, n, index);
+            rowRays += settings->numRays;
+        }
+        numRays += rowRays;
+    });
+
+    if (statistics != NULL)
+    {
+        statistics->numRays = numRays;
+        statistics->seconds = timerSecondsSince(start);
+    }
+}
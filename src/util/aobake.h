@@ -0,0 +1,79 @@
+// --------------------------------------------------------------
+// aobake.h
+// Bake the ambient occlusion of a mesh into its vertices or into
+// a texture by casting rays into its BVH on the CPU.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef AOBAKE_H
+#define AOBAKE_H
+
+#include "bvh.h"
+
+//
+// The occlusion of a point is the cosine weighted fraction of its
+// hemisphere whose rays hit the mesh within maxDistance; the baked value is
+// 1 - occlusion, 1 for an open point. The rays of every point are the
+// cosine kernel of samplingHemisphere() turned about the normal by an
+// angle of its own, so the noise of neighbours does not line up. The
+// angle comes from the index of the point and the seed, so the result does
+// not depend on the number of threads.
+//
+struct AoBakeSettings
+{
+    uint32_t numRays;        // Per point
+    float    maxDistance;    // 0 is unbounded
+    float    bias;           // The rays start that far along the normal
+    uint32_t seed;
+    uint32_t numThreads;     // As parallelFor()
+};
+
+extern void aoBakeDefaultSettings(AoBakeSettings* settings);
+
+struct AoBakeStatistics
+{
+    uint64_t numRays;
+    double   seconds;
+};
+
+// The area weighted normals of the vertices, 3 floats each. The vertices
+// of no triangle get (0, 1, 0).
+extern void aoVertexNormals(const float* positions,
+                            uint32_t numVertices,
+                            const uint32_t* indices,
+                            uint32_t numTriangles,
+                            float* normals);
+
+// The value of every vertex into ao[numVertices].
+extern void aoBakeVertices(const Bvh* bvh,
+                           const float* positions,
+                           const float* normals,
+                           uint32_t numVertices,
+                           const AoBakeSettings* settings,
+                           float* ao,
+                           AoBakeStatistics* statistics);
+
+// The value of every texel of a width * height texture into ao, row by
+// row. texcoords has the 2 texture coordinates of every corner of every
+// triangle, numTriangles * 6 floats, as the corners of a mesh with seams
+// have several. The texel (i, j) is at (i + 0.5, j + 0.5) / (width, height)
+// with v down, and the texels of no triangle are -1 so that the caller can
+// dilate the charts.
+extern void aoBakeTexels(const Bvh* bvh,
+                         const float* positions,
+                         const float* normals,
+                         const uint32_t* indices,
+                         const float* texcoords,
+                         uint32_t numTriangles,
+                         uint32_t width,
+                         uint32_t height,
+                         const AoBakeSettings* settings,
+                         float* ao,
+                         AoBakeStatistics* statistics);
+
+#endif // !AOBAKE_H
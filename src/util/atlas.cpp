@@ -0,0 +1,555 @@
+// --------------------------------------------------------------
+// atlas.cpp
+// Pack many small images into one texture atlas with mip-safe
+// gutters and UV remap tables.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "atlas.h"
+
+#include "image.h"
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#define ATLAS_MAGIC   0x534c5441 // "ATLS"
+#define ATLAS_VERSION 1
+
+namespace
+{
+    // All the packing is done in units of the mip alignment so that the
+    // placed cells are aligned by construction.
+    struct Cell
+    {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    struct MetadataHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t numMips;
+        uint32_t gutter;
+        uint32_t numImages;
+    };
+
+    inline uint32_t alignUp(uint32_t value, uint32_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    inline bool contains(const Cell& a, const Cell& b)
+    {
+        return b.x >= a.x && b.y >= a.y &&
+               b.x + b.width <= a.x + a.width &&
+               b.y + b.height <= a.y + a.height;
+    }
+
+    inline bool intersects(const Cell& a, const Cell& b)
+    {
+        return a.x < b.x + b.width && b.x < a.x + a.width &&
+               a.y < b.y + b.height && b.y < a.y + a.height;
+    }
+
+    // The mip alignment and the gutter in texels of mip 0. The gutter is
+    // at least one texel at the smallest mip.
+    void getGutter(uint32_t numMips, uint32_t padding, uint32_t* alignment, uint32_t* gutter)
+    {
+        *alignment = 1u << (numMips - 1);
+        *gutter = alignUp(std::max(padding, *alignment), *alignment);
+    }
+
+    struct LargerCellFirst
+    {
+        const std::vector<Cell>* cells;
+        bool operator()(uint32_t a, uint32_t b) const
+        {
+            const Cell& ca = (*cells)[a];
+            const Cell& cb = (*cells)[b];
+            uint32_t sa = std::max(ca.width, ca.height);
+            uint32_t sb = std::max(cb.width, cb.height);
+            if (sa != sb)
+            {
+                return sa > sb;
+            }
+            if (ca.width * ca.height != cb.width * cb.height)
+            {
+                return ca.width * ca.height > cb.width * cb.height;
+            }
+            return a < b;
+        }
+    };
+
+    // MaxRects with the best short side fit heuristic. The cells are not
+    // rotated since that would flip the UVs.
+    bool maxRects(uint32_t binWidth, uint32_t binHeight,
+                  const std::vector<uint32_t>& order,
+                  std::vector<Cell>& cells)
+    {
+        std::vector<Cell> freeCells;
+        std::vector<Cell> splits;
+
+        Cell bin = { 0, 0, binWidth, binHeight };
+        freeCells.push_back(bin);
+
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            Cell& cell = cells[order[i]];
+
+            size_t best = freeCells.size();
+            uint32_t bestShort = 0xffffffff;
+            uint32_t bestLong = 0xffffffff;
+            for (size_t j = 0; j < freeCells.size(); ++j)
+            {
+                const Cell& f = freeCells[j];
+                if (f.width >= cell.width && f.height >= cell.height)
+                {
+                    uint32_t dw = f.width - cell.width;
+                    uint32_t dh = f.height - cell.height;
+                    uint32_t s = std::min(dw, dh);
+                    uint32_t l = std::max(dw, dh);
+                    if (s < bestShort || (s == bestShort && l < bestLong))
+                    {
+                        best = j;
+                        bestShort = s;
+                        bestLong = l;
+                    }
+                }
+            }
+            if (best == freeCells.size())
+            {
+                return false;
+            }
+
+            cell.x = freeCells[best].x;
+            cell.y = freeCells[best].y;
+
+            // Split every free cell the new one overlaps into the maximal
+            // free cells around it.
+            splits.clear();
+            for (size_t j = 0; j < freeCells.size(); )
+            {
+                Cell f = freeCells[j];
+                if (!intersects(f, cell))
+                {
+                    ++j;
+                    continue;
+                }
+
+                freeCells[j] = freeCells.back();
+                freeCells.pop_back();
+
+                if (cell.x > f.x)
+                {
+                    Cell s = { f.x, f.y, cell.x - f.x, f.height };
+                    splits.push_back(s);
+                }
+                if (cell.x + cell.width < f.x + f.width)
+                {
+                    Cell s = { cell.x + cell.width, f.y, f.x + f.width - cell.x - cell.width, f.height };
+                    splits.push_back(s);
+                }
+                if (cell.y > f.y)
+                {
+                    Cell s = { f.x, f.y, f.width, cell.y - f.y };
+                    splits.push_back(s);
+                }
+                if (cell.y + cell.height < f.y + f.height)
+                {
+                    Cell s = { f.x, cell.y + cell.height, f.width, f.y + f.height - cell.y - cell.height };
+                    splits.push_back(s);
+                }
+            }
+            freeCells.insert(freeCells.end(), splits.begin(), splits.end());
+
+            // Drop the free cells contained in others.
+            for (size_t j = 0; j < freeCells.size(); ++j)
+            {
+                for (size_t k = j + 1; k < freeCells.size(); )
+                {
+                    if (contains(freeCells[j], freeCells[k]))
+                    {
+                        freeCells[k] = freeCells.back();
+                        freeCells.pop_back();
+                    }
+                    else if (contains(freeCells[k], freeCells[j]))
+                    {
+                        freeCells[j] = freeCells[k];
+                        freeCells[k] = freeCells.back();
+                        freeCells.pop_back();
+                        k = j + 1;
+                    }
+                    else
+                    {
+                        ++k;
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+    inline void fetch(const AtlasImage* image, uint32_t x, uint32_t y, uint8_t* rgba)
+    {
+        const uint8_t* p = image->data + (y * image->width + x) * image->numChannels;
+        switch (image->numChannels)
+        {
+            case 1: rgba[0] = rgba[1] = rgba[2] = p[0]; rgba[3] = 255; break;
+            case 2: rgba[0] = rgba[1] = rgba[2] = p[0]; rgba[3] = p[1]; break;
+            case 3: rgba[0] = p[0]; rgba[1] = p[1]; rgba[2] = p[2]; rgba[3] = 255; break;
+            default: rgba[0] = p[0]; rgba[1] = p[1]; rgba[2] = p[2]; rgba[3] = p[3]; break;
+        }
+    }
+}
+
+AtlasResultEnum atlasPackRects(const uint32_t* sizes,
+                               uint32_t numRects,
+                               uint32_t maxSize,
+                               uint32_t numMips,
+                               uint32_t padding,
+                               AtlasRect* outRects,
+                               uint32_t* outWidth,
+                               uint32_t* outHeight,
+                               uint32_t* outGutter)
+{
+    if (numRects == 0 || numMips == 0 || numMips > ATLAS_MAX_MIPS)
+    {
+        return ATLAS_ERROR_INVALID_INPUT;
+    }
+
+    uint32_t alignment;
+    uint32_t gutter;
+    getGutter(numMips, padding, &alignment, &gutter);
+
+    std::vector<Cell> cells(numRects);
+    std::vector<uint32_t> order(numRects);
+    uint64_t area = 0;
+    for (uint32_t i = 0; i < numRects; ++i)
+    {
+        if (sizes[i * 2] == 0 || sizes[i * 2 + 1] == 0)
+        {
+            return ATLAS_ERROR_INVALID_INPUT;
+        }
+
+        cells[i].x = 0;
+        cells[i].y = 0;
+        cells[i].width  = (alignUp(sizes[i * 2], alignment) + gutter * 2) / alignment;
+        cells[i].height = (alignUp(sizes[i * 2 + 1], alignment) + gutter * 2) / alignment;
+        area += (uint64_t)cells[i].width * cells[i].height;
+        order[i] = i;
+    }
+
+    LargerCellFirst larger;
+    larger.cells = &cells;
+    std::sort(order.begin(), order.end(), larger);
+
+    uint32_t maxCellWidth = 0;
+    uint32_t maxCellHeight = 0;
+    for (uint32_t i = 0; i < numRects; ++i)
+    {
+        maxCellWidth = std::max(maxCellWidth, cells[i].width);
+        maxCellHeight = std::max(maxCellHeight, cells[i].height);
+    }
+
+    // For each power-of-two width, search the smallest height that fits.
+    // Keep the one with the shortest longer side, which is the squarest
+    // and still tight, and the smaller area on ties.
+    uint32_t maxUnits = maxSize / alignment;
+    uint32_t bestWidth = 0;
+    uint32_t bestHeight = 0;
+    for (uint32_t w = 1; w <= maxUnits && w != 0; w <<= 1)
+    {
+        if (w < maxCellWidth || !maxRects(w, maxUnits, order, cells))
+        {
+            continue;
+        }
+
+        uint32_t lo = std::max(maxCellHeight, (uint32_t)((area + w - 1) / w));
+        uint32_t hi = maxUnits;
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (maxRects(w, mid, order, cells))
+            {
+                hi = mid;
+            }
+            else
+            {
+                lo = mid + 1;
+            }
+        }
+
+        uint32_t side = std::max(w, hi);
+        uint32_t bestSide = std::max(bestWidth, bestHeight);
+        uint64_t a = (uint64_t)w * hi;
+        uint64_t best = (uint64_t)bestWidth * bestHeight;
+        if (bestWidth == 0 || side < bestSide || (side == bestSide && a < best))
+        {
+            bestWidth = w;
+            bestHeight = hi;
+        }
+    }
+
+    if (bestWidth != 0)
+    {
+        maxRects(bestWidth, bestHeight, order, cells);
+        for (uint32_t i = 0; i < numRects; ++i)
+        {
+            outRects[i].x      = cells[i].x * alignment + gutter;
+            outRects[i].y      = cells[i].y * alignment + gutter;
+            outRects[i].width  = sizes[i * 2];
+            outRects[i].height = sizes[i * 2 + 1];
+        }
+        *outWidth = bestWidth * alignment;
+        *outHeight = bestHeight * alignment;
+        *outGutter = gutter;
+        return ATLAS_OK;
+    }
+
+    return ATLAS_ERROR_TOO_LARGE;
+}
+
+AtlasResultEnum atlasBuild(const Image* const* images,
+                           uint32_t numImages,
+                           uint32_t maxSize,
+                           uint32_t numMips,
+                           uint32_t padding,
+                           Atlas* atlas)
+{
+    std::vector<AtlasImage> views(numImages);
+    for (uint32_t i = 0; i < numImages; ++i)
+    {
+        views[i].width       = images[i]->width;
+        views[i].height      = images[i]->height;
+        views[i].numChannels = images[i]->numChannels;
+        views[i].data        = images[i]->data;
+    }
+    return atlasBuildImages(numImages > 0? &views[0] : NULL, numImages, maxSize, numMips, padding, atlas);
+}
+
+AtlasResultEnum atlasBuildImages(const AtlasImage* images,
+                                 uint32_t numImages,
+                                 uint32_t maxSize,
+                                 uint32_t numMips,
+                                 uint32_t padding,
+                                 Atlas* atlas)
+{
+    memset(atlas, 0, sizeof(Atlas));
+
+    std::vector<uint32_t> sizes(numImages * 2);
+    for (uint32_t i = 0; i < numImages; ++i)
+    {
+        if (images[i].data == NULL || images[i].numChannels == 0 || images[i].numChannels > 4)
+        {
+            return ATLAS_ERROR_INVALID_INPUT;
+        }
+        sizes[i * 2]     = images[i].width;
+        sizes[i * 2 + 1] = images[i].height;
+    }
+
+    std::vector<AtlasRect> rects(numImages);
+    uint32_t width;
+    uint32_t height;
+    uint32_t gutter;
+    AtlasResultEnum ret = atlasPackRects(numImages > 0? &sizes[0] : NULL, numImages,
+        maxSize, numMips, padding, numImages > 0? &rects[0] : NULL, &width, &height, &gutter);
+    if (ret != ATLAS_OK)
+    {
+        return ret;
+    }
+
+    uint32_t alignment = 1u << (numMips - 1);
+
+    atlas->width     = width;
+    atlas->height    = height;
+    atlas->numMips   = numMips;
+    atlas->gutter    = gutter;
+    atlas->numImages = numImages;
+    atlas->rects     = new AtlasRect [numImages];
+    atlas->uvs       = new AtlasUV [numImages];
+    memcpy(atlas->rects, &rects[0], sizeof(AtlasRect) * numImages);
+
+    uint8_t* base = new uint8_t [width * height * 4];
+    memset(base, 0, width * height * 4);
+    atlas->mips[0] = base;
+
+    for (uint32_t i = 0; i < numImages; ++i)
+    {
+        const AtlasImage* image = &images[i];
+        const AtlasRect& r = rects[i];
+
+        // Fill the whole cell and clamp to the image border so that the
+        // gutter repeats the edge texels.
+        uint32_t x0 = r.x - gutter;
+        uint32_t y0 = r.y - gutter;
+        uint32_t x1 = r.x + alignUp(r.width, alignment) + gutter;
+        uint32_t y1 = r.y + alignUp(r.height, alignment) + gutter;
+        for (uint32_t y = y0; y < y1; ++y)
+        {
+            uint32_t sy = y < r.y? 0 : std::min(y - r.y, r.height - 1);
+            uint8_t* dst = base + (y * width + x0) * 4;
+            for (uint32_t x = x0; x < x1; ++x, dst += 4)
+            {
+                uint32_t sx = x < r.x? 0 : std::min(x - r.x, r.width - 1);
+                fetch(image, sx, sy, dst);
+            }
+        }
+
+        AtlasUV& uv = atlas->uvs[i];
+        uv.scaleU  = (float)r.width / (float)width;
+        uv.scaleV  = (float)r.height / (float)height;
+        uv.offsetU = (float)r.x / (float)width;
+        uv.offsetV = (float)r.y / (float)height;
+    }
+
+    // The box filter of an aligned cell only reads from the same cell.
+    for (uint32_t m = 1; m < numMips; ++m)
+    {
+        uint32_t sw = std::max(width >> (m - 1), 1u);
+        uint32_t sh = std::max(height >> (m - 1), 1u);
+        uint32_t dw = std::max(width >> m, 1u);
+        uint32_t dh = std::max(height >> m, 1u);
+
+        const uint8_t* src = atlas->mips[m - 1];
+        uint8_t* dst = new uint8_t [dw * dh * 4];
+        atlas->mips[m] = dst;
+
+        for (uint32_t y = 0; y < dh; ++y)
+        {
+            uint32_t y0 = std::min(y * 2, sh - 1);
+            uint32_t y1 = std::min(y * 2 + 1, sh - 1);
+            for (uint32_t x = 0; x < dw; ++x)
+            {
+                uint32_t x0 = std::min(x * 2, sw - 1);
+                uint32_t x1 = std::min(x * 2 + 1, sw - 1);
+                for (uint32_t c = 0; c < 4; ++c)
+                {
+                    uint32_t sum = src[(y0 * sw + x0) * 4 + c] + src[(y0 * sw + x1) * 4 + c] +
+                                   src[(y1 * sw + x0) * 4 + c] + src[(y1 * sw + x1) * 4 + c];
+                    dst[(y * dw + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+                }
+            }
+        }
+    }
+
+    return ATLAS_OK;
+}
+
+void atlasDelete(Atlas* atlas)
+{
+    delete [] atlas->rects;
+    delete [] atlas->uvs;
+    for (uint32_t m = 0; m < ATLAS_MAX_MIPS; ++m)
+    {
+        delete [] atlas->mips[m];
+    }
+    memset(atlas, 0, sizeof(Atlas));
+}
+
+size_t atlasWriteMetadata(const Atlas* atlas, void* buffer, size_t size)
+{
+    size_t total = sizeof(MetadataHeader) + (sizeof(AtlasRect) + sizeof(AtlasUV)) * atlas->numImages;
+    if (buffer == NULL)
+    {
+        return total;
+    }
+    if (size < total)
+    {
+        return 0;
+    }
+
+    MetadataHeader header;
+    header.magic     = ATLAS_MAGIC;
+    header.version   = ATLAS_VERSION;
+    header.width     = atlas->width;
+    header.height    = atlas->height;
+    header.numMips   = atlas->numMips;
+    header.gutter    = atlas->gutter;
+    header.numImages = atlas->numImages;
+
+    uint8_t* p = (uint8_t*)buffer;
+    memcpy(p, &header, sizeof(MetadataHeader));
+    p += sizeof(MetadataHeader);
+    memcpy(p, atlas->rects, sizeof(AtlasRect) * atlas->numImages);
+    p += sizeof(AtlasRect) * atlas->numImages;
+    memcpy(p, atlas->uvs, sizeof(AtlasUV) * atlas->numImages);
+
+    return total;
+}
+
+AtlasResultEnum atlasReadMetadata(const void* buffer, size_t size, Atlas* atlas)
+{
+    memset(atlas, 0, sizeof(Atlas));
+
+    MetadataHeader header;
+    if (size < sizeof(MetadataHeader))
+    {
+        return ATLAS_ERROR_INVALID_DATA;
+    }
+    memcpy(&header, buffer, sizeof(MetadataHeader));
+    if (header.magic != ATLAS_MAGIC || header.version != ATLAS_VERSION ||
+        header.numMips == 0 || header.numMips > ATLAS_MAX_MIPS ||
+        (uint64_t)size < sizeof(MetadataHeader) + (uint64_t)(sizeof(AtlasRect) + sizeof(AtlasUV)) * header.numImages)
+    {
+        return ATLAS_ERROR_INVALID_DATA;
+    }
+
+    atlas->width     = header.width;
+    atlas->height    = header.height;
+    atlas->numMips   = header.numMips;
+    atlas->gutter    = header.gutter;
+    atlas->numImages = header.numImages;
+    atlas->rects     = new AtlasRect [header.numImages];
+    atlas->uvs       = new AtlasUV [header.numImages];
+
+    const uint8_t* p = (const uint8_t*)buffer + sizeof(MetadataHeader);
+    memcpy(atlas->rects, p, sizeof(AtlasRect) * header.numImages);
+    p += sizeof(AtlasRect) * header.numImages;
+    memcpy(atlas->uvs, p, sizeof(AtlasUV) * header.numImages);
+
+    return ATLAS_OK;
+}
+
+float atlasEfficiency(const Atlas* atlas)
+{
+    uint64_t used = 0;
+    for (uint32_t i = 0; i < atlas->numImages; ++i)
+    {
+        used += (uint64_t)atlas->rects[i].width * atlas->rects[i].height;
+    }
+    return (float)((double)used / ((double)atlas->width * atlas->height));
+}
+
+void atlasReport(const Atlas* atlas, FILE* fp)
+{
+    uint32_t alignment = 1u << (atlas->numMips - 1);
+
+    uint64_t total = (uint64_t)atlas->width * atlas->height;
+    uint64_t used = 0;
+    uint64_t cells = 0;
+    for (uint32_t i = 0; i < atlas->numImages; ++i)
+    {
+        const AtlasRect& r = atlas->rects[i];
+        used += (uint64_t)r.width * r.height;
+        cells += (uint64_t)(alignUp(r.width, alignment) + atlas->gutter * 2) *
+                 (alignUp(r.height, alignment) + atlas->gutter * 2);
+    }
+
+    fprintf(fp, "atlas %ux%u, %u images, %u mips, gutter %u\n",
+        atlas->width, atlas->height, atlas->numImages, atlas->numMips, atlas->gutter);
+    fprintf(fp, "  images: %5.1f%%\n", 100.0 * used / total);
+    fprintf(fp, "  gutter: %5.1f%%\n", 100.0 * (cells - used) / total);
+    fprintf(fp, "  free:   %5.1f%%\n", 100.0 * (total - cells) / total);
+}
@@ -0,0 +1,128 @@
+// --------------------------------------------------------------
+// atlas.h
+// Pack many small images into one texture atlas with mip-safe
+// gutters and UV remap tables.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct Image;
+
+#define ATLAS_MAX_MIPS 16
+
+enum AtlasResultEnum
+{
+    ATLAS_OK,
+    ATLAS_ERROR_INVALID_INPUT,  // An empty image or an unsupported channel count.
+    ATLAS_ERROR_TOO_LARGE,      // The images don't fit into maxSize x maxSize.
+    ATLAS_ERROR_INVALID_DATA,   // The metadata blob is corrupted.
+};
+
+// Where an image lives in the atlas, in texels of mip 0. The gutter
+// around it is not included.
+struct AtlasRect
+{
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+// The UV remap of an image: atlasUV = uv * scale + offset. It has the
+// same layout as the tilingUV float4 in the walking demo's shaders,
+// i.e., (scale.x, scale.y, offset.x, offset.y).
+struct AtlasUV
+{
+    float scaleU;
+    float scaleV;
+    float offsetU;
+    float offsetV;
+};
+
+// The atlas is always RGBA8. The mip chain is box filtered and every
+// level is tightly packed (rowPitch = width * 4).
+struct Atlas
+{
+    uint32_t   width;
+    uint32_t   height;
+    uint32_t   numMips;
+    uint32_t   gutter;      // in texels of mip 0
+    uint32_t   numImages;
+    AtlasRect* rects;
+    AtlasUV*   uvs;
+    uint8_t*   mips[ATLAS_MAX_MIPS];
+};
+
+// Place numRects rectangles of the given sizes (width, height pairs) with
+// MaxRects (best short side fit). Every rectangle is surrounded with a
+// gutter wide enough for numMips mipmaps and aligned so that the box
+// filter never mixes two images. The atlas width is a power of two and
+// the height a multiple of the alignment, both not larger than maxSize;
+// the shortest longer side and then the smallest area wins. No pixel is touched, so it can be
+// used to evaluate a packing on the CPU alone.
+extern AtlasResultEnum atlasPackRects(const uint32_t* sizes,
+                                      uint32_t numRects,
+                                      uint32_t maxSize,
+                                      uint32_t numMips,
+                                      uint32_t padding,
+                                      AtlasRect* outRects,
+                                      uint32_t* outWidth,
+                                      uint32_t* outHeight,
+                                      uint32_t* outGutter);
+
+// The pixels of an image to pack, rows of width * numChannels bytes
+// without padding, as in Image.
+struct AtlasImage
+{
+    uint32_t       width;
+    uint32_t       height;
+    uint32_t       numChannels;
+    const uint8_t* data;
+};
+
+// Pack the images, copy the pixels, replicate the image borders into the
+// gutters and build the mip chain. The images may have 1, 2, 3 or 4
+// channels; the missing ones are expanded as gray and opaque alpha.
+// padding is the minimum gutter in texels of mip 0.
+extern AtlasResultEnum atlasBuild(const Image* const* images,
+                                  uint32_t numImages,
+                                  uint32_t maxSize,
+                                  uint32_t numMips,
+                                  uint32_t padding,
+                                  Atlas* atlas);
+// The same for pixels that are not in Images, e.g., generated ones.
+extern AtlasResultEnum atlasBuildImages(const AtlasImage* images,
+                                        uint32_t numImages,
+                                        uint32_t maxSize,
+                                        uint32_t numMips,
+                                        uint32_t padding,
+                                        Atlas* atlas);
+
+extern void atlasDelete(Atlas* atlas);
+
+// The metadata blob holds the atlas size, the gutter, the rectangles and
+// the UV remap table. Return the size of the blob; call it with a NULL
+// buffer to query the size.
+extern size_t atlasWriteMetadata(const Atlas* atlas, void* buffer, size_t size);
+// Read the blob back into an atlas without pixels. The rects and uvs are
+// allocated and must be released with atlasDelete.
+extern AtlasResultEnum atlasReadMetadata(const void* buffer, size_t size, Atlas* atlas);
+
+// The fraction of the atlas covered by the images themselves.
+extern float atlasEfficiency(const Atlas* atlas);
+// Print the size, the efficiency and the waste in the gutters and
+// the free space.
+extern void atlasReport(const Atlas* atlas, FILE* fp);
+
+#endif // !ATLAS_H
@@ -0,0 +1,559 @@
+// --------------------------------------------------------------
+// bvh.cpp
+// The bounding volume hierarchy of a triangle mesh for ray
+// casting on the CPU, built with the binned SAH.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "bvh.h"
+
+#include "parallel.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+//
+// Boxes
+//
+struct BvhBox
+{
+    float lower[3];
+    float upper[3];
+
+    void clear()
+    {
+        lower[0] = lower[1] = lower[2] = FLT_MAX;
+        upper[0] = upper[1] = upper[2] = -FLT_MAX;
+    }
+
+    void grow(const BvhBox& box)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            lower[a] = std::min(lower[a], box.lower[a]);
+            upper[a] = std::max(upper[a], box.upper[a]);
+        }
+    }
+
+    void grow(const float* p)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            lower[a] = std::min(lower[a], p[a]);
+            upper[a] = std::max(upper[a], p[a]);
+        }
+    }
+
+    // Half of the surface area, 0 for an empty box.
+    float area() const
+    {
+        float dx = upper[0] - lower[0];
+        float dy = upper[1] - lower[1];
+        float dz = upper[2] - lower[2];
+        if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+        {
+            return 0.0f;
+        }
+        return dx * dy + dy * dz + dz * dx;
+    }
+};
+
+//
+// Build
+//
+struct BvhBuilder
+{
+    std::vector<BvhBox> boxes;       // Of the triangles
+    std::vector<float>  centroids;   // Of the boxes
+    uint32_t*           order;       // The triangles, partitioned in place
+
+    BvhBox bounds(uint32_t first, uint32_t count) const
+    {
+        BvhBox box;
+        box.clear();
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            box.grow(boxes[order[i]]);
+        }
+        return box;
+    }
+
+    // Partition the triangles of [first, first + count) by the binned SAH
+    // and return the first one of the second child, or 0 for a leaf.
+    uint32_t split(uint32_t first, uint32_t count, const BvhBox& box)
+    {
+        if (count <= 1)
+        {
+            return 0;
+        }
+
+        BvhBox centroidBox;
+        centroidBox.clear();
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            centroidBox.grow(&centroids[order[i] * 3]);
+        }
+
+        // The costs are relative to the area of the node, which is the cost
+        // of visiting it.
+        float leafCost = (float)count * box.area();
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        int bestBin = 0;
+        for (int a = 0; a < 3; ++a)
+        {
+            float extent = centroidBox.upper[a] - centroidBox.lower[a];
+            if (extent <= 0.0f)
+            {
+                continue;
+            }
+            float scale = (float)BVH_NUM_BINS / extent;
+
+            BvhBox binBoxes[BVH_NUM_BINS];
+            uint32_t binCounts[BVH_NUM_BINS];
+            for (int b = 0; b < BVH_NUM_BINS; ++b)
+            {
+                binBoxes[b].clear();
+                binCounts[b] = 0;
+            }
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                uint32_t t = order[i];
+                int b = std::min((int)((centroids[t * 3 + a] - centroidBox.lower[a]) * scale), BVH_NUM_BINS - 1);
+                binBoxes[b].grow(boxes[t]);
+                binCounts[b]++;
+            }
+
+            // The areas and counts on the right of every split, then sweep
+            // from the left.
+            float rightAreas[BVH_NUM_BINS];
+            uint32_t rightCounts[BVH_NUM_BINS];
+            BvhBox right;
+            right.clear();
+            uint32_t rightCount = 0;
+            for (int b = BVH_NUM_BINS - 1; b > 0; --b)
+            {
+                right.grow(binBoxes[b]);
+                rightCount += binCounts[b];
+                rightAreas[b] = right.area();
+                rightCounts[b] = rightCount;
+            }
+            BvhBox left;
+            left.clear();
+            uint32_t leftCount = 0;
+            for (int b = 0; b < BVH_NUM_BINS - 1; ++b)
+            {
+                left.grow(binBoxes[b]);
+                leftCount += binCounts[b];
+                if (leftCount == 0 || rightCounts[b + 1] == 0)
+                {
+                    continue;
+                }
+                float cost = box.area() + left.area() * (float)leftCount + rightAreas[b + 1] * (float)rightCounts[b + 1];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = a;
+                    bestBin = b;
+                }
+            }
+        }
+
+        if (bestAxis < 0)
+        {
+            // The centroids are all the same; only split big leaves, in
+            // the middle.
+            return count > BVH_MAX_LEAF_SIZE? first + count / 2 : 0;
+        }
+        if (bestCost >= leafCost && count <= BVH_MAX_LEAF_SIZE)
+        {
+            return 0;
+        }
+
+        float lower = centroidBox.lower[bestAxis];
+        float scale = (float)BVH_NUM_BINS / (centroidBox.upper[bestAxis] - lower);
+        struct OnLeft
+        {
+            const float* centroids;
+            int          axis;
+            float        lower;
+            float        scale;
+            int          bin;
+            bool operator()(uint32_t t) const
+            {
+                return std::min((int)((centroids[t * 3 + axis] - lower) * scale), BVH_NUM_BINS - 1) <= bin;
+            }
+        };
+        OnLeft onLeft = { &centroids[0], bestAxis, lower, scale, bestBin };
+        uint32_t* mid = std::partition(order + first, order + first + count, onLeft);
+        return (uint32_t)(mid - order);
+    }
+
+    // Build the subtree of the node nodes[root] over [first, first + count)
+    // into nodes, with the children allocated at the end.
+    void buildSubtree(std::vector<BvhNode>& nodes, uint32_t root, uint32_t first, uint32_t count)
+    {
+        struct Item
+        {
+            uint32_t node;
+            uint32_t first;
+            uint32_t count;
+        };
+        std::vector<Item> stack;
+        Item item = { root, first, count };
+        stack.push_back(item);
+        while (!stack.empty())
+        {
+            Item current = stack.back();
+            stack.pop_back();
+
+            BvhBox box = bounds(current.first, current.count);
+            uint32_t mid = split(current.first, current.count, box);
+
+            BvhNode& node = nodes[current.node];
+            for (int a = 0; a < 3; ++a)
+            {
+                node.lower[a] = box.lower[a];
+                node.upper[a] = box.upper[a];
+            }
+            if (mid == 0)
+            {
+                node.offset = current.first;
+                node.count = current.count;
+                continue;
+            }
+
+            uint32_t child = (uint32_t)nodes.size();
+            node.offset = child;
+            node.count = 0;
+            nodes.resize(nodes.size() + 2);
+
+            Item second = { child + 1, mid, current.first + current.count - mid };
+            Item first = { child, current.first, mid - current.first };
+            stack.push_back(second);
+            stack.push_back(first);
+        }
+    }
+};
+
+void bvhBuild(Bvh* bvh, const float* positions, const uint32_t* indices, uint32_t numTriangles, uint32_t numThreads)
+{
+    assert(bvh != NULL);
+
+    bvh->nodes.clear();
+    bvh->triangles.resize(numTriangles);
+    bvh->vertices.resize((size_t)numTriangles * 9);
+
+    BvhNode root;
+    root.lower[0] = root.lower[1] = root.lower[2] = 0.0f;
+    root.upper[0] = root.upper[1] = root.upper[2] = 0.0f;
+    root.offset = 0;
+    root.count = 0;
+    bvh->nodes.push_back(root);
+    if (numTriangles == 0)
+    {
+        return;
+    }
+
+    BvhBuilder builder;
+    builder.boxes.resize(numTriangles);
+    builder.centroids.resize(numTriangles * 3);
+    builder.order = &bvh->triangles[0];
+    for (uint32_t t = 0; t < numTriangles; ++t)
+    {
+        BvhBox& box = builder.boxes[t];
+        box.clear();
+        for (int c = 0; c < 3; ++c)
+        {
+            box.grow(positions + indices[t * 3 + c] * 3);
+        }
+        for (int a = 0; a < 3; ++a)
+        {
+            builder.centroids[t * 3 + a] = (box.lower[a] + box.upper[a]) * 0.5f;
+        }
+        builder.order[t] = t;
+    }
+
+    // Split the top of the tree here, down to the subtrees small enough
+    // for one task. The size only depends on the mesh, so the tasks and
+    // the tree do not depend on the number of threads.
+    const uint32_t taskSize = std::max(numTriangles / 128, 1024u);
+
+    struct Task
+    {
+        uint32_t node;
+        uint32_t first;
+        uint32_t count;
+    };
+    std::vector<Task> tasks;
+    std::vector<Task> stack;
+    Task top = { 0, 0, numTriangles };
+    stack.push_back(top);
+    while (!stack.empty())
+    {
+        Task current = stack.back();
+        stack.pop_back();
+        if (current.count <= taskSize)
+        {
+            tasks.push_back(current);
+            continue;
+        }
+
+        BvhBox box = builder.bounds(current.first, current.count);
+        uint32_t mid = builder.split(current.first, current.count, box);
+        BvhNode& node = bvh->nodes[current.node];
+        for (int a = 0; a < 3; ++a)
+        {
+            node.lower[a] = box.lower[a];
+            node.upper[a] = box.upper[a];
+        }
+        if (mid == 0)
+        {
+            node.offset = current.first;
+            node.count = current.count;
+            continue;
+        }
+
+        uint32_t child = (uint32_t)bvh->nodes.size();
+        node.offset = child;
+        node.count = 0;
+        bvh->nodes.resize(bvh->nodes.size() + 2);
+        Task second = { child + 1, mid, current.first + current.count - mid };
+        Task first = { child, current.first, mid - current.first };
+        stack.push_back(second);
+        stack.push_back(first);
+    }
+
+    // The subtrees, each into its own nodes with the root at 0. The tasks
+    // own disjoint ranges of the triangles.
+    std::vector<std::vector<BvhNode> > subtrees(tasks.size());
+    parallelFor((uint32_t)tasks.size(), numThreads, [&](uint32_t k)
+    {
+        subtrees[k].resize(1);
+        builder.buildSubtree(subtrees[k], 0, tasks[k].first, tasks[k].count);
+    });
+
+    // Append the subtrees in the order of the tasks; the local node k > 0
+    // goes to base + k - 1 and the local root to the node of the task.
+    for (size_t k = 0; k < tasks.size(); ++k)
+    {
+        const std::vector<BvhNode>& subtree = subtrees[k];
+        uint32_t base = (uint32_t)bvh->nodes.size();
+        for (size_t i = 0; i < subtree.size(); ++i)
+        {
+            BvhNode node = subtree[i];
+            if (node.count == 0)
+            {
+                node.offset = base + node.offset - 1;
+            }
+            if (i == 0)
+            {
+                bvh->nodes[tasks[k].node] = node;
+            }
+            else
+            {
+                bvh->nodes.push_back(node);
+            }
+        }
+    }
+
+    // The corners in the order of the leaves.
+    for (uint32_t i = 0; i < numTriangles; ++i)
+    {
+        uint32_t t = bvh->triangles[i];
+        for (int c = 0; c < 3; ++c)
+        {
+            const float* p = positions + indices[t * 3 + c] * 3;
+            bvh->vertices[i * 9 + c * 3 + 0] = p[0];
+            bvh->vertices[i * 9 + c * 3 + 1] = p[1];
+            bvh->vertices[i * 9 + c * 3 + 2] = p[2];
+        }
+    }
+}
+
+float bvhSahCost(const Bvh* bvh)
+{
+    if (bvh->triangles.empty())
+    {
+        return 0.0f;
+    }
+
+    double cost = 0.0;
+    for (size_t i = 0; i < bvh->nodes.size(); ++i)
+    {
+        const BvhNode& node = bvh->nodes[i];
+        BvhBox box;
+        for (int a = 0; a < 3; ++a)
+        {
+            box.lower[a] = node.lower[a];
+            box.upper[a] = node.upper[a];
+        }
+        cost += (double)box.area() * (node.count == 0? 1.0 : (double)node.count);
+    }
+
+    const BvhNode& root = bvh->nodes[0];
+    BvhBox rootBox;
+    for (int a = 0; a < 3; ++a)
+    {
+        rootBox.lower[a] = root.lower[a];
+        rootBox.upper[a] = root.upper[a];
+    }
+    return (float)(cost / std::max((double)rootBox.area(), 1e-30));
+}
+
+//
+// Traversal
+//
+// The entry distance of the ray into the box, or FLT_MAX when it misses
+// the box in (tmin, tmax).
+static inline float intersectBox(const BvhNode& node,
+                                 const float* origin,
+                                 const float* inverse,
+                                 float tmin,
+                                 float tmax)
+{
+    for (int a = 0; a < 3; ++a)
+    {
+        float t0 = (node.lower[a] - origin[a]) * inverse[a];
+        float t1 = (node.upper[a] - origin[a]) * inverse[a];
+        tmin = std::max(tmin, std::min(t0, t1));
+        tmax = std::min(tmax, std::max(t0, t1));
+    }
+    return tmin <= tmax? tmin : FLT_MAX;
+}
+
+// Moller-Trumbore. Return whether the triangle is hit in (tmin, *t), and
+// then lower *t to the hit.
+static inline bool intersectTriangle(const float* v, const BvhRay* ray, float tmin, float* t, float* u, float* w)
+{
+    float e1[3] = { v[3] - v[0], v[4] - v[1], v[5] - v[2] };
+    float e2[3] = { v[6] - v[0], v[7] - v[1], v[8] - v[2] };
+    const float* d = ray->direction;
+    float p[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+    float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    if (det == 0.0f)
+    {
+        return false;
+    }
+    float invDet = 1.0f / det;
+    float s[3] = { ray->origin[0] - v[0], ray->origin[1] - v[1], ray->origin[2] - v[2] };
+    float b1 = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+    if (b1 < 0.0f || b1 > 1.0f)
+    {
+        return false;
+    }
+    float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+    float b2 = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * invDet;
+    if (b2 < 0.0f || b1 + b2 > 1.0f)
+    {
+        return false;
+    }
+    float distance = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * invDet;
+    if (distance <= tmin || distance >= *t)
+    {
+        return false;
+    }
+    *t = distance;
+    *u = b1;
+    *w = b2;
+    return true;
+}
+
+// The closest hit, or any hit when anyHit is set.
+static bool traverse(const Bvh* bvh, const BvhRay* ray, bool anyHit, BvhHit* hit)
+{
+    if (bvh->triangles.empty())
+    {
+        return false;
+    }
+
+    float inverse[3];
+    for (int a = 0; a < 3; ++a)
+    {
+        inverse[a] = 1.0f / ray->direction[a];
+    }
+
+    const BvhNode* nodes = &bvh->nodes[0];
+    float tmax = ray->tmax;
+    bool found = false;
+    if (intersectBox(nodes[0], ray->origin, inverse, ray->tmin, tmax) == FLT_MAX)
+    {
+        return false;
+    }
+
+    uint32_t stack[BVH_MAX_DEPTH];
+    uint32_t stackSize = 0;
+    uint32_t current = 0;
+    for (;;)
+    {
+        const BvhNode& node = nodes[current];
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i)
+            {
+                float u;
+                float v;
+                if (intersectTriangle(&bvh->vertices[i * 9], ray, ray->tmin, &tmax, &u, &v))
+                {
+                    found = true;
+                    if (anyHit)
+                    {
+                        return true;
+                    }
+                    hit->t = tmax;
+                    hit->u = u;
+                    hit->v = v;
+                    hit->triangle = bvh->triangles[i];
+                }
+            }
+        }
+        else
+        {
+            // The nearer child first.
+            uint32_t nearChild = node.offset;
+            uint32_t farChild = node.offset + 1;
+            float tNear = intersectBox(nodes[nearChild], ray->origin, inverse, ray->tmin, tmax);
+            float tFar = intersectBox(nodes[farChild], ray->origin, inverse, ray->tmin, tmax);
+            if (tFar < tNear)
+            {
+                std::swap(nearChild, farChild);
+                std::swap(tNear, tFar);
+            }
+            if (tNear != FLT_MAX)
+            {
+                if (tFar != FLT_MAX)
+                {
+                    assert(stackSize < BVH_MAX_DEPTH);
+                    stack[stackSize++] = farChild;
+                }
+                current = nearChild;
+                continue;
+            }
+        }
+
+        if (stackSize == 0)
+        {
+            break;
+        }
+        current = stack[--stackSize];
+    }
+
+    return found;
+}
+
+bool bvhIntersect(const Bvh* bvh, const BvhRay* ray, BvhHit* hit)
+{
+    return traverse(bvh, ray, false, hit);
+}
+
+bool bvhOccluded(const Bvh* bvh, const BvhRay* ray)
+{
+    return traverse(bvh, ray, true, NULL);
+}
@@ -0,0 +1,80 @@
+// --------------------------------------------------------------
+// bvh.h
+// The bounding volume hierarchy of a triangle mesh for ray
+// casting on the CPU, built with the binned SAH.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef BVH_H
+#define BVH_H
+
+#include <stdint.h>
+#include <vector>
+
+// The bins of the SAH along each axis.
+#define BVH_NUM_BINS 16
+// The leaves hold at most that many triangles.
+#define BVH_MAX_LEAF_SIZE 8
+// The size of the traversal stack.
+#define BVH_MAX_DEPTH 128
+
+// 32 bytes, two per cache line.
+struct BvhNode
+{
+    float    lower[3];
+    uint32_t offset;         // The first child, the second follows it; or the first triangle of a leaf
+    float    upper[3];
+    uint32_t count;          // The triangles of a leaf; 0 for an inner node
+};
+
+struct Bvh
+{
+    std::vector<BvhNode>  nodes;         // nodes[0] is the root
+    // The triangles of the mesh in the order of the leaves.
+    std::vector<uint32_t> triangles;
+    // The corners of the triangles, 9 floats each, in the same order.
+    std::vector<float>    vertices;
+};
+
+// Build the BVH of numTriangles triangles of the indices into positions
+// (x, y, z). The top of the tree is split on the calling thread, then the
+// subtrees are built by numThreads threads with parallelFor(). The tree
+// does not depend on the number of threads.
+extern void bvhBuild(Bvh* bvh,
+                     const float* positions,
+                     const uint32_t* indices,
+                     uint32_t numTriangles,
+                     uint32_t numThreads);
+
+// The SAH cost of the tree, with the cost of an inner node and of a
+// triangle both 1, for comparing the builds.
+extern float bvhSahCost(const Bvh* bvh);
+
+struct BvhRay
+{
+    float origin[3];
+    float direction[3];      // Not necessarily normalized
+    float tmin;
+    float tmax;
+};
+
+struct BvhHit
+{
+    float    t;
+    float    u;              // The barycentrics of the second and third corners
+    float    v;
+    uint32_t triangle;       // In the mesh
+};
+
+// The closest hit in (tmin, tmax). Return false when there is none.
+extern bool bvhIntersect(const Bvh* bvh, const BvhRay* ray, BvhHit* hit);
+
+// Whether anything is hit in (tmin, tmax); it stops at the first hit.
+extern bool bvhOccluded(const Bvh* bvh, const BvhRay* ray);
+
+#endif // !BVH_H
@@ -0,0 +1,407 @@
+// --------------------------------------------------------------
+// dds.cpp
+// Platform-independent DDS header parsing, subresource layout
+// and read-only file mapping.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "dds.h"
+
+#include <string.h>
+
+#if defined _WIN32
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+//
+// Bits per pixel indexed by the DXGI_FORMAT value. The formats after
+// DXGI_FORMAT_B4G4R4A4_UNORM (115) are not supported.
+//
+static const uint8_t BITS_PER_PIXEL[] =
+{
+    0,                                  // UNKNOWN
+    128, 128, 128, 128,                 // R32G32B32A32
+    96, 96, 96, 96,                     // R32G32B32
+    64, 64, 64, 64, 64, 64,             // R16G16B16A16
+    64, 64, 64, 64,                     // R32G32
+    64, 64, 64, 64,                     // R32G8X24, D32_FLOAT_S8X24
+    32, 32, 32, 32,                     // R10G10B10A2, R11G11B10
+    32, 32, 32, 32, 32, 32,             // R8G8B8A8
+    32, 32, 32, 32, 32, 32,             // R16G16
+    32, 32, 32, 32, 32,                 // R32
+    32, 32, 32, 32,                     // R24G8, D24_UNORM_S8
+    16, 16, 16, 16, 16,                 // R8G8
+    16, 16, 16, 16, 16, 16, 16,         // R16, D16
+    8, 8, 8, 8, 8, 8,                   // R8, A8
+    1,                                  // R1
+    32, 32, 32,                         // R9G9B9E5, R8G8_B8G8, G8R8_G8B8
+    4, 4, 4,                            // BC1
+    8, 8, 8,                            // BC2
+    8, 8, 8,                            // BC3
+    4, 4, 4,                            // BC4
+    8, 8, 8,                            // BC5
+    16, 16,                             // B5G6R5, B5G5R5A1
+    32, 32, 32, 32, 32, 32, 32,         // B8G8R8A8, B8G8R8X8, R10G10B10_XR_BIAS_A2
+    8, 8, 8,                            // BC6H
+    8, 8, 8,                            // BC7
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0,       // Video formats
+    0, 0, 0, 0, 0,
+    16,                                 // B4G4R4A4
+};
+
+#define DDS_FORMAT_BC1_TYPELESS   70
+#define DDS_FORMAT_BC5_SNORM      84
+#define DDS_FORMAT_BC6H_TYPELESS  94
+#define DDS_FORMAT_BC7_UNORM_SRGB 99
+#define DDS_FORMAT_R8G8_B8G8      68
+#define DDS_FORMAT_G8R8_G8B8      69
+
+size_t ddsBitsPerPixel(uint32_t format)
+{
+    if (format >= sizeof(BITS_PER_PIXEL) / sizeof(BITS_PER_PIXEL[0]))
+    {
+        return 0;
+    }
+    return BITS_PER_PIXEL[format];
+}
+
+bool ddsIsBlockCompressed(uint32_t format)
+{
+    return (format >= DDS_FORMAT_BC1_TYPELESS && format <= DDS_FORMAT_BC5_SNORM) ||
+           (format >= DDS_FORMAT_BC6H_TYPELESS && format <= DDS_FORMAT_BC7_UNORM_SRGB);
+}
+
+void ddsGetSurfaceInfo(size_t width,
+                       size_t height,
+                       uint32_t format,
+                       size_t* outNumBytes,
+                       size_t* outRowBytes,
+                       size_t* outNumRows)
+{
+    size_t rowBytes;
+    size_t numRows;
+
+    bool bc = ddsIsBlockCompressed(format);
+    bool packed = (format == DDS_FORMAT_R8G8_B8G8 || format == DDS_FORMAT_G8R8_G8B8);
+
+    if (bc)
+    {
+        // A 4x4 block has 16 pixels so that the block size is twice of bpp.
+        size_t numBytesPerBlock = ddsBitsPerPixel(format) * 2;
+        size_t numBlocksWide = width > 0? (width + 3) / 4 : 0;
+        size_t numBlocksHigh = height > 0? (height + 3) / 4 : 0;
+        rowBytes = numBlocksWide * numBytesPerBlock;
+        numRows = numBlocksHigh;
+    }
+    else if (packed)
+    {
+        rowBytes = ((width + 1) >> 1) * 4;
+        numRows = height;
+    }
+    else
+    {
+        rowBytes = (width * ddsBitsPerPixel(format) + 7) / 8; // round up to nearest byte
+        numRows = height;
+    }
+
+    if (outNumBytes != NULL)
+    {
+        *outNumBytes = rowBytes * numRows;
+    }
+    if (outRowBytes != NULL)
+    {
+        *outRowBytes = rowBytes;
+    }
+    if (outNumRows != NULL)
+    {
+        *outNumRows = numRows;
+    }
+}
+
+DDSResultEnum ddsParse(const uint8_t* data, size_t size, DDSFile* file)
+{
+    memset(file, 0, sizeof(DDSFile));
+
+    // Need at least enough data to fill the header and magic number to be a valid DDS
+    if (data == NULL || size < sizeof(uint32_t) + sizeof(DDS_HEADER))
+    {
+        return DDS_ERROR_INVALID_DATA;
+    }
+
+    // DDS files always start with the same magic number ("DDS ")
+    uint32_t magic;
+    memcpy(&magic, data, sizeof(uint32_t));
+    if (magic != DDS_MAGIC)
+    {
+        return DDS_ERROR_INVALID_DATA;
+    }
+
+    const DDS_HEADER* header = (const DDS_HEADER*)(data + sizeof(uint32_t));
+    if (header->size != sizeof(DDS_HEADER) ||
+        header->ddspf.size != sizeof(DDS_PIXELFORMAT))
+    {
+        return DDS_ERROR_INVALID_DATA;
+    }
+
+    size_t offset = sizeof(uint32_t) + sizeof(DDS_HEADER);
+
+    // Check for DX10 extension
+    if ((header->ddspf.flags & DDS_FOURCC) &&
+        (MAKEFOURCC('D', 'X', '1', '0') == header->ddspf.fourCC))
+    {
+        // Must be long enough for both headers and magic value
+        if (size < offset + sizeof(DDS_HEADER_DXT10))
+        {
+            return DDS_ERROR_INVALID_DATA;
+        }
+
+        file->header10 = (const DDS_HEADER_DXT10*)(data + offset);
+        offset += sizeof(DDS_HEADER_DXT10);
+    }
+
+    file->header  = header;
+    file->bitData = data + offset;
+    file->bitSize = size - offset;
+
+    return DDS_OK;
+}
+
+uint32_t ddsGetFormat(const DDSFile* file)
+{
+    if (file->header10 != NULL)
+    {
+        return ddsBitsPerPixel(file->header10->dxgiFormat) != 0? file->header10->dxgiFormat : 0;
+    }
+
+    const DDS_PIXELFORMAT& ddpf = file->header->ddspf;
+    if (ddpf.flags & DDS_FOURCC)
+    {
+        switch (ddpf.fourCC)
+        {
+            case MAKEFOURCC('D', 'X', 'T', '1'): return 71; // BC1_UNORM
+            case MAKEFOURCC('D', 'X', 'T', '2'):
+            case MAKEFOURCC('D', 'X', 'T', '3'): return 74; // BC2_UNORM
+            case MAKEFOURCC('D', 'X', 'T', '4'):
+            case MAKEFOURCC('D', 'X', 'T', '5'): return 77; // BC3_UNORM
+            case MAKEFOURCC('A', 'T', 'I', '1'):
+            case MAKEFOURCC('B', 'C', '4', 'U'): return 80; // BC4_UNORM
+            case MAKEFOURCC('A', 'T', 'I', '2'):
+            case MAKEFOURCC('B', 'C', '5', 'U'): return 83; // BC5_UNORM
+        }
+    }
+    else if ((ddpf.flags & DDS_RGB) && ddpf.RGBBitCount == 32)
+    {
+        if (ddpf.RBitMask == 0x000000ff && ddpf.GBitMask == 0x0000ff00 &&
+            ddpf.BBitMask == 0x00ff0000 && ddpf.ABitMask == 0xff000000)
+        {
+            return 28; // R8G8B8A8_UNORM
+        }
+        if (ddpf.RBitMask == 0x00ff0000 && ddpf.GBitMask == 0x0000ff00 &&
+            ddpf.BBitMask == 0x000000ff)
+        {
+            return ddpf.ABitMask == 0xff000000? 87 : 88; // B8G8R8A8_UNORM or B8G8R8X8_UNORM
+        }
+    }
+
+    return 0;
+}
+
+DDSResultEnum ddsFillSubresources(size_t width,
+                                  size_t height,
+                                  size_t depth,
+                                  size_t mipCount,
+                                  size_t arraySize,
+                                  uint32_t format,
+                                  size_t maxsize,
+                                  const uint8_t* bitData,
+                                  size_t bitSize,
+                                  DDSLayout* layout,
+                                  DDSSubresource* subresources)
+{
+    memset(layout, 0, sizeof(DDSLayout));
+
+    size_t numBytes;
+    size_t rowBytes;
+    // Use offsets instead of pointers so that a corrupted header can't
+    // make the pointer arithmetic overflow.
+    size_t offset = 0;
+    size_t index = 0;
+
+    for (size_t j = 0; j < arraySize; j++)
+    {
+        size_t w = width;
+        size_t h = height;
+        size_t d = depth;
+        for (size_t i = 0; i < mipCount; i++)
+        {
+            ddsGetSurfaceInfo(w, h, format, &numBytes, &rowBytes, NULL);
+
+            if (mipCount <= 1 || maxsize == 0 || (w <= maxsize && h <= maxsize && d <= maxsize))
+            {
+                if (layout->width == 0)
+                {
+                    layout->width  = w;
+                    layout->height = h;
+                    layout->depth  = d;
+                }
+
+                subresources[index].data       = bitData + offset;
+                subresources[index].rowPitch   = rowBytes;
+                subresources[index].slicePitch = numBytes;
+                ++index;
+            }
+            else if (j == 0)
+            {
+                // Count number of skipped mipmaps (first item only)
+                ++layout->skipMip;
+            }
+
+            if (numBytes * d > bitSize - offset)
+            {
+                return DDS_ERROR_EOF;
+            }
+
+            offset += numBytes * d;
+
+            w = w > 1? w >> 1 : 1;
+            h = h > 1? h >> 1 : 1;
+            d = d > 1? d >> 1 : 1;
+        }
+    }
+
+    layout->numSubresources = index;
+
+    return index > 0? DDS_OK : DDS_ERROR_NO_SURFACE;
+}
+
+//
+// File mapping
+//
+#if defined _WIN32
+
+static bool ddsMapHandle(HANDLE file, DDSMappedFile* mappedFile)
+{
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    // A view larger than the address space can't be mapped on 32-bit.
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0 ||
+        (ULONGLONG)fileSize.QuadPart > (ULONGLONG)(SIZE_T)-1)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    mappedFile->data    = (const uint8_t*)view;
+    mappedFile->size    = (size_t)fileSize.QuadPart;
+    mappedFile->file    = file;
+    mappedFile->mapping = mapping;
+
+    return true;
+}
+
+bool ddsMapFile(const char* path, DDSMappedFile* mappedFile)
+{
+    memset(mappedFile, 0, sizeof(DDSMappedFile));
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    return ddsMapHandle(file, mappedFile);
+}
+
+bool ddsMapFile(const wchar_t* path, DDSMappedFile* mappedFile)
+{
+    memset(mappedFile, 0, sizeof(DDSMappedFile));
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    return ddsMapHandle(file, mappedFile);
+}
+
+void ddsUnmapFile(DDSMappedFile* mappedFile)
+{
+    if (mappedFile->data != NULL)
+    {
+        UnmapViewOfFile(mappedFile->data);
+    }
+    if (mappedFile->mapping != NULL)
+    {
+        CloseHandle((HANDLE)mappedFile->mapping);
+    }
+    if (mappedFile->file != NULL)
+    {
+        CloseHandle((HANDLE)mappedFile->file);
+    }
+    memset(mappedFile, 0, sizeof(DDSMappedFile));
+}
+
+#else
+
+bool ddsMapFile(const char* path, DDSMappedFile* mappedFile)
+{
+    memset(mappedFile, 0, sizeof(DDSMappedFile));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping holds its own reference to the file.
+    close(fd);
+    if (view == MAP_FAILED)
+    {
+        return false;
+    }
+    madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    mappedFile->data = (const uint8_t*)view;
+    mappedFile->size = (size_t)st.st_size;
+
+    return true;
+}
+
+void ddsUnmapFile(DDSMappedFile* mappedFile)
+{
+    if (mappedFile->data != NULL)
+    {
+        munmap((void*)mappedFile->data, mappedFile->size);
+    }
+    memset(mappedFile, 0, sizeof(DDSMappedFile));
+}
+
+#endif // _WIN32
@@ -0,0 +1,196 @@
+// --------------------------------------------------------------
+// dds.h
+// Platform-independent DDS header parsing, subresource layout
+// and read-only file mapping.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef DDS_H
+#define DDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MAKEFOURCC
+    #define MAKEFOURCC(ch0, ch1, ch2, ch3)                              \
+                ((uint32_t)(uint8_t)(ch0) | ((uint32_t)(uint8_t)(ch1) << 8) |       \
+                ((uint32_t)(uint8_t)(ch2) << 16) | ((uint32_t)(uint8_t)(ch3) << 24 ))
+#endif /* defined(MAKEFOURCC) */
+
+//
+// DDS file structure definitions
+//
+// See DDS.h in the 'Texconv' sample and the 'DirectXTex' library
+#pragma pack(push,1)
+
+const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+
+struct DDS_PIXELFORMAT
+{
+    uint32_t    size;
+    uint32_t    flags;
+    uint32_t    fourCC;
+    uint32_t    RGBBitCount;
+    uint32_t    RBitMask;
+    uint32_t    GBitMask;
+    uint32_t    BBitMask;
+    uint32_t    ABitMask;
+};
+
+#define DDS_FOURCC      0x00000004  // DDPF_FOURCC
+#define DDS_RGB         0x00000040  // DDPF_RGB
+#define DDS_LUMINANCE   0x00020000  // DDPF_LUMINANCE
+#define DDS_ALPHA       0x00000002  // DDPF_ALPHA
+
+#define DDS_HEADER_FLAGS_VOLUME         0x00800000  // DDSD_DEPTH
+
+#define DDS_HEIGHT 0x00000002 // DDSD_HEIGHT
+#define DDS_WIDTH  0x00000004 // DDSD_WIDTH
+
+#define DDS_CUBEMAP_POSITIVEX 0x00000600 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_POSITIVEX
+#define DDS_CUBEMAP_NEGATIVEX 0x00000a00 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_NEGATIVEX
+#define DDS_CUBEMAP_POSITIVEY 0x00001200 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_POSITIVEY
+#define DDS_CUBEMAP_NEGATIVEY 0x00002200 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_NEGATIVEY
+#define DDS_CUBEMAP_POSITIVEZ 0x00004200 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_POSITIVEZ
+#define DDS_CUBEMAP_NEGATIVEZ 0x00008200 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_NEGATIVEZ
+
+#define DDS_CUBEMAP_ALLFACES ( DDS_CUBEMAP_POSITIVEX | DDS_CUBEMAP_NEGATIVEX |\
+                               DDS_CUBEMAP_POSITIVEY | DDS_CUBEMAP_NEGATIVEY |\
+                               DDS_CUBEMAP_POSITIVEZ | DDS_CUBEMAP_NEGATIVEZ )
+
+#define DDS_CUBEMAP 0x00000200 // DDSCAPS2_CUBEMAP
+
+enum DDS_MISC_FLAGS2
+{
+    DDS_MISC_FLAGS2_ALPHA_MODE_MASK = 0x7L,
+};
+
+struct DDS_HEADER
+{
+    uint32_t        size;
+    uint32_t        flags;
+    uint32_t        height;
+    uint32_t        width;
+    uint32_t        pitchOrLinearSize;
+    uint32_t        depth; // only if DDS_HEADER_FLAGS_VOLUME is set in flags
+    uint32_t        mipMapCount;
+    uint32_t        reserved1[11];
+    DDS_PIXELFORMAT ddspf;
+    uint32_t        caps;
+    uint32_t        caps2;
+    uint32_t        caps3;
+    uint32_t        caps4;
+    uint32_t        reserved2;
+};
+
+// The dxgiFormat is the numeric value of a DXGI_FORMAT so that
+// this header doesn't depend on the DirectX headers.
+struct DDS_HEADER_DXT10
+{
+    uint32_t        dxgiFormat;
+    uint32_t        resourceDimension;
+    uint32_t        miscFlag; // see D3D11_RESOURCE_MISC_FLAG
+    uint32_t        arraySize;
+    uint32_t        miscFlags2;
+};
+
+#pragma pack(pop)
+
+enum DDSResultEnum
+{
+    DDS_OK,
+    DDS_ERROR_INVALID_DATA,  // Not a DDS file or the header is corrupted.
+    DDS_ERROR_EOF,           // The surfaces run over the end of the data.
+    DDS_ERROR_NO_SURFACE,    // No surface is left after skipping mipmaps.
+};
+
+// A parsed DDS file. The pointers point into the caller's memory and
+// no data is copied.
+struct DDSFile
+{
+    const DDS_HEADER*       header;
+    const DDS_HEADER_DXT10* header10; // NULL when there is no "DX10" extension.
+    const uint8_t*          bitData;
+    size_t                  bitSize;
+};
+
+// The layout of one subresource. It has the same meaning as
+// D3D11_SUBRESOURCE_DATA.
+struct DDSSubresource
+{
+    const uint8_t* data;
+    size_t         rowPitch;
+    size_t         slicePitch;
+};
+
+// The size of the texture after skipping the mipmaps larger than maxsize.
+struct DDSLayout
+{
+    size_t width;
+    size_t height;
+    size_t depth;
+    size_t skipMip;
+    size_t numSubresources;
+};
+
+// Return the bits per pixel of a DXGI_FORMAT value, or 0 when the format
+// is not supported.
+extern size_t ddsBitsPerPixel(uint32_t format);
+
+// Return true for the BC1-BC7 formats, which are stored in 4x4 blocks.
+extern bool ddsIsBlockCompressed(uint32_t format);
+
+// Get the size in bytes of a surface, of a row and the number of rows
+// (block rows for compressed formats).
+extern void ddsGetSurfaceInfo(size_t width,
+                              size_t height,
+                              uint32_t format,
+                              size_t* outNumBytes,
+                              size_t* outRowBytes,
+                              size_t* outNumRows);
+
+// Validate the magic number and the headers of a DDS file in memory.
+extern DDSResultEnum ddsParse(const uint8_t* data, size_t size, DDSFile* file);
+
+// Return the DXGI_FORMAT value of the file, or 0 when it's not recognized.
+// Only the "DX10" extension, the BCn FourCCs and 32-bit RGBA/BGRA masks are
+// handled here; see GetDXGIFormat() in DDSTextureLoader for the full list.
+extern uint32_t ddsGetFormat(const DDSFile* file);
+
+// Compute where each subresource lives in bitData. The subresources array
+// must hold at least mipCount * arraySize elements. Mipmaps larger than
+// maxsize (0 means no limit) are skipped.
+extern DDSResultEnum ddsFillSubresources(size_t width,
+                                         size_t height,
+                                         size_t depth,
+                                         size_t mipCount,
+                                         size_t arraySize,
+                                         uint32_t format,
+                                         size_t maxsize,
+                                         const uint8_t* bitData,
+                                         size_t bitSize,
+                                         DDSLayout* layout,
+                                         DDSSubresource* subresources);
+
+// A read-only view of a whole file.
+struct DDSMappedFile
+{
+    const uint8_t* data;
+    size_t         size;
+    void*          file;     // File handle or descriptor.
+    void*          mapping;  // Mapping handle (Windows only).
+};
+
+// Map the file into memory. The view stays valid until ddsUnmapFile.
+extern bool ddsMapFile(const char* path, DDSMappedFile* mappedFile);
+#if defined _WIN32
+extern bool ddsMapFile(const wchar_t* path, DDSMappedFile* mappedFile);
+#endif
+extern void ddsUnmapFile(DDSMappedFile* mappedFile);
+
+#endif // !DDS_H
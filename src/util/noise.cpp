@@ -0,0 +1,677 @@
+// --------------------------------------------------------------
+// noise.cpp
+// Perlin and simplex noise on the CPU, with the permutation and
+// the gradients of the walking demo's shaders.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "noise.h"
+
+#include "parallel.h"
+
+#include <assert.h>
+#include <math.h>
+#include <emmintrin.h>
+#include <algorithm>
+
+// The Permutation of ground.hlsl and perlin.hlsl.
+static const int32_t g_permutation[256] =
+{
+  225,155,210,108,175,199,221,144,203,116, 70,213, 69,158, 33,252,
+  5, 82,173,133,222,139,174, 27,  9, 71, 90,246, 75,130, 91,191,
+  169,138,  2,151,194,235, 81,  7, 25,113,228,159,205,253,134,142,
+  248, 65,224,217, 22,121,229, 63, 89,103, 96,104,156, 17,201,129,
+  36,  8,165,110,237,117,231, 56,132,211,152, 20,181,111,239,218,
+  170,163, 51,172,157, 47, 80,212,176,250, 87, 49, 99,242,136,189,
+  162,115, 44, 43,124, 94,150, 16,141,247, 32, 10,198,223,255, 72,
+  53,131, 84, 57,220,197, 58, 50,208, 11,241, 28,  3,192, 62,202,
+  18,215,153, 24, 76, 41, 15,179, 39, 46, 55,  6,128,167, 23,188,
+  106, 34,187,140,164, 73,112,182,244,195,227, 13, 35, 77,196,185,
+  26,200,226,119, 31,123,168,125,249, 68,183,230,177,135,160,180,
+  12,  1,243,148,102,166, 38,238,251, 37,240,126, 64, 74,161, 40,
+  184,149,171,178,101, 66, 29, 59,146, 61,254,107, 42, 86,154,  4,
+  236,232,120, 21,233,209, 45, 98,193,114, 78, 19,206, 14,118,127,
+  48, 79,147, 85, 30,207,219, 54, 88,234,190,122, 95, 67,143,109,
+  137,214,145, 93, 92,100,245,  0,216,186, 60, 83,105, 97,204, 52
+};
+
+// The skew factors of the simplex grids and the scales bringing the
+// simplex noise to about [-1, 1].
+#define NOISE_F2 0.36602540378f  // (sqrt(3) - 1) / 2
+#define NOISE_G2 0.21132486540f  // (3 - sqrt(3)) / 6
+#define NOISE_F3 0.33333333333f
+#define NOISE_G3 0.16666666667f
+#define NOISE_SIMPLEX2D_SCALE 99.0f
+#define NOISE_SIMPLEX3D_SCALE 32.0f
+
+void noiseInitialize(Noise* noise, const float* gradients)
+{
+    assert(noise != NULL && gradients != NULL);
+
+    for (int i = 0; i < 512; ++i)
+    {
+        noise->perm[i] = g_permutation[i & 255];
+    }
+
+    for (int h = 0; h < 256; ++h)
+    {
+        // As the sampler computes it; the texture coordinate 1 wraps to
+        // the first texel.
+        float u = (float)h / 255.0f;
+        int texel = (int)floorf(u * (float)NOISE_NUM_GRADIENTS) & (NOISE_NUM_GRADIENTS - 1);
+        noise->gradX[h] = gradients[texel * 2 + 0];
+        noise->gradY[h] = gradients[texel * 2 + 1];
+    }
+}
+
+//
+// The scalar versions
+//
+static inline float fade(float t)
+{
+    return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+// HLSL lerp(a, b, t) is a + t * (b - a).
+static inline float lerp(float a, float b, float t)
+{
+    return a + t * (b - a);
+}
+
+static inline float grad2D(const Noise* noise, int32_t h, float x, float y)
+{
+    return noise->gradX[h] * x + noise->gradY[h] * y;
+}
+
+// The improved noise gradients: the 12 edges of the cube, 4 of them twice.
+static inline float grad3D(int32_t h, float x, float y, float z)
+{
+    h &= 15;
+    float u = h < 8? x : y;
+    float v = h < 4? y : ((h == 12 || h == 14)? x : z);
+    return ((h & 1)? -u : u) + ((h & 2)? -v : v);
+}
+
+float noisePerlin2D(const Noise* noise, float x, float y)
+{
+    float fx = floorf(x);
+    float fy = floorf(y);
+    int32_t X = (int32_t)fx & 255;
+    int32_t Y = (int32_t)fy & 255;
+
+    x -= fx;
+    y -= fy;
+
+    float u = fade(x);
+    float v = fade(y);
+
+    // Hash the coordinates of the 4 corners.
+    const int32_t* perm = noise->perm;
+    int32_t A = perm[X] + Y;
+    int32_t B = perm[X + 1] + Y;
+
+    return lerp(lerp(grad2D(noise, perm[A], x, y),
+                     grad2D(noise, perm[B], x - 1.0f, y), u),
+                lerp(grad2D(noise, perm[A + 1], x, y - 1.0f),
+                     grad2D(noise, perm[B + 1], x - 1.0f, y - 1.0f), u), v);
+}
+
+float noisePerlin3D(const Noise* noise, float x, float y, float z)
+{
+    float fx = floorf(x);
+    float fy = floorf(y);
+    float fz = floorf(z);
+    int32_t X = (int32_t)fx & 255;
+    int32_t Y = (int32_t)fy & 255;
+    int32_t Z = (int32_t)fz & 255;
+
+    x -= fx;
+    y -= fy;
+    z -= fz;
+
+    float u = fade(x);
+    float v = fade(y);
+    float w = fade(z);
+
+    // Hash the coordinates of the 8 corners as perlin3D() of perlin.hlsl.
+    const int32_t* perm = noise->perm;
+    int32_t A = perm[X] + Y;
+    int32_t AA = perm[A] + Z;
+    int32_t AB = perm[A + 1] + Z;
+    int32_t B = perm[X + 1] + Y;
+    int32_t BA = perm[B] + Z;
+    int32_t BB = perm[B + 1] + Z;
+
+    return lerp(lerp(lerp(grad3D(perm[AA], x, y, z),
+                          grad3D(perm[BA], x - 1.0f, y, z), u),
+                     lerp(grad3D(perm[AB], x, y - 1.0f, z),
+                          grad3D(perm[BB], x - 1.0f, y - 1.0f, z), u), v),
+                lerp(lerp(grad3D(perm[AA + 1], x, y, z - 1.0f),
+                          grad3D(perm[BA + 1], x - 1.0f, y, z - 1.0f), u),
+                     lerp(grad3D(perm[AB + 1], x, y - 1.0f, z - 1.0f),
+                          grad3D(perm[BB + 1], x - 1.0f, y - 1.0f, z - 1.0f), u), v),
+                w);
+}
+
+// The contribution of a corner of the simplex.
+static inline float corner2D(const Noise* noise, int32_t h, float x, float y)
+{
+    float t = 0.5f - x * x - y * y;
+    if (t < 0.0f)
+    {
+        return 0.0f;
+    }
+    t = t * t;
+    return t * t * grad2D(noise, h, x, y);
+}
+
+static inline float corner3D(int32_t h, float x, float y, float z)
+{
+    float t = 0.6f - x * x - y * y - z * z;
+    if (t < 0.0f)
+    {
+        return 0.0f;
+    }
+    t = t * t;
+    return t * t * grad3D(h, x, y, z);
+}
+
+float noiseSimplex2D(const Noise* noise, float x, float y)
+{
+    // The simplex cell and the position in it.
+    float s = (x + y) * NOISE_F2;
+    float i = floorf(x + s);
+    float j = floorf(y + s);
+    float t = (i + j) * NOISE_G2;
+    float x0 = x - (i - t);
+    float y0 = y - (j - t);
+
+    int32_t i1 = x0 > y0? 1 : 0;
+    int32_t j1 = 1 - i1;
+
+    float x1 = x0 - (float)i1 + NOISE_G2;
+    float y1 = y0 - (float)j1 + NOISE_G2;
+    float x2 = x0 - 1.0f + 2.0f * NOISE_G2;
+    float y2 = y0 - 1.0f + 2.0f * NOISE_G2;
+
+    const int32_t* perm = noise->perm;
+    int32_t I = (int32_t)i & 255;
+    int32_t J = (int32_t)j & 255;
+
+    float n0 = corner2D(noise, perm[perm[I] + J], x0, y0);
+    float n1 = corner2D(noise, perm[perm[I + i1] + J + j1], x1, y1);
+    float n2 = corner2D(noise, perm[perm[I + 1] + J + 1], x2, y2);
+
+    return NOISE_SIMPLEX2D_SCALE * (n0 + n1 + n2);
+}
+
+float noiseSimplex3D(const Noise* noise, float x, float y, float z)
+{
+    float s = (x + y + z) * NOISE_F3;
+    float i = floorf(x + s);
+    float j = floorf(y + s);
+    float k = floorf(z + s);
+    float t = (i + j + k) * NOISE_G3;
+    float x0 = x - (i - t);
+    float y0 = y - (j - t);
+    float z0 = z - (k - t);
+
+    // The second and the third corners follow the order of x0, y0, z0.
+    int32_t xy = x0 >= y0? 1 : 0;
+    int32_t yz = y0 >= z0? 1 : 0;
+    int32_t xz = x0 >= z0? 1 : 0;
+    int32_t i1 = xy & xz;
+    int32_t j1 = yz & (1 - xy);
+    int32_t k1 = (1 - xz) & (1 - yz);
+    int32_t i2 = xy | xz;
+    int32_t j2 = yz | (1 - xy);
+    int32_t k2 = (1 - xz) | (1 - yz);
+
+    float x1 = x0 - (float)i1 + NOISE_G3;
+    float y1 = y0 - (float)j1 + NOISE_G3;
+    float z1 = z0 - (float)k1 + NOISE_G3;
+    float x2 = x0 - (float)i2 + 2.0f * NOISE_G3;
+    float y2 = y0 - (float)j2 + 2.0f * NOISE_G3;
+    float z2 = z0 - (float)k2 + 2.0f * NOISE_G3;
+    float x3 = x0 - 1.0f + 3.0f * NOISE_G3;
+    float y3 = y0 - 1.0f + 3.0f * NOISE_G3;
+    float z3 = z0 - 1.0f + 3.0f * NOISE_G3;
+
+    const int32_t* perm = noise->perm;
+    int32_t I = (int32_t)i & 255;
+    int32_t J = (int32_t)j & 255;
+    int32_t K = (int32_t)k & 255;
+
+    float n0 = corner3D(perm[perm[perm[I] + J] + K], x0, y0, z0);
+    float n1 = corner3D(perm[perm[perm[I + i1] + J + j1] + K + k1], x1, y1, z1);
+    float n2 = corner3D(perm[perm[perm[I + i2] + J + j2] + K + k2], x2, y2, z2);
+    float n3 = corner3D(perm[perm[perm[I + 1] + J + 1] + K + 1], x3, y3, z3);
+
+    return NOISE_SIMPLEX3D_SCALE * (n0 + n1 + n2 + n3);
+}
+
+//
+// The SSE2 versions. They repeat the scalar operations in the same order
+// so that the results are identical. SSE2 has no gather, so the table
+// lookups go through the memory; the rest is 4 points at a time.
+//
+static inline __m128 floor4(__m128 x)
+{
+    // Truncate and step down where it rounded up, i.e., x < 0.
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+}
+
+static inline __m128 fade4(__m128 t)
+{
+    __m128 t3 = _mm_mul_ps(_mm_mul_ps(t, t), t);
+    __m128 p = _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f));
+    p = _mm_add_ps(_mm_mul_ps(t, p), _mm_set1_ps(10.0f));
+    return _mm_mul_ps(t3, p);
+}
+
+static inline __m128 lerp4(__m128 a, __m128 b, __m128 t)
+{
+    return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+static inline __m128i wrap4(__m128 f)
+{
+    return _mm_and_si128(_mm_cvttps_epi32(f), _mm_set1_epi32(255));
+}
+
+static inline __m128i gather4(const int32_t* table, __m128i index)
+{
+    int32_t i[4];
+    _mm_storeu_si128((__m128i*)i, index);
+    return _mm_setr_epi32(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+}
+
+static inline __m128 grad2D4(const Noise* noise, __m128i h, __m128 x, __m128 y)
+{
+    int32_t i[4];
+    _mm_storeu_si128((__m128i*)i, h);
+    __m128 gx = _mm_setr_ps(noise->gradX[i[0]], noise->gradX[i[1]], noise->gradX[i[2]], noise->gradX[i[3]]);
+    __m128 gy = _mm_setr_ps(noise->gradY[i[0]], noise->gradY[i[1]], noise->gradY[i[2]], noise->gradY[i[3]]);
+    return _mm_add_ps(_mm_mul_ps(gx, x), _mm_mul_ps(gy, y));
+}
+
+static inline __m128 select4(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 grad3D4(__m128i h, __m128 x, __m128 y, __m128 z)
+{
+    h = _mm_and_si128(h, _mm_set1_epi32(15));
+    __m128 lt8 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(8)));
+    __m128 lt4 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+    __m128 x12 = _mm_castsi128_ps(_mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)),
+                                               _mm_cmpeq_epi32(h, _mm_set1_epi32(14))));
+    __m128 u = select4(lt8, x, y);
+    __m128 v = select4(lt4, y, select4(x12, x, z));
+
+    // Flip the signs.
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 su = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31));
+    __m128 sv = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30));
+    u = _mm_xor_ps(u, _mm_and_ps(su, sign));
+    v = _mm_xor_ps(v, _mm_and_ps(sv, sign));
+    return _mm_add_ps(u, v);
+}
+
+static void perlin2D4(const Noise* noise, const float* px, const float* py, float* out)
+{
+    __m128 x = _mm_loadu_ps(px);
+    __m128 y = _mm_loadu_ps(py);
+    __m128 fx = floor4(x);
+    __m128 fy = floor4(y);
+    __m128i X = wrap4(fx);
+    __m128i Y = wrap4(fy);
+
+    x = _mm_sub_ps(x, fx);
+    y = _mm_sub_ps(y, fy);
+
+    __m128 u = fade4(x);
+    __m128 v = fade4(y);
+
+    const int32_t* perm = noise->perm;
+    __m128i one = _mm_set1_epi32(1);
+    __m128i A = _mm_add_epi32(gather4(perm, X), Y);
+    __m128i B = _mm_add_epi32(gather4(perm, _mm_add_epi32(X, one)), Y);
+
+    __m128 x1 = _mm_sub_ps(x, _mm_set1_ps(1.0f));
+    __m128 y1 = _mm_sub_ps(y, _mm_set1_ps(1.0f));
+
+    __m128 r = lerp4(lerp4(grad2D4(noise, gather4(perm, A), x, y),
+                           grad2D4(noise, gather4(perm, B), x1, y), u),
+                     lerp4(grad2D4(noise, gather4(perm, _mm_add_epi32(A, one)), x, y1),
+                           grad2D4(noise, gather4(perm, _mm_add_epi32(B, one)), x1, y1), u), v);
+    _mm_storeu_ps(out, r);
+}
+
+static void perlin3D4(const Noise* noise, const float* px, const float* py, const float* pz, float* out)
+{
+    __m128 x = _mm_loadu_ps(px);
+    __m128 y = _mm_loadu_ps(py);
+    __m128 z = _mm_loadu_ps(pz);
+    __m128 fx = floor4(x);
+    __m128 fy = floor4(y);
+    __m128 fz = floor4(z);
+    __m128i X = wrap4(fx);
+    __m128i Y = wrap4(fy);
+    __m128i Z = wrap4(fz);
+
+    x = _mm_sub_ps(x, fx);
+    y = _mm_sub_ps(y, fy);
+    z = _mm_sub_ps(z, fz);
+
+    __m128 u = fade4(x);
+    __m128 v = fade4(y);
+    __m128 w = fade4(z);
+
+    const int32_t* perm = noise->perm;
+    __m128i one = _mm_set1_epi32(1);
+    __m128i A = _mm_add_epi32(gather4(perm, X), Y);
+    __m128i AA = _mm_add_epi32(gather4(perm, A), Z);
+    __m128i AB = _mm_add_epi32(gather4(perm, _mm_add_epi32(A, one)), Z);
+    __m128i B = _mm_add_epi32(gather4(perm, _mm_add_epi32(X, one)), Y);
+    __m128i BA = _mm_add_epi32(gather4(perm, B), Z);
+    __m128i BB = _mm_add_epi32(gather4(perm, _mm_add_epi32(B, one)), Z);
+
+    __m128 x1 = _mm_sub_ps(x, _mm_set1_ps(1.0f));
+    __m128 y1 = _mm_sub_ps(y, _mm_set1_ps(1.0f));
+    __m128 z1 = _mm_sub_ps(z, _mm_set1_ps(1.0f));
+
+    __m128 r = lerp4(lerp4(lerp4(grad3D4(gather4(perm, AA), x, y, z),
+                                 grad3D4(gather4(perm, BA), x1, y, z), u),
+                           lerp4(grad3D4(gather4(perm, AB), x, y1, z),
+                                 grad3D4(gather4(perm, BB), x1, y1, z), u), v),
+                     lerp4(lerp4(grad3D4(gather4(perm, _mm_add_epi32(AA, one)), x, y, z1),
+                                 grad3D4(gather4(perm, _mm_add_epi32(BA, one)), x1, y, z1), u),
+                           lerp4(grad3D4(gather4(perm, _mm_add_epi32(AB, one)), x, y1, z1),
+                                 grad3D4(gather4(perm, _mm_add_epi32(BB, one)), x1, y1, z1), u), v),
+                     w);
+    _mm_storeu_ps(out, r);
+}
+
+static inline __m128 falloff4(__m128 t, __m128 g)
+{
+    __m128 mask = _mm_cmpnlt_ps(t, _mm_setzero_ps());
+    t = _mm_mul_ps(t, t);
+    return _mm_and_ps(mask, _mm_mul_ps(_mm_mul_ps(t, t), g));
+}
+
+static void simplex2D4(const Noise* noise, const float* px, const float* py, float* out)
+{
+    __m128 x = _mm_loadu_ps(px);
+    __m128 y = _mm_loadu_ps(py);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 G2 = _mm_set1_ps(NOISE_G2);
+
+    __m128 s = _mm_mul_ps(_mm_add_ps(x, y), _mm_set1_ps(NOISE_F2));
+    __m128 i = floor4(_mm_add_ps(x, s));
+    __m128 j = floor4(_mm_add_ps(y, s));
+    __m128 t = _mm_mul_ps(_mm_add_ps(i, j), G2);
+    __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(i, t));
+    __m128 y0 = _mm_sub_ps(y, _mm_sub_ps(j, t));
+
+    __m128 xy = _mm_cmpgt_ps(x0, y0);
+    __m128 i1 = _mm_and_ps(xy, one);
+    __m128 j1 = _mm_andnot_ps(xy, one);
+
+    __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, i1), G2);
+    __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, j1), G2);
+    __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, one), _mm_set1_ps(2.0f * NOISE_G2));
+    __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, one), _mm_set1_ps(2.0f * NOISE_G2));
+
+    const int32_t* perm = noise->perm;
+    __m128i I = wrap4(i);
+    __m128i J = wrap4(j);
+    __m128i I1 = _mm_cvttps_epi32(i1);
+    __m128i J1 = _mm_cvttps_epi32(j1);
+    __m128i onei = _mm_set1_epi32(1);
+
+    __m128i h0 = gather4(perm, _mm_add_epi32(gather4(perm, I), J));
+    __m128i h1 = gather4(perm, _mm_add_epi32(gather4(perm, _mm_add_epi32(I, I1)), _mm_add_epi32(J, J1)));
+    __m128i h2 = gather4(perm, _mm_add_epi32(gather4(perm, _mm_add_epi32(I, onei)), _mm_add_epi32(J, onei)));
+
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 t0 = _mm_sub_ps(_mm_sub_ps(half, _mm_mul_ps(x0, x0)), _mm_mul_ps(y0, y0));
+    __m128 t1 = _mm_sub_ps(_mm_sub_ps(half, _mm_mul_ps(x1, x1)), _mm_mul_ps(y1, y1));
+    __m128 t2 = _mm_sub_ps(_mm_sub_ps(half, _mm_mul_ps(x2, x2)), _mm_mul_ps(y2, y2));
+
+    __m128 n0 = falloff4(t0, grad2D4(noise, h0, x0, y0));
+    __m128 n1 = falloff4(t1, grad2D4(noise, h1, x1, y1));
+    __m128 n2 = falloff4(t2, grad2D4(noise, h2, x2, y2));
+
+    __m128 r = _mm_mul_ps(_mm_set1_ps(NOISE_SIMPLEX2D_SCALE), _mm_add_ps(_mm_add_ps(n0, n1), n2));
+    _mm_storeu_ps(out, r);
+}
+
+static void simplex3D4(const Noise* noise, const float* px, const float* py, const float* pz, float* out)
+{
+    __m128 x = _mm_loadu_ps(px);
+    __m128 y = _mm_loadu_ps(py);
+    __m128 z = _mm_loadu_ps(pz);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 G3 = _mm_set1_ps(NOISE_G3);
+
+    __m128 s = _mm_mul_ps(_mm_add_ps(_mm_add_ps(x, y), z), _mm_set1_ps(NOISE_F3));
+    __m128 i = floor4(_mm_add_ps(x, s));
+    __m128 j = floor4(_mm_add_ps(y, s));
+    __m128 k = floor4(_mm_add_ps(z, s));
+    __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(i, j), k), G3);
+    __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(i, t));
+    __m128 y0 = _mm_sub_ps(y, _mm_sub_ps(j, t));
+    __m128 z0 = _mm_sub_ps(z, _mm_sub_ps(k, t));
+
+    __m128 xy = _mm_cmpge_ps(x0, y0);
+    __m128 yz = _mm_cmpge_ps(y0, z0);
+    __m128 xz = _mm_cmpge_ps(x0, z0);
+    __m128 i1 = _mm_and_ps(_mm_and_ps(xy, xz), one);
+    __m128 j1 = _mm_and_ps(_mm_andnot_ps(xy, yz), one);
+    __m128 k1 = _mm_andnot_ps(_mm_or_ps(xz, yz), one);
+    __m128 i2 = _mm_and_ps(_mm_or_ps(xy, xz), one);
+    __m128 j2 = _mm_andnot_ps(_mm_andnot_ps(yz, xy), one);
+    __m128 k2 = _mm_andnot_ps(_mm_and_ps(xz, yz), one);
+
+    __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, i1), G3);
+    __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, j1), G3);
+    __m128 z1 = _mm_add_ps(_mm_sub_ps(z0, k1), G3);
+    __m128 G32 = _mm_set1_ps(2.0f * NOISE_G3);
+    __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, i2), G32);
+    __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, j2), G32);
+    __m128 z2 = _mm_add_ps(_mm_sub_ps(z0, k2), G32);
+    __m128 G33 = _mm_set1_ps(3.0f * NOISE_G3);
+    __m128 x3 = _mm_add_ps(_mm_sub_ps(x0, one), G33);
+    __m128 y3 = _mm_add_ps(_mm_sub_ps(y0, one), G33);
+    __m128 z3 = _mm_add_ps(_mm_sub_ps(z0, one), G33);
+
+    const int32_t* perm = noise->perm;
+    __m128i I = wrap4(i);
+    __m128i J = wrap4(j);
+    __m128i K = wrap4(k);
+    __m128i onei = _mm_set1_epi32(1);
+
+    __m128i h0 = gather4(perm, _mm_add_epi32(gather4(perm, _mm_add_epi32(gather4(perm, I), J)), K));
+    __m128i h1 = gather4(perm, _mm_add_epi32(gather4(perm, _mm_add_epi32(gather4(perm,
+        _mm_add_epi32(I, _mm_cvttps_epi32(i1))), _mm_add_epi32(J, _mm_cvttps_epi32(j1)))),
+        _mm_add_epi32(K, _mm_cvttps_epi32(k1))));
+    __m128i h2 = gather4(perm, _mm_add_epi32(gather4(perm, _mm_add_epi32(gather4(perm,
+        _mm_add_epi32(I, _mm_cvttps_epi32(i2))), _mm_add_epi32(J, _mm_cvttps_epi32(j2)))),
+        _mm_add_epi32(K, _mm_cvttps_epi32(k2))));
+    __m128i h3 = gather4(perm, _mm_add_epi32(gather4(perm, _mm_add_epi32(gather4(perm,
+        _mm_add_epi32(I, onei)), _mm_add_epi32(J, onei))), _mm_add_epi32(K, onei)));
+
+    __m128 r0 = _mm_set1_ps(0.6f);
+    __m128 t0 = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(r0, _mm_mul_ps(x0, x0)), _mm_mul_ps(y0, y0)), _mm_mul_ps(z0, z0));
+    __m128 t1 = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(r0, _mm_mul_ps(x1, x1)), _mm_mul_ps(y1, y1)), _mm_mul_ps(z1, z1));
+    __m128 t2 = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(r0, _mm_mul_ps(x2, x2)), _mm_mul_ps(y2, y2)), _mm_mul_ps(z2, z2));
+    __m128 t3 = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(r0, _mm_mul_ps(x3, x3)), _mm_mul_ps(y3, y3)), _mm_mul_ps(z3, z3));
+
+    __m128 n0 = falloff4(t0, grad3D4(h0, x0, y0, z0));
+    __m128 n1 = falloff4(t1, grad3D4(h1, x1, y1, z1));
+    __m128 n2 = falloff4(t2, grad3D4(h2, x2, y2, z2));
+    __m128 n3 = falloff4(t3, grad3D4(h3, x3, y3, z3));
+
+    __m128 r = _mm_mul_ps(_mm_set1_ps(NOISE_SIMPLEX3D_SCALE),
+        _mm_add_ps(_mm_add_ps(_mm_add_ps(n0, n1), n2), n3));
+    _mm_storeu_ps(out, r);
+}
+
+void noisePerlin4(const Noise* noise, const float* x, const float* y, const float* z, float* out)
+{
+    if (z == NULL)
+    {
+        perlin2D4(noise, x, y, out);
+    }
+    else
+    {
+        perlin3D4(noise, x, y, z, out);
+    }
+}
+
+void noisePerlin8(const Noise* noise, const float* x, const float* y, const float* z, float* out)
+{
+    noisePerlin4(noise, x, y, z, out);
+    noisePerlin4(noise, x + 4, y + 4, z != NULL? z + 4 : NULL, out + 4);
+}
+
+void noiseSimplex4(const Noise* noise, const float* x, const float* y, const float* z, float* out)
+{
+    if (z == NULL)
+    {
+        simplex2D4(noise, x, y, out);
+    }
+    else
+    {
+        simplex3D4(noise, x, y, z, out);
+    }
+}
+
+void noiseSimplex8(const Noise* noise, const float* x, const float* y, const float* z, float* out)
+{
+    noiseSimplex4(noise, x, y, z, out);
+    noiseSimplex4(noise, x + 4, y + 4, z != NULL? z + 4 : NULL, out + 4);
+}
+
+//
+// fBm
+//
+float noiseFbm2D(const Noise* noise, const NoiseFbm* fbm, float x, float y)
+{
+    float sum = 0.0f;
+    float frequency = fbm->frequency;
+    float amplitude = fbm->amplitude;
+    for (uint32_t o = 0; o < fbm->numOctaves; ++o)
+    {
+        float n = (fbm->type == NOISE_PERLIN)?
+            noisePerlin2D(noise, x * frequency, y * frequency) :
+            noiseSimplex2D(noise, x * frequency, y * frequency);
+        sum += amplitude * n;
+        frequency *= fbm->lacunarity;
+        amplitude *= fbm->gain;
+    }
+    return sum;
+}
+
+void noiseFbm2D8(const Noise* noise, const NoiseFbm* fbm, const float* x, const float* y, float* out)
+{
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    __m128 x0 = _mm_loadu_ps(x);
+    __m128 x1 = _mm_loadu_ps(x + 4);
+    __m128 y0 = _mm_loadu_ps(y);
+    __m128 y1 = _mm_loadu_ps(y + 4);
+
+    float frequency = fbm->frequency;
+    float amplitude = fbm->amplitude;
+    for (uint32_t o = 0; o < fbm->numOctaves; ++o)
+    {
+        __m128 f = _mm_set1_ps(frequency);
+        float px[8];
+        float py[8];
+        float n[8];
+        _mm_storeu_ps(px, _mm_mul_ps(x0, f));
+        _mm_storeu_ps(px + 4, _mm_mul_ps(x1, f));
+        _mm_storeu_ps(py, _mm_mul_ps(y0, f));
+        _mm_storeu_ps(py + 4, _mm_mul_ps(y1, f));
+
+        if (fbm->type == NOISE_PERLIN)
+        {
+            noisePerlin8(noise, px, py, NULL, n);
+        }
+        else
+        {
+            noiseSimplex8(noise, px, py, NULL, n);
+        }
+
+        __m128 a = _mm_set1_ps(amplitude);
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(a, _mm_loadu_ps(n)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(a, _mm_loadu_ps(n + 4)));
+        frequency *= fbm->lacunarity;
+        amplitude *= fbm->gain;
+    }
+
+    _mm_storeu_ps(out, sum0);
+    _mm_storeu_ps(out + 4, sum1);
+}
+
+//
+// Heightfield
+//
+static void fillRow(const Noise* noise,
+                    const NoiseFbm* fbm,
+                    float x0,
+                    float y,
+                    float spacing,
+                    uint32_t width,
+                    float* out)
+{
+    float px[8];
+    float py[8];
+    float h[8];
+    for (int k = 0; k < 8; ++k)
+    {
+        py[k] = y;
+    }
+
+    for (uint32_t i = 0; i < width; i += 8)
+    {
+        uint32_t n = std::min(width - i, 8u);
+        for (uint32_t k = 0; k < 8; ++k)
+        {
+            // The tail repeats the last sample.
+            px[k] = x0 + (float)(i + std::min(k, n - 1)) * spacing;
+        }
+        noiseFbm2D8(noise, fbm, px, py, h);
+        for (uint32_t k = 0; k < n; ++k)
+        {
+            out[i + k] = h[k];
+        }
+    }
+}
+
+void noiseHeightfield(const Noise* noise,
+                      const NoiseFbm* fbm,
+                      float x0,
+                      float y0,
+                      float spacing,
+                      uint32_t width,
+                      uint32_t height,
+                      float* out,
+                      uint32_t numThreads)
+{
+    assert(noise != NULL && fbm != NULL && out != NULL);
+
+    parallelFor(height, numThreads, [&](uint32_t j)
+    {
+        fillRow(noise, fbm, x0, y0 + (float)j * spacing, spacing, width, out + (size_t)j * width);
+    });
+}
@@ -0,0 +1,89 @@
+// --------------------------------------------------------------
+// noise.h
+// Perlin and simplex noise on the CPU, with the permutation and
+// the gradients of the walking demo's shaders.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef NOISE_H
+#define NOISE_H
+
+#include <stdint.h>
+
+// The texels of the 1D gradient texture the shaders sample.
+#define NOISE_NUM_GRADIENTS 128
+
+//
+// The tables of the noise. The 2D noise takes its gradients from the
+// gradient texture: the shader samples the hash h at u = h / 255 with
+// point filtering and wrapping, i.e., the texel floor(u * 128) mod 128.
+// The 3D noise has no gradient texture and uses the 12 edges of the cube
+// as the improved noise does.
+struct Noise
+{
+    int32_t perm[512];       // Permutation[i & 255]
+    float   gradX[256];      // The 2D gradient of the hash
+    float   gradY[256];
+};
+
+// gradients are NOISE_NUM_GRADIENTS (x, y) pairs, the content of the
+// gradient texture.
+extern void noiseInitialize(Noise* noise, const float* gradients);
+
+// The scalar versions follow the shader code operation by operation, so
+// the results only differ by the rounding of the GPU. perlin2D() of
+// ground.hlsl is noisePerlin2D(); the ground shades the world position
+// (x, z) with noisePerlin2D(noise, z, x) * 0.5f + 0.5f.
+extern float noisePerlin2D(const Noise* noise, float x, float y);
+extern float noisePerlin3D(const Noise* noise, float x, float y, float z);
+// About [-1, 1].
+extern float noiseSimplex2D(const Noise* noise, float x, float y);
+extern float noiseSimplex3D(const Noise* noise, float x, float y, float z);
+
+// 4 and 8 points per call with SSE2. The results are identical to the
+// scalar versions. z may be NULL for the 2D noise.
+extern void noisePerlin4(const Noise* noise, const float* x, const float* y, const float* z, float* out);
+extern void noisePerlin8(const Noise* noise, const float* x, const float* y, const float* z, float* out);
+extern void noiseSimplex4(const Noise* noise, const float* x, const float* y, const float* z, float* out);
+extern void noiseSimplex8(const Noise* noise, const float* x, const float* y, const float* z, float* out);
+
+enum NoiseTypeEnum
+{
+    NOISE_PERLIN,
+    NOISE_SIMPLEX,
+};
+
+// The sum of octaves of the 2D noise: octave i is sampled at
+// p * frequency * lacunarity^i and weighted by amplitude * gain^i.
+struct NoiseFbm
+{
+    NoiseTypeEnum type;
+    uint32_t      numOctaves;
+    float         frequency;
+    float         amplitude;
+    float         lacunarity;
+    float         gain;
+};
+
+extern float noiseFbm2D(const Noise* noise, const NoiseFbm* fbm, float x, float y);
+extern void noiseFbm2D8(const Noise* noise, const NoiseFbm* fbm, const float* x, const float* y, float* out);
+
+// Fill width * height samples of the 2D fBm: the sample (i, j) is at
+// (x0 + i * spacing, y0 + j * spacing) and stored at out[j * width + i].
+// The rows are shared by numThreads threads with parallelFor().
+extern void noiseHeightfield(const Noise* noise,
+                             const NoiseFbm* fbm,
+                             float x0,
+                             float y0,
+                             float spacing,
+                             uint32_t width,
+                             uint32_t height,
+                             float* out,
+                             uint32_t numThreads);
+
+#endif // !NOISE_H
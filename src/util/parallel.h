@@ -0,0 +1,57 @@
+// --------------------------------------------------------------
+// parallel.h
+// Share a loop among a few threads on the CPU.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Run task(i) for every i in [0, count) on numThreads threads, the calling
+// one included; 0 means one per hardware thread. The indices are handed out
+// one at a time, which balances better than fixed bands when the threads
+// are shared with other work, so a result that only depends on i does not
+// depend on the number of threads. Return when all the tasks are done.
+template<typename Task>
+void parallelFor(uint32_t count, uint32_t numThreads, const Task& task)
+{
+    if (numThreads == 0)
+    {
+        numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    numThreads = std::min(numThreads, count);
+
+    std::atomic<uint32_t> next(0);
+    auto work = [&]()
+    {
+        uint32_t i;
+        while ((i = next++) < count)
+        {
+            task(i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t t = 1; t < numThreads; ++t)
+    {
+        threads.push_back(std::thread(work));
+    }
+    work();
+    for (size_t t = 0; t < threads.size(); ++t)
+    {
+        threads[t].join();
+    }
+}
+
+#endif // !PARALLEL_H
@@ -0,0 +1,247 @@
+// --------------------------------------------------------------
+// random.cpp
+// Small and fast random number generators with independent
+// streams, for replacing rand() and for the threads.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "random.h"
+
+#include <string.h>
+#include <emmintrin.h>
+
+static inline uint64_t splitmix64(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+uint64_t randomSplitSeed(uint64_t seed, uint64_t index)
+{
+    uint64_t state = seed;
+    uint64_t a = splitmix64(&state);
+    state = a ^ index;
+    return splitmix64(&state);
+}
+
+//
+// PCG32
+//
+void randomPCG32Seed(RandomPCG32* random, uint64_t seed, uint64_t stream)
+{
+    random->state = 0;
+    random->increment = (stream << 1) | 1;
+    randomPCG32Next(random);
+    random->state += seed;
+    randomPCG32Next(random);
+}
+
+void randomPCG32Advance(RandomPCG32* random, uint64_t delta)
+{
+    // The LCG of delta steps is again an LCG, of the multiplier and the
+    // increment built by squaring (Brown, "Random Number Generation with
+    // Arbitrary Strides").
+    uint64_t multiplier = 6364136223846793005ull;
+    uint64_t increment = random->increment;
+    uint64_t accMultiplier = 1;
+    uint64_t accIncrement = 0;
+    while (delta > 0)
+    {
+        if (delta & 1)
+        {
+            accMultiplier *= multiplier;
+            accIncrement = accIncrement * multiplier + increment;
+        }
+        increment = (multiplier + 1) * increment;
+        multiplier *= multiplier;
+        delta >>= 1;
+    }
+    random->state = accMultiplier * random->state + accIncrement;
+}
+
+//
+// xoshiro128**
+//
+void randomXoshiro128Seed(RandomXoshiro128* random, uint64_t seed)
+{
+    uint64_t state = seed;
+    uint64_t a = splitmix64(&state);
+    uint64_t b = splitmix64(&state);
+    random->s[0] = (uint32_t)a;
+    random->s[1] = (uint32_t)(a >> 32);
+    random->s[2] = (uint32_t)b;
+    random->s[3] = (uint32_t)(b >> 32);
+    // The all zero state is the only one to avoid.
+    if ((random->s[0] | random->s[1] | random->s[2] | random->s[3]) == 0)
+    {
+        random->s[0] = 1;
+    }
+}
+
+void randomXoshiro128Jump(RandomXoshiro128* random)
+{
+    static const uint32_t JUMP[4] = { 0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b };
+
+    uint32_t s[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 4; ++i)
+    {
+        for (int b = 0; b < 32; ++b)
+        {
+            if (JUMP[i] & (1u << b))
+            {
+                s[0] ^= random->s[0];
+                s[1] ^= random->s[1];
+                s[2] ^= random->s[2];
+                s[3] ^= random->s[3];
+            }
+            randomXoshiro128Next(random);
+        }
+    }
+    memcpy(random->s, s, sizeof(s));
+}
+
+//
+// Batches
+//
+void randomBatchSeed(RandomBatch* random, uint64_t seed)
+{
+    RandomXoshiro128 lane;
+    randomXoshiro128Seed(&lane, seed);
+    for (int k = 0; k < 4; ++k)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            random->s[i][k] = lane.s[i];
+        }
+        randomXoshiro128Jump(&lane);
+    }
+}
+
+// The next number of the four lanes.
+static inline __m128i nextBatch(__m128i* s)
+{
+    __m128i r = _mm_add_epi32(_mm_slli_epi32(s[1], 2), s[1]);                 // * 5
+    r = _mm_or_si128(_mm_slli_epi32(r, 7), _mm_srli_epi32(r, 25));
+    __m128i result = _mm_add_epi32(_mm_slli_epi32(r, 3), r);                  // * 9
+    __m128i t = _mm_slli_epi32(s[1], 9);
+    s[2] = _mm_xor_si128(s[2], s[0]);
+    s[3] = _mm_xor_si128(s[3], s[1]);
+    s[1] = _mm_xor_si128(s[1], s[2]);
+    s[0] = _mm_xor_si128(s[0], s[3]);
+    s[2] = _mm_xor_si128(s[2], t);
+    s[3] = _mm_or_si128(_mm_slli_epi32(s[3], 11), _mm_srli_epi32(s[3], 21));
+    return result;
+}
+
+static inline __m128 toFloats(__m128i x)
+{
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(x, 8)), _mm_set1_ps(1.0f / 16777216.0f));
+}
+
+static inline void loadBatch(const RandomBatch* random, __m128i* s)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        s[i] = _mm_loadu_si128((const __m128i*)random->s[i]);
+    }
+}
+
+static inline void storeBatch(RandomBatch* random, const __m128i* s)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        _mm_storeu_si128((__m128i*)random->s[i], s[i]);
+    }
+}
+
+void randomBatchFloats(RandomBatch* random, float* out, uint32_t n)
+{
+    __m128i s[4];
+    loadBatch(random, s);
+
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(out + i, toFloats(nextBatch(s)));
+    }
+    if (i < n)
+    {
+        float tail[4];
+        _mm_storeu_ps(tail, toFloats(nextBatch(s)));
+        memcpy(out + i, tail, sizeof(float) * (n - i));
+    }
+
+    storeBatch(random, s);
+}
+
+// sin and cos of h in [-pi / 2, pi / 2], Taylor to h^11 and h^12. The
+// errors are below 1e-7.
+static inline void sinCos(__m128 h, __m128* s, __m128* c)
+{
+    __m128 h2 = _mm_mul_ps(h, h);
+
+    __m128 ps = _mm_set1_ps(-1.0f / 39916800.0f);
+    ps = _mm_add_ps(_mm_mul_ps(ps, h2), _mm_set1_ps(1.0f / 362880.0f));
+    ps = _mm_add_ps(_mm_mul_ps(ps, h2), _mm_set1_ps(-1.0f / 5040.0f));
+    ps = _mm_add_ps(_mm_mul_ps(ps, h2), _mm_set1_ps(1.0f / 120.0f));
+    ps = _mm_add_ps(_mm_mul_ps(ps, h2), _mm_set1_ps(-1.0f / 6.0f));
+    ps = _mm_add_ps(_mm_mul_ps(ps, h2), _mm_set1_ps(1.0f));
+    *s = _mm_mul_ps(ps, h);
+
+    __m128 pc = _mm_set1_ps(1.0f / 479001600.0f);
+    pc = _mm_add_ps(_mm_mul_ps(pc, h2), _mm_set1_ps(-1.0f / 3628800.0f));
+    pc = _mm_add_ps(_mm_mul_ps(pc, h2), _mm_set1_ps(1.0f / 40320.0f));
+    pc = _mm_add_ps(_mm_mul_ps(pc, h2), _mm_set1_ps(-1.0f / 720.0f));
+    pc = _mm_add_ps(_mm_mul_ps(pc, h2), _mm_set1_ps(1.0f / 24.0f));
+    pc = _mm_add_ps(_mm_mul_ps(pc, h2), _mm_set1_ps(-0.5f));
+    *c = _mm_add_ps(_mm_mul_ps(pc, h2), _mm_set1_ps(1.0f));
+}
+
+void randomBatchUnitVectors(RandomBatch* random, float* out, uint32_t n)
+{
+    const float PI = 3.14159265358979f;
+
+    __m128i s[4];
+    loadBatch(random, s);
+
+    for (uint32_t i = 0; i < n; i += 4)
+    {
+        __m128 u = toFloats(nextBatch(s));
+        __m128 v = toFloats(nextBatch(s));
+
+        __m128 y = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_add_ps(u, u));
+        __m128 l = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(y, y)), _mm_setzero_ps()));
+
+        // phi = 2 pi v = a + pi with a = 2 pi (v - 1/2) in [-pi, pi), from
+        // the half angle h = a / 2 in [-pi / 2, pi / 2).
+        __m128 h = _mm_mul_ps(_mm_sub_ps(v, _mm_set1_ps(0.5f)), _mm_set1_ps(PI));
+        __m128 sh;
+        __m128 ch;
+        sinCos(h, &sh, &ch);
+        // sin(phi) = -sin(a) = -2 sin(h) cos(h), cos(phi) = -cos(a) = sin(h)^2 - cos(h)^2.
+        __m128 sinPhi = _mm_mul_ps(_mm_set1_ps(-2.0f), _mm_mul_ps(sh, ch));
+        __m128 cosPhi = _mm_sub_ps(_mm_mul_ps(sh, sh), _mm_mul_ps(ch, ch));
+
+        float x4[4];
+        float y4[4];
+        float z4[4];
+        _mm_storeu_ps(x4, _mm_mul_ps(l, sinPhi));
+        _mm_storeu_ps(y4, y);
+        _mm_storeu_ps(z4, _mm_mul_ps(l, cosPhi));
+        for (uint32_t k = 0; k < 4 && i + k < n; ++k)
+        {
+            out[(i + k) * 3 + 0] = x4[k];
+            out[(i + k) * 3 + 1] = y4[k];
+            out[(i + k) * 3 + 2] = z4[k];
+        }
+    }
+
+    storeBatch(random, s);
+}
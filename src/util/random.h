@@ -0,0 +1,135 @@
+// --------------------------------------------------------------
+// random.h
+// Small and fast random number generators with independent
+// streams, for replacing rand() and for the threads.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+//
+// The generators have no global state, so each thread or each item of work
+// owns one. For results that do not depend on the number of threads, seed
+// the generator of an item of work, e.g., a row or a tile, from the item
+// and not from the thread that happens to run it:
+//
+//   RandomPCG32 random;
+//   randomPCG32Seed(&random, seed, row);
+//
+// Every generator gives the same numbers on every platform for the same
+// seed, unlike rand().
+//
+
+// The seed of the independent stream index of a seed, splitmix64 of both.
+extern uint64_t randomSplitSeed(uint64_t seed, uint64_t index);
+
+//
+// PCG32 (O'Neill, PCG-XSH-RR): a 64-bit LCG with a permuted 32-bit output.
+// Each stream has its own increment, so the streams of one seed never
+// overlap.
+//
+struct RandomPCG32
+{
+    uint64_t state;
+    uint64_t increment;      // Odd
+};
+
+extern void randomPCG32Seed(RandomPCG32* random, uint64_t seed, uint64_t stream);
+// Skip delta numbers in O(log delta), e.g., to the part of a sequence a
+// thread generates.
+extern void randomPCG32Advance(RandomPCG32* random, uint64_t delta);
+
+inline uint32_t randomPCG32Next(RandomPCG32* random)
+{
+    uint64_t old = random->state;
+    random->state = old * 6364136223846793005ull + random->increment;
+    uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+    uint32_t rot = (uint32_t)(old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+// [0, 1), the 24 high bits.
+inline float randomPCG32Float(RandomPCG32* random)
+{
+    return (float)(randomPCG32Next(random) >> 8) * (1.0f / 16777216.0f);
+}
+
+// [0, bound) without the bias of the modulo (Lemire).
+inline uint32_t randomPCG32Bounded(RandomPCG32* random, uint32_t bound)
+{
+    uint64_t m = (uint64_t)randomPCG32Next(random) * bound;
+    uint32_t low = (uint32_t)m;
+    if (low < bound)
+    {
+        uint32_t threshold = (0u - bound) % bound;
+        while (low < threshold)
+        {
+            m = (uint64_t)randomPCG32Next(random) * bound;
+            low = (uint32_t)m;
+        }
+    }
+    return (uint32_t)(m >> 32);
+}
+
+//
+// xoshiro128** (Blackman and Vigna), 128 bits of state and only 32-bit
+// operations. randomXoshiro128Jump() skips 2^64 numbers, so the streams
+// made by jumping one generator k times do not overlap.
+//
+struct RandomXoshiro128
+{
+    uint32_t s[4];
+};
+
+extern void randomXoshiro128Seed(RandomXoshiro128* random, uint64_t seed);
+extern void randomXoshiro128Jump(RandomXoshiro128* random);
+
+inline uint32_t randomXoshiro128Next(RandomXoshiro128* random)
+{
+    uint32_t* s = random->s;
+    uint32_t r = s[1] * 5;
+    uint32_t result = ((r << 7) | (r >> 25)) * 9;
+    uint32_t t = s[1] << 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 11) | (s[3] >> 21);
+    return result;
+}
+
+inline float randomXoshiro128Float(RandomXoshiro128* random)
+{
+    return (float)(randomXoshiro128Next(random) >> 8) * (1.0f / 16777216.0f);
+}
+
+//
+// Four xoshiro128** generators in the lanes of SSE2 registers for the
+// batches. Lane k is the generator of the seed jumped k times. A call
+// takes ceil(n / 4) steps of the lanes, whatever the alignment of n.
+//
+struct RandomBatch
+{
+    uint32_t s[4][4];        // s[i][lane]
+};
+
+extern void randomBatchSeed(RandomBatch* random, uint64_t seed);
+
+// n floats in [0, 1).
+extern void randomBatchFloats(RandomBatch* random, float* out, uint32_t n);
+
+// n unit vectors uniform on the sphere as interleaved x, y, z: y is
+// uniform in [-1, 1) and the azimuth goes from z to x, as the sphere
+// samplers map the square.
+extern void randomBatchUnitVectors(RandomBatch* random, float* out, uint32_t n);
+
+#endif // !RANDOM_H
@@ -0,0 +1,973 @@
+// --------------------------------------------------------------
+// raytrace.cpp
+// Wide BVHs collapsed from the binary BVH and their SIMD ray
+// traversal kernels.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "raytrace.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <limits>
+#include <emmintrin.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+// The far distances of the boxes are scaled by at least 1 + 2 gamma(3),
+// gamma(n) = n eps / (1 - n eps), which covers the rounding of the slab
+// test (Ize).
+#define RAYTRACE_ROBUST_FAR (1.0f + 4.0f * FLT_EPSILON)
+
+// The cosine of the largest angle between the rays of a coherent packet.
+#define RAYTRACE_PACKET_SPREAD 0.98f
+
+//
+// Collapse
+//
+static float nodeArea(const BvhNode& node)
+{
+    float dx = node.upper[0] - node.lower[0];
+    float dy = node.upper[1] - node.lower[1];
+    float dz = node.upper[2] - node.lower[2];
+    return dx * dy + dy * dz + dz * dx;
+}
+
+// The blocks of the triangles of the binary leaf, and its child reference.
+template<int N>
+static uint32_t collapseLeaf(RaytraceBvh<N>* wide, const Bvh* bvh, const BvhNode& leaf)
+{
+    uint32_t first = (uint32_t)wide->blocks.size();
+    uint32_t numBlocks = (leaf.count + 3) / 4;
+    assert(numBlocks > 0 && numBlocks <= RAYTRACE_MAX_LEAF_BLOCKS);
+    assert(first + numBlocks < (1u << RAYTRACE_LEAF_SHIFT));
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    for (uint32_t b = 0; b < numBlocks; ++b)
+    {
+        RaytraceTriangleBlock block;
+        for (uint32_t j = 0; j < 4; ++j)
+        {
+            uint32_t i = b * 4 + j;
+            for (int c = 0; c < 3; ++c)
+            {
+                for (int a = 0; a < 3; ++a)
+                {
+                    block.corners[c][a][j] = i < leaf.count? bvh->vertices[(leaf.offset + i) * 9 + c * 3 + a] : nan;
+                }
+            }
+            block.triangles[j] = i < leaf.count? bvh->triangles[leaf.offset + i] : UINT32_MAX;
+        }
+        wide->blocks.push_back(block);
+    }
+
+    return RAYTRACE_LEAF | ((numBlocks - 1) << RAYTRACE_LEAF_SHIFT) | first;
+}
+
+template<int N>
+static void collapse(RaytraceBvh<N>* wide, const Bvh* bvh)
+{
+    assert(wide != NULL && bvh != NULL);
+
+    wide->nodes.clear();
+    wide->blocks.clear();
+    if (bvh->triangles.empty())
+    {
+        return;
+    }
+
+    struct Item
+    {
+        uint32_t binary;
+        uint32_t node;
+    };
+    std::vector<Item> stack;
+    Item root = { 0, 0 };
+    stack.push_back(root);
+    wide->nodes.resize(1);
+    while (!stack.empty())
+    {
+        Item item = stack.back();
+        stack.pop_back();
+
+        // Open the inner child of the largest area until the node is full.
+        // A root that is a leaf becomes the only child.
+        uint32_t children[N];
+        int numChildren;
+        const BvhNode& binary = bvh->nodes[item.binary];
+        if (binary.count > 0)
+        {
+            children[0] = item.binary;
+            numChildren = 1;
+        }
+        else
+        {
+            children[0] = binary.offset;
+            children[1] = binary.offset + 1;
+            numChildren = 2;
+        }
+        while (numChildren < N)
+        {
+            int best = -1;
+            float bestArea = -1.0f;
+            for (int k = 0; k < numChildren; ++k)
+            {
+                const BvhNode& child = bvh->nodes[children[k]];
+                if (child.count == 0 && nodeArea(child) > bestArea)
+                {
+                    best = k;
+                    bestArea = nodeArea(child);
+                }
+            }
+            if (best < 0)
+            {
+                break;
+            }
+            uint32_t first = bvh->nodes[children[best]].offset;
+            children[best] = first;
+            children[numChildren++] = first + 1;
+        }
+
+        RaytraceNode<N> node;
+        for (int k = 0; k < N; ++k)
+        {
+            if (k >= numChildren)
+            {
+                for (int a = 0; a < 3; ++a)
+                {
+                    node.bounds[a][k] = FLT_MAX;
+                    node.bounds[a + 3][k] = -FLT_MAX;
+                }
+                node.children[k] = RAYTRACE_EMPTY;
+                continue;
+            }
+
+            const BvhNode& child = bvh->nodes[children[k]];
+            for (int a = 0; a < 3; ++a)
+            {
+                node.bounds[a][k] = child.lower[a];
+                node.bounds[a + 3][k] = child.upper[a];
+            }
+            if (child.count > 0)
+            {
+                node.children[k] = collapseLeaf(wide, bvh, child);
+            }
+            else
+            {
+                Item next = { children[k], (uint32_t)wide->nodes.size() };
+                wide->nodes.resize(wide->nodes.size() + 1);
+                stack.push_back(next);
+                node.children[k] = next.node;
+            }
+        }
+        wide->nodes[item.node] = node;
+    }
+}
+
+void raytraceCollapse4(RaytraceBvh4* wide, const Bvh* bvh)
+{
+    collapse(wide, bvh);
+}
+
+void raytraceCollapse8(RaytraceBvh8* wide, const Bvh* bvh)
+{
+    collapse(wide, bvh);
+}
+
+//
+// Triangles
+//
+
+// Redo the edge functions that are exactly 0 in double, where the products
+// of floats are exact, so that the edge shared by two triangles gets the
+// same sign in both (Woop et al., section 3.4). It is rare.
+static inline void fixEdges(__m128* u, __m128* v, __m128* w,
+                            __m128 ax, __m128 ay, __m128 bx, __m128 by, __m128 cx, __m128 cy)
+{
+    __m128 zero = _mm_setzero_ps();
+    __m128 onEdge = _mm_or_ps(_mm_or_ps(_mm_cmpeq_ps(*u, zero), _mm_cmpeq_ps(*v, zero)), _mm_cmpeq_ps(*w, zero));
+    int mask = _mm_movemask_ps(onEdge);
+    if (mask == 0)
+    {
+        return;
+    }
+
+    float x[6][4];
+    float e[3][4];
+    _mm_storeu_ps(x[0], ax);
+    _mm_storeu_ps(x[1], ay);
+    _mm_storeu_ps(x[2], bx);
+    _mm_storeu_ps(x[3], by);
+    _mm_storeu_ps(x[4], cx);
+    _mm_storeu_ps(x[5], cy);
+    _mm_storeu_ps(e[0], *u);
+    _mm_storeu_ps(e[1], *v);
+    _mm_storeu_ps(e[2], *w);
+    for (int k = 0; k < 4; ++k)
+    {
+        if (mask & (1 << k))
+        {
+            e[0][k] = (float)((double)x[4][k] * (double)x[3][k] - (double)x[5][k] * (double)x[2][k]);
+            e[1][k] = (float)((double)x[0][k] * (double)x[5][k] - (double)x[1][k] * (double)x[4][k]);
+            e[2][k] = (float)((double)x[2][k] * (double)x[1][k] - (double)x[3][k] * (double)x[0][k]);
+        }
+    }
+    *u = _mm_loadu_ps(e[0]);
+    *v = _mm_loadu_ps(e[1]);
+    *w = _mm_loadu_ps(e[2]);
+}
+
+// The watertight test of 4 triangles and rays, with the corners relative
+// to the origins and sheared so that the rays go along +z: x and y are the
+// sheared ones, z is scaled by sz. Return the mask of the hits in
+// (tmin, tmax) and their distances and barycentrics. The NaN corners of
+// the unused triangles fail every comparison.
+static inline __m128 intersectTriangles(__m128 ax, __m128 ay, __m128 az,
+                                        __m128 bx, __m128 by, __m128 bz,
+                                        __m128 cx, __m128 cy, __m128 cz,
+                                        __m128 tmin, __m128 tmax,
+                                        __m128* t, __m128* u, __m128* v)
+{
+    __m128 e0 = _mm_sub_ps(_mm_mul_ps(cx, by), _mm_mul_ps(cy, bx));
+    __m128 e1 = _mm_sub_ps(_mm_mul_ps(ax, cy), _mm_mul_ps(ay, cx));
+    __m128 e2 = _mm_sub_ps(_mm_mul_ps(bx, ay), _mm_mul_ps(by, ax));
+    fixEdges(&e0, &e1, &e2, ax, ay, bx, by, cx, cy);
+
+    // Inside if the signs agree, 0 counting as either.
+    __m128 zero = _mm_setzero_ps();
+    __m128 negative = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(e0, zero), _mm_cmplt_ps(e1, zero)), _mm_cmplt_ps(e2, zero));
+    __m128 positive = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(e0, zero), _mm_cmpgt_ps(e1, zero)), _mm_cmpgt_ps(e2, zero));
+
+    // The distance scaled by the determinant, compared without dividing.
+    __m128 det = _mm_add_ps(_mm_add_ps(e0, e1), e2);
+    __m128 scaled = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e0, az), _mm_mul_ps(e1, bz)), _mm_mul_ps(e2, cz));
+    __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 signedT = _mm_xor_ps(scaled, _mm_and_ps(det, signMask));
+    __m128 absDet = _mm_andnot_ps(signMask, det);
+    __m128 valid = _mm_and_ps(_mm_cmpgt_ps(signedT, _mm_mul_ps(tmin, absDet)),
+                              _mm_cmplt_ps(signedT, _mm_mul_ps(tmax, absDet)));
+    valid = _mm_and_ps(valid, _mm_cmpneq_ps(det, zero));
+    valid = _mm_andnot_ps(_mm_and_ps(negative, positive), valid);
+
+    __m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), det);
+    *t = _mm_mul_ps(scaled, inverse);
+    *u = _mm_mul_ps(e1, inverse);
+    *v = _mm_mul_ps(e2, inverse);
+    return valid;
+}
+
+//
+// Single rays
+//
+struct RaytraceRay
+{
+    float origin[3];
+    float inverse[3];
+    int   nearPlanes[3];     // The rows of the bounds of the near and the far planes
+    int   farPlanes[3];
+    int   kx;                // The axes of the shear, kz of the largest component
+    int   ky;
+    int   kz;
+    float sx;
+    float sy;
+    float sz;
+    float tmin;
+};
+
+static void setupRay(const BvhRay* ray, RaytraceRay* r)
+{
+    const float* d = ray->direction;
+    for (int a = 0; a < 3; ++a)
+    {
+        r->origin[a] = ray->origin[a];
+        // No infinities, which make NaNs on the planes through the origin.
+        float da = fabsf(d[a]) < 1e-18f? (d[a] >= 0.0f? 1e-18f : -1e-18f) : d[a];
+        r->inverse[a] = 1.0f / da;
+        r->nearPlanes[a] = d[a] >= 0.0f? a : a + 3;
+        r->farPlanes[a] = d[a] >= 0.0f? a + 3 : a;
+    }
+
+    r->kz = 0;
+    if (fabsf(d[1]) > fabsf(d[r->kz]))
+    {
+        r->kz = 1;
+    }
+    if (fabsf(d[2]) > fabsf(d[r->kz]))
+    {
+        r->kz = 2;
+    }
+    assert(d[r->kz] != 0.0f);
+    r->kx = (r->kz + 1) % 3;
+    r->ky = (r->kx + 1) % 3;
+    // Keep the winding, so that the signs of the edges mean the same.
+    if (d[r->kz] < 0.0f)
+    {
+        std::swap(r->kx, r->ky);
+    }
+    r->sx = d[r->kx] / d[r->kz];
+    r->sy = d[r->ky] / d[r->kz];
+    r->sz = 1.0f / d[r->kz];
+    r->tmin = ray->tmin;
+}
+
+// The 4 children [first, first + 4) of the node, their distances into
+// distances and the mask of the hits shifted to first.
+template<int N>
+static inline uint32_t intersectBoxes4(const RaytraceNode<N>& node, int first, const RaytraceRay& r, float tmax, float* distances)
+{
+    __m128 t0[3];
+    __m128 t1[3];
+    for (int a = 0; a < 3; ++a)
+    {
+        __m128 origin = _mm_set1_ps(r.origin[a]);
+        __m128 inverse = _mm_set1_ps(r.inverse[a]);
+        t0[a] = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.bounds[r.nearPlanes[a]][first]), origin), inverse);
+        t1[a] = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.bounds[r.farPlanes[a]][first]), origin), inverse);
+    }
+    __m128 tnear = _mm_max_ps(_mm_max_ps(t0[0], t0[1]), _mm_max_ps(t0[2], _mm_set1_ps(r.tmin)));
+    __m128 tfar = _mm_mul_ps(_mm_min_ps(_mm_min_ps(t1[0], t1[1]), t1[2]), _mm_set1_ps(RAYTRACE_ROBUST_FAR));
+    tfar = _mm_min_ps(tfar, _mm_set1_ps(tmax));
+    _mm_storeu_ps(distances + first, tnear);
+    return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(tnear, tfar)) << first;
+}
+
+static inline uint32_t intersectChildren(const RaytraceNode<4>& node, const RaytraceRay& r, float tmax, float* distances)
+{
+    return intersectBoxes4(node, 0, r, tmax, distances);
+}
+
+static inline uint32_t intersectChildren(const RaytraceNode<8>& node, const RaytraceRay& r, float tmax, float* distances)
+{
+#if defined(__AVX__)
+    __m256 t0[3];
+    __m256 t1[3];
+    for (int a = 0; a < 3; ++a)
+    {
+        __m256 origin = _mm256_set1_ps(r.origin[a]);
+        __m256 inverse = _mm256_set1_ps(r.inverse[a]);
+        t0[a] = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.bounds[r.nearPlanes[a]]), origin), inverse);
+        t1[a] = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.bounds[r.farPlanes[a]]), origin), inverse);
+    }
+    __m256 tnear = _mm256_max_ps(_mm256_max_ps(t0[0], t0[1]), _mm256_max_ps(t0[2], _mm256_set1_ps(r.tmin)));
+    __m256 tfar = _mm256_mul_ps(_mm256_min_ps(_mm256_min_ps(t1[0], t1[1]), t1[2]), _mm256_set1_ps(RAYTRACE_ROBUST_FAR));
+    tfar = _mm256_min_ps(tfar, _mm256_set1_ps(tmax));
+    _mm256_storeu_ps(distances, tnear);
+    return (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(tnear, tfar, _CMP_LE_OQ));
+#else
+    return intersectBoxes4(node, 0, r, tmax, distances) | intersectBoxes4(node, 4, r, tmax, distances);
+#endif
+}
+
+// The triangles of the block against the ray: the mask of the hits in
+// (tmin, tmax), and their distances and barycentrics.
+static inline uint32_t intersectBlock(const RaytraceTriangleBlock& block, const RaytraceRay& r, float tmax,
+                                      float* t, float* u, float* v)
+{
+    __m128 ox = _mm_set1_ps(r.origin[r.kx]);
+    __m128 oy = _mm_set1_ps(r.origin[r.ky]);
+    __m128 oz = _mm_set1_ps(r.origin[r.kz]);
+    __m128 sx = _mm_set1_ps(r.sx);
+    __m128 sy = _mm_set1_ps(r.sy);
+    __m128 sz = _mm_set1_ps(r.sz);
+
+    __m128 x[3];
+    __m128 y[3];
+    __m128 z[3];
+    for (int c = 0; c < 3; ++c)
+    {
+        __m128 cz = _mm_sub_ps(_mm_loadu_ps(block.corners[c][r.kz]), oz);
+        x[c] = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(block.corners[c][r.kx]), ox), _mm_mul_ps(sx, cz));
+        y[c] = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(block.corners[c][r.ky]), oy), _mm_mul_ps(sy, cz));
+        z[c] = _mm_mul_ps(sz, cz);
+    }
+
+    __m128 t4;
+    __m128 u4;
+    __m128 v4;
+    __m128 valid = intersectTriangles(x[0], y[0], z[0], x[1], y[1], z[1], x[2], y[2], z[2],
+        _mm_set1_ps(r.tmin), _mm_set1_ps(tmax), &t4, &u4, &v4);
+    _mm_storeu_ps(t, t4);
+    _mm_storeu_ps(u, u4);
+    _mm_storeu_ps(v, v4);
+    return (uint32_t)_mm_movemask_ps(valid);
+}
+
+struct RaytraceStackItem
+{
+    uint32_t child;
+    float    t;              // Where the rays enter it
+};
+
+// Push the children of the mask but the nearest, the farthest first, and
+// return the nearest one.
+template<int N>
+static inline uint32_t pushOrdered(RaytraceStackItem* stack,
+                                   uint32_t* stackSize,
+                                   const RaytraceNode<N>& node,
+                                   const float* distances,
+                                   uint32_t mask)
+{
+    RaytraceStackItem hits[N];
+    int numHits = 0;
+    for (int k = 0; k < N; ++k)
+    {
+        if (mask & (1u << k))
+        {
+            // Insert in the order of decreasing distance.
+            int i = numHits++;
+            while (i > 0 && hits[i - 1].t < distances[k])
+            {
+                hits[i] = hits[i - 1];
+                i--;
+            }
+            hits[i].child = node.children[k];
+            hits[i].t = distances[k];
+        }
+    }
+    assert(*stackSize + numHits - 1 <= RAYTRACE_STACK_SIZE);
+    for (int i = 0; i < numHits - 1; ++i)
+    {
+        stack[(*stackSize)++] = hits[i];
+    }
+    return hits[numHits - 1].child;
+}
+
+// Push the children of the mask but the first, and return the first one.
+template<int N>
+static inline uint32_t pushAll(RaytraceStackItem* stack,
+                               uint32_t* stackSize,
+                               const RaytraceNode<N>& node,
+                               const float* distances,
+                               uint32_t mask)
+{
+    uint32_t first = RAYTRACE_EMPTY;
+    for (int k = 0; k < N; ++k)
+    {
+        if (mask & (1u << k))
+        {
+            if (first == RAYTRACE_EMPTY)
+            {
+                first = node.children[k];
+                continue;
+            }
+            assert(*stackSize < RAYTRACE_STACK_SIZE);
+            stack[*stackSize].child = node.children[k];
+            stack[*stackSize].t = distances[k];
+            (*stackSize)++;
+        }
+    }
+    return first;
+}
+
+template<int N, bool OCCLUSION>
+static bool traverse(const RaytraceBvh<N>* bvh, const BvhRay* ray, BvhHit* hit)
+{
+    assert(bvh != NULL && ray != NULL);
+
+    if (bvh->nodes.empty())
+    {
+        return false;
+    }
+
+    RaytraceRay r;
+    setupRay(ray, &r);
+    float tmax = ray->tmax;
+    bool found = false;
+
+    RaytraceStackItem stack[RAYTRACE_STACK_SIZE];
+    uint32_t stackSize = 1;
+    stack[0].child = 0;
+    stack[0].t = ray->tmin;
+    while (stackSize > 0)
+    {
+        RaytraceStackItem item = stack[--stackSize];
+        // Behind the closest hit so far.
+        if (item.t > tmax)
+        {
+            continue;
+        }
+
+        uint32_t child = item.child;
+        while ((child & RAYTRACE_LEAF) == 0)
+        {
+            const RaytraceNode<N>& node = bvh->nodes[child];
+            float distances[N];
+            uint32_t mask = intersectChildren(node, r, tmax, distances);
+            if (mask == 0)
+            {
+                child = RAYTRACE_EMPTY;
+                break;
+            }
+            child = OCCLUSION? pushAll(stack, &stackSize, node, distances, mask) :
+                               pushOrdered(stack, &stackSize, node, distances, mask);
+        }
+        if (child == RAYTRACE_EMPTY)
+        {
+            continue;
+        }
+
+        uint32_t first = child & ((1u << RAYTRACE_LEAF_SHIFT) - 1);
+        uint32_t numBlocks = ((child & ~RAYTRACE_LEAF) >> RAYTRACE_LEAF_SHIFT) + 1;
+        for (uint32_t b = first; b < first + numBlocks; ++b)
+        {
+            const RaytraceTriangleBlock& block = bvh->blocks[b];
+            float t[4];
+            float u[4];
+            float v[4];
+            uint32_t mask = intersectBlock(block, r, tmax, t, u, v);
+            if (mask == 0)
+            {
+                continue;
+            }
+            if (OCCLUSION)
+            {
+                return true;
+            }
+            for (int k = 0; k < 4; ++k)
+            {
+                if ((mask & (1u << k)) && t[k] < tmax)
+                {
+                    tmax = t[k];
+                    hit->t = t[k];
+                    hit->u = u[k];
+                    hit->v = v[k];
+                    hit->triangle = block.triangles[k];
+                    found = true;
+                }
+            }
+        }
+    }
+
+    return found;
+}
+
+bool raytraceIntersect4(const RaytraceBvh4* bvh, const BvhRay* ray, BvhHit* hit)
+{
+    assert(hit != NULL);
+    return traverse<4, false>(bvh, ray, hit);
+}
+
+bool raytraceIntersect8(const RaytraceBvh8* bvh, const BvhRay* ray, BvhHit* hit)
+{
+    assert(hit != NULL);
+    return traverse<8, false>(bvh, ray, hit);
+}
+
+bool raytraceOccluded4(const RaytraceBvh4* bvh, const BvhRay* ray)
+{
+    return traverse<4, true>(bvh, ray, NULL);
+}
+
+bool raytraceOccluded8(const RaytraceBvh8* bvh, const BvhRay* ray)
+{
+    return traverse<8, true>(bvh, ray, NULL);
+}
+
+//
+// Packets
+//
+struct RaytracePacket
+{
+    __m128 origin[3];
+    __m128 inverse[3];
+    __m128 tmin;
+    // The shear of every ray; the masks of the lanes whose axis is 0 and 1.
+    __m128 kx[2];
+    __m128 ky[2];
+    __m128 kz[2];
+    __m128 sx;
+    __m128 sy;
+    __m128 sz;
+    // The coherent rays share the origin and the planes of the boxes, so
+    // that the packet is tested against all the children at once with the
+    // intervals of the inverse directions.
+    float  center[3];        // The origin
+    float  inverseMin[3];
+    float  inverseMax[3];
+    int    nearPlanes[3];
+    int    farPlanes[3];
+    float  tminMin;
+};
+
+// The component of v of the axis of the masks in every lane.
+static inline __m128 selectAxis(const __m128* v, const __m128* k)
+{
+    return _mm_or_ps(_mm_or_ps(_mm_and_ps(k[0], v[0]), _mm_and_ps(k[1], v[1])),
+                     _mm_andnot_ps(_mm_or_ps(k[0], k[1]), v[2]));
+}
+
+static inline __m128 axisMask(const int* axes, int axis)
+{
+    return _mm_castsi128_ps(_mm_setr_epi32(axes[0] == axis? -1 : 0, axes[1] == axis? -1 : 0,
+                                           axes[2] == axis? -1 : 0, axes[3] == axis? -1 : 0));
+}
+
+// The packet, and the tmax of every ray in tmax, -FLT_MAX for the
+// inactive ones. Return the mask of the active rays.
+static uint32_t setupPacket(const BvhRay* rays, RaytracePacket* packet, float* tmax)
+{
+    float origin[3][4];
+    float inverse[3][4];
+    float tmin[4];
+    float s[3][4];
+    int k[3][4];
+    uint32_t active = 0;
+    packet->tminMin = FLT_MAX;
+    for (int i = 0; i < 4; ++i)
+    {
+        // The inactive rays may have no direction.
+        BvhRay ray = rays[i];
+        if (!(ray.tmin < ray.tmax))
+        {
+            ray.direction[0] = ray.direction[1] = 0.0f;
+            ray.direction[2] = 1.0f;
+        }
+        RaytraceRay r;
+        setupRay(&ray, &r);
+        for (int a = 0; a < 3; ++a)
+        {
+            origin[a][i] = r.origin[a];
+            inverse[a][i] = r.inverse[a];
+        }
+        k[0][i] = r.kx;
+        k[1][i] = r.ky;
+        k[2][i] = r.kz;
+        s[0][i] = r.sx;
+        s[1][i] = r.sy;
+        s[2][i] = r.sz;
+        tmin[i] = r.tmin;
+        if (ray.tmin < ray.tmax)
+        {
+            tmax[i] = ray.tmax;
+            active |= 1u << i;
+        }
+        else
+        {
+            tmax[i] = -FLT_MAX;
+            continue;
+        }
+
+        packet->tminMin = std::min(packet->tminMin, r.tmin);
+        for (int a = 0; a < 3; ++a)
+        {
+            if (active == (1u << i))
+            {
+                packet->center[a] = r.origin[a];
+                packet->inverseMin[a] = packet->inverseMax[a] = r.inverse[a];
+                packet->nearPlanes[a] = r.nearPlanes[a];
+                packet->farPlanes[a] = r.farPlanes[a];
+                continue;
+            }
+            packet->inverseMin[a] = std::min(packet->inverseMin[a], r.inverse[a]);
+            packet->inverseMax[a] = std::max(packet->inverseMax[a], r.inverse[a]);
+        }
+    }
+
+    for (int a = 0; a < 3; ++a)
+    {
+        packet->origin[a] = _mm_loadu_ps(origin[a]);
+        packet->inverse[a] = _mm_loadu_ps(inverse[a]);
+    }
+    packet->tmin = _mm_loadu_ps(tmin);
+    for (int a = 0; a < 2; ++a)
+    {
+        packet->kx[a] = axisMask(k[0], a);
+        packet->ky[a] = axisMask(k[1], a);
+        packet->kz[a] = axisMask(k[2], a);
+    }
+    packet->sx = _mm_loadu_ps(s[0]);
+    packet->sy = _mm_loadu_ps(s[1]);
+    packet->sz = _mm_loadu_ps(s[2]);
+    return active;
+}
+
+// Whether the active rays are coherent: of one origin and of directions
+// in one octant within RAYTRACE_PACKET_SPREAD of each other, so that the
+// intervals of their distances to the planes are tight.
+static bool coherentPacket(const BvhRay* rays, uint32_t active)
+{
+    const BvhRay* first = NULL;
+    float firstLength2 = 0.0f;
+    for (int i = 0; i < 4; ++i)
+    {
+        if ((active & (1u << i)) == 0)
+        {
+            continue;
+        }
+        const float* d = rays[i].direction;
+        float length2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+        if (first == NULL)
+        {
+            first = &rays[i];
+            firstLength2 = length2;
+            continue;
+        }
+
+        const float* d0 = first->direction;
+        for (int a = 0; a < 3; ++a)
+        {
+            if (rays[i].origin[a] != first->origin[a] || (d[a] >= 0.0f) != (d0[a] >= 0.0f))
+            {
+                return false;
+            }
+        }
+        float cosine = d[0] * d0[0] + d[1] * d0[1] + d[2] * d0[2];
+        if (cosine * cosine < RAYTRACE_PACKET_SPREAD * RAYTRACE_PACKET_SPREAD * length2 * firstLength2)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The 4 children [first, first + 4) of the node against the coherent
+// packet: the mask of the children that some of the rays may hit, shifted
+// to first, and the least distances where they may enter them. The
+// distances to the planes are (plane - origin) * inverse, which lie between
+// the products with the least and the largest inverse of the rays.
+template<int N>
+static inline uint32_t intersectPacketBoxes4(const RaytraceNode<N>& node, int first, const RaytracePacket& packet,
+                                             float tmax, float* distances)
+{
+    __m128 tnear = _mm_set1_ps(packet.tminMin);
+    __m128 tfar = _mm_set1_ps(FLT_MAX);
+    for (int a = 0; a < 3; ++a)
+    {
+        __m128 origin = _mm_set1_ps(packet.center[a]);
+        __m128 inverseMin = _mm_set1_ps(packet.inverseMin[a]);
+        __m128 inverseMax = _mm_set1_ps(packet.inverseMax[a]);
+        __m128 d0 = _mm_sub_ps(_mm_loadu_ps(&node.bounds[packet.nearPlanes[a]][first]), origin);
+        __m128 d1 = _mm_sub_ps(_mm_loadu_ps(&node.bounds[packet.farPlanes[a]][first]), origin);
+        tnear = _mm_max_ps(tnear, _mm_min_ps(_mm_mul_ps(d0, inverseMin), _mm_mul_ps(d0, inverseMax)));
+        tfar = _mm_min_ps(tfar, _mm_max_ps(_mm_mul_ps(d1, inverseMin), _mm_mul_ps(d1, inverseMax)));
+    }
+    tfar = _mm_min_ps(_mm_mul_ps(tfar, _mm_set1_ps(RAYTRACE_ROBUST_FAR)), _mm_set1_ps(tmax));
+    _mm_storeu_ps(distances + first, tnear);
+    return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(tnear, tfar)) << first;
+}
+
+static inline uint32_t intersectPacketChildren(const RaytraceNode<4>& node, const RaytracePacket& packet,
+                                               float tmax, float* distances)
+{
+    return intersectPacketBoxes4(node, 0, packet, tmax, distances);
+}
+
+static inline uint32_t intersectPacketChildren(const RaytraceNode<8>& node, const RaytracePacket& packet,
+                                               float tmax, float* distances)
+{
+#if defined(__AVX__)
+    __m256 tnear = _mm256_set1_ps(packet.tminMin);
+    __m256 tfar = _mm256_set1_ps(FLT_MAX);
+    for (int a = 0; a < 3; ++a)
+    {
+        __m256 origin = _mm256_set1_ps(packet.center[a]);
+        __m256 inverseMin = _mm256_set1_ps(packet.inverseMin[a]);
+        __m256 inverseMax = _mm256_set1_ps(packet.inverseMax[a]);
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(node.bounds[packet.nearPlanes[a]]), origin);
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(node.bounds[packet.farPlanes[a]]), origin);
+        tnear = _mm256_max_ps(tnear, _mm256_min_ps(_mm256_mul_ps(d0, inverseMin), _mm256_mul_ps(d0, inverseMax)));
+        tfar = _mm256_min_ps(tfar, _mm256_max_ps(_mm256_mul_ps(d1, inverseMin), _mm256_mul_ps(d1, inverseMax)));
+    }
+    tfar = _mm256_min_ps(_mm256_mul_ps(tfar, _mm256_set1_ps(RAYTRACE_ROBUST_FAR)), _mm256_set1_ps(tmax));
+    _mm256_storeu_ps(distances, tnear);
+    return (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(tnear, tfar, _CMP_LE_OQ));
+#else
+    return intersectPacketBoxes4(node, 0, packet, tmax, distances) |
+           intersectPacketBoxes4(node, 4, packet, tmax, distances);
+#endif
+}
+
+// The triangle j of the block against the rays.
+static inline __m128 intersectPacketTriangle(const RaytraceTriangleBlock& block, int j, const RaytracePacket& packet,
+                                             __m128 tmax, __m128* t, __m128* u, __m128* v)
+{
+    __m128 x[3];
+    __m128 y[3];
+    __m128 z[3];
+    for (int c = 0; c < 3; ++c)
+    {
+        __m128 p[3];
+        for (int a = 0; a < 3; ++a)
+        {
+            p[a] = _mm_sub_ps(_mm_set1_ps(block.corners[c][a][j]), packet.origin[a]);
+        }
+        __m128 pz = selectAxis(p, packet.kz);
+        x[c] = _mm_sub_ps(selectAxis(p, packet.kx), _mm_mul_ps(packet.sx, pz));
+        y[c] = _mm_sub_ps(selectAxis(p, packet.ky), _mm_mul_ps(packet.sy, pz));
+        z[c] = _mm_mul_ps(packet.sz, pz);
+    }
+    return intersectTriangles(x[0], y[0], z[0], x[1], y[1], z[1], x[2], y[2], z[2], packet.tmin, tmax, t, u, v);
+}
+
+template<int N, bool OCCLUSION>
+static uint32_t traversePacket(const RaytraceBvh<N>* bvh, const BvhRay* rays, BvhHit* hits)
+{
+    assert(bvh != NULL && rays != NULL);
+
+    uint32_t active = 0;
+    for (int k = 0; k < 4; ++k)
+    {
+        if (rays[k].tmin < rays[k].tmax)
+        {
+            active |= 1u << k;
+        }
+    }
+    if (bvh->nodes.empty() || active == 0)
+    {
+        return 0;
+    }
+    if (!coherentPacket(rays, active))
+    {
+        // Together, diverging rays visit the union of the nodes each one
+        // visits, which costs more than tracing them one by one.
+        uint32_t result = 0;
+        for (int k = 0; k < 4; ++k)
+        {
+            if ((active & (1u << k)) && traverse<N, OCCLUSION>(bvh, &rays[k], OCCLUSION? NULL : &hits[k]))
+            {
+                result |= 1u << k;
+            }
+        }
+        return result;
+    }
+
+    RaytracePacket packet;
+    float tmaxes[4];
+    setupPacket(rays, &packet, tmaxes);
+    __m128 tmax = _mm_loadu_ps(tmaxes);
+    float farthest = std::max(std::max(tmaxes[0], tmaxes[1]), std::max(tmaxes[2], tmaxes[3]));
+
+    uint32_t result = 0;
+    float u[4];
+    float v[4];
+    uint32_t triangles[4];
+
+    RaytraceStackItem stack[RAYTRACE_STACK_SIZE];
+    uint32_t stackSize = 1;
+    stack[0].child = 0;
+    stack[0].t = -FLT_MAX;
+    while (stackSize > 0)
+    {
+        RaytraceStackItem item = stack[--stackSize];
+        // Behind the closest hits of all the rays, or of the rays that are
+        // not occluded yet.
+        if (item.t > farthest)
+        {
+            continue;
+        }
+
+        uint32_t child = item.child;
+        while ((child & RAYTRACE_LEAF) == 0)
+        {
+            const RaytraceNode<N>& node = bvh->nodes[child];
+            float distances[N];
+            uint32_t mask = intersectPacketChildren(node, packet, farthest, distances);
+            if (mask == 0)
+            {
+                child = RAYTRACE_EMPTY;
+                break;
+            }
+            child = OCCLUSION? pushAll(stack, &stackSize, node, distances, mask) :
+                               pushOrdered(stack, &stackSize, node, distances, mask);
+        }
+        if (child == RAYTRACE_EMPTY)
+        {
+            continue;
+        }
+
+        uint32_t first = child & ((1u << RAYTRACE_LEAF_SHIFT) - 1);
+        uint32_t numBlocks = ((child & ~RAYTRACE_LEAF) >> RAYTRACE_LEAF_SHIFT) + 1;
+        for (uint32_t b = first; b < first + numBlocks; ++b)
+        {
+            const RaytraceTriangleBlock& block = bvh->blocks[b];
+            for (int j = 0; j < 4 && block.triangles[j] != UINT32_MAX; ++j)
+            {
+                __m128 t4;
+                __m128 u4;
+                __m128 v4;
+                __m128 valid = intersectPacketTriangle(block, j, packet, tmax, &t4, &u4, &v4);
+                uint32_t mask = (uint32_t)_mm_movemask_ps(valid);
+                if (mask == 0)
+                {
+                    continue;
+                }
+
+                if (OCCLUSION)
+                {
+                    // The occluded rays are done.
+                    result |= mask;
+                    if (result == active)
+                    {
+                        return result;
+                    }
+                    tmax = _mm_or_ps(_mm_and_ps(valid, _mm_set1_ps(-FLT_MAX)), _mm_andnot_ps(valid, tmax));
+                    continue;
+                }
+
+                result |= mask;
+                tmax = _mm_or_ps(_mm_and_ps(valid, t4), _mm_andnot_ps(valid, tmax));
+                float u1[4];
+                float v1[4];
+                _mm_storeu_ps(u1, u4);
+                _mm_storeu_ps(v1, v4);
+                for (int k = 0; k < 4; ++k)
+                {
+                    if (mask & (1u << k))
+                    {
+                        u[k] = u1[k];
+                        v[k] = v1[k];
+                        triangles[k] = block.triangles[j];
+                    }
+                }
+            }
+        }
+
+        _mm_storeu_ps(tmaxes, tmax);
+        farthest = std::max(std::max(tmaxes[0], tmaxes[1]), std::max(tmaxes[2], tmaxes[3]));
+    }
+
+    if (!OCCLUSION)
+    {
+        for (int k = 0; k < 4; ++k)
+        {
+            if (result & (1u << k))
+            {
+                hits[k].t = tmaxes[k];
+                hits[k].u = u[k];
+                hits[k].v = v[k];
+                hits[k].triangle = triangles[k];
+            }
+        }
+    }
+    return result;
+}
+
+uint32_t raytraceIntersectPacket4(const RaytraceBvh4* bvh, const BvhRay* rays, BvhHit* hits)
+{
+    assert(hits != NULL);
+    return traversePacket<4, false>(bvh, rays, hits);
+}
+
+uint32_t raytraceIntersectPacket8(const RaytraceBvh8* bvh, const BvhRay* rays, BvhHit* hits)
+{
+    assert(hits != NULL);
+    return traversePacket<8, false>(bvh, rays, hits);
+}
+
+uint32_t raytraceOccludedPacket4(const RaytraceBvh4* bvh, const BvhRay* rays)
+{
+    return traversePacket<4, true>(bvh, rays, NULL);
+}
+
+uint32_t raytraceOccludedPacket8(const RaytraceBvh8* bvh, const BvhRay* rays)
+{
+    return traversePacket<8, true>(bvh, rays, NULL);
+}
@@ -0,0 +1,94 @@
+// --------------------------------------------------------------
+// raytrace.h
+// Wide BVHs collapsed from the binary BVH and their SIMD ray
+// traversal kernels.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef RAYTRACE_H
+#define RAYTRACE_H
+
+#include "bvh.h"
+
+//
+// The nodes of a wide BVH hold the boxes of their N children side by side
+// so that one ray is tested against all of them with a few SSE (N = 4) or
+// AVX (N = 8) instructions; without AVX the 8 boxes take two SSE tests.
+// The leaves are blocks of 4 triangles in the SSE layout.
+//
+// The triangle test is the watertight one of Woop et al., "Watertight
+// Ray/Triangle Intersection", and the box test is made conservative as in
+// Ize, "Robust BVH Ray Traversal", so no ray slips through a shared edge or
+// vertex of a closed mesh as it can with bvhIntersect().
+//
+// The single ray kernels are for incoherent rays, e.g., of the ambient
+// occlusion. The packet kernels trace 4 rays of one origin and of close
+// directions, e.g., of the pixels of a 2x2 quad of a camera, through the
+// tree together, testing the packet against all the children of a node
+// at once with the intervals of the directions. Other packets are traced
+// as 4 single rays, which costs less than tracing them together.
+//
+
+// A child that is a leaf: the first block of its triangles and the number
+// of the blocks.
+#define RAYTRACE_LEAF            0x80000000u
+#define RAYTRACE_LEAF_SHIFT      28
+#define RAYTRACE_MAX_LEAF_BLOCKS 8
+// An unused child slot; its box is empty.
+#define RAYTRACE_EMPTY           0xffffffffu
+// The size of the traversal stacks, up to N - 1 children for every level.
+#define RAYTRACE_STACK_SIZE      (BVH_MAX_DEPTH * 8)
+
+template<int N>
+struct RaytraceNode
+{
+    float    bounds[6][N];       // The lower x, y, z, then the upper x, y, z of the children
+    uint32_t children[N];        // A node, RAYTRACE_LEAF | the blocks, or RAYTRACE_EMPTY
+};
+
+// 4 triangles. The unused ones of the last block of a leaf have NaN corners,
+// which no ray hits, and the triangle UINT32_MAX.
+struct RaytraceTriangleBlock
+{
+    float    corners[3][3][4];   // [corner][axis][triangle]
+    uint32_t triangles[4];       // In the mesh
+};
+
+template<int N>
+struct RaytraceBvh
+{
+    std::vector<RaytraceNode<N> >      nodes;        // nodes[0] is the root
+    std::vector<RaytraceTriangleBlock> blocks;
+};
+
+typedef RaytraceBvh<4> RaytraceBvh4;
+typedef RaytraceBvh<8> RaytraceBvh8;
+
+// Collapse the binary BVH into a wide one by pulling the children of the
+// child of the largest surface area into the node until it has N children.
+// The binary BVH is not used after.
+extern void raytraceCollapse4(RaytraceBvh4* wide, const Bvh* bvh);
+extern void raytraceCollapse8(RaytraceBvh8* wide, const Bvh* bvh);
+
+// The closest hit in (tmin, tmax) as bvhIntersect(), and whether anything
+// is hit as bvhOccluded(); the occlusion stops at the first hit and does
+// not order the children.
+extern bool raytraceIntersect4(const RaytraceBvh4* bvh, const BvhRay* ray, BvhHit* hit);
+extern bool raytraceIntersect8(const RaytraceBvh8* bvh, const BvhRay* ray, BvhHit* hit);
+extern bool raytraceOccluded4(const RaytraceBvh4* bvh, const BvhRay* ray);
+extern bool raytraceOccluded8(const RaytraceBvh8* bvh, const BvhRay* ray);
+
+// The packets of 4 rays. Return the mask of the rays that hit, bit k for
+// rays[k]; hits[k] is only written for those. A ray of tmin >= tmax is
+// inactive, for the packets that are not full.
+extern uint32_t raytraceIntersectPacket4(const RaytraceBvh4* bvh, const BvhRay* rays, BvhHit* hits);
+extern uint32_t raytraceIntersectPacket8(const RaytraceBvh8* bvh, const BvhRay* rays, BvhHit* hits);
+extern uint32_t raytraceOccludedPacket4(const RaytraceBvh4* bvh, const BvhRay* rays);
+extern uint32_t raytraceOccludedPacket8(const RaytraceBvh8* bvh, const BvhRay* rays);
+
+#endif // !RAYTRACE_H
@@ -0,0 +1,236 @@
+// --------------------------------------------------------------
+// residency.cpp
+// Mipmap residency decisions and memory budget accounting for
+// streamed textures. It knows nothing about the GPU.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "residency.h"
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+ResidencyManager::ResidencyManager(uint64_t budget)
+{
+    m_budget = budget;
+    m_residentBytes = 0;
+    m_pendingBytes = 0;
+}
+
+ResidencyManager::~ResidencyManager()
+{
+}
+
+int ResidencyManager::add(uint32_t numMips, const uint64_t* mipBytes, uint32_t tailMip)
+{
+    assert(numMips > 0 && numMips <= RESIDENCY_MAX_MIPS);
+    assert(tailMip < numMips);
+
+    Entry entry;
+    memset(&entry, 0, sizeof(Entry));
+    entry.used         = true;
+    entry.numMips      = numMips;
+    memcpy(entry.mipBytes, mipBytes, sizeof(uint64_t) * numMips);
+    entry.tailMip      = tailMip;
+    entry.requestedMip = tailMip;
+    entry.residentMip  = tailMip;
+    entry.targetMip    = tailMip;
+    entry.pendingMip   = numMips;
+    entry.priority     = 0;
+
+    // Reuse a free slot so that the ids stay small.
+    int id = (int)m_textures.size();
+    for (size_t i = 0; i < m_textures.size(); ++i)
+    {
+        if (!m_textures[i].used)
+        {
+            id = (int)i;
+            break;
+        }
+    }
+    if (id == (int)m_textures.size())
+    {
+        m_textures.push_back(entry);
+    }
+    else
+    {
+        m_textures[id] = entry;
+    }
+
+    m_residentBytes += bytes(id, tailMip);
+
+    return id;
+}
+
+void ResidencyManager::remove(int id)
+{
+    Entry& entry = m_textures[id];
+    assert(entry.used);
+
+    m_residentBytes -= bytes(id, entry.residentMip);
+    if (entry.pendingMip < entry.numMips)
+    {
+        m_pendingBytes -= entry.mipBytes[entry.pendingMip];
+    }
+    entry.used = false;
+}
+
+void ResidencyManager::setRequestedMip(int id, uint32_t mip, float priority)
+{
+    Entry& entry = m_textures[id];
+    entry.requestedMip = std::min(mip, entry.tailMip);
+    entry.priority = priority;
+}
+
+void ResidencyManager::onLoaded(int id, uint32_t mip)
+{
+    Entry& entry = m_textures[id];
+    assert(entry.pendingMip == mip && mip + 1 == entry.residentMip);
+
+    m_pendingBytes -= entry.mipBytes[mip];
+    m_residentBytes += entry.mipBytes[mip];
+    entry.residentMip = mip;
+    entry.pendingMip = entry.numMips;
+}
+
+void ResidencyManager::onEvicted(int id, uint32_t mip)
+{
+    Entry& entry = m_textures[id];
+    assert(mip > entry.residentMip && mip <= entry.tailMip);
+
+    for (uint32_t m = entry.residentMip; m < mip; ++m)
+    {
+        m_residentBytes -= entry.mipBytes[m];
+    }
+    entry.residentMip = mip;
+}
+
+void ResidencyManager::onCancelled(int id)
+{
+    Entry& entry = m_textures[id];
+    if (entry.pendingMip < entry.numMips)
+    {
+        m_pendingBytes -= entry.mipBytes[entry.pendingMip];
+        entry.pendingMip = entry.numMips;
+    }
+}
+
+uint64_t ResidencyManager::bytes(int id, uint32_t mip) const
+{
+    const Entry& entry = m_textures[id];
+
+    uint64_t ret = 0;
+    for (uint32_t m = mip; m < entry.numMips; ++m)
+    {
+        ret += entry.mipBytes[m];
+    }
+    return ret;
+}
+
+void ResidencyManager::update(std::vector<ResidencyRequest>* requests)
+{
+    requests->clear();
+
+    // The mip tails are always resident.
+    m_order.clear();
+    uint64_t mandatory = 0;
+    for (size_t i = 0; i < m_textures.size(); ++i)
+    {
+        Entry& entry = m_textures[i];
+        if (entry.used)
+        {
+            entry.targetMip = entry.tailMip;
+            mandatory += bytes((int)i, entry.tailMip);
+            m_order.push_back((int)i);
+        }
+    }
+
+    struct PriorityGreater
+    {
+        const std::vector<Entry>* textures;
+        bool operator()(int a, int b) const
+        {
+            if ((*textures)[a].priority != (*textures)[b].priority)
+            {
+                return (*textures)[a].priority > (*textures)[b].priority;
+            }
+            return a < b;
+        }
+    } greater;
+    greater.textures = &m_textures;
+    std::sort(m_order.begin(), m_order.end(), greater);
+
+    // Refine the targets one mip at a time in the priority order so that
+    // a single huge texture can't starve the others.
+    uint64_t available = m_budget > mandatory? m_budget - mandatory : 0;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = 0; i < m_order.size(); ++i)
+        {
+            Entry& entry = m_textures[m_order[i]];
+            if (entry.targetMip > entry.requestedMip)
+            {
+                uint64_t cost = entry.mipBytes[entry.targetMip - 1];
+                if (cost <= available)
+                {
+                    available -= cost;
+                    entry.targetMip--;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // Evict first so that the freed memory is available to the loads.
+    uint64_t projected = m_residentBytes;
+    for (size_t i = 0; i < m_order.size(); ++i)
+    {
+        int id = m_order[i];
+        Entry& entry = m_textures[id];
+        if (entry.targetMip > entry.residentMip)
+        {
+            ResidencyRequest request;
+            request.action = RESIDENCY_EVICT;
+            request.id     = id;
+            request.mip    = entry.targetMip;
+            requests->push_back(request);
+
+            for (uint32_t m = entry.residentMip; m < entry.targetMip; ++m)
+            {
+                projected -= entry.mipBytes[m];
+            }
+        }
+    }
+
+    for (size_t i = 0; i < m_order.size(); ++i)
+    {
+        int id = m_order[i];
+        Entry& entry = m_textures[id];
+        if (entry.targetMip < entry.residentMip && entry.pendingMip == entry.numMips)
+        {
+            uint32_t mip = entry.residentMip - 1;
+            uint64_t cost = entry.mipBytes[mip];
+            if (projected + m_pendingBytes + cost > m_budget)
+            {
+                continue;
+            }
+
+            ResidencyRequest request;
+            request.action = RESIDENCY_LOAD;
+            request.id     = id;
+            request.mip    = mip;
+            requests->push_back(request);
+
+            entry.pendingMip = mip;
+            m_pendingBytes += cost;
+        }
+    }
+}
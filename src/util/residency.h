@@ -0,0 +1,94 @@
+// --------------------------------------------------------------
+// residency.h
+// Mipmap residency decisions and memory budget accounting for
+// streamed textures. It knows nothing about the GPU.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+#include <stdint.h>
+#include <vector>
+
+#define RESIDENCY_MAX_MIPS 16
+
+enum ResidencyActionEnum
+{
+    RESIDENCY_LOAD,   // Make one more detailed mip resident.
+    RESIDENCY_EVICT,  // Drop the mips more detailed than the given one.
+};
+
+struct ResidencyRequest
+{
+    ResidencyActionEnum action;
+    int                 id;
+    // For RESIDENCY_LOAD, the mip to load. For RESIDENCY_EVICT, the new
+    // most detailed resident mip.
+    uint32_t            mip;
+};
+
+// Mip 0 is the most detailed one. A texture with mips [m, numMips)
+// resident is said to have resident mip m.
+class ResidencyManager
+{
+public:
+    ResidencyManager(uint64_t budget);
+    ~ResidencyManager();
+
+    // Register a texture. The mips from tailMip to the end are always
+    // resident and are accounted immediately. Return the texture id.
+    int add(uint32_t numMips, const uint64_t* mipBytes, uint32_t tailMip);
+    void remove(int id);
+
+    // The most detailed mip the texture needs and its priority among
+    // others when the budget is short.
+    void setRequestedMip(int id, uint32_t mip, float priority);
+
+    // Called when a request has been carried out.
+    void onLoaded(int id, uint32_t mip);
+    void onEvicted(int id, uint32_t mip);
+    // Called when a load has failed or was given up.
+    void onCancelled(int id);
+
+    // Decide the target mips within the budget and output the actions
+    // to approach them. Evictions come before loads. At most one load is
+    // in flight per texture.
+    void update(std::vector<ResidencyRequest>* requests);
+
+    void setBudget(uint64_t budget) { m_budget = budget; }
+    uint64_t budget() const { return m_budget; }
+    uint64_t residentBytes() const { return m_residentBytes; }
+    uint64_t pendingBytes() const { return m_pendingBytes; }
+    uint32_t residentMip(int id) const { return m_textures[id].residentMip; }
+    uint32_t targetMip(int id) const { return m_textures[id].targetMip; }
+    // The bytes of the mips [mip, numMips) of a texture.
+    uint64_t bytes(int id, uint32_t mip) const;
+
+private:
+    struct Entry
+    {
+        bool     used;
+        uint32_t numMips;
+        uint64_t mipBytes[RESIDENCY_MAX_MIPS];
+        uint32_t tailMip;
+        uint32_t requestedMip;
+        uint32_t residentMip;
+        uint32_t targetMip;
+        uint32_t pendingMip; // numMips when no load is in flight
+        float    priority;
+    };
+
+    std::vector<Entry> m_textures;
+    std::vector<int>   m_order;  // scratch for update()
+    uint64_t           m_budget;
+    uint64_t           m_residentBytes;
+    uint64_t           m_pendingBytes;
+};
+
+#endif // !RESIDENCY_H
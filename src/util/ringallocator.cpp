@@ -0,0 +1,90 @@
+// --------------------------------------------------------------
+// ringallocator.cpp
+// Frame-scoped bump allocation in a ring of bytes that the GPU
+// reads. It only does the bookkeeping; the memory and the fences
+// belong to the caller.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "ringallocator.h"
+
+#include <assert.h>
+
+RingAllocator::RingAllocator(uint64_t capacity)
+{
+    assert(capacity > 0);
+    m_capacity = capacity;
+    m_head = 0;
+    m_tail = 0;
+    m_frameBegin = 0;
+}
+
+RingAllocator::~RingAllocator()
+{
+}
+
+uint64_t RingAllocator::allocate(uint64_t size, uint64_t alignment)
+{
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+    assert(m_capacity % alignment == 0);
+
+    if (size == 0 || size > m_capacity)
+    {
+        return RING_ALLOCATOR_FULL;
+    }
+
+    uint64_t offset = m_head % m_capacity;
+    uint64_t aligned = (offset + alignment - 1) & ~(alignment - 1);
+    if (aligned + size > m_capacity)
+    {
+        // Skip to the beginning.
+        aligned = m_capacity;
+    }
+
+    uint64_t head = m_head + (aligned - offset) + size;
+    if (head - m_tail > m_capacity)
+    {
+        return RING_ALLOCATOR_FULL;
+    }
+
+    m_head = head;
+    return aligned % m_capacity;
+}
+
+void RingAllocator::endFrame(uint64_t fence)
+{
+    assert(m_frames.empty() || m_frames.back().fence < fence);
+
+    if (m_head == m_frameBegin)
+    {
+        // Nothing to wait for.
+        return;
+    }
+
+    Frame frame;
+    frame.fence = fence;
+    frame.end = m_head;
+    m_frames.push_back(frame);
+
+    m_frameBegin = m_head;
+}
+
+void RingAllocator::retire(uint64_t completedFence)
+{
+    while (!m_frames.empty() && m_frames.front().fence <= completedFence)
+    {
+        m_tail = m_frames.front().end;
+        m_frames.pop_front();
+    }
+}
+
+void RingAllocator::reset()
+{
+    m_frames.clear();
+    m_tail = m_frameBegin;
+}
@@ -0,0 +1,78 @@
+// --------------------------------------------------------------
+// ringallocator.h
+// Frame-scoped bump allocation in a ring of bytes that the GPU
+// reads. It only does the bookkeeping; the memory and the fences
+// belong to the caller.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef RINGALLOCATOR_H
+#define RINGALLOCATOR_H
+
+#include <stdint.h>
+#include <deque>
+
+#define RING_ALLOCATOR_FULL ((uint64_t)-1)
+
+//
+// The allocations of a frame are closed under a fence value when the frame
+// ends. Once the caller learns that the GPU has passed a fence, the space
+// of all the frames up to it is reused.
+//
+//   uint64_t offset = ring.allocate(256, 256);
+//   ...
+//   ring.endFrame(fence++);
+//   ...
+//   ring.retire(lastCompletedFence);
+//
+// An allocation is contiguous; when it does not fit before the end of the
+// ring, the rest of the ring is skipped and it starts at offset 0.
+class RingAllocator
+{
+public:
+    RingAllocator(uint64_t capacity);
+    ~RingAllocator();
+
+    // Return the offset of size bytes aligned to alignment (a power of
+    // two), or RING_ALLOCATOR_FULL when the frames in flight leave no room.
+    uint64_t allocate(uint64_t size, uint64_t alignment);
+
+    // Close the allocations made since the last call. The fences must
+    // increase.
+    void endFrame(uint64_t fence);
+    // Reuse the space of the closed frames whose fence <= completedFence.
+    void retire(uint64_t completedFence);
+    // Forget all the frames, e.g., after the device waited for idle.
+    void reset();
+
+    uint64_t capacity() const { return m_capacity; }
+    // The bytes held by the frames in flight and the current frame,
+    // including the padding.
+    uint64_t usedBytes() const { return m_head - m_tail; }
+    // The bytes allocated in the current frame, including the padding.
+    uint64_t frameBytes() const { return m_head - m_frameBegin; }
+    uint32_t numFramesInFlight() const { return (uint32_t)m_frames.size(); }
+    // The fence of the oldest frame in flight. Only valid when there is one.
+    uint64_t oldestFence() const { return m_frames.front().fence; }
+
+private:
+    struct Frame
+    {
+        uint64_t fence;
+        uint64_t end;    // m_head when the frame ended
+    };
+
+    uint64_t          m_capacity;
+    // Running byte counts; the offset is the count modulo the capacity.
+    uint64_t          m_head;
+    uint64_t          m_tail;
+    uint64_t          m_frameBegin;
+    std::deque<Frame> m_frames;
+};
+
+#endif // !RINGALLOCATOR_H
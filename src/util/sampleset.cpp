@@ -0,0 +1,153 @@
+// --------------------------------------------------------------
+// sampleset.cpp
+// The binary file of a generated sample set and the cache of
+// them keyed by the generator parameters.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "sampleset.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char* typeNames[SAMPLESET_NUM_TYPES] =
+{
+    "sphere",
+    "hemisphere",
+    "ring",
+};
+
+static uint32_t checksum(const float* samples, size_t numFloats)
+{
+    const uint8_t* bytes = (const uint8_t*)samples;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < numFloats * sizeof(float); ++i)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+const char* sampleSetTypeName(uint32_t type)
+{
+    return type < SAMPLESET_NUM_TYPES? typeNames[type] : NULL;
+}
+
+uint32_t sampleSetTypeFromName(const char* name)
+{
+    for (uint32_t type = 0; type < SAMPLESET_NUM_TYPES; ++type)
+    {
+        if (strcmp(name, typeNames[type]) == 0)
+        {
+            return type;
+        }
+    }
+    return SAMPLESET_NUM_TYPES;
+}
+
+uint32_t sampleSetNumComponents(uint32_t type)
+{
+    return type == SAMPLESET_RING? 2 : 3;
+}
+
+void sampleSetPath(const char* directory, const SampleSetKey* key, char* path, size_t size)
+{
+    assert(key->type < SAMPLESET_NUM_TYPES);
+#if defined(_MSC_VER) && _MSC_VER < 1900
+    _snprintf_s(path, size, _TRUNCATE, "%s/%s-%u-%u-%u.dxss", directory, typeNames[key->type],
+        key->numSamples, key->capacity, key->seed);
+#else
+    snprintf(path, size, "%s/%s-%u-%u-%u.dxss", directory, typeNames[key->type],
+        key->numSamples, key->capacity, key->seed);
+#endif
+}
+
+bool sampleSetWrite(const char* path, const SampleSetKey* key, const float* samples)
+{
+    assert(key->type < SAMPLESET_NUM_TYPES);
+
+    SampleSetHeader header;
+    header.magic         = SAMPLESET_MAGIC;
+    header.version       = SAMPLESET_VERSION;
+    header.type          = key->type;
+    header.numSamples    = key->numSamples;
+    header.capacity      = key->capacity;
+    header.seed          = key->seed;
+    header.numComponents = sampleSetNumComponents(key->type);
+
+    size_t numFloats = (size_t)header.numSamples * header.numComponents;
+    header.checksum = checksum(samples, numFloats);
+
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(samples, sizeof(float), numFloats, fp) == numFloats;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok)
+    {
+        remove(path);
+    }
+    return ok;
+}
+
+bool sampleSetRead(const char* path, const SampleSetKey* key, std::vector<float>* samples)
+{
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    SampleSetHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        header.magic != SAMPLESET_MAGIC ||
+        header.version != SAMPLESET_VERSION ||
+        header.type != key->type ||
+        header.numSamples != key->numSamples ||
+        header.capacity != key->capacity ||
+        header.seed != key->seed ||
+        header.numComponents != sampleSetNumComponents(key->type))
+    {
+        fclose(fp);
+        return false;
+    }
+
+    size_t numFloats = (size_t)header.numSamples * header.numComponents;
+    samples->resize(numFloats);
+    bool ok = numFloats == 0 || fread(&(*samples)[0], sizeof(float), numFloats, fp) == numFloats;
+    fclose(fp);
+
+    if (!ok || checksum(numFloats == 0? NULL : &(*samples)[0], numFloats) != header.checksum)
+    {
+        samples->clear();
+        return false;
+    }
+    return true;
+}
+
+bool sampleSetWriteXYZ(const char* path, const SampleSetKey* key, const float* samples)
+{
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    uint32_t numComponents = sampleSetNumComponents(key->type);
+    for (uint32_t i = 0; i < key->numSamples; ++i)
+    {
+        const float* s = samples + i * numComponents;
+        fprintf(fp, "%f %f %f \n", s[0], s[1], numComponents == 3? s[2] : 0.0f);
+    }
+
+    return fclose(fp) == 0;
+}
@@ -0,0 +1,83 @@
+// --------------------------------------------------------------
+// sampleset.h
+// The binary file of a generated sample set and the cache of
+// them keyed by the generator parameters.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef SAMPLESET_H
+#define SAMPLESET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+const uint32_t SAMPLESET_MAGIC = 0x53535844; // "DXSS"
+// Bump it whenever the generators change their output, so the stale
+// files are not read anymore.
+const uint32_t SAMPLESET_VERSION = 2;
+
+enum SampleSetType
+{
+    SAMPLESET_SPHERE,
+    SAMPLESET_HEMISPHERE,    // y >= 0
+    SAMPLESET_RING,          // x, y on the unit circle
+
+    SAMPLESET_NUM_TYPES,
+};
+
+// The parameters a sample set only depends on.
+struct SampleSetKey
+{
+    uint32_t type;
+    uint32_t numSamples;
+    uint32_t capacity;       // The points per sample of the generator
+    uint32_t seed;
+};
+
+//
+// The file is the header followed by the numSamples * numComponents
+// floats, little endian. The checksum is FNV-1a over the floats.
+//
+#pragma pack(push,1)
+struct SampleSetHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t type;
+    uint32_t numSamples;
+    uint32_t capacity;
+    uint32_t seed;
+    uint32_t numComponents;
+    uint32_t checksum;
+};
+#pragma pack(pop)
+
+// "sphere", "hemisphere" or "ring"; NULL for an unknown type.
+extern const char* sampleSetTypeName(uint32_t type);
+// SAMPLESET_NUM_TYPES for an unknown name.
+extern uint32_t sampleSetTypeFromName(const char* name);
+// 2 for the ring, 3 otherwise.
+extern uint32_t sampleSetNumComponents(uint32_t type);
+
+// The file of the key in the directory, e.g. "dir/sphere-128-256-10001.dxss".
+extern void sampleSetPath(const char* directory, const SampleSetKey* key, char* path, size_t size);
+
+// numSamples * numComponents floats. Return false when the file can not
+// be written.
+extern bool sampleSetWrite(const char* path, const SampleSetKey* key, const float* samples);
+
+// Return false when the file is missing, corrupted, of another version or
+// made with another key.
+extern bool sampleSetRead(const char* path, const SampleSetKey* key, std::vector<float>* samples);
+
+// Write the samples as the text point cloud of xyzRead(), one sample per
+// line; the ring samples get z = 0.
+extern bool sampleSetWriteXYZ(const char* path, const SampleSetKey* key, const float* samples);
+
+#endif // !SAMPLESET_H
@@ -0,0 +1,909 @@
+// --------------------------------------------------------------
+// sampling.cpp
+// Blue-noise and low-discrepancy sample generators in the unit
+// square and on the unit sphere, and the metrics to compare them.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "sampling.h"
+#include "random.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+
+static const double PI = 3.14159265358979323846;
+
+//
+// Hashing for the scrambling
+//
+static inline uint32_t hash32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// A float in [0, 1) from the 24 high bits.
+static inline float toUnit(uint32_t x)
+{
+    return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+//
+// Poisson disk
+//
+void samplingPoissonDisk2D(float radius, uint32_t numAttempts, uint32_t seed, std::vector<float>* points)
+{
+    assert(radius > 0.0f);
+
+    points->clear();
+
+    // A cell of radius / sqrt(2) holds one point at most.
+    float cell = radius / sqrtf(2.0f);
+    int32_t res = (int32_t)ceilf(1.0f / cell);
+    std::vector<int32_t> grid(res * res, -1);
+
+    RandomPCG32 random;
+    randomPCG32Seed(&random, seed, 0);
+    std::vector<uint32_t> active;
+
+    float r2 = radius * radius;
+
+    float x0 = randomPCG32Float(&random);
+    float y0 = randomPCG32Float(&random);
+    points->push_back(x0);
+    points->push_back(y0);
+    grid[(int32_t)(y0 / cell) * res + (int32_t)(x0 / cell)] = 0;
+    active.push_back(0);
+
+    while (!active.empty())
+    {
+        uint32_t a = randomPCG32Bounded(&random, (uint32_t)active.size());
+        float px = (*points)[active[a] * 2 + 0];
+        float py = (*points)[active[a] * 2 + 1];
+
+        bool found = false;
+        for (uint32_t k = 0; k < numAttempts && !found; ++k)
+        {
+            // Uniform in the area of the annulus.
+            float angle = randomPCG32Float(&random) * (float)(2.0 * PI);
+            float d = radius * sqrtf(1.0f + 3.0f * randomPCG32Float(&random));
+            float x = px + d * cosf(angle);
+            float y = py + d * sinf(angle);
+            if (x < 0.0f || x >= 1.0f || y < 0.0f || y >= 1.0f)
+            {
+                continue;
+            }
+
+            int32_t cx = (int32_t)(x / cell);
+            int32_t cy = (int32_t)(y / cell);
+            bool accepted = true;
+            for (int32_t j = std::max(cy - 2, 0); j <= std::min(cy + 2, res - 1) && accepted; ++j)
+            {
+                for (int32_t i = std::max(cx - 2, 0); i <= std::min(cx + 2, res - 1); ++i)
+                {
+                    int32_t q = grid[j * res + i];
+                    if (q >= 0)
+                    {
+                        float dx = (*points)[q * 2 + 0] - x;
+                        float dy = (*points)[q * 2 + 1] - y;
+                        if (dx * dx + dy * dy < r2)
+                        {
+                            accepted = false;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if (accepted)
+            {
+                uint32_t index = (uint32_t)(points->size() / 2);
+                points->push_back(x);
+                points->push_back(y);
+                grid[cy * res + cx] = (int32_t)index;
+                active.push_back(index);
+                found = true;
+            }
+        }
+
+        if (!found)
+        {
+            active[a] = active.back();
+            active.pop_back();
+        }
+    }
+}
+
+void samplingPoissonDiskSphere(float angle, uint32_t numAttempts, uint32_t seed, std::vector<float>* points)
+{
+    assert(angle > 0.0f && angle < (float)PI * 0.5f);
+
+    points->clear();
+
+    // The points are compared by their chords. A grid of chord-sized
+    // cells over [-1, 1]^3 has the neighbors in the 27 cells around.
+    float chord = 2.0f * sinf(angle * 0.5f);
+    float chord2 = chord * chord;
+    int32_t res = std::max((int32_t)(2.0f / chord), 1);
+    float cell = 2.0f / (float)res;
+    std::vector<int32_t> head(res * res * res, -1);
+    std::vector<int32_t> next;
+
+    RandomPCG32 random;
+    randomPCG32Seed(&random, seed, 0);
+    std::vector<uint32_t> active;
+
+    float cosAngle = cosf(angle);
+    float cos2Angle = cosf(2.0f * angle);
+
+    struct Local
+    {
+        static int32_t coordinate(float c, float cell, int32_t res)
+        {
+            return std::max(0, std::min(res - 1, (int32_t)((c + 1.0f) / cell)));
+        }
+    };
+
+    // The first point is uniform on the sphere.
+    float y0 = 1.0f - 2.0f * randomPCG32Float(&random);
+    float phi0 = randomPCG32Float(&random) * (float)(2.0 * PI);
+    float l0 = sqrtf(std::max(1.0f - y0 * y0, 0.0f));
+    float candidate[3] = { l0 * sinf(phi0), y0, l0 * cosf(phi0) };
+
+    for (;;)
+    {
+        int32_t c[3];
+        for (int a = 0; a < 3; ++a)
+        {
+            c[a] = Local::coordinate(candidate[a], cell, res);
+        }
+        int32_t index = (int32_t)(points->size() / 3);
+        points->insert(points->end(), candidate, candidate + 3);
+        int32_t h = (c[0] * res + c[1]) * res + c[2];
+        next.push_back(head[h]);
+        head[h] = index;
+        active.push_back((uint32_t)index);
+
+        bool found = false;
+        while (!active.empty() && !found)
+        {
+            uint32_t a = randomPCG32Bounded(&random, (uint32_t)active.size());
+            const float* p = &(*points)[active[a] * 3];
+
+            // A tangent basis at p.
+            float t1[3];
+            if (fabsf(p[0]) < 0.9f)
+            {
+                t1[0] = 0.0f; t1[1] = p[2]; t1[2] = -p[1];
+            }
+            else
+            {
+                t1[0] = -p[2]; t1[1] = 0.0f; t1[2] = p[0];
+            }
+            float l = sqrtf(t1[0] * t1[0] + t1[1] * t1[1] + t1[2] * t1[2]);
+            t1[0] /= l; t1[1] /= l; t1[2] /= l;
+            float t2[3] =
+            {
+                p[1] * t1[2] - p[2] * t1[1],
+                p[2] * t1[0] - p[0] * t1[2],
+                p[0] * t1[1] - p[1] * t1[0],
+            };
+
+            for (uint32_t k = 0; k < numAttempts && !found; ++k)
+            {
+                // Uniform in the area of the spherical annulus.
+                float cosTheta = cosAngle - randomPCG32Float(&random) * (cosAngle - cos2Angle);
+                float sinTheta = sqrtf(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+                float phi = randomPCG32Float(&random) * (float)(2.0 * PI);
+                float u = sinTheta * cosf(phi);
+                float v = sinTheta * sinf(phi);
+                float q[3];
+                for (int i = 0; i < 3; ++i)
+                {
+                    q[i] = p[i] * cosTheta + t1[i] * u + t2[i] * v;
+                }
+
+                int32_t qc[3];
+                for (int i = 0; i < 3; ++i)
+                {
+                    qc[i] = Local::coordinate(q[i], cell, res);
+                }
+
+                bool accepted = true;
+                for (int32_t x = std::max(qc[0] - 1, 0); x <= std::min(qc[0] + 1, res - 1) && accepted; ++x)
+                {
+                    for (int32_t y = std::max(qc[1] - 1, 0); y <= std::min(qc[1] + 1, res - 1) && accepted; ++y)
+                    {
+                        for (int32_t z = std::max(qc[2] - 1, 0); z <= std::min(qc[2] + 1, res - 1) && accepted; ++z)
+                        {
+                            for (int32_t o = head[(x * res + y) * res + z]; o >= 0; o = next[o])
+                            {
+                                const float* r = &(*points)[o * 3];
+                                float dx = r[0] - q[0];
+                                float dy = r[1] - q[1];
+                                float dz = r[2] - q[2];
+                                if (dx * dx + dy * dy + dz * dz < chord2)
+                                {
+                                    accepted = false;
+                                    break;
+                                }
+                            }
+                        }
+                    }
+                }
+
+                if (accepted)
+                {
+                    candidate[0] = q[0];
+                    candidate[1] = q[1];
+                    candidate[2] = q[2];
+                    found = true;
+                }
+            }
+
+            if (!found)
+            {
+                active[a] = active.back();
+                active.pop_back();
+            }
+        }
+
+        if (!found)
+        {
+            break;
+        }
+    }
+}
+
+//
+// Lattices and grids
+//
+void samplingFibonacciSphere(uint32_t n, std::vector<float>* points)
+{
+    // The golden angle
+    const double turn = PI * (3.0 - sqrt(5.0));
+
+    points->resize(n * 3);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        double y = 1.0 - (2.0 * i + 1.0) / (double)n;
+        double l = sqrt(std::max(1.0 - y * y, 0.0));
+        double phi = turn * i;
+        (*points)[i * 3 + 0] = (float)(l * sin(phi));
+        (*points)[i * 3 + 1] = (float)y;
+        (*points)[i * 3 + 2] = (float)(l * cos(phi));
+    }
+}
+
+void samplingJittered2D(uint32_t nx, uint32_t ny, float jitter, uint32_t seed, std::vector<float>* points)
+{
+    RandomPCG32 random;
+    randomPCG32Seed(&random, seed, 0);
+
+    points->resize(nx * ny * 2);
+    for (uint32_t j = 0; j < ny; ++j)
+    {
+        for (uint32_t i = 0; i < nx; ++i)
+        {
+            float u = 0.5f + jitter * (randomPCG32Float(&random) - 0.5f);
+            float v = 0.5f + jitter * (randomPCG32Float(&random) - 0.5f);
+            float x = ((float)i + u) / (float)nx;
+            float y = ((float)j + v) / (float)ny;
+            (*points)[(j * nx + i) * 2 + 0] = std::min(x, 1.0f - FLT_EPSILON * 0.5f);
+            (*points)[(j * nx + i) * 2 + 1] = std::min(y, 1.0f - FLT_EPSILON * 0.5f);
+        }
+    }
+}
+
+//
+// Low-discrepancy sequences
+//
+static inline uint32_t reverseBits(uint32_t x)
+{
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+// The second Sobol dimension as a 0.32 fixed point number.
+static inline uint32_t sobolSecond(uint32_t i)
+{
+    uint32_t r = 0;
+    for (uint32_t v = 1u << 31; i != 0; i >>= 1, v ^= v >> 1)
+    {
+        if (i & 1)
+        {
+            r ^= v;
+        }
+    }
+    return r;
+}
+
+// Owen's scrambling of a 0.32 fixed point number: every bit is flipped
+// by a hash of the seed and the higher bits. Reversed, the higher bits
+// are the lower ones, which are the only ones the multiplications carry
+// into (Laine and Karras, Burley).
+static inline uint32_t owenScramble(uint32_t x, uint32_t seed)
+{
+    x = reverseBits(x);
+    x ^= x * 0x3d20adeau;
+    x += seed;
+    x *= (seed >> 16) | 1;
+    x ^= x * 0x05526c56u;
+    x ^= x * 0x53a22864u;
+    return reverseBits(x);
+}
+
+void samplingSobol2D(uint32_t n, uint32_t seed, std::vector<float>* points)
+{
+    uint32_t seed0 = hash32(seed);
+    uint32_t seed1 = hash32(seed0 ^ 0x68e31da4u);
+
+    points->resize(n * 2);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        (*points)[i * 2 + 0] = toUnit(owenScramble(reverseBits(i), seed0));
+        (*points)[i * 2 + 1] = toUnit(owenScramble(sobolSecond(i), seed1));
+    }
+}
+
+// The radical inverse of i in the base with each digit permuted by a hash
+// of the seed, the level and the digits before it. The digits past the
+// ones of i are zeros, permuted too, up to the precision of a float.
+static float scrambledRadicalInverse(uint32_t i, uint32_t base, uint32_t seed)
+{
+    assert(base >= 2 && base <= 16);
+
+    double inverse = 1.0 / (double)base;
+    double scale = inverse;
+    double result = 0.0;
+    uint32_t prefix = seed;
+    while (scale > 1e-8)
+    {
+        uint32_t digit = i % base;
+        i /= base;
+
+        // A permutation of the base digits from the hash, Fisher-Yates.
+        uint32_t permutation[16];
+        for (uint32_t d = 0; d < base; ++d)
+        {
+            permutation[d] = d;
+        }
+        uint32_t h = hash32(prefix);
+        for (uint32_t d = base - 1; d > 0; --d)
+        {
+            std::swap(permutation[d], permutation[h % (d + 1)]);
+            h /= d + 1;
+        }
+
+        result += permutation[digit] * scale;
+        scale *= inverse;
+        prefix = hash32(prefix ^ (digit + 1) * 0x9e3779b9u);
+    }
+
+    return std::min((float)result, 1.0f - FLT_EPSILON * 0.5f);
+}
+
+void samplingHalton2D(uint32_t n, uint32_t seed, std::vector<float>* points)
+{
+    uint32_t seed0 = hash32(seed);
+    uint32_t seed1 = hash32(seed0 ^ 0x68e31da4u);
+
+    points->resize(n * 2);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        // The base 2 digits are bits.
+        (*points)[i * 2 + 0] = toUnit(owenScramble(reverseBits(i), seed0));
+        (*points)[i * 2 + 1] = scrambledRadicalInverse(i, 3, seed1);
+    }
+}
+
+//
+// Mappings
+//
+static void squareToSphere(const float* square, uint32_t n, float yScale, std::vector<float>* points)
+{
+    points->resize(n * 3);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        float y = 1.0f - yScale * square[i * 2 + 0];
+        float l = sqrtf(std::max(1.0f - y * y, 0.0f));
+        float phi = square[i * 2 + 1] * (float)(2.0 * PI);
+        (*points)[i * 3 + 0] = l * sinf(phi);
+        (*points)[i * 3 + 1] = y;
+        (*points)[i * 3 + 2] = l * cosf(phi);
+    }
+}
+
+void samplingSquareToSphere(const float* square, uint32_t n, std::vector<float>* points)
+{
+    squareToSphere(square, n, 2.0f, points);
+}
+
+void samplingSquareToHemisphere(const float* square, uint32_t n, std::vector<float>* points)
+{
+    squareToSphere(square, n, 1.0f, points);
+}
+
+//
+// Hemisphere kernels
+//
+// cos(theta) of the uniform u in [0, 1) under the distribution, 1 at u = 0.
+static inline float hemisphereCosTheta(uint32_t type, float exponent, float u)
+{
+    switch (type)
+    {
+        case SAMPLING_HEMISPHERE_UNIFORM:
+            return 1.0f - u;
+        case SAMPLING_HEMISPHERE_COSINE:
+            return sqrtf(1.0f - u);
+        default:
+            return powf(1.0f - u, 1.0f / (exponent + 1.0f));
+    }
+}
+
+void samplingHemisphere(uint32_t type, float exponent, uint32_t n, uint32_t seed, std::vector<float>* points)
+{
+    assert(type <= SAMPLING_HEMISPHERE_POWER_COSINE);
+    assert(exponent >= 0.0f);
+
+    std::vector<float> square;
+    samplingSobol2D(n, seed, &square);
+
+    points->resize(n * 3);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        float y = hemisphereCosTheta(type, exponent, square[i * 2 + 0]);
+        float l = sqrtf(std::max(1.0f - y * y, 0.0f));
+        float phi = square[i * 2 + 1] * (float)(2.0 * PI);
+        (*points)[i * 3 + 0] = l * sinf(phi);
+        (*points)[i * 3 + 1] = y;
+        (*points)[i * 3 + 2] = l * cosf(phi);
+    }
+}
+
+float samplingHemispherePdf(uint32_t type, float exponent, float cosTheta)
+{
+    if (cosTheta < 0.0f)
+    {
+        return 0.0f;
+    }
+    switch (type)
+    {
+        case SAMPLING_HEMISPHERE_UNIFORM:
+            return (float)(0.5 / PI);
+        case SAMPLING_HEMISPHERE_COSINE:
+            return cosTheta * (float)(1.0 / PI);
+        default:
+            return (exponent + 1.0f) * (float)(0.5 / PI) * powf(cosTheta, exponent);
+    }
+}
+
+void samplingProgressiveOrder(const float* points, uint32_t n, uint32_t numComponents, std::vector<uint32_t>* order)
+{
+    order->clear();
+    if (n == 0)
+    {
+        return;
+    }
+
+    // The squared distance of every point to the ones taken so far.
+    std::vector<float> distances(n, FLT_MAX);
+    std::vector<char> taken(n, 0);
+    uint32_t next = 0;
+    for (uint32_t k = 0; k < n; ++k)
+    {
+        order->push_back(next);
+        taken[next] = 1;
+
+        const float* p = points + next * numComponents;
+        float farthest = -1.0f;
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            if (taken[i])
+            {
+                continue;
+            }
+            const float* q = points + i * numComponents;
+            float d2 = 0.0f;
+            for (uint32_t c = 0; c < numComponents; ++c)
+            {
+                d2 += (q[c] - p[c]) * (q[c] - p[c]);
+            }
+            distances[i] = std::min(distances[i], d2);
+            if (distances[i] > farthest)
+            {
+                farthest = distances[i];
+                next = i;
+            }
+        }
+    }
+}
+
+void samplingHemisphereKernel(const float* points, uint32_t n, uint32_t type, float exponent, float* kernel)
+{
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        float cosTheta = points[i * 3 + 1];
+        kernel[i * 4 + 0] = points[i * 3 + 0];
+        kernel[i * 4 + 1] = cosTheta;
+        kernel[i * 4 + 2] = points[i * 3 + 2];
+        if (type == SAMPLING_HEMISPHERE_POWER_COSINE)
+        {
+            kernel[i * 4 + 3] = 1.0f;
+        }
+        else
+        {
+            float pdf = samplingHemispherePdf(type, exponent, cosTheta);
+            kernel[i * 4 + 3] = pdf > 0.0f? cosTheta / ((float)PI * pdf) : 0.0f;
+        }
+    }
+}
+
+//
+// Metrics
+//
+float samplingMinDistance(const float* points, uint32_t n, uint32_t numComponents)
+{
+    assert(numComponents == 2 || numComponents == 3);
+
+    // Sweep the points in increasing x; only the following ones closer
+    // in x than the best distance so accepted can be closer.
+    std::vector<uint32_t> order(n);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        order[i] = i;
+    }
+    struct ByX
+    {
+        const float* points;
+        uint32_t     numComponents;
+        bool operator()(uint32_t a, uint32_t b) const
+        {
+            return points[a * numComponents] < points[b * numComponents];
+        }
+    };
+    ByX byX = { points, numComponents };
+    std::sort(order.begin(), order.end(), byX);
+
+    float best2 = FLT_MAX;
+    for (uint32_t a = 0; a < n; ++a)
+    {
+        const float* p = points + order[a] * numComponents;
+        for (uint32_t b = a + 1; b < n; ++b)
+        {
+            const float* q = points + order[b] * numComponents;
+            float dx = q[0] - p[0];
+            if (dx * dx >= best2)
+            {
+                break;
+            }
+            float d2 = 0.0f;
+            for (uint32_t c = 0; c < numComponents; ++c)
+            {
+                d2 += (q[c] - p[c]) * (q[c] - p[c]);
+            }
+            best2 = std::min(best2, d2);
+        }
+    }
+
+    return sqrtf(best2);
+}
+
+float samplingPackingDistance(uint32_t n, uint32_t numComponents)
+{
+    // A point of the hexagonal packing of spacing d covers sqrt(3) / 2 d^2.
+    double area = numComponents == 2? 1.0 : 4.0 * PI;
+    return (float)sqrt(2.0 * area / (sqrt(3.0) * (double)n));
+}
+
+double samplingL2Discrepancy2D(const float* points, uint32_t n)
+{
+    double sum1 = 0.0;
+    double sum2 = 0.0;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        double xi = points[i * 2 + 0];
+        double yi = points[i * 2 + 1];
+        sum1 += (1.0 - xi * xi) * (1.0 - yi * yi);
+
+        // The pairs (i, j) and (j, i) are the same.
+        sum2 += (1.0 - xi) * (1.0 - yi);
+        for (uint32_t j = i + 1; j < n; ++j)
+        {
+            double x = std::max(xi, (double)points[j * 2 + 0]);
+            double y = std::max(yi, (double)points[j * 2 + 1]);
+            sum2 += 2.0 * (1.0 - x) * (1.0 - y);
+        }
+    }
+
+    double t2 = 1.0 / 9.0 - sum1 / (2.0 * n) + sum2 / ((double)n * n);
+    return sqrt(std::max(t2, 0.0));
+}
+
+double samplingCapDiscrepancySphere(const float* points, uint32_t n)
+{
+    double sum = 0.0;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        const float* p = points + i * 3;
+        for (uint32_t j = i + 1; j < n; ++j)
+        {
+            const float* q = points + j * 3;
+            double dx = p[0] - q[0];
+            double dy = p[1] - q[1];
+            double dz = p[2] - q[2];
+            sum += 2.0 * sqrt(dx * dx + dy * dy + dz * dz);
+        }
+    }
+
+    // mean |x - y| + 4 D^2 = 4 / 3, the mean distance of the sphere.
+    double d2 = (4.0 / 3.0 - sum / ((double)n * n)) / 4.0;
+    return sqrt(std::max(d2, 0.0));
+}
+
+//
+// The nearest sample to a point through a uniform grid over the bounds
+// of the points, searched in growing shells of cells.
+//
+class SamplingGrid
+{
+public:
+    SamplingGrid(const float* points, uint32_t n, uint32_t numComponents, float lo, float hi, float cellSize)
+    {
+        m_points = points;
+        m_numComponents = numComponents;
+        m_lo = lo;
+        m_res = std::max((int32_t)ceilf((hi - lo) / cellSize), 1);
+        m_cellSize = (hi - lo) / (float)m_res;
+        m_resZ = numComponents == 3? m_res : 1;
+
+        // The samples sorted by cell.
+        uint32_t numCells = (uint32_t)(m_res * m_res * m_resZ);
+        m_first.assign(numCells + 1, 0);
+        std::vector<uint32_t> cellOf(n);
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            cellOf[i] = cell(points + i * numComponents);
+            m_first[cellOf[i] + 1]++;
+        }
+        for (uint32_t c = 0; c < numCells; ++c)
+        {
+            m_first[c + 1] += m_first[c];
+        }
+        std::vector<uint32_t> fill(m_first.begin(), m_first.end() - 1);
+        m_samples.resize(n);
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            m_samples[fill[cellOf[i]]++] = i;
+        }
+    }
+
+    // The squared distance to the nearest sample.
+    float nearest(const float* q) const
+    {
+        int32_t c[3] = { coordinate(q[0]), coordinate(q[1]), m_numComponents == 3? coordinate(q[2]) : 0 };
+        int32_t maxShell = std::max(m_res, m_resZ);
+
+        float best2 = FLT_MAX;
+        for (int32_t k = 0; k <= maxShell; ++k)
+        {
+            int32_t kz = m_numComponents == 3? k : 0;
+            for (int32_t z = c[2] - kz; z <= c[2] + kz; ++z)
+            {
+                if (z < 0 || z >= m_resZ)
+                {
+                    continue;
+                }
+                for (int32_t y = c[1] - k; y <= c[1] + k; ++y)
+                {
+                    if (y < 0 || y >= m_res)
+                    {
+                        continue;
+                    }
+                    for (int32_t x = c[0] - k; x <= c[0] + k; ++x)
+                    {
+                        if (x < 0 || x >= m_res)
+                        {
+                            continue;
+                        }
+                        // Only the cells of the shell k.
+                        if (std::max(std::max(abs(x - c[0]), abs(y - c[1])), abs(z - c[2])) != k)
+                        {
+                            continue;
+                        }
+                        uint32_t h = (uint32_t)((z * m_res + y) * m_res + x);
+                        for (uint32_t s = m_first[h]; s < m_first[h + 1]; ++s)
+                        {
+                            const float* p = m_points + m_samples[s] * m_numComponents;
+                            float d2 = 0.0f;
+                            for (uint32_t a = 0; a < m_numComponents; ++a)
+                            {
+                                d2 += (p[a] - q[a]) * (p[a] - q[a]);
+                            }
+                            best2 = std::min(best2, d2);
+                        }
+                    }
+                }
+            }
+
+            // Past the shell k, the cells are at least k cells away.
+            float reach = (float)k * m_cellSize;
+            if (best2 <= reach * reach)
+            {
+                break;
+            }
+        }
+        return best2;
+    }
+
+private:
+    int32_t coordinate(float v) const
+    {
+        return std::max(0, std::min(m_res - 1, (int32_t)((v - m_lo) / m_cellSize)));
+    }
+
+    uint32_t cell(const float* p) const
+    {
+        int32_t z = m_numComponents == 3? coordinate(p[2]) : 0;
+        return (uint32_t)((z * m_res + coordinate(p[1])) * m_res + coordinate(p[0]));
+    }
+
+private:
+    const float*          m_points;
+    uint32_t              m_numComponents;
+    float                 m_lo;
+    float                 m_cellSize;
+    int32_t               m_res;
+    int32_t               m_resZ;
+    std::vector<uint32_t> m_first;
+    std::vector<uint32_t> m_samples;
+};
+
+double samplingEnergy(const float* points,
+                      uint32_t n,
+                      uint32_t numComponents,
+                      uint32_t numReference,
+                      uint32_t seed)
+{
+    assert(numComponents == 2 || numComponents == 3);
+
+    bool sphere = numComponents == 3;
+    double area = sphere? 4.0 * PI : 1.0;
+    float cellSize = (float)sqrt(area / (double)n);
+    SamplingGrid grid(points, n, numComponents, sphere? -1.0f : 0.0f, 1.0f, cellSize);
+
+    RandomPCG32 random;
+    randomPCG32Seed(&random, seed, 0);
+    double energy = 0.0;
+    for (uint32_t r = 0; r < numReference; ++r)
+    {
+        float q[3];
+        if (sphere)
+        {
+            q[1] = 1.0f - 2.0f * randomPCG32Float(&random);
+            float l = sqrtf(std::max(1.0f - q[1] * q[1], 0.0f));
+            float phi = randomPCG32Float(&random) * (float)(2.0 * PI);
+            q[0] = l * sinf(phi);
+            q[2] = l * cosf(phi);
+
+            // The angle from the chord.
+            float chord = sqrtf(grid.nearest(q));
+            double angle = 2.0 * asin(std::min(chord * 0.5, 1.0));
+            energy += angle * angle;
+        }
+        else
+        {
+            q[0] = randomPCG32Float(&random);
+            q[1] = randomPCG32Float(&random);
+            energy += grid.nearest(q);
+        }
+    }
+
+    return energy;
+}
+
+double samplingNormalizedEnergy(double energy, uint32_t n, uint32_t numComponents, uint32_t numReference)
+{
+    // The mean squared distance over twice the area of a cell.
+    double area = numComponents == 2? 1.0 : 4.0 * PI;
+    return energy / (double)numReference / (2.0 * area / (double)n);
+}
+
+void samplingRadialSpectrum2D(const float* points, uint32_t n, uint32_t numBins, std::vector<double>* spectrum)
+{
+    // The sums at the frequencies (fx, fy), fx in [0, F] and fy in
+    // [-F, F], the other half being conjugate.
+    int32_t F = (int32_t)numBins;
+    int32_t width = 2 * F + 1;
+    std::vector<double> re((F + 1) * width, 0.0);
+    std::vector<double> im((F + 1) * width, 0.0);
+    std::vector<double> cx(F + 1);
+    std::vector<double> sx(F + 1);
+    std::vector<double> cy(width);
+    std::vector<double> sy(width);
+
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        double ax = -2.0 * PI * points[i * 2 + 0];
+        double ay = -2.0 * PI * points[i * 2 + 1];
+        for (int32_t f = 0; f <= F; ++f)
+        {
+            cx[f] = cos(ax * f);
+            sx[f] = sin(ax * f);
+        }
+        for (int32_t f = -F; f <= F; ++f)
+        {
+            cy[f + F] = cos(ay * f);
+            sy[f + F] = sin(ay * f);
+        }
+        for (int32_t fx = 0; fx <= F; ++fx)
+        {
+            double* r = &re[fx * width];
+            double* m = &im[fx * width];
+            for (int32_t fy = 0; fy < width; ++fy)
+            {
+                r[fy] += cx[fx] * cy[fy] - sx[fx] * sy[fy];
+                m[fy] += cx[fx] * sy[fy] + sx[fx] * cy[fy];
+            }
+        }
+    }
+
+    spectrum->assign(numBins, 0.0);
+    std::vector<uint32_t> counts(numBins, 0);
+    for (int32_t fx = 0; fx <= F; ++fx)
+    {
+        for (int32_t fy = -F; fy <= F; ++fy)
+        {
+            // Skip the conjugate half of the fx = 0 column and DC.
+            if (fx == 0 && fy <= 0)
+            {
+                continue;
+            }
+            uint32_t bin = (uint32_t)(sqrt((double)(fx * fx + fy * fy)) + 0.5);
+            if (bin >= numBins)
+            {
+                continue;
+            }
+            double r = re[fx * width + fy + F];
+            double m = im[fx * width + fy + F];
+            (*spectrum)[bin] += (r * r + m * m) / (double)n;
+            counts[bin]++;
+        }
+    }
+    for (uint32_t b = 0; b < numBins; ++b)
+    {
+        if (counts[b] > 0)
+        {
+            (*spectrum)[b] /= (double)counts[b];
+        }
+    }
+}
+
+double samplingLowFrequencyPower2D(const float* points, uint32_t n)
+{
+    uint32_t numBins = std::max((uint32_t)(0.5 * sqrt((double)n)), 2u);
+    std::vector<double> spectrum;
+    samplingRadialSpectrum2D(points, n, numBins, &spectrum);
+
+    double sum = 0.0;
+    for (uint32_t b = 1; b < numBins; ++b)
+    {
+        sum += spectrum[b];
+    }
+    return sum / (double)(numBins - 1);
+}
@@ -0,0 +1,154 @@
+// --------------------------------------------------------------
+// sampling.h
+// Blue-noise and low-discrepancy sample generators in the unit
+// square and on the unit sphere, and the metrics to compare them.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <stdint.h>
+#include <vector>
+
+//
+// The generators replace the content of points with the interleaved
+// coordinates: x, y in [0, 1) for the square and unit x, y, z for the
+// sphere. The same seed gives the same points.
+//
+
+// Bridson's Poisson-disk sampling: no two points are closer than radius,
+// and every point of the square is within 2 * radius of one. Each active
+// point tries numAttempts candidates in the annulus [radius, 2 * radius)
+// around it, 30 in the paper.
+extern void samplingPoissonDisk2D(float radius, uint32_t numAttempts, uint32_t seed, std::vector<float>* points);
+
+// Bridson's sampling on the sphere, with the distances as angles.
+extern void samplingPoissonDiskSphere(float angle, uint32_t numAttempts, uint32_t seed, std::vector<float>* points);
+
+// The spherical Fibonacci lattice of n points: equal area bands in y,
+// turned by the golden angle.
+extern void samplingFibonacciSphere(uint32_t n, std::vector<float>* points);
+
+// One point in each cell of an nx x ny grid, moved from the cell center
+// by up to jitter cells; 0 is the regular grid and 1 the full jitter.
+extern void samplingJittered2D(uint32_t nx, uint32_t ny, float jitter, uint32_t seed, std::vector<float>* points);
+
+// The first n points of the 2D Sobol sequence (van der Corput and the
+// second Sobol dimension), Owen-scrambled by hashing as in Burley,
+// "Practical Hash-based Owen Scrambling", 2020. The first 2^k points
+// keep one point per elementary interval.
+extern void samplingSobol2D(uint32_t n, uint32_t seed, std::vector<float>* points);
+
+// The first n points of the Halton sequence in bases 2 and 3, with
+// every digit permuted by a hash of the seed and the higher digits,
+// which is Owen's scrambling.
+extern void samplingHalton2D(uint32_t n, uint32_t seed, std::vector<float>* points);
+
+// Map n points of the square to the sphere or the upper hemisphere
+// (y >= 0), keeping the areas: y = 1 - 2u (1 - u for the hemisphere)
+// and the azimuth 2 pi v from z to x, as SphereSampler does.
+extern void samplingSquareToSphere(const float* square, uint32_t n, std::vector<float>* points);
+extern void samplingSquareToHemisphere(const float* square, uint32_t n, std::vector<float>* points);
+
+//
+// Hemisphere kernels, around +y as the hemisphere of SphereSampler.
+//
+enum SamplingHemisphereType
+{
+    SAMPLING_HEMISPHERE_UNIFORM,         // pdf 1 / (2 pi)
+    SAMPLING_HEMISPHERE_COSINE,          // pdf cos / pi
+    SAMPLING_HEMISPHERE_POWER_COSINE,    // pdf (e + 1) / (2 pi) cos^e
+};
+
+// n directions of the distribution, the scrambled Sobol points warped by
+// the inverse of its CDF. The warp keeps the stratification, so every
+// prefix of the sequence is well distributed: the first 2^k directions
+// have one in each elementary interval, and the lengths in between are
+// nearly as good. A shader can use the first k of the n samples for any
+// k. exponent is only used by the power cosine, where 0 is uniform and 1
+// the cosine.
+extern void samplingHemisphere(uint32_t type, float exponent, uint32_t n, uint32_t seed, std::vector<float>* points);
+
+// The density of the distribution per solid angle.
+extern float samplingHemispherePdf(uint32_t type, float exponent, float cosTheta);
+
+// The order of the n points in which every point is the farthest one from
+// the points before, greedily, so that the prefixes of a set with no
+// order of its own, e.g. points.xyz or SphereSampler, are spread too.
+// O(n^2).
+extern void samplingProgressiveOrder(const float* points,
+                                     uint32_t n,
+                                     uint32_t numComponents,
+                                     std::vector<uint32_t>* order);
+
+// n directions of the distribution as float4s, 16 bytes each: the
+// direction in xyz and in w its weight in the ambient occlusion estimate,
+// so the occlusion of the first k samples is sum(w * V) / k for any k. It
+// is the layout of a float4 array in a cbuffer and of a
+// DXGI_FORMAT_R32G32B32A32_FLOAT texture.
+//
+// For the uniform and the cosine kernels w is cos / (pi pdf), and the
+// estimate is the cosine weighted occlusion. The power cosine one has
+// w = 1 and estimates the occlusion weighted by its own pdf, which is
+// narrower than the cosine: reweighting it to the cosine needs
+// 2 cos^(1 - e) / (e + 1), unbounded at the horizon for e > 1, and every
+// short prefix would come out too dark.
+extern void samplingHemisphereKernel(const float* points,
+                                     uint32_t n,
+                                     uint32_t type,
+                                     float exponent,
+                                     float* kernel);
+
+//
+// Metrics. numComponents is 2 for the square and 3 for the sphere.
+//
+
+// The smallest Euclidean distance between two points, the chord on the
+// sphere.
+extern float samplingMinDistance(const float* points, uint32_t n, uint32_t numComponents);
+
+// The distance between the points of the hexagonal packing of n points
+// in the square, or on the area of the sphere, to normalize the minimum
+// distance. Poisson-disk sets reach about 0.75 of it, random ones much
+// less.
+extern float samplingPackingDistance(uint32_t n, uint32_t numComponents);
+
+// The L2 star discrepancy in the square, Warnock's formula. O(n^2).
+extern double samplingL2Discrepancy2D(const float* points, uint32_t n);
+
+// The L2 spherical cap discrepancy from the sum of the distances by
+// Stolarsky's invariance principle. O(n^2).
+extern double samplingCapDiscrepancySphere(const float* points, uint32_t n);
+
+// The sum of the squared distances of numReference uniform random points
+// to their nearest sample, angles on the sphere. With 256 * n reference
+// points on the sphere it is comparable to the energy of SphereSampler,
+// which is the same sum under the constraint of equal cells.
+extern double samplingEnergy(const float* points,
+                             uint32_t n,
+                             uint32_t numComponents,
+                             uint32_t numReference,
+                             uint32_t seed);
+
+// The energy as the dimensionless normalized second moment, the same for
+// any n: about 0.0802 for the hexagonal lattice and 0.159 for random
+// points.
+extern double samplingNormalizedEnergy(double energy, uint32_t n, uint32_t numComponents, uint32_t numReference);
+
+// The periodogram |sum exp(-2 pi i f.x)|^2 / n of the points in the
+// square at the integer frequencies f, averaged over the rings of the
+// radius |f| in [0, numBins). It is 1 everywhere for white noise, and
+// low up to about sqrt(n) for blue noise.
+extern void samplingRadialSpectrum2D(const float* points, uint32_t n, uint32_t numBins, std::vector<double>* spectrum);
+
+// The mean of the radial spectrum below half of sqrt(n), the low
+// frequencies blue noise keeps out.
+extern double samplingLowFrequencyPower2D(const float* points, uint32_t n);
+
+#endif // !SAMPLING_H
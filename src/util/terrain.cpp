@@ -0,0 +1,414 @@
+// --------------------------------------------------------------
+// terrain.cpp
+// Chunked heightmap terrain meshes with per-LOD index lists,
+// skirts and a quadtree for the LOD selection.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "terrain.h"
+
+#include "parallel.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <emmintrin.h>
+#include <algorithm>
+
+void terrainNumChunks(const TerrainDesc* desc, uint32_t* numChunksX, uint32_t* numChunksZ)
+{
+    uint32_t n = desc->chunkSize;
+    *numChunksX = std::max((desc->width - 1 + n - 1) / n, 1u);
+    *numChunksZ = std::max((desc->height - 1 + n - 1) / n, 1u);
+}
+
+uint32_t terrainNumChunkVertices(const TerrainDesc* desc)
+{
+    uint32_t n = desc->chunkSize + 1;
+    return n * n + 4 * n;
+}
+
+void terrainBuildIndices(const TerrainDesc* desc, uint32_t lod, std::vector<uint16_t>* indices)
+{
+    assert(lod < desc->numLods);
+
+    uint32_t n = desc->chunkSize;
+    uint32_t s = 1u << lod;
+    uint32_t pitch = n + 1;
+
+    indices->clear();
+    indices->reserve((n / s) * (n / s) * 6 + (n / s) * 4 * 6);
+
+    // The grid: a = (i, j), b = (i + s, j), c = (i, j + s), d = (i + s, j + s).
+    for (uint32_t j = 0; j < n; j += s)
+    {
+        for (uint32_t i = 0; i < n; i += s)
+        {
+            uint16_t a = (uint16_t)(j * pitch + i);
+            uint16_t b = (uint16_t)(a + s);
+            uint16_t c = (uint16_t)(a + s * pitch);
+            uint16_t d = (uint16_t)(c + s);
+
+            indices->push_back(a); indices->push_back(c); indices->push_back(b);
+            indices->push_back(b); indices->push_back(c); indices->push_back(d);
+        }
+    }
+
+    // The skirts. The borders z = 0 and x = n run with the outside on
+    // their right; the other two are flipped.
+    uint32_t borders[4][2] =
+    {
+        { 0, 1 },                  // z = 0: the first vertex and the step
+        { n, pitch },              // x = n
+        { n * pitch, 1 },          // z = n
+        { 0, pitch },              // x = 0
+    };
+    for (uint32_t b = 0; b < 4; ++b)
+    {
+        uint32_t skirt = pitch * pitch + b * pitch;
+        for (uint32_t k = 0; k < n; k += s)
+        {
+            uint16_t p0 = (uint16_t)(borders[b][0] + k * borders[b][1]);
+            uint16_t p1 = (uint16_t)(borders[b][0] + (k + s) * borders[b][1]);
+            uint16_t q0 = (uint16_t)(skirt + k);
+            uint16_t q1 = (uint16_t)(skirt + k + s);
+
+            if (b < 2)
+            {
+                indices->push_back(p0); indices->push_back(p1); indices->push_back(q0);
+                indices->push_back(q0); indices->push_back(p1); indices->push_back(q1);
+            }
+            else
+            {
+                indices->push_back(p0); indices->push_back(q0); indices->push_back(p1);
+                indices->push_back(q0); indices->push_back(q1); indices->push_back(p1);
+            }
+        }
+    }
+}
+
+// The heightmap sample with the coordinates clamped to it.
+static inline float sampleHeight(const TerrainDesc* desc, const float* heights, int32_t x, int32_t z)
+{
+    x = std::min(std::max(x, 0), (int32_t)desc->width - 1);
+    z = std::min(std::max(z, 0), (int32_t)desc->height - 1);
+    return heights[(size_t)z * desc->width + x];
+}
+
+void terrainBuildChunk(const TerrainDesc* desc, const float* heights, uint32_t x, uint32_t z, TerrainChunk* chunk)
+{
+    assert(desc->chunkSize <= 128 && (desc->chunkSize & (desc->chunkSize - 1)) == 0);
+    assert(desc->numLods > 0 && desc->numLods <= TERRAIN_MAX_LODS && (1u << (desc->numLods - 1)) <= desc->chunkSize);
+
+    uint32_t n = desc->chunkSize;
+    uint32_t pitch = n + 1;
+    int32_t x0 = (int32_t)(x * n);
+    int32_t z0 = (int32_t)(z * n);
+
+    chunk->x = x;
+    chunk->z = z;
+    chunk->minY = FLT_MAX;
+    chunk->maxY = -FLT_MAX;
+    chunk->vertices.resize(terrainNumChunkVertices(desc));
+
+    float du = 1.0f / (float)std::max(desc->width - 1, 1u);
+    float dv = 1.0f / (float)std::max(desc->height - 1, 1u);
+
+    // The rows j - 1, j and j + 1 from x0 - 1 to x0 + n + 1, padded to a
+    // multiple of 4 so that the whole row runs through SSE2. div and sqrt
+    // are exact in SSE2, so a vertex gets the same normal in both of the
+    // chunks sharing it.
+    const uint32_t numPadded = (pitch + 3) & ~3u;
+    float rows[3][128 + 8];
+    float normals[3][128 + 4];
+
+    __m128 scale = _mm_set1_ps(desc->heightScale / (2.0f * desc->spacing));
+    __m128 one = _mm_set1_ps(1.0f);
+
+    TerrainVertex* vertices = &chunk->vertices[0];
+    for (uint32_t j = 0; j < pitch; ++j)
+    {
+        int32_t gz = z0 + (int32_t)j;
+        for (uint32_t r = 0; r < 3; ++r)
+        {
+            for (uint32_t i = 0; i < numPadded + 2; ++i)
+            {
+                rows[r][i] = sampleHeight(desc, heights, x0 + (int32_t)i - 1, gz + (int32_t)r - 1);
+            }
+        }
+
+        for (uint32_t i = 0; i < numPadded; i += 4)
+        {
+            __m128 left = _mm_loadu_ps(&rows[1][i]);
+            __m128 right = _mm_loadu_ps(&rows[1][i + 2]);
+            __m128 back = _mm_loadu_ps(&rows[0][i + 1]);
+            __m128 front = _mm_loadu_ps(&rows[2][i + 1]);
+
+            // n = (-dh/dx, 1, -dh/dz) normalized.
+            __m128 sx = _mm_mul_ps(_mm_sub_ps(left, right), scale);
+            __m128 sz = _mm_mul_ps(_mm_sub_ps(back, front), scale);
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, sx), one), _mm_mul_ps(sz, sz)));
+
+            _mm_storeu_ps(&normals[0][i], _mm_div_ps(sx, length));
+            _mm_storeu_ps(&normals[1][i], _mm_div_ps(one, length));
+            _mm_storeu_ps(&normals[2][i], _mm_div_ps(sz, length));
+        }
+
+        for (uint32_t i = 0; i < pitch; ++i)
+        {
+            int32_t gx = x0 + (int32_t)i;
+            TerrainVertex& vertex = vertices[j * pitch + i];
+            vertex.x = (float)gx * desc->spacing;
+            vertex.y = rows[1][i + 1] * desc->heightScale;
+            vertex.z = (float)gz * desc->spacing;
+            vertex.nx = normals[0][i];
+            vertex.ny = normals[1][i];
+            vertex.nz = normals[2][i];
+            vertex.u = (float)gx * du;
+            vertex.v = (float)gz * dv;
+
+            chunk->minY = std::min(chunk->minY, vertex.y);
+            chunk->maxY = std::max(chunk->maxY, vertex.y);
+        }
+    }
+
+    // The skirts copy the borders, lowered.
+    uint32_t borders[4][2] =
+    {
+        { 0, 1 },
+        { n, pitch },
+        { n * pitch, 1 },
+        { 0, pitch },
+    };
+    for (uint32_t b = 0; b < 4; ++b)
+    {
+        TerrainVertex* skirt = vertices + pitch * pitch + b * pitch;
+        for (uint32_t k = 0; k < pitch; ++k)
+        {
+            skirt[k] = vertices[borders[b][0] + k * borders[b][1]];
+            skirt[k].y -= desc->skirtDepth;
+        }
+    }
+}
+
+void terrainBuildChunks(const TerrainDesc* desc,
+                        const float* heights,
+                        std::vector<TerrainChunk>* chunks,
+                        uint32_t numThreads)
+{
+    uint32_t numChunksX;
+    uint32_t numChunksZ;
+    terrainNumChunks(desc, &numChunksX, &numChunksZ);
+
+    uint32_t numChunks = numChunksX * numChunksZ;
+    chunks->resize(numChunks);
+
+    parallelFor(numChunks, numThreads, [&](uint32_t c)
+    {
+        terrainBuildChunk(desc, heights, c % numChunksX, c / numChunksX, &(*chunks)[c]);
+    });
+}
+
+//
+// TerrainQuadtree
+//
+TerrainQuadtree::TerrainQuadtree()
+{
+    m_spacing = 0.0f;
+    m_chunkSize = 0;
+    m_numLods = 0;
+    m_numChunksX = 0;
+    m_numChunksZ = 0;
+}
+
+TerrainQuadtree::~TerrainQuadtree()
+{
+}
+
+void TerrainQuadtree::build(const TerrainDesc* desc, const std::vector<TerrainChunk>& chunks)
+{
+    m_spacing = desc->spacing;
+    m_chunkSize = desc->chunkSize;
+    m_numLods = desc->numLods;
+    terrainNumChunks(desc, &m_numChunksX, &m_numChunksZ);
+    assert(chunks.size() == m_numChunksX * m_numChunksZ);
+
+    uint32_t size = 1;
+    while (size < m_numChunksX || size < m_numChunksZ)
+    {
+        size <<= 1;
+    }
+
+    m_nodes.clear();
+    buildNode(0, 0, size, chunks);
+}
+
+int32_t TerrainQuadtree::buildNode(uint32_t x, uint32_t z, uint32_t size, const std::vector<TerrainChunk>& chunks)
+{
+    if (x >= m_numChunksX || z >= m_numChunksZ)
+    {
+        return -1;
+    }
+
+    int32_t index = (int32_t)m_nodes.size();
+    m_nodes.push_back(Node());
+
+    Node node;
+    node.x = x;
+    node.z = z;
+    node.size = size;
+
+    float extent = (float)(m_chunkSize) * m_spacing;
+    node.bounds[0] = (float)x * extent;
+    node.bounds[2] = (float)z * extent;
+    node.bounds[3] = (float)std::min(x + size, m_numChunksX) * extent;
+    node.bounds[5] = (float)std::min(z + size, m_numChunksZ) * extent;
+
+    if (size == 1)
+    {
+        const TerrainChunk& chunk = chunks[z * m_numChunksX + x];
+        node.bounds[1] = chunk.minY;
+        node.bounds[4] = chunk.maxY;
+        node.children[0] = node.children[1] = node.children[2] = node.children[3] = -1;
+    }
+    else
+    {
+        node.bounds[1] = FLT_MAX;
+        node.bounds[4] = -FLT_MAX;
+
+        uint32_t half = size / 2;
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            int32_t child = buildNode(x + (c & 1) * half, z + (c >> 1) * half, half, chunks);
+            node.children[c] = child;
+            if (child >= 0)
+            {
+                node.bounds[1] = std::min(node.bounds[1], m_nodes[child].bounds[1]);
+                node.bounds[4] = std::max(node.bounds[4], m_nodes[child].bounds[4]);
+            }
+        }
+    }
+
+    m_nodes[index] = node;
+    return index;
+}
+
+uint32_t TerrainQuadtree::lodOf(float distance, float lodDistance) const
+{
+    uint32_t lod = 0;
+    float range = lodDistance;
+    while (distance >= range && lod + 1 < m_numLods)
+    {
+        range *= 2.0f;
+        lod++;
+    }
+    return lod;
+}
+
+void TerrainQuadtree::select(const float eye[3],
+                             float lodDistance,
+                             const float (*planes)[4],
+                             std::vector<TerrainSelection>* selection) const
+{
+    selection->clear();
+    if (!m_nodes.empty())
+    {
+        selectNode(0, eye, lodDistance, planes, selection);
+    }
+}
+
+void TerrainQuadtree::selectNode(int32_t index,
+                                 const float eye[3],
+                                 float lodDistance,
+                                 const float (*planes)[4],
+                                 std::vector<TerrainSelection>* selection) const
+{
+    const Node& node = m_nodes[index];
+    const float* bounds = node.bounds;
+
+    bool inside = true;
+    if (planes != NULL)
+    {
+        for (uint32_t p = 0; p < 6; ++p)
+        {
+            const float* plane = planes[p];
+
+            // The corners farthest inside and outside along the normal.
+            float pmax = plane[3];
+            float pmin = plane[3];
+            for (uint32_t a = 0; a < 3; ++a)
+            {
+                float lo = plane[a] * bounds[a];
+                float hi = plane[a] * bounds[a + 3];
+                pmax += std::max(lo, hi);
+                pmin += std::min(lo, hi);
+            }
+
+            if (pmax < 0.0f)
+            {
+                return;
+            }
+            inside &= (pmin >= 0.0f);
+        }
+    }
+
+    // The distances to the nearest and the farthest points of the box.
+    float nearest = 0.0f;
+    float farthest = 0.0f;
+    for (uint32_t a = 0; a < 3; ++a)
+    {
+        float lo = bounds[a] - eye[a];
+        float hi = eye[a] - bounds[a + 3];
+        float d = std::max(std::max(lo, hi), 0.0f);
+        float f = std::max(fabsf(lo), fabsf(hi));
+        nearest += d * d;
+        farthest += f * f;
+    }
+    uint32_t lod = lodOf(sqrtf(nearest), lodDistance);
+
+    if (node.size == 1)
+    {
+        TerrainSelection s = { node.z * m_numChunksX + node.x, lod };
+        selection->push_back(s);
+        return;
+    }
+
+    if (inside && lod == lodOf(sqrtf(farthest), lodDistance))
+    {
+        selectAll(index, lod, selection);
+        return;
+    }
+
+    // The children of a node inside the frustum are inside too.
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        if (node.children[c] >= 0)
+        {
+            selectNode(node.children[c], eye, lodDistance, inside? NULL : planes, selection);
+        }
+    }
+}
+
+void TerrainQuadtree::selectAll(int32_t index, uint32_t lod, std::vector<TerrainSelection>* selection) const
+{
+    const Node& node = m_nodes[index];
+    if (node.size == 1)
+    {
+        TerrainSelection s = { node.z * m_numChunksX + node.x, lod };
+        selection->push_back(s);
+        return;
+    }
+
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        if (node.children[c] >= 0)
+        {
+            selectAll(node.children[c], lod, selection);
+        }
+    }
+}
@@ -0,0 +1,141 @@
+// --------------------------------------------------------------
+// terrain.h
+// Chunked heightmap terrain meshes with per-LOD index lists,
+// skirts and a quadtree for the LOD selection.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define TERRAIN_MAX_LODS 8
+
+// The heightmap sample (i, j) is at (i * spacing, h * heightScale,
+// j * spacing). A chunk is chunkSize x chunkSize quads; the LOD l only
+// uses every 2^l-th vertex of it, so chunkSize must be a power of two
+// not smaller than 2^(numLods - 1) and at most 128 for 16-bit indices.
+struct TerrainDesc
+{
+    uint32_t width;        // The samples of the heightmap
+    uint32_t height;
+    float    spacing;
+    float    heightScale;
+    uint32_t chunkSize;
+    uint32_t numLods;
+    // The skirts hang that deep under the border of every chunk to hide
+    // the cracks between chunks of different LODs.
+    float    skirtDepth;
+};
+
+// The layout of the vertices of Model: position, normal, texcoord.
+struct TerrainVertex
+{
+    float x;
+    float y;
+    float z;
+    float nx;
+    float ny;
+    float nz;
+    float u;       // [0, 1] over the whole terrain
+    float v;
+};
+
+//
+// The vertices of a chunk are the (chunkSize + 1)^2 grid, row by row
+// along x, followed by the skirts: the 4 borders z = 0, x = chunkSize,
+// z = chunkSize and x = 0, each of chunkSize + 1 vertices in increasing
+// x or z. Every chunk has the same layout, so the index lists of the
+// LODs are shared by all the chunks.
+struct TerrainChunk
+{
+    uint32_t                   x;      // The chunk coordinates
+    uint32_t                   z;
+    float                      minY;   // The bounds of the grid vertices
+    float                      maxY;
+    std::vector<TerrainVertex> vertices;
+};
+
+// The chunks along x and z. The chunks on the far borders are completed
+// by repeating the last samples.
+extern void terrainNumChunks(const TerrainDesc* desc, uint32_t* numChunksX, uint32_t* numChunksZ);
+extern uint32_t terrainNumChunkVertices(const TerrainDesc* desc);
+
+// The triangle list of the grid and the skirts of the LOD, clockwise
+// seen from above and from the outside.
+extern void terrainBuildIndices(const TerrainDesc* desc, uint32_t lod, std::vector<uint16_t>* indices);
+
+// Build the chunk (x, z). The normals are the central differences of the
+// heightmap, so they are continuous across the chunk borders.
+extern void terrainBuildChunk(const TerrainDesc* desc, const float* heights, uint32_t x, uint32_t z, TerrainChunk* chunk);
+
+// Build all the chunks on numThreads threads with parallelFor().
+extern void terrainBuildChunks(const TerrainDesc* desc,
+                               const float* heights,
+                               std::vector<TerrainChunk>* chunks,
+                               uint32_t numThreads);
+
+// A chunk and the LOD to draw it with.
+struct TerrainSelection
+{
+    uint32_t chunk;   // The index in the chunks, z * numChunksX + x
+    uint32_t lod;
+};
+
+//
+// The quadtree over the chunks. The LOD of a chunk follows its distance
+// to the eye: LOD 0 below lodDistance, then one LOD more each time the
+// distance doubles. A node whose nearest and farthest points get the same
+// LOD, or which is outside the frustum, is not visited further.
+class TerrainQuadtree
+{
+public:
+    TerrainQuadtree();
+    ~TerrainQuadtree();
+
+    void build(const TerrainDesc* desc, const std::vector<TerrainChunk>& chunks);
+
+    // planes are the 6 planes (a, b, c, d) of the frustum with the inside
+    // at a * x + b * y + c * z + d >= 0, or NULL to skip the culling.
+    void select(const float eye[3],
+                float lodDistance,
+                const float (*planes)[4],
+                std::vector<TerrainSelection>* selection) const;
+
+    uint32_t numNodes() const { return (uint32_t)m_nodes.size(); }
+
+private:
+    struct Node
+    {
+        float    bounds[6];   // min x, y, z, max x, y, z
+        uint32_t x;           // The first chunk
+        uint32_t z;
+        uint32_t size;        // The chunks along each side
+        int32_t  children[4]; // -1 when missing
+    };
+
+    int32_t buildNode(uint32_t x, uint32_t z, uint32_t size, const std::vector<TerrainChunk>& chunks);
+    uint32_t lodOf(float distance, float lodDistance) const;
+    void selectNode(int32_t node, const float eye[3], float lodDistance, const float (*planes)[4],
+                    std::vector<TerrainSelection>* selection) const;
+    // Select every chunk of the node with the same LOD.
+    void selectAll(int32_t node, uint32_t lod, std::vector<TerrainSelection>* selection) const;
+
+private:
+    std::vector<Node> m_nodes;  // The root first
+    float             m_spacing;
+    uint32_t          m_chunkSize;
+    uint32_t          m_numLods;
+    uint32_t          m_numChunksX;
+    uint32_t          m_numChunksZ;
+};
+
+#endif // !TERRAIN_H
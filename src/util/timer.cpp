@@ -0,0 +1,65 @@
+// --------------------------------------------------------------
+// timer.cpp
+// The high resolution clock of the benchmarks.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#include "timer.h"
+
+#if defined _WIN32
+# include <windows.h>
+#else
+# include <chrono>
+#endif
+
+#if defined _WIN32
+
+// The frequency is fixed at boot, so query it once.
+static double timerPeriod()
+{
+    static double period = 0.0;
+    if (period == 0.0)
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        period = 1.0 / (double)frequency.QuadPart;
+    }
+    return period;
+}
+
+uint64_t timerNow()
+{
+    LARGE_INTEGER count;
+    QueryPerformanceCounter(&count);
+    return (uint64_t)count.QuadPart;
+}
+
+double timerSecondsBetween(uint64_t start, uint64_t end)
+{
+    return (double)(int64_t)(end - start) * timerPeriod();
+}
+
+#else
+
+uint64_t timerNow()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double timerSecondsBetween(uint64_t start, uint64_t end)
+{
+    return (double)(int64_t)(end - start) * 1e-9;
+}
+
+#endif
+
+double timerSecondsSince(uint64_t start)
+{
+    return timerSecondsBetween(start, timerNow());
+}
@@ -0,0 +1,34 @@
+// --------------------------------------------------------------
+// timer.h
+// The high resolution clock of the benchmarks.
+//
+// A DirectX11 framework.
+//
+// All rights reserved by AMD.
+//
+// Hongwei Li (hongwei.li@amd.com)
+// --------------------------------------------------------------
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+//
+// QueryPerformanceCounter() on Windows. The steady_clock of VS2012 ticks
+// at the 15.6 ms of the system timer, which is longer than most of what
+// the benchmarks time, so don't use it for them.
+//
+//   uint64_t start = timerNow();
+//   ...
+//   double seconds = timerSecondsSince(start);
+//
+
+// The current count of the clock.
+extern uint64_t timerNow();
+// The seconds between two counts of timerNow().
+extern double timerSecondsBetween(uint64_t start, uint64_t end);
+// The seconds since a count of timerNow().
+extern double timerSecondsSince(uint64_t start);
+
+#endif // !TIMER_H
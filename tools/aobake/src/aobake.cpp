@@ -0,0 +1,794 @@
+// aobake.cpp
+//
+// Created at 2014/04/22
+//
+// Hongwei Li hongwei.li@amd.com
+// All rights reserved
+//
+// Bake the ambient occlusion of an OBJ mesh on the CPU into its vertices
+// or into a texture with dxf/util/aobake.h, and report the rays per second
+// and how the baking scales with the threads. It does not need D3D, so it
+// runs on the build machines too. The benchmark mode compares the ray
+// kernels of dxf/util/bvh.h and dxf/util/raytrace.h on camera rays and on
+// ambient occlusion rays. It is built with AVX for the 8-wide kernels, so
+// it needs a CPU with AVX.
+//
+//   aobake ../demos/walking/media/models/teapot.obj -rays 128 -obj teapot_ao.obj
+//   aobake ../demos/rao/media/models/sibenik.obj -scaling
+//   aobake mesh.obj -texture 1024 1024 ao.pgm
+//   aobake benchmark ../demos/walking/media/models/teapot.obj ../demos/rao/media/models/sibenik.obj
+//
+// The values of -o and -obj follow the order of the v lines, which is the
+// order of the vertices of Model::loadObj(), so a demo can read them
+// straight into a vertex buffer.
+//
+
+#include <dxf/util/aobake.h>
+#include <dxf/util/random.h>
+#include <dxf/util/raytrace.h>
+#include <dxf/util/timer.h>
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+
+static void usage()
+{
+    fprintf(stderr,
+        "Usage: aobake <mesh.obj> [options]\n"
+        "  -rays <n>         The rays per vertex or texel (default 64)\n"
+        "  -distance <d>     The length of the rays, 0 for unbounded (default 0)\n"
+        "  -bias <b>         The offset of the rays along the normal (default 1e-4 of the diagonal)\n"
+        "  -seed <n>         The seed of the kernel and the rotations (default 1)\n"
+        "  -threads <n>      The threads, 0 for one per hardware thread (default 0)\n"
+        "  -o <file>         Write the value of every vertex, one per line\n"
+        "  -obj <file>       Write the mesh with the values as the vertex colors\n"
+        "  -texture <w> <h> <file>\n"
+        "                    Bake a texture of the texture coordinates of the mesh into a PGM\n"
+        "  -scaling          Bake the vertices with 1, 2, 4 and up to the hardware threads\n"
+        "       aobake benchmark <mesh.obj> [more.obj ...] [options]\n"
+        "  -size <n>         The camera rays are n x n (default 512)\n"
+        "  -rays <n>         The ambient occlusion rays per camera hit (default 8)\n"
+        "  -seed <n>         The seed of the ambient occlusion rays (default 1)\n");
+}
+
+//
+// The OBJ files, only what the baking needs: the positions, the texture
+// coordinates and the faces as fans of triangles.
+//
+struct Mesh
+{
+    std::vector<float>    positions;
+    std::vector<float>    texcoords;         // Of the vt lines
+    std::vector<uint32_t> indices;           // Into positions, 3 per triangle
+    std::vector<float>    cornerTexcoords;   // 6 per triangle, if every face has them
+    bool                  hasTexcoords;
+};
+
+// The index of a v or vt reference, 1-based or negative from the end.
+static bool resolveIndex(long index, size_t count, uint32_t* out)
+{
+    if (index < 0)
+    {
+        index += (long)count + 1;
+    }
+    if (index <= 0 || (size_t)index > count)
+    {
+        return false;
+    }
+    *out = (uint32_t)(index - 1);
+    return true;
+}
+
+static bool loadObj(const char* path, Mesh* mesh)
+{
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Failed to open %s.\n", path);
+        return false;
+    }
+
+    mesh->hasTexcoords = true;
+
+    char line[1024];
+    uint32_t lineNumber = 0;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        lineNumber++;
+        if (line[0] == 'v' && line[1] == ' ')
+        {
+            float x, y, z;
+            if (sscanf(line + 2, "%f %f %f", &x, &y, &z) != 3)
+            {
+                fprintf(stderr, "%s(%u): invalid vertex.\n", path, lineNumber);
+                fclose(fp);
+                return false;
+            }
+            mesh->positions.push_back(x);
+            mesh->positions.push_back(y);
+            mesh->positions.push_back(z);
+        }
+        else if (line[0] == 'v' && line[1] == 't' && line[2] == ' ')
+        {
+            float u = 0.0f;
+            float v = 0.0f;
+            sscanf(line + 3, "%f %f", &u, &v);
+            mesh->texcoords.push_back(u);
+            // OBJ has v up, the textures of D3D v down.
+            mesh->texcoords.push_back(1.0f - v);
+        }
+        else if (line[0] == 'f' && line[1] == ' ')
+        {
+            // v, v/vt, v//vn or v/vt/vn
+            uint32_t positions[64];
+            uint32_t texcoords[64];
+            uint32_t numCorners = 0;
+            bool corners = true;
+            bool faceTexcoords = true;
+            char* token = strtok(line + 2, " \t\r\n");
+            while (token != NULL && numCorners < 64)
+            {
+                char* end;
+                long v = strtol(token, &end, 10);
+                if (end == token || !resolveIndex(v, mesh->positions.size() / 3, &positions[numCorners]))
+                {
+                    corners = false;
+                    break;
+                }
+                if (*end == '/' && end[1] != '/')
+                {
+                    char* vtEnd;
+                    long vt = strtol(end + 1, &vtEnd, 10);
+                    if (vtEnd == end + 1 || !resolveIndex(vt, mesh->texcoords.size() / 2, &texcoords[numCorners]))
+                    {
+                        faceTexcoords = false;
+                    }
+                }
+                else
+                {
+                    faceTexcoords = false;
+                }
+                numCorners++;
+                token = strtok(NULL, " \t\r\n");
+            }
+            if (!corners || numCorners < 3)
+            {
+                fprintf(stderr, "%s(%u): invalid face.\n", path, lineNumber);
+                fclose(fp);
+                return false;
+            }
+            mesh->hasTexcoords = mesh->hasTexcoords && faceTexcoords;
+
+            for (uint32_t k = 2; k < numCorners; ++k)
+            {
+                uint32_t fan[3] = { 0, k - 1, k };
+                for (int c = 0; c < 3; ++c)
+                {
+                    mesh->indices.push_back(positions[fan[c]]);
+                    if (faceTexcoords)
+                    {
+                        mesh->cornerTexcoords.push_back(mesh->texcoords[texcoords[fan[c]] * 2 + 0]);
+                        mesh->cornerTexcoords.push_back(mesh->texcoords[texcoords[fan[c]] * 2 + 1]);
+                    }
+                    else
+                    {
+                        mesh->cornerTexcoords.push_back(0.0f);
+                        mesh->cornerTexcoords.push_back(0.0f);
+                    }
+                }
+            }
+        }
+    }
+
+    fclose(fp);
+
+    if (mesh->indices.empty())
+    {
+        fprintf(stderr, "%s has no faces.\n", path);
+        return false;
+    }
+    return true;
+}
+
+//
+// The outputs
+//
+static bool writeValues(const char* path, const float* ao, uint32_t n)
+{
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Failed to write %s.\n", path);
+        return false;
+    }
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        fprintf(fp, "%.6f\n", ao[i]);
+    }
+    fclose(fp);
+    return true;
+}
+
+static bool writeObj(const char* path, const Mesh& mesh, const float* ao)
+{
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Failed to write %s.\n", path);
+        return false;
+    }
+    fprintf(fp, "# The ambient occlusion as the vertex colors, baked by aobake\n");
+    uint32_t numVertices = (uint32_t)(mesh.positions.size() / 3);
+    for (uint32_t i = 0; i < numVertices; ++i)
+    {
+        const float* p = &mesh.positions[i * 3];
+        fprintf(fp, "v %f %f %f %.4f %.4f %.4f\n", p[0], p[1], p[2], ao[i], ao[i], ao[i]);
+    }
+    for (size_t t = 0; t < mesh.indices.size(); t += 3)
+    {
+        fprintf(fp, "f %u %u %u\n", mesh.indices[t] + 1, mesh.indices[t + 1] + 1, mesh.indices[t + 2] + 1);
+    }
+    fclose(fp);
+    return true;
+}
+
+// Grow the charts over the texels of no triangle, so that the bilinear
+// filtering and the mipmaps do not bleed the background in, then fill the
+// rest with 1.
+static void dilate(float* ao, uint32_t width, uint32_t height, uint32_t numPasses)
+{
+    std::vector<float> source(ao, ao + (size_t)width * height);
+    for (uint32_t pass = 0; pass < numPasses; ++pass)
+    {
+        for (uint32_t j = 0; j < height; ++j)
+        {
+            for (uint32_t i = 0; i < width; ++i)
+            {
+                if (source[j * width + i] >= 0.0f)
+                {
+                    continue;
+                }
+                float sum = 0.0f;
+                uint32_t count = 0;
+                for (int dj = -1; dj <= 1; ++dj)
+                {
+                    for (int di = -1; di <= 1; ++di)
+                    {
+                        int x = (int)i + di;
+                        int y = (int)j + dj;
+                        if (x >= 0 && y >= 0 && x < (int)width && y < (int)height && source[y * width + x] >= 0.0f)
+                        {
+                            sum += source[y * width + x];
+                            count++;
+                        }
+                    }
+                }
+                if (count > 0)
+                {
+                    ao[j * width + i] = sum / (float)count;
+                }
+            }
+        }
+        source.assign(ao, ao + (size_t)width * height);
+    }
+    for (size_t i = 0; i < source.size(); ++i)
+    {
+        if (ao[i] < 0.0f)
+        {
+            ao[i] = 1.0f;
+        }
+    }
+}
+
+static bool writePgm(const char* path, const float* ao, uint32_t width, uint32_t height)
+{
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Failed to write %s.\n", path);
+        return false;
+    }
+    fprintf(fp, "P5\n%u %u\n255\n", width, height);
+    std::vector<unsigned char> row(width);
+    for (uint32_t j = 0; j < height; ++j)
+    {
+        for (uint32_t i = 0; i < width; ++i)
+        {
+            float v = std::min(std::max(ao[j * width + i], 0.0f), 1.0f);
+            row[i] = (unsigned char)(v * 255.0f + 0.5f);
+        }
+        fwrite(&row[0], 1, width, fp);
+    }
+    fclose(fp);
+    return true;
+}
+
+//
+// The benchmark
+//
+
+// The rays of a size x size camera looking at the mesh, in 2x2 quads of
+// pixels for the packets.
+static void cameraRays(const float* lower, const float* upper, uint32_t size, std::vector<BvhRay>* rays)
+{
+    float center[3];
+    float radius = 0.0f;
+    for (int a = 0; a < 3; ++a)
+    {
+        center[a] = (lower[a] + upper[a]) * 0.5f;
+        radius += (upper[a] - lower[a]) * (upper[a] - lower[a]);
+    }
+    radius = sqrtf(radius) * 0.5f;
+
+    // From the front right, above; 45 degrees of the field of view.
+    float back[3] = { 0.6f, 0.5f, 1.0f };
+    float l = sqrtf(back[0] * back[0] + back[1] * back[1] + back[2] * back[2]);
+    float eye[3];
+    float forward[3];
+    for (int a = 0; a < 3; ++a)
+    {
+        eye[a] = center[a] + back[a] / l * radius * 2.5f;
+        forward[a] = -back[a] / l;
+    }
+    float right[3] = { -forward[2], 0.0f, forward[0] };
+    l = sqrtf(right[0] * right[0] + right[2] * right[2]);
+    right[0] /= l;
+    right[2] /= l;
+    float up[3] = { right[1] * forward[2] - right[2] * forward[1],
+                    right[2] * forward[0] - right[0] * forward[2],
+                    right[0] * forward[1] - right[1] * forward[0] };
+    float scale = tanf(22.5f * 3.14159265f / 180.0f);
+
+    rays->resize((size_t)size * size);
+    size_t n = 0;
+    for (uint32_t qy = 0; qy < size; qy += 2)
+    {
+        for (uint32_t qx = 0; qx < size; qx += 2)
+        {
+            for (uint32_t k = 0; k < 4; ++k)
+            {
+                float x = ((float)(qx + (k & 1)) + 0.5f) / (float)size * 2.0f - 1.0f;
+                float y = 1.0f - ((float)(qy + (k >> 1)) + 0.5f) / (float)size * 2.0f;
+                BvhRay& ray = (*rays)[n++];
+                for (int a = 0; a < 3; ++a)
+                {
+                    ray.origin[a] = eye[a];
+                    ray.direction[a] = forward[a] + (right[a] * x + up[a] * y) * scale;
+                }
+                ray.tmin = 0.0f;
+                ray.tmax = FLT_MAX;
+            }
+        }
+    }
+}
+
+// numRays cosine distributed rays about the normal of the triangle of
+// every hit, on the side of the camera, in fours for the packets.
+static void occlusionRays(const Mesh& mesh,
+                          const std::vector<BvhRay>& cameraRays,
+                          const std::vector<BvhHit>& hits,
+                          const std::vector<char>& found,
+                          uint32_t numRays,
+                          float bias,
+                          uint32_t seed,
+                          std::vector<BvhRay>* rays)
+{
+    RandomPCG32 random;
+    randomPCG32Seed(&random, seed, 0);
+    rays->clear();
+    for (size_t i = 0; i < hits.size(); ++i)
+    {
+        if (!found[i])
+        {
+            continue;
+        }
+
+        const BvhRay& camera = cameraRays[i];
+        const BvhHit& hit = hits[i];
+        const float* p0 = &mesh.positions[mesh.indices[hit.triangle * 3 + 0] * 3];
+        const float* p1 = &mesh.positions[mesh.indices[hit.triangle * 3 + 1] * 3];
+        const float* p2 = &mesh.positions[mesh.indices[hit.triangle * 3 + 2] * 3];
+        float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        float l = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (n[0] * camera.direction[0] + n[1] * camera.direction[1] + n[2] * camera.direction[2] > 0.0f)
+        {
+            l = -l;
+        }
+        float t[3];
+        float s[3];
+        for (int a = 0; a < 3; ++a)
+        {
+            n[a] /= l;
+        }
+        // Any tangent will do.
+        if (fabsf(n[0]) > fabsf(n[1]))
+        {
+            l = sqrtf(n[0] * n[0] + n[2] * n[2]);
+            t[0] = -n[2] / l;
+            t[1] = 0.0f;
+            t[2] = n[0] / l;
+        }
+        else
+        {
+            l = sqrtf(n[1] * n[1] + n[2] * n[2]);
+            t[0] = 0.0f;
+            t[1] = n[2] / l;
+            t[2] = -n[1] / l;
+        }
+        s[0] = n[1] * t[2] - n[2] * t[1];
+        s[1] = n[2] * t[0] - n[0] * t[2];
+        s[2] = n[0] * t[1] - n[1] * t[0];
+
+        for (uint32_t r = 0; r < numRays; ++r)
+        {
+            float u = randomPCG32Float(&random);
+            float phi = randomPCG32Float(&random) * 6.28318531f;
+            float sinTheta = sqrtf(u);
+            float cosTheta = sqrtf(1.0f - u);
+            BvhRay ray;
+            for (int a = 0; a < 3; ++a)
+            {
+                ray.origin[a] = camera.origin[a] + camera.direction[a] * hit.t + n[a] * bias;
+                ray.direction[a] = (t[a] * cosf(phi) + s[a] * sinf(phi)) * sinTheta + n[a] * cosTheta;
+            }
+            ray.tmin = 0.0f;
+            ray.tmax = FLT_MAX;
+            rays->push_back(ray);
+        }
+    }
+
+    // Pad to whole packets with inactive rays.
+    while (rays->size() % 4 != 0)
+    {
+        BvhRay ray = rays->back();
+        ray.tmax = 0.0f;
+        rays->push_back(ray);
+    }
+}
+
+static void printKernel(const char* name, size_t numRays, double seconds, size_t numHits)
+{
+    fprintf(stderr, "  %-10s %10.2f %10.2f %10u\n", name, seconds * 1000.0, (double)numRays / seconds * 1e-6, (uint32_t)numHits);
+}
+
+static bool benchmarkMesh(const char* path, uint32_t size, uint32_t numRays, uint32_t seed)
+{
+    Mesh mesh;
+    if (!loadObj(path, &mesh))
+    {
+        return false;
+    }
+    uint32_t numTriangles = (uint32_t)(mesh.indices.size() / 3);
+    fprintf(stderr, "%s, %u triangles\n", path, numTriangles);
+
+    float lower[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float upper[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (size_t i = 0; i < mesh.positions.size(); i += 3)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            lower[a] = std::min(lower[a], mesh.positions[i + a]);
+            upper[a] = std::max(upper[a], mesh.positions[i + a]);
+        }
+    }
+
+    // The builds, on one thread as the kernels.
+    Bvh bvh;
+    RaytraceBvh4 bvh4;
+    RaytraceBvh8 bvh8;
+    uint64_t start = timerNow();
+    bvhBuild(&bvh, &mesh.positions[0], &mesh.indices[0], numTriangles, 1);
+    double binarySeconds = timerSecondsSince(start);
+    start = timerNow();
+    raytraceCollapse4(&bvh4, &bvh);
+    double seconds4 = timerSecondsSince(start);
+    start = timerNow();
+    raytraceCollapse8(&bvh8, &bvh);
+    double seconds8 = timerSecondsSince(start);
+    fprintf(stderr, "  %-10s %10s %10s\n", "build", "ms", "nodes");
+    fprintf(stderr, "  %-10s %10.2f %10u   SAH cost %.1f\n", "binary", binarySeconds * 1000.0, (uint32_t)bvh.nodes.size(), bvhSahCost(&bvh));
+    fprintf(stderr, "  %-10s %10.2f %10u\n", "bvh4", seconds4 * 1000.0, (uint32_t)bvh4.nodes.size());
+    fprintf(stderr, "  %-10s %10.2f %10u\n", "bvh8", seconds8 * 1000.0, (uint32_t)bvh8.nodes.size());
+
+    // The closest hits of the camera rays.
+    std::vector<BvhRay> rays;
+    cameraRays(lower, upper, size, &rays);
+    std::vector<BvhHit> hits(rays.size());
+    std::vector<char> found(rays.size());
+    size_t numHits;
+    fprintf(stderr, "  %-10s %10s %10s %10s\n", "camera", "ms", "Mrays/s", "hits");
+
+#define RUN_SINGLE(name, call)                                          \
+    numHits = 0;                                                        \
+    start = timerNow();                                                 \
+    for (size_t i = 0; i < rays.size(); ++i)                            \
+    {                                                                   \
+        found[i] = call;                                                \
+        numHits += found[i];                                            \
+    }                                                                   \
+    printKernel(name, rays.size(), timerSecondsSince(start), numHits);
+
+#define RUN_PACKET(name, call)                                          \
+    numHits = 0;                                                        \
+    start = timerNow();                                                 \
+    for (size_t i = 0; i < rays.size(); i += 4)                         \
+    {                                                                   \
+        uint32_t mask = call;                                           \
+        for (int k = 0; k < 4; ++k)                                     \
+        {                                                               \
+            found[i + k] = (mask >> k) & 1;                             \
+            numHits += found[i + k];                                    \
+        }                                                               \
+    }                                                                   \
+    printKernel(name, rays.size(), timerSecondsSince(start), numHits);
+
+    RUN_SINGLE("binary", bvhIntersect(&bvh, &rays[i], &hits[i]));
+    RUN_SINGLE("bvh4", raytraceIntersect4(&bvh4, &rays[i], &hits[i]));
+    RUN_PACKET("packet4", raytraceIntersectPacket4(&bvh4, &rays[i], &hits[i]));
+    RUN_PACKET("packet8", raytraceIntersectPacket8(&bvh8, &rays[i], &hits[i]));
+    // Last, for the hits of the occlusion rays.
+    RUN_SINGLE("bvh8", raytraceIntersect8(&bvh8, &rays[i], &hits[i]));
+
+    // The occlusion rays from the hits.
+    float diagonal = sqrtf((upper[0] - lower[0]) * (upper[0] - lower[0]) +
+                           (upper[1] - lower[1]) * (upper[1] - lower[1]) +
+                           (upper[2] - lower[2]) * (upper[2] - lower[2]));
+    std::vector<BvhRay> cameras;
+    cameras.swap(rays);
+    occlusionRays(mesh, cameras, hits, found, numRays, diagonal * 1e-4f, seed, &rays);
+    found.resize(rays.size());
+    fprintf(stderr, "  %-10s %10s %10s %10s\n", "occlusion", "ms", "Mrays/s", "hits");
+    RUN_SINGLE("binary", bvhOccluded(&bvh, &rays[i]));
+    RUN_SINGLE("bvh4", raytraceOccluded4(&bvh4, &rays[i]));
+    RUN_SINGLE("bvh8", raytraceOccluded8(&bvh8, &rays[i]));
+    RUN_PACKET("packet4", raytraceOccludedPacket4(&bvh4, &rays[i]));
+    RUN_PACKET("packet8", raytraceOccludedPacket8(&bvh8, &rays[i]));
+
+#undef RUN_SINGLE
+#undef RUN_PACKET
+
+    return true;
+}
+
+static int benchmark(int argc, char** argv)
+{
+    uint32_t size = 512;
+    uint32_t numRays = 8;
+    uint32_t seed = 1;
+    std::vector<const char*> paths;
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-size") == 0 && i + 1 < argc)
+        {
+            // Whole quads.
+            size = ((uint32_t)strtoul(argv[++i], NULL, 10) + 1) & ~1u;
+        }
+        else if (strcmp(argv[i], "-rays") == 0 && i + 1 < argc)
+        {
+            numRays = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+        {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s.\n", argv[i]);
+            usage();
+            return 1;
+        }
+        else
+        {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty() || size == 0 || numRays == 0)
+    {
+        usage();
+        return 1;
+    }
+
+    fprintf(stderr, "%ux%u camera rays, %u occlusion rays per hit, one thread%s\n",
+        size, size, numRays,
+#if defined(__AVX__)
+        ", AVX"
+#else
+        ", SSE2"
+#endif
+        );
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        if (!benchmarkMesh(paths[i], size, numRays, seed))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "benchmark") == 0)
+    {
+        return benchmark(argc, argv);
+    }
+    if (argc < 2 || argv[1][0] == '-')
+    {
+        usage();
+        return 1;
+    }
+
+    AoBakeSettings settings;
+    aoBakeDefaultSettings(&settings);
+    float bias = -1.0f;
+    const char* output = NULL;
+    const char* objOutput = NULL;
+    const char* texture = NULL;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    bool scaling = false;
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-rays") == 0 && i + 1 < argc)
+        {
+            settings.numRays = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-distance") == 0 && i + 1 < argc)
+        {
+            settings.maxDistance = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-bias") == 0 && i + 1 < argc)
+        {
+            bias = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+        {
+            settings.seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+        {
+            settings.numThreads = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (strcmp(argv[i], "-obj") == 0 && i + 1 < argc)
+        {
+            objOutput = argv[++i];
+        }
+        else if (strcmp(argv[i], "-texture") == 0 && i + 3 < argc)
+        {
+            width = (uint32_t)strtoul(argv[++i], NULL, 10);
+            height = (uint32_t)strtoul(argv[++i], NULL, 10);
+            texture = argv[++i];
+        }
+        else if (strcmp(argv[i], "-scaling") == 0)
+        {
+            scaling = true;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s.\n", argv[i]);
+            usage();
+            return 1;
+        }
+    }
+    if (settings.numRays == 0)
+    {
+        fprintf(stderr, "Invalid number of rays.\n");
+        return 1;
+    }
+    if (texture != NULL && (width == 0 || height == 0))
+    {
+        fprintf(stderr, "Invalid texture size.\n");
+        return 1;
+    }
+
+    Mesh mesh;
+    uint64_t start = timerNow();
+    if (!loadObj(argv[1], &mesh))
+    {
+        return 1;
+    }
+    uint32_t numVertices = (uint32_t)(mesh.positions.size() / 3);
+    uint32_t numTriangles = (uint32_t)(mesh.indices.size() / 3);
+    double loadSeconds = timerSecondsSince(start);
+    fprintf(stderr, "%s: %u vertices, %u triangles, loaded in %.1f ms\n",
+        argv[1], numVertices, numTriangles, loadSeconds * 1000.0);
+
+    float lower[3] = { 1e30f, 1e30f, 1e30f };
+    float upper[3] = { -1e30f, -1e30f, -1e30f };
+    for (uint32_t i = 0; i < numVertices; ++i)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            lower[a] = std::min(lower[a], mesh.positions[i * 3 + a]);
+            upper[a] = std::max(upper[a], mesh.positions[i * 3 + a]);
+        }
+    }
+    float diagonal = sqrtf((upper[0] - lower[0]) * (upper[0] - lower[0]) +
+                           (upper[1] - lower[1]) * (upper[1] - lower[1]) +
+                           (upper[2] - lower[2]) * (upper[2] - lower[2]));
+    settings.bias = bias >= 0.0f? bias : diagonal * 1e-4f;
+
+    Bvh bvh;
+    start = timerNow();
+    bvhBuild(&bvh, &mesh.positions[0], &mesh.indices[0], numTriangles, settings.numThreads);
+    double buildSeconds = timerSecondsSince(start);
+    fprintf(stderr, "BVH: %u nodes, SAH cost %.1f, built in %.1f ms\n",
+        (uint32_t)bvh.nodes.size(), bvhSahCost(&bvh), buildSeconds * 1000.0);
+
+    std::vector<float> normals(mesh.positions.size());
+    aoVertexNormals(&mesh.positions[0], numVertices, &mesh.indices[0], numTriangles, &normals[0]);
+
+    std::vector<float> ao(numVertices);
+    AoBakeStatistics statistics;
+    if (scaling)
+    {
+        uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+        double base = 0.0;
+        fprintf(stderr, "threads     Mrays/s   speedup\n");
+        for (uint32_t n = 1; ; n = std::min(n * 2, maxThreads))
+        {
+            AoBakeSettings threaded = settings;
+            threaded.numThreads = n;
+            aoBakeVertices(&bvh, &mesh.positions[0], &normals[0], numVertices, &threaded, &ao[0], &statistics);
+            double raysPerSecond = (double)statistics.numRays / statistics.seconds;
+            if (n == 1)
+            {
+                base = raysPerSecond;
+            }
+            fprintf(stderr, "%7u %11.2f %9.2f\n", n, raysPerSecond * 1e-6, raysPerSecond / base);
+            if (n == maxThreads)
+            {
+                break;
+            }
+        }
+    }
+    else if (output != NULL || objOutput != NULL || texture == NULL)
+    {
+        aoBakeVertices(&bvh, &mesh.positions[0], &normals[0], numVertices, &settings, &ao[0], &statistics);
+        fprintf(stderr, "Vertices: %llu rays in %.1f ms, %.2f Mrays/s\n",
+            (unsigned long long)statistics.numRays, statistics.seconds * 1000.0,
+            (double)statistics.numRays / statistics.seconds * 1e-6);
+    }
+
+    if (output != NULL && !writeValues(output, &ao[0], numVertices))
+    {
+        return 1;
+    }
+    if (objOutput != NULL && !writeObj(objOutput, mesh, &ao[0]))
+    {
+        return 1;
+    }
+
+    if (texture != NULL)
+    {
+        if (!mesh.hasTexcoords)
+        {
+            fprintf(stderr, "%s has faces without texture coordinates.\n", argv[1]);
+            return 1;
+        }
+        std::vector<float> texels((size_t)width * height);
+        aoBakeTexels(&bvh, &mesh.positions[0], &normals[0], &mesh.indices[0], &mesh.cornerTexcoords[0],
+            numTriangles, width, height, &settings, &texels[0], &statistics);
+        fprintf(stderr, "Texels: %llu rays in %.1f ms, %.2f Mrays/s\n",
+            (unsigned long long)statistics.numRays, statistics.seconds * 1000.0,
+            (double)statistics.numRays / statistics.seconds * 1e-6);
+        dilate(&texels[0], width, height, 4);
+        if (!writePgm(texture, &texels[0], width, height))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
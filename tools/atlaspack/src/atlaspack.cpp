@@ -0,0 +1,420 @@
+// atlaspack.cpp
+//
+// Created at 2014/04/26
+//
+// Hongwei Li hongwei.li@amd.com
+// All rights reserved
+//
+// Build atlases of representative sets of generated images with
+// atlasBuildImages() and print the atlasReport() of every packing, for
+// tuning the packer and the gutter without loading any image. Every atlas
+// is also checked:
+// - the cells of the images, gutters included, are inside the atlas,
+//   aligned and do not overlap;
+// - the images are copied and the gutters repeat their edge texels;
+// - the box filter keeps every mip of a cell inside the cell;
+// - the metadata reads back the same.
+//
+//   atlaspack
+//   atlaspack -mips 5 -padding 2 -size 2048
+//
+
+#include <dxf/util/atlas.h>
+#include <dxf/util/random.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+static void usage()
+{
+    fprintf(stderr,
+        "Usage: atlaspack [options]\n"
+        "  -size <n>     The maximum width and height of the atlas (default 4096)\n"
+        "  -mips <n>     The number of mipmaps the gutters are made for (default 1 and 5)\n"
+        "  -padding <n>  The minimum gutter (default 1)\n"
+        "  -seed <n>     The seed of the random sets (default 1)\n");
+}
+
+//
+// The rectangle sets, as (width, height) pairs
+//
+
+// The tiles of the walking demo's terrain, all of one size.
+static void uniformTiles(uint32_t seed, std::vector<uint32_t>* sizes)
+{
+    (void)seed;
+    for (uint32_t i = 0; i < 64; ++i)
+    {
+        sizes->push_back(128);
+        sizes->push_back(128);
+    }
+}
+
+// Textures of power-of-two sizes from 16 to 256, not always square.
+static void powerOfTwo(uint32_t seed, std::vector<uint32_t>* sizes)
+{
+    RandomPCG32 random;
+    randomPCG32Seed(&random, seed, 1);
+    for (uint32_t i = 0; i < 96; ++i)
+    {
+        sizes->push_back(16u << randomPCG32Bounded(&random, 5));
+        sizes->push_back(16u << randomPCG32Bounded(&random, 5));
+    }
+}
+
+// Sprites and decals of any size.
+static void randomSizes(uint32_t seed, std::vector<uint32_t>* sizes)
+{
+    RandomPCG32 random;
+    randomPCG32Seed(&random, seed, 2);
+    for (uint32_t i = 0; i < 128; ++i)
+    {
+        sizes->push_back(8 + randomPCG32Bounded(&random, 185));
+        sizes->push_back(8 + randomPCG32Bounded(&random, 185));
+    }
+}
+
+// The glyphs of a font, many small ones of one height.
+static void glyphs(uint32_t seed, std::vector<uint32_t>* sizes)
+{
+    RandomPCG32 random;
+    randomPCG32Seed(&random, seed, 3);
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        sizes->push_back(4 + randomPCG32Bounded(&random, 21));
+        sizes->push_back(24);
+    }
+}
+
+// Strips, e.g., of trails and UI bars, which waste the most.
+static void strips(uint32_t seed, std::vector<uint32_t>* sizes)
+{
+    RandomPCG32 random;
+    randomPCG32Seed(&random, seed, 4);
+    for (uint32_t i = 0; i < 48; ++i)
+    {
+        uint32_t length = 128 + randomPCG32Bounded(&random, 385);
+        uint32_t width = 4 + randomPCG32Bounded(&random, 13);
+        if (i % 2 == 0)
+        {
+            sizes->push_back(length);
+            sizes->push_back(width);
+        }
+        else
+        {
+            sizes->push_back(width);
+            sizes->push_back(length);
+        }
+    }
+}
+
+struct RectSet
+{
+    const char* name;
+    void      (*generate)(uint32_t seed, std::vector<uint32_t>* sizes);
+};
+
+static const RectSet RECT_SETS[] =
+{
+    { "uniform tiles", uniformTiles },
+    { "power of two",  powerOfTwo },
+    { "random sizes",  randomSizes },
+    { "glyphs",        glyphs },
+    { "strips",        strips },
+};
+
+//
+// The images
+//
+
+// The texel (x, y) of image i: a solid color with a distinct border, and
+// a gradient so that a texel copied from the wrong place shows. Blue and
+// alpha tag the image, which no other image and no empty texel has.
+static void imageTexel(uint32_t i, uint32_t width, uint32_t height, uint32_t x, uint32_t y, uint8_t* rgba)
+{
+    bool border = x == 0 || y == 0 || x == width - 1 || y == height - 1;
+    rgba[0] = border? 240 : 40;
+    rgba[1] = (uint8_t)(x * 7 + y * 13);
+    rgba[2] = (uint8_t)(i % 251 + 1);
+    rgba[3] = (uint8_t)(i / 251 + 1);
+}
+
+static void makeImages(const std::vector<uint32_t>& sizes, std::vector<AtlasImage>* images,
+                       std::vector<std::vector<uint8_t> >* pixels)
+{
+    uint32_t numImages = (uint32_t)sizes.size() / 2;
+    images->resize(numImages);
+    pixels->resize(numImages);
+    for (uint32_t i = 0; i < numImages; ++i)
+    {
+        AtlasImage& image = (*images)[i];
+        std::vector<uint8_t>& data = (*pixels)[i];
+        image.width = sizes[i * 2];
+        image.height = sizes[i * 2 + 1];
+        image.numChannels = 4;
+        data.resize(image.width * image.height * 4);
+        for (uint32_t y = 0; y < image.height; ++y)
+        {
+            for (uint32_t x = 0; x < image.width; ++x)
+            {
+                imageTexel(i, image.width, image.height, x, y, &data[(y * image.width + x) * 4]);
+            }
+        }
+        image.data = &data[0];
+    }
+}
+
+//
+// The checks
+//
+
+// The cell of rect i, i.e., the rect grown by the gutter and aligned.
+static AtlasRect cellOf(const Atlas* atlas, uint32_t i)
+{
+    uint32_t alignment = 1u << (atlas->numMips - 1);
+    const AtlasRect& r = atlas->rects[i];
+    AtlasRect c;
+    c.x = r.x - atlas->gutter;
+    c.y = r.y - atlas->gutter;
+    c.width  = (r.width + alignment - 1) / alignment * alignment + atlas->gutter * 2;
+    c.height = (r.height + alignment - 1) / alignment * alignment + atlas->gutter * 2;
+    return c;
+}
+
+// The cells of the rectangles, i.e., the rectangles grown by the gutter
+// and aligned, are inside the atlas, start at multiples of the alignment
+// and are disjoint.
+static bool checkPacking(const Atlas* atlas)
+{
+    uint32_t alignment = 1u << (atlas->numMips - 1);
+    std::vector<AtlasRect> cells(atlas->numImages);
+    for (uint32_t i = 0; i < atlas->numImages; ++i)
+    {
+        const AtlasRect& r = atlas->rects[i];
+        if (r.x < atlas->gutter || r.y < atlas->gutter)
+        {
+            fprintf(stderr, "  rect %u has no room for the gutter\n", i);
+            return false;
+        }
+
+        cells[i] = cellOf(atlas, i);
+        const AtlasRect& c = cells[i];
+        if (c.x % alignment != 0 || c.y % alignment != 0)
+        {
+            fprintf(stderr, "  rect %u is not aligned to %u\n", i, alignment);
+            return false;
+        }
+        if (c.x + c.width > atlas->width || c.y + c.height > atlas->height)
+        {
+            fprintf(stderr, "  rect %u is out of the atlas\n", i);
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < atlas->numImages; ++i)
+    {
+        for (uint32_t j = i + 1; j < atlas->numImages; ++j)
+        {
+            const AtlasRect& a = cells[i];
+            const AtlasRect& b = cells[j];
+            if (a.x < b.x + b.width && b.x < a.x + a.width &&
+                a.y < b.y + b.height && b.y < a.y + a.height)
+            {
+                fprintf(stderr, "  rects %u and %u overlap\n", i, j);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Every texel of a cell in mip 0 is the texel of the image, or of the
+// nearest edge of the image in the gutter and in the alignment padding.
+static bool checkPixels(const Atlas* atlas)
+{
+    for (uint32_t i = 0; i < atlas->numImages; ++i)
+    {
+        const AtlasRect& r = atlas->rects[i];
+        AtlasRect c = cellOf(atlas, i);
+        for (uint32_t y = c.y; y < c.y + c.height; ++y)
+        {
+            for (uint32_t x = c.x; x < c.x + c.width; ++x)
+            {
+                uint32_t sx = x < r.x? 0 : std::min(x - r.x, r.width - 1);
+                uint32_t sy = y < r.y? 0 : std::min(y - r.y, r.height - 1);
+                uint8_t expected[4];
+                imageTexel(i, r.width, r.height, sx, sy, expected);
+                if (memcmp(&atlas->mips[0][(y * atlas->width + x) * 4], expected, 4) != 0)
+                {
+                    bool gutter = x < r.x || y < r.y || x >= r.x + r.width || y >= r.y + r.height;
+                    fprintf(stderr, "  image %u: the %s texel (%u, %u) is not the %s texel (%u, %u)\n",
+                        i, gutter? "gutter" : "image", x, y, gutter? "edge" : "image", sx, sy);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// The box filter of a cell only reads from the same cell, so every texel
+// of the cell in every mip keeps the tag of its image.
+static bool checkMips(const Atlas* atlas)
+{
+    for (uint32_t m = 1; m < atlas->numMips; ++m)
+    {
+        uint32_t width = std::max(atlas->width >> m, 1u);
+        const uint8_t* mip = atlas->mips[m];
+        if (mip == NULL)
+        {
+            fprintf(stderr, "  mip %u is missing\n", m);
+            return false;
+        }
+        for (uint32_t i = 0; i < atlas->numImages; ++i)
+        {
+            AtlasRect c = cellOf(atlas, i);
+            uint8_t tag[4];
+            imageTexel(i, 1, 1, 0, 0, tag);
+            for (uint32_t y = c.y >> m; y < (c.y + c.height) >> m; ++y)
+            {
+                for (uint32_t x = c.x >> m; x < (c.x + c.width) >> m; ++x)
+                {
+                    const uint8_t* texel = &mip[(y * width + x) * 4];
+                    if (texel[2] != tag[2] || texel[3] != tag[3])
+                    {
+                        fprintf(stderr, "  image %u: the texel (%u, %u) of mip %u is mixed with another cell\n",
+                            i, x, y, m);
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// The metadata blob reads back into the same rectangles and UVs.
+static bool checkMetadata(const Atlas* atlas)
+{
+    std::vector<uint8_t> blob(atlasWriteMetadata(atlas, NULL, 0));
+    if (atlasWriteMetadata(atlas, &blob[0], blob.size()) != blob.size())
+    {
+        fprintf(stderr, "  failed to write the metadata\n");
+        return false;
+    }
+
+    Atlas read;
+    if (atlasReadMetadata(&blob[0], blob.size(), &read) != ATLAS_OK)
+    {
+        fprintf(stderr, "  failed to read the metadata back\n");
+        return false;
+    }
+    bool same = read.width == atlas->width && read.height == atlas->height &&
+                read.gutter == atlas->gutter && read.numImages == atlas->numImages &&
+                memcmp(read.rects, atlas->rects, sizeof(AtlasRect) * atlas->numImages) == 0 &&
+                memcmp(read.uvs, atlas->uvs, sizeof(AtlasUV) * atlas->numImages) == 0;
+    atlasDelete(&read);
+    if (!same)
+    {
+        fprintf(stderr, "  the metadata does not read back the same\n");
+    }
+    return same;
+}
+
+// Build the atlas of the set and report it. Return false if the atlas is
+// wrong; a set that does not fit is only logged.
+static bool pack(const RectSet* set, uint32_t seed, uint32_t maxSize, uint32_t numMips, uint32_t padding)
+{
+    std::vector<uint32_t> sizes;
+    set->generate(seed, &sizes);
+    std::vector<AtlasImage> images;
+    std::vector<std::vector<uint8_t> > pixels;
+    makeImages(sizes, &images, &pixels);
+    uint32_t numImages = (uint32_t)images.size();
+
+    fprintf(stderr, "%s, %u images, %u mips, padding %u:\n", set->name, numImages, numMips, padding);
+    Atlas atlas;
+    AtlasResultEnum result = atlasBuildImages(&images[0], numImages, maxSize, numMips, padding, &atlas);
+    if (result != ATLAS_OK)
+    {
+        fprintf(stderr, "  does not fit into %ux%u\n\n", maxSize, maxSize);
+        atlasDelete(&atlas);
+        return true;
+    }
+
+    atlasReport(&atlas, stderr);
+    fprintf(stderr, "  efficiency %.3f\n\n", atlasEfficiency(&atlas));
+
+    bool ok = checkPacking(&atlas) && checkPixels(&atlas) && checkMips(&atlas) && checkMetadata(&atlas);
+    atlasDelete(&atlas);
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t maxSize = 4096;
+    uint32_t numMips = 0;
+    uint32_t padding = 1;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-size") == 0 && i + 1 < argc)
+        {
+            maxSize = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-mips") == 0 && i + 1 < argc)
+        {
+            numMips = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-padding") == 0 && i + 1 < argc)
+        {
+            padding = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+        {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (numMips > ATLAS_MAX_MIPS)
+    {
+        fprintf(stderr, "At most %u mips.\n", ATLAS_MAX_MIPS);
+        return 1;
+    }
+
+    // Without -mips, a single level, and the gutters of the 5 levels down
+    // to 1/16, which the terrain tiles need.
+    uint32_t mips[2] = { 1, 5 };
+    uint32_t numPasses = 2;
+    if (numMips != 0)
+    {
+        mips[0] = numMips;
+        numPasses = 1;
+    }
+
+    uint32_t numFailed = 0;
+    for (uint32_t p = 0; p < numPasses; ++p)
+    {
+        for (size_t s = 0; s < sizeof(RECT_SETS) / sizeof(RECT_SETS[0]); ++s)
+        {
+            if (!pack(&RECT_SETS[s], seed, maxSize, mips[p], padding))
+            {
+                numFailed++;
+            }
+        }
+    }
+
+    if (numFailed != 0)
+    {
+        fprintf(stderr, "%u packings are wrong.\n", numFailed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,546 @@
+// ddscheck.cpp
+//
+// Created at 2014/04/28
+//
+// Hongwei Li hongwei.li@amd.com
+// All rights reserved
+//
+// Check the DDS parsing of dxf/util/dds.h on the CPU alone. The cases build
+// DDS files in memory, a BC1 mip chain of the FourCC header, a BC7 one of
+// odd size, a DX10 texture array, cubemaps of both headers, a volume and
+// uncompressed and packed formats of odd sizes, and compare ddsParse(),
+// ddsGetSurfaceInfo() and ddsFillSubresources() with the sizes worked out
+// by hand; every subresource is filled with its own byte, so a wrong
+// offset or pitch shows. The corrupted and truncated files must fail.
+//
+// The benchmark then writes a large file and times loading it as
+// DDSTextureLoader does, through ddsMapFile(), against reading it into the
+// heap, both reading every byte of the subresources.
+//
+//   ddscheck
+//   ddscheck -size 4096 -runs 20 -file D:\temp\ddscheck.dds
+//
+
+#include <dxf/util/dds.h>
+#include <dxf/util/timer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+static void usage()
+{
+    fprintf(stderr,
+        "Usage: ddscheck [options]\n"
+        "  -size <n>     The width and height of the RGBA8 file of the benchmark (default 2048)\n"
+        "  -runs <n>     The loads of each kind in the benchmark (default 10)\n"
+        "  -file <path>  Where the benchmark writes its file (default ddscheck.dds)\n");
+}
+
+static uint32_t numFailed = 0;
+
+static void check(bool condition, const char* expression, int line)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "  line %d: %s failed\n", line, expression);
+        numFailed++;
+    }
+}
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+// The DXGI_FORMAT values of the cases.
+#define FORMAT_R8G8B8A8_UNORM 28
+#define FORMAT_R8_UNORM       61
+#define FORMAT_R8G8_B8G8      68
+#define FORMAT_BC1_UNORM      71
+#define FORMAT_BC3_UNORM      77
+#define FORMAT_BC7_UNORM      98
+
+// D3D11_RESOURCE_DIMENSION_TEXTURE2D/3D and D3D11_RESOURCE_MISC_TEXTURECUBE.
+#define DIMENSION_TEXTURE2D   3
+#define DIMENSION_TEXTURE3D   4
+#define MISC_TEXTURECUBE      0x4
+
+//
+// The files
+//
+struct DdsDesc
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+    uint32_t mipCount;
+    uint32_t arraySize;      // Of the DX10 header; 6 faces per cube
+    uint32_t format;
+    uint32_t fourCC;         // 0 for the DX10 header
+    bool     cubemap;
+};
+
+static DdsDesc makeDesc(uint32_t width, uint32_t height, uint32_t mipCount, uint32_t format, uint32_t fourCC)
+{
+    DdsDesc desc;
+    desc.width = width;
+    desc.height = height;
+    desc.depth = 1;
+    desc.mipCount = mipCount;
+    desc.arraySize = 1;
+    desc.format = format;
+    desc.fourCC = fourCC;
+    desc.cubemap = false;
+    return desc;
+}
+
+// The number of the 2D surfaces of the file.
+static uint32_t numItems(const DdsDesc& desc)
+{
+    return desc.cubemap? desc.arraySize * 6 : desc.arraySize;
+}
+
+// The bytes of a mip, worked out without ddsGetSurfaceInfo().
+static size_t mipBytes(const DdsDesc& desc, uint32_t mip, size_t* rowBytes)
+{
+    size_t w = std::max(desc.width >> mip, 1u);
+    size_t h = std::max(desc.height >> mip, 1u);
+    size_t d = std::max(desc.depth >> mip, 1u);
+    size_t rows;
+    switch (desc.format)
+    {
+        case FORMAT_BC1_UNORM:
+            *rowBytes = (w + 3) / 4 * 8;
+            rows = (h + 3) / 4;
+            break;
+        case FORMAT_BC3_UNORM:
+        case FORMAT_BC7_UNORM:
+            *rowBytes = (w + 3) / 4 * 16;
+            rows = (h + 3) / 4;
+            break;
+        case FORMAT_R8G8_B8G8:
+            *rowBytes = (w + 1) / 2 * 4;
+            rows = h;
+            break;
+        case FORMAT_R8_UNORM:
+            *rowBytes = w;
+            rows = h;
+            break;
+        default:
+            *rowBytes = w * 4;
+            rows = h;
+            break;
+    }
+    return *rowBytes * rows * d;
+}
+
+// The byte every subresource is filled with.
+static uint8_t subresourceByte(size_t index)
+{
+    return (uint8_t)(index * 37 + 11);
+}
+
+static void makeFile(const DdsDesc& desc, std::vector<uint8_t>* file)
+{
+    DDS_HEADER header;
+    memset(&header, 0, sizeof(header));
+    header.size = sizeof(DDS_HEADER);
+    header.flags = DDS_WIDTH | DDS_HEIGHT | (desc.depth > 1? DDS_HEADER_FLAGS_VOLUME : 0);
+    header.width = desc.width;
+    header.height = desc.height;
+    header.depth = desc.depth;
+    header.mipMapCount = desc.mipCount;
+    header.ddspf.size = sizeof(DDS_PIXELFORMAT);
+    header.ddspf.flags = DDS_FOURCC;
+    header.ddspf.fourCC = desc.fourCC != 0? desc.fourCC : MAKEFOURCC('D', 'X', '1', '0');
+    header.caps2 = desc.cubemap? DDS_CUBEMAP_ALLFACES : 0;
+
+    file->clear();
+    const uint8_t* p = (const uint8_t*)&DDS_MAGIC;
+    file->insert(file->end(), p, p + sizeof(uint32_t));
+    p = (const uint8_t*)&header;
+    file->insert(file->end(), p, p + sizeof(header));
+    if (desc.fourCC == 0)
+    {
+        DDS_HEADER_DXT10 header10;
+        memset(&header10, 0, sizeof(header10));
+        header10.dxgiFormat = desc.format;
+        header10.resourceDimension = desc.depth > 1? DIMENSION_TEXTURE3D : DIMENSION_TEXTURE2D;
+        header10.miscFlag = desc.cubemap? MISC_TEXTURECUBE : 0;
+        header10.arraySize = desc.arraySize;
+        p = (const uint8_t*)&header10;
+        file->insert(file->end(), p, p + sizeof(header10));
+    }
+
+    size_t index = 0;
+    for (uint32_t j = 0; j < numItems(desc); ++j)
+    {
+        for (uint32_t i = 0; i < desc.mipCount; ++i)
+        {
+            size_t rowBytes;
+            file->insert(file->end(), mipBytes(desc, i, &rowBytes), subresourceByte(index++));
+        }
+    }
+}
+
+// Parse the file and lay out its subresources as DDSTextureLoader does,
+// and compare them with the desc.
+static void checkLayout(const char* name, const DdsDesc& desc)
+{
+    fprintf(stderr, "%s\n", name);
+    uint32_t numFailedBefore = numFailed;
+
+    std::vector<uint8_t> data;
+    makeFile(desc, &data);
+
+    DDSFile file;
+    CHECK(ddsParse(&data[0], data.size(), &file) == DDS_OK);
+    CHECK(file.header != NULL && file.header->width == desc.width && file.header->height == desc.height);
+    CHECK((file.header10 != NULL) == (desc.fourCC == 0));
+    CHECK(ddsGetFormat(&file) == desc.format);
+    if (numFailed != numFailedBefore)
+    {
+        return;
+    }
+
+    bool cubemap = file.header10 != NULL? (file.header10->miscFlag & MISC_TEXTURECUBE) != 0 :
+                                          (file.header->caps2 & DDS_CUBEMAP) != 0;
+    CHECK(cubemap == desc.cubemap);
+    size_t arraySize = file.header10 != NULL? file.header10->arraySize : 1;
+    if (cubemap)
+    {
+        arraySize *= 6;
+    }
+    CHECK(arraySize == numItems(desc));
+
+    std::vector<DDSSubresource> subresources(desc.mipCount * arraySize);
+    DDSLayout layout;
+    DDSResultEnum result = ddsFillSubresources(desc.width, desc.height, desc.depth, desc.mipCount,
+        arraySize, desc.format, 0, file.bitData, file.bitSize, &layout, &subresources[0]);
+    CHECK(result == DDS_OK);
+    CHECK(layout.width == desc.width && layout.height == desc.height && layout.depth == desc.depth);
+    CHECK(layout.skipMip == 0);
+    CHECK(layout.numSubresources == subresources.size());
+    // The subresources after a failure are not filled.
+    if (result != DDS_OK || layout.numSubresources != subresources.size())
+    {
+        return;
+    }
+
+    size_t offset = 0;
+    for (size_t j = 0; j < arraySize; ++j)
+    {
+        for (uint32_t i = 0; i < desc.mipCount; ++i)
+        {
+            size_t index = j * desc.mipCount + i;
+            const DDSSubresource& s = subresources[index];
+            size_t rowBytes;
+            size_t bytes = mipBytes(desc, i, &rowBytes);
+            size_t depth = std::max(desc.depth >> i, 1u);
+
+            size_t numBytes;
+            size_t surfaceRowBytes;
+            ddsGetSurfaceInfo(std::max(desc.width >> i, 1u), std::max(desc.height >> i, 1u), desc.format,
+                &numBytes, &surfaceRowBytes, NULL);
+            CHECK(surfaceRowBytes == rowBytes && numBytes * depth == bytes);
+
+            CHECK(s.data == file.bitData + offset);
+            CHECK(s.rowPitch == rowBytes);
+            CHECK(s.slicePitch * depth == bytes);
+            // The first and the last byte are of this subresource.
+            CHECK(s.data[0] == subresourceByte(index) && s.data[bytes - 1] == subresourceByte(index));
+            offset += bytes;
+        }
+    }
+    CHECK(offset == file.bitSize);
+}
+
+//
+// The cases
+//
+static void testLayouts()
+{
+    DdsDesc desc = makeDesc(256, 256, 9, FORMAT_BC1_UNORM, MAKEFOURCC('D', 'X', 'T', '1'));
+    checkLayout("BC1, DXT1 header, 256x256, 9 mips", desc);
+
+    desc = makeDesc(37, 19, 6, FORMAT_BC7_UNORM, 0);
+    checkLayout("BC7, DX10 header, 37x19, 6 mips", desc);
+
+    desc = makeDesc(3, 5, 3, FORMAT_BC1_UNORM, MAKEFOURCC('D', 'X', 'T', '1'));
+    checkLayout("BC1, 3x5, blocks of the partial sizes", desc);
+
+    desc = makeDesc(64, 32, 7, FORMAT_R8G8B8A8_UNORM, 0);
+    desc.arraySize = 4;
+    checkLayout("RGBA8, DX10 array of 4, 64x32, 7 mips", desc);
+
+    desc = makeDesc(32, 32, 6, FORMAT_BC3_UNORM, MAKEFOURCC('D', 'X', 'T', '5'));
+    desc.cubemap = true;
+    checkLayout("BC3 cubemap, DXT5 header, 32x32, 6 mips", desc);
+
+    desc = makeDesc(16, 16, 5, FORMAT_BC7_UNORM, 0);
+    desc.cubemap = true;
+    desc.arraySize = 2;
+    checkLayout("BC7 cubemap array of 2, DX10 header, 16x16, 5 mips", desc);
+
+    desc = makeDesc(16, 8, 4, FORMAT_R8G8B8A8_UNORM, 0);
+    desc.depth = 4;
+    checkLayout("RGBA8 volume, 16x8x4, 4 mips", desc);
+
+    desc = makeDesc(13, 7, 4, FORMAT_R8_UNORM, 0);
+    checkLayout("R8, 13x7, 4 mips", desc);
+
+    desc = makeDesc(5, 3, 3, FORMAT_R8G8_B8G8, 0);
+    checkLayout("R8G8_B8G8, 5x3, 3 mips", desc);
+}
+
+static void testSurfaceInfo()
+{
+    fprintf(stderr, "surface info\n");
+
+    size_t numBytes;
+    size_t rowBytes;
+    size_t numRows;
+    ddsGetSurfaceInfo(1, 1, FORMAT_BC1_UNORM, &numBytes, &rowBytes, &numRows);
+    CHECK(numBytes == 8 && rowBytes == 8 && numRows == 1);
+    ddsGetSurfaceInfo(5, 9, FORMAT_BC7_UNORM, &numBytes, &rowBytes, &numRows);
+    CHECK(numBytes == 96 && rowBytes == 32 && numRows == 3);
+    ddsGetSurfaceInfo(7, 3, FORMAT_R8G8_B8G8, &numBytes, &rowBytes, &numRows);
+    CHECK(numBytes == 48 && rowBytes == 16 && numRows == 3);
+    ddsGetSurfaceInfo(7, 3, FORMAT_R8G8B8A8_UNORM, &numBytes, &rowBytes, &numRows);
+    CHECK(numBytes == 84 && rowBytes == 28 && numRows == 3);
+
+    CHECK(ddsIsBlockCompressed(FORMAT_BC1_UNORM) && ddsIsBlockCompressed(FORMAT_BC7_UNORM));
+    CHECK(!ddsIsBlockCompressed(FORMAT_R8G8B8A8_UNORM) && !ddsIsBlockCompressed(FORMAT_R8G8_B8G8));
+    CHECK(ddsBitsPerPixel(FORMAT_BC1_UNORM) == 4 && ddsBitsPerPixel(FORMAT_BC7_UNORM) == 8);
+    CHECK(ddsBitsPerPixel(1000) == 0);
+}
+
+static void testSkipMips()
+{
+    fprintf(stderr, "skip mips\n");
+
+    DdsDesc desc = makeDesc(256, 128, 9, FORMAT_BC1_UNORM, MAKEFOURCC('D', 'X', 'T', '1'));
+    std::vector<uint8_t> data;
+    makeFile(desc, &data);
+    DDSFile file;
+    CHECK(ddsParse(&data[0], data.size(), &file) == DDS_OK);
+
+    // 256x128 and 128x64 are larger than 64.
+    std::vector<DDSSubresource> subresources(desc.mipCount);
+    DDSLayout layout;
+    CHECK(ddsFillSubresources(256, 128, 1, 9, 1, FORMAT_BC1_UNORM, 64, file.bitData, file.bitSize,
+        &layout, &subresources[0]) == DDS_OK);
+    CHECK(layout.skipMip == 2);
+    CHECK(layout.width == 64 && layout.height == 32);
+    CHECK(layout.numSubresources == 7);
+    CHECK(subresources[0].data == file.bitData + 256 * 128 / 2 + 128 * 64 / 2);
+    CHECK(subresources[0].data[0] == subresourceByte(2));
+
+    // A maxsize below the smallest mip leaves nothing.
+    CHECK(ddsFillSubresources(256, 128, 1, 3, 1, FORMAT_BC1_UNORM, 16, file.bitData, file.bitSize,
+        &layout, &subresources[0]) == DDS_ERROR_NO_SURFACE);
+}
+
+static void testCorrupted()
+{
+    fprintf(stderr, "corrupted\n");
+
+    DdsDesc desc = makeDesc(64, 64, 7, FORMAT_BC7_UNORM, 0);
+    desc.arraySize = 3;
+    std::vector<uint8_t> data;
+    makeFile(desc, &data);
+    DDSFile file;
+    const size_t headerSize = sizeof(uint32_t) + sizeof(DDS_HEADER);
+
+    CHECK(ddsParse(NULL, data.size(), &file) == DDS_ERROR_INVALID_DATA);
+    CHECK(ddsParse(&data[0], headerSize - 1, &file) == DDS_ERROR_INVALID_DATA);
+    // The DX10 header is cut.
+    CHECK(ddsParse(&data[0], headerSize + sizeof(DDS_HEADER_DXT10) - 1, &file) == DDS_ERROR_INVALID_DATA);
+    CHECK(file.header == NULL && file.bitData == NULL);
+
+    std::vector<uint8_t> bad(data);
+    bad[0] = 'X';
+    CHECK(ddsParse(&bad[0], bad.size(), &file) == DDS_ERROR_INVALID_DATA);
+    bad = data;
+    ((DDS_HEADER*)&bad[sizeof(uint32_t)])->size = 100;
+    CHECK(ddsParse(&bad[0], bad.size(), &file) == DDS_ERROR_INVALID_DATA);
+    bad = data;
+    ((DDS_HEADER*)&bad[sizeof(uint32_t)])->ddspf.size = 0;
+    CHECK(ddsParse(&bad[0], bad.size(), &file) == DDS_ERROR_INVALID_DATA);
+
+    // An unknown format.
+    bad = data;
+    ((DDS_HEADER_DXT10*)&bad[headerSize])->dxgiFormat = 500;
+    CHECK(ddsParse(&bad[0], bad.size(), &file) == DDS_OK);
+    CHECK(ddsGetFormat(&file) == 0);
+
+    // The last subresource is one byte short, and a header claiming more
+    // array items than there are.
+    CHECK(ddsParse(&data[0], data.size() - 1, &file) == DDS_OK);
+    std::vector<DDSSubresource> subresources(desc.mipCount * 1000);
+    DDSLayout layout;
+    CHECK(ddsFillSubresources(64, 64, 1, 7, 3, FORMAT_BC7_UNORM, 0, file.bitData, file.bitSize,
+        &layout, &subresources[0]) == DDS_ERROR_EOF);
+    CHECK(ddsParse(&data[0], data.size(), &file) == DDS_OK);
+    CHECK(ddsFillSubresources(64, 64, 1, 7, 1000, FORMAT_BC7_UNORM, 0, file.bitData, file.bitSize,
+        &layout, &subresources[0]) == DDS_ERROR_EOF);
+}
+
+//
+// The benchmark
+//
+
+// Lay out the subresources and read all their bytes, as the upload to the
+// texture does; return the sum of the bytes.
+static uint64_t readSubresources(const uint8_t* data, size_t size, const DdsDesc& desc)
+{
+    DDSFile file;
+    if (ddsParse(data, size, &file) != DDS_OK)
+    {
+        return 0;
+    }
+    std::vector<DDSSubresource> subresources(desc.mipCount);
+    DDSLayout layout;
+    if (ddsFillSubresources(desc.width, desc.height, 1, desc.mipCount, 1, ddsGetFormat(&file), 0,
+            file.bitData, file.bitSize, &layout, &subresources[0]) != DDS_OK)
+    {
+        return 0;
+    }
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i < layout.numSubresources; ++i)
+    {
+        const uint8_t* p = subresources[i].data;
+        for (size_t k = 0; k < subresources[i].slicePitch; ++k)
+        {
+            sum += p[k];
+        }
+    }
+    return sum;
+}
+
+static void benchmark(uint32_t size, uint32_t numRuns, const char* path)
+{
+    uint32_t mipCount = 1;
+    while ((size >> mipCount) != 0)
+    {
+        mipCount++;
+    }
+    DdsDesc desc = makeDesc(size, size, mipCount, FORMAT_R8G8B8A8_UNORM, 0);
+    std::vector<uint8_t> data;
+    makeFile(desc, &data);
+
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL || fwrite(&data[0], 1, data.size(), fp) != data.size())
+    {
+        fprintf(stderr, "Failed to write %s.\n", path);
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+        numFailed++;
+        return;
+    }
+    fclose(fp);
+    uint64_t expected = readSubresources(&data[0], data.size(), desc);
+    double megabytes = data.size() / (1024.0 * 1024.0);
+    std::vector<uint8_t>().swap(data);
+
+    // The file is in the cache after it is written, so both time the
+    // loads from memory and not from the disk.
+    fprintf(stderr, "load %ux%u RGBA8, %u mips, %.1f MB, best and mean of %u runs\n",
+        size, size, mipCount, megabytes, numRuns);
+    double best[2] = { 1e30, 1e30 };
+    double total[2] = { 0.0, 0.0 };
+    for (uint32_t run = 0; run < numRuns; ++run)
+    {
+        // Read into the heap.
+        uint64_t start = timerNow();
+        uint64_t sum = 0;
+        fp = fopen(path, "rb");
+        if (fp != NULL)
+        {
+            fseek(fp, 0, SEEK_END);
+            long fileSize = ftell(fp);
+            fseek(fp, 0, SEEK_SET);
+            std::vector<uint8_t> heap(fileSize > 0? (size_t)fileSize : 1);
+            if (fileSize > 0 && fread(&heap[0], 1, (size_t)fileSize, fp) == (size_t)fileSize)
+            {
+                sum = readSubresources(&heap[0], (size_t)fileSize, desc);
+            }
+            fclose(fp);
+        }
+        double seconds = timerSecondsSince(start);
+        CHECK(sum == expected);
+        best[0] = std::min(best[0], seconds);
+        total[0] += seconds;
+
+        // Map.
+        start = timerNow();
+        sum = 0;
+        DDSMappedFile mapped;
+        if (ddsMapFile(path, &mapped))
+        {
+            sum = readSubresources(mapped.data, mapped.size, desc);
+            ddsUnmapFile(&mapped);
+        }
+        seconds = timerSecondsSince(start);
+        CHECK(sum == expected);
+        best[1] = std::min(best[1], seconds);
+        total[1] += seconds;
+    }
+    remove(path);
+
+    const char* names[2] = { "heap", "mapped" };
+    for (int k = 0; k < 2; ++k)
+    {
+        fprintf(stderr, "  %-8s %8.2f ms %8.2f ms %8.0f MB/s\n", names[k], best[k] * 1000.0,
+            total[k] / numRuns * 1000.0, megabytes / best[k]);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t size = 2048;
+    uint32_t numRuns = 10;
+    const char* path = "ddscheck.dds";
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-size") == 0 && i + 1 < argc)
+        {
+            size = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-runs") == 0 && i + 1 < argc)
+        {
+            numRuns = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-file") == 0 && i + 1 < argc)
+        {
+            path = argv[++i];
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (size == 0 || size > 16384 || numRuns == 0)
+    {
+        usage();
+        return 1;
+    }
+
+    testLayouts();
+    testSurfaceInfo();
+    testSkipMips();
+    testCorrupted();
+    benchmark(size, numRuns, path);
+
+    if (numFailed != 0)
+    {
+        fprintf(stderr, "%u checks failed.\n", numFailed);
+        return 1;
+    }
+    fprintf(stderr, "All checks passed.\n");
+    return 0;
+}
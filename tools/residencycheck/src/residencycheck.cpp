@@ -0,0 +1,677 @@
+// residencycheck.cpp
+//
+// Created at 2014/04/29
+//
+// Hongwei Li hongwei.li@amd.com
+// All rights reserved
+//
+// Check ResidencyManager on the CPU alone. The cases go through the
+// accounting of add and remove, a texture refined one mip at a time up to
+// its request and evicted down again, a budget too small for the requests
+// and even for the mip tails, the order in which the textures give up
+// their mips when the budget shrinks, and requests below the mip tail. The
+// stress run then drives the manager the way TextureStreamer::update()
+// does: the loads finish some frames late or are cancelled, the evictions
+// of a texture wait while it loads, and the requests, the priorities, the
+// budget and the textures themselves change at random. Every frame the
+// byte counts are compared with the ones kept by the driver.
+//
+//   residencycheck
+//   residencycheck -frames 100000 -latency 4 -textures 64
+//
+
+#include <dxf/util/random.h>
+#include <dxf/util/residency.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static void usage()
+{
+    fprintf(stderr,
+        "Usage: residencycheck [options]\n"
+        "  -frames <n>    The number of frames of the stress run (default 10000)\n"
+        "  -latency <n>   The frames a load takes in the stress run (default 3)\n"
+        "  -textures <n>  The number of textures of the stress run (default 32)\n"
+        "  -seed <n>      The seed of the stress run (default 1)\n");
+}
+
+static uint32_t numFailed = 0;
+
+static void check(bool condition, const char* expression, int line)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "  line %d: %s failed\n", line, expression);
+        numFailed++;
+    }
+}
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+// The mips of a square RGBA8 texture. Return the number of mips.
+static uint32_t makeMips(uint32_t size, uint64_t* mipBytes)
+{
+    uint32_t numMips = 0;
+    for (uint32_t s = size; s > 0; s >>= 1)
+    {
+        mipBytes[numMips++] = (uint64_t)s * s * 4;
+    }
+    return numMips;
+}
+
+static uint32_t countActions(const std::vector<ResidencyRequest>& requests, ResidencyActionEnum action)
+{
+    uint32_t count = 0;
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        if (requests[i].action == action)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Carry out the requests at once, as if the loads took no time.
+static void carryOut(ResidencyManager* residency, const std::vector<ResidencyRequest>& requests)
+{
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        const ResidencyRequest& request = requests[i];
+        if (request.action == RESIDENCY_EVICT)
+        {
+            residency->onEvicted(request.id, request.mip);
+        }
+        else
+        {
+            residency->onLoaded(request.id, request.mip);
+        }
+    }
+}
+
+// Update and carry out until nothing is requested. Return the number of
+// updates that requested something.
+static uint32_t settle(ResidencyManager* residency)
+{
+    std::vector<ResidencyRequest> requests;
+    uint32_t numUpdates = 0;
+    for (;;)
+    {
+        residency->update(&requests);
+        if (requests.empty() || numUpdates == 1000)
+        {
+            return numUpdates;
+        }
+        carryOut(residency, requests);
+        numUpdates++;
+    }
+}
+
+//
+// The cases
+//
+
+// A 256x256 texture has 9 mips; from 16x16 down they are its tail.
+#define TAIL_MIP   4
+#define TAIL_BYTES (1024 + 256 + 64 + 16 + 4)
+#define FULL_BYTES (262144 + 65536 + 16384 + 4096 + TAIL_BYTES)
+
+static void testAdd()
+{
+    fprintf(stderr, "add\n");
+
+    uint64_t mipBytes[RESIDENCY_MAX_MIPS];
+    uint32_t numMips = makeMips(256, mipBytes);
+    CHECK(numMips == 9);
+
+    ResidencyManager residency(1 << 20);
+    int a = residency.add(numMips, mipBytes, TAIL_MIP);
+    int b = residency.add(numMips, mipBytes, TAIL_MIP);
+    CHECK(a == 0 && b == 1);
+    // The tails are resident as soon as they are added.
+    CHECK(residency.residentMip(a) == TAIL_MIP && residency.targetMip(a) == TAIL_MIP);
+    CHECK(residency.bytes(a, TAIL_MIP) == TAIL_BYTES);
+    CHECK(residency.bytes(a, 0) == FULL_BYTES);
+    CHECK(residency.residentBytes() == 2 * TAIL_BYTES);
+    CHECK(residency.pendingBytes() == 0);
+
+    // Nothing is requested beyond the tails.
+    std::vector<ResidencyRequest> requests;
+    residency.update(&requests);
+    CHECK(requests.empty());
+
+    // A removed texture gives its bytes back, its load in flight included,
+    // and its id is reused.
+    residency.setRequestedMip(a, 0, 1.0f);
+    residency.update(&requests);
+    CHECK(requests.size() == 1 && residency.pendingBytes() == 4096);
+    residency.remove(a);
+    CHECK(residency.residentBytes() == TAIL_BYTES);
+    CHECK(residency.pendingBytes() == 0);
+    CHECK(residency.add(numMips, mipBytes, TAIL_MIP) == a);
+    CHECK(residency.residentBytes() == 2 * TAIL_BYTES);
+}
+
+static void testLoadUp()
+{
+    fprintf(stderr, "load up\n");
+
+    uint64_t mipBytes[RESIDENCY_MAX_MIPS];
+    uint32_t numMips = makeMips(256, mipBytes);
+    ResidencyManager residency(1 << 20);
+    int a = residency.add(numMips, mipBytes, TAIL_MIP);
+
+    residency.setRequestedMip(a, 0, 1.0f);
+    std::vector<ResidencyRequest> requests;
+    for (uint32_t mip = TAIL_MIP; mip-- > 0;)
+    {
+        // One mip at a time, the next more detailed one.
+        residency.update(&requests);
+        CHECK(requests.size() == 1);
+        CHECK(requests[0].action == RESIDENCY_LOAD && requests[0].id == a && requests[0].mip == mip);
+        CHECK(residency.targetMip(a) == 0);
+        CHECK(residency.pendingBytes() == mipBytes[mip]);
+
+        // Not again while it is in flight.
+        residency.update(&requests);
+        CHECK(requests.empty());
+
+        residency.onLoaded(a, mip);
+        CHECK(residency.residentMip(a) == mip);
+        CHECK(residency.residentBytes() == residency.bytes(a, mip));
+        CHECK(residency.pendingBytes() == 0);
+    }
+    residency.update(&requests);
+    CHECK(requests.empty());
+
+    // A cancelled load is requested again.
+    residency.setRequestedMip(a, 2, 1.0f);
+    CHECK(settle(&residency) == 1);
+    residency.setRequestedMip(a, 1, 1.0f);
+    residency.update(&requests);
+    CHECK(requests.size() == 1 && requests[0].mip == 1);
+    residency.onCancelled(a);
+    CHECK(residency.pendingBytes() == 0 && residency.residentMip(a) == 2);
+    residency.update(&requests);
+    CHECK(requests.size() == 1 && requests[0].action == RESIDENCY_LOAD && requests[0].mip == 1);
+}
+
+static void testLodDown()
+{
+    fprintf(stderr, "lod down\n");
+
+    uint64_t mipBytes[RESIDENCY_MAX_MIPS];
+    uint32_t numMips = makeMips(256, mipBytes);
+    ResidencyManager residency(1 << 20);
+    int a = residency.add(numMips, mipBytes, TAIL_MIP);
+    int b = residency.add(numMips, mipBytes, TAIL_MIP);
+    residency.setRequestedMip(a, 0, 1.0f);
+    CHECK(settle(&residency) == TAIL_MIP);
+    CHECK(residency.residentMip(a) == 0);
+
+    // All the mips above the request go in one eviction.
+    residency.setRequestedMip(a, 2, 1.0f);
+    std::vector<ResidencyRequest> requests;
+    residency.update(&requests);
+    CHECK(requests.size() == 1);
+    CHECK(requests[0].action == RESIDENCY_EVICT && requests[0].id == a && requests[0].mip == 2);
+    residency.onEvicted(a, 2);
+    CHECK(residency.residentBytes() == residency.bytes(a, 2) + TAIL_BYTES);
+
+    // The evictions come before the loads, even those of the textures of
+    // a lower priority.
+    residency.setRequestedMip(a, 3, 0.0f);
+    residency.setRequestedMip(b, 0, 1.0f);
+    residency.update(&requests);
+    CHECK(requests.size() == 2);
+    CHECK(requests[0].action == RESIDENCY_EVICT && requests[0].id == a && requests[0].mip == 3);
+    CHECK(requests[1].action == RESIDENCY_LOAD && requests[1].id == b && requests[1].mip == 3);
+    carryOut(&residency, requests);
+
+    // Up again.
+    residency.setRequestedMip(a, 1, 0.0f);
+    settle(&residency);
+    CHECK(residency.residentMip(a) == 1 && residency.residentMip(b) == 0);
+    CHECK(residency.residentBytes() == residency.bytes(a, 1) + FULL_BYTES);
+}
+
+static void testBudget()
+{
+    fprintf(stderr, "budget\n");
+
+    uint64_t mipBytes[RESIDENCY_MAX_MIPS];
+    uint32_t numMips = makeMips(256, mipBytes);
+    // Beyond the tails, room for mip 3 of both and mip 2 of one.
+    const uint64_t budget = 2 * TAIL_BYTES + 4096 + 4096 + 16384;
+    ResidencyManager residency(budget);
+    int a = residency.add(numMips, mipBytes, TAIL_MIP);
+    int b = residency.add(numMips, mipBytes, TAIL_MIP);
+    residency.setRequestedMip(a, 0, 2.0f);
+    residency.setRequestedMip(b, 0, 1.0f);
+
+    // The targets are refined a mip at a time, so the lower priority gets
+    // its first mip before the higher one gets its second.
+    std::vector<ResidencyRequest> requests;
+    residency.update(&requests);
+    CHECK(residency.targetMip(a) == 2 && residency.targetMip(b) == 3);
+    CHECK(countActions(requests, RESIDENCY_LOAD) == 2);
+    CHECK(residency.residentBytes() + residency.pendingBytes() <= budget);
+    carryOut(&residency, requests);
+    settle(&residency);
+    CHECK(residency.residentMip(a) == 2 && residency.residentMip(b) == 3);
+    CHECK(residency.residentBytes() == budget);
+
+    // A load that does not fit waits for an eviction.
+    residency.setRequestedMip(b, 2, 3.0f);
+    residency.update(&requests);
+    CHECK(residency.targetMip(a) == 3 && residency.targetMip(b) == 2);
+    CHECK(requests.size() == 2);
+    CHECK(requests[0].action == RESIDENCY_EVICT && requests[0].id == a && requests[0].mip == 3);
+    CHECK(requests[1].action == RESIDENCY_LOAD && requests[1].id == b && requests[1].mip == 2);
+    carryOut(&residency, requests);
+    CHECK(residency.residentBytes() == budget);
+
+    // A load in flight counts against the budget until it is done, even
+    // when its texture is no longer the one that gets the room.
+    residency.setBudget(2 * TAIL_BYTES + 4096);
+    residency.setRequestedMip(a, TAIL_MIP, 0.0f);
+    residency.setRequestedMip(b, TAIL_MIP, 0.0f);
+    settle(&residency);
+    residency.setRequestedMip(a, 3, 0.0f);
+    residency.update(&requests);
+    CHECK(requests.size() == 1 && requests[0].id == a && requests[0].mip == 3);
+    residency.setRequestedMip(b, 3, 1.0f);
+    residency.update(&requests);
+    CHECK(requests.empty());
+    residency.onLoaded(a, 3);
+    residency.update(&requests);
+    CHECK(requests.size() == 2);
+    CHECK(requests[0].action == RESIDENCY_EVICT && requests[0].id == a && requests[0].mip == TAIL_MIP);
+    CHECK(requests[1].action == RESIDENCY_LOAD && requests[1].id == b && requests[1].mip == 3);
+    carryOut(&residency, requests);
+    CHECK(residency.residentBytes() == 2 * TAIL_BYTES + 4096);
+
+    // Not even the tails fit: everything else goes and nothing is loaded.
+    residency.setBudget(TAIL_BYTES);
+    residency.update(&requests);
+    CHECK(countActions(requests, RESIDENCY_EVICT) == 1);
+    CHECK(countActions(requests, RESIDENCY_LOAD) == 0);
+    carryOut(&residency, requests);
+    CHECK(residency.residentMip(a) == TAIL_MIP && residency.residentMip(b) == TAIL_MIP);
+    CHECK(residency.residentBytes() == 2 * TAIL_BYTES);
+    residency.update(&requests);
+    CHECK(requests.empty());
+
+    // A texture larger than the whole budget gets what fits.
+    residency.setBudget(2 * TAIL_BYTES + 65536 + 16384 + 4096);
+    residency.setRequestedMip(a, 0, 1.0f);
+    residency.setRequestedMip(b, TAIL_MIP, 0.0f);
+    CHECK(settle(&residency) == 3);
+    CHECK(residency.residentMip(a) == 1 && residency.residentMip(b) == TAIL_MIP);
+}
+
+static void testEvictionOrder()
+{
+    fprintf(stderr, "eviction order\n");
+
+    uint64_t mipBytes[RESIDENCY_MAX_MIPS];
+    uint32_t numMips = makeMips(256, mipBytes);
+    ResidencyManager residency(3 * FULL_BYTES);
+    int ids[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        ids[i] = residency.add(numMips, mipBytes, TAIL_MIP);
+    }
+    // The last one added has the highest priority.
+    for (int i = 0; i < 3; ++i)
+    {
+        residency.setRequestedMip(ids[i], 0, (float)i);
+    }
+    settle(&residency);
+    CHECK(residency.residentBytes() == 3 * FULL_BYTES);
+
+    // A byte short: the lowest priority gives up its mip 0, and only that.
+    std::vector<ResidencyRequest> requests;
+    residency.setBudget(3 * FULL_BYTES - 1);
+    residency.update(&requests);
+    CHECK(requests.size() == 1);
+    CHECK(requests[0].action == RESIDENCY_EVICT && requests[0].id == ids[0] && requests[0].mip == 1);
+    carryOut(&residency, requests);
+
+    // Then the middle one.
+    residency.setBudget(3 * FULL_BYTES - 2 * 262144);
+    residency.update(&requests);
+    CHECK(requests.size() == 1);
+    CHECK(requests[0].action == RESIDENCY_EVICT && requests[0].id == ids[1] && requests[0].mip == 1);
+    carryOut(&residency, requests);
+
+    // Down to the tails, more detail always stays with a higher priority.
+    for (uint32_t k = 0; k < 3 * FULL_BYTES / 4096; ++k)
+    {
+        uint64_t budget = 3 * FULL_BYTES - k * 4096;
+        residency.setBudget(budget);
+        settle(&residency);
+        CHECK(residency.residentBytes() <= budget);
+        CHECK(residency.residentMip(ids[2]) <= residency.residentMip(ids[1]));
+        CHECK(residency.residentMip(ids[1]) <= residency.residentMip(ids[0]));
+    }
+
+    // Equal priorities: the lower id wins.
+    residency.setBudget(3 * TAIL_BYTES + 4096);
+    for (int i = 0; i < 3; ++i)
+    {
+        residency.setRequestedMip(ids[i], 0, 1.0f);
+    }
+    settle(&residency);
+    CHECK(residency.residentMip(ids[0]) == 3);
+    CHECK(residency.residentMip(ids[1]) == TAIL_MIP && residency.residentMip(ids[2]) == TAIL_MIP);
+}
+
+static void testMipTail()
+{
+    fprintf(stderr, "mip tail\n");
+
+    uint64_t mipBytes[RESIDENCY_MAX_MIPS];
+    uint32_t numMips = makeMips(256, mipBytes);
+    ResidencyManager residency(1 << 20);
+    int a = residency.add(numMips, mipBytes, TAIL_MIP);
+    // The whole texture is its tail, and only its last mip.
+    int b = residency.add(numMips, mipBytes, 0);
+    int c = residency.add(numMips, mipBytes, numMips - 1);
+    CHECK(residency.residentBytes() == TAIL_BYTES + FULL_BYTES + 4);
+
+    // A request below the tail is the tail.
+    residency.setRequestedMip(a, 0, 1.0f);
+    settle(&residency);
+    residency.setRequestedMip(a, 100, 1.0f);
+    residency.setRequestedMip(b, 100, 1.0f);
+    residency.setRequestedMip(c, 100, 1.0f);
+    std::vector<ResidencyRequest> requests;
+    residency.update(&requests);
+    CHECK(requests.size() == 1);
+    CHECK(requests[0].action == RESIDENCY_EVICT && requests[0].id == a && requests[0].mip == TAIL_MIP);
+    carryOut(&residency, requests);
+    CHECK(residency.targetMip(b) == 0 && residency.targetMip(c) == numMips - 1);
+
+    // No budget at all.
+    residency.setBudget(0);
+    residency.setRequestedMip(a, 0, 1.0f);
+    residency.setRequestedMip(c, 0, 1.0f);
+    residency.update(&requests);
+    CHECK(requests.empty());
+    CHECK(residency.residentMip(a) == TAIL_MIP && residency.residentMip(b) == 0);
+    CHECK(residency.residentMip(c) == numMips - 1);
+    CHECK(residency.residentBytes() == TAIL_BYTES + FULL_BYTES + 4);
+}
+
+//
+// The stress run
+//
+
+// A texture as the driver sees it.
+struct Texture
+{
+    int      id;        // -1 when removed
+    uint32_t numMips;
+    uint64_t mipBytes[RESIDENCY_MAX_MIPS];
+    uint32_t tailMip;
+    uint32_t residentMip;
+    uint32_t loadingMip;  // numMips when no load is in flight
+    uint32_t loadFrame;
+};
+
+static uint64_t textureBytes(const Texture& texture, uint32_t mip)
+{
+    uint64_t bytes = 0;
+    for (uint32_t m = mip; m < texture.numMips; ++m)
+    {
+        bytes += texture.mipBytes[m];
+    }
+    return bytes;
+}
+
+static void addTexture(ResidencyManager* residency, RandomPCG32* random, Texture* texture)
+{
+    // 16x16 to 2048x2048 with a tail of one to five mips.
+    texture->numMips = makeMips(16u << randomPCG32Bounded(random, 8), texture->mipBytes);
+    texture->tailMip = texture->numMips - 1 - randomPCG32Bounded(random, 5);
+    texture->residentMip = texture->tailMip;
+    texture->loadingMip = texture->numMips;
+    texture->loadFrame = 0;
+    texture->id = residency->add(texture->numMips, texture->mipBytes, texture->tailMip);
+}
+
+static void testStress(uint32_t numFrames, uint32_t latency, uint32_t numTextures, uint32_t seed)
+{
+    fprintf(stderr, "stress, %u frames, latency %u, %u textures\n", numFrames, latency, numTextures);
+
+    RandomPCG32 random;
+    randomPCG32Seed(&random, seed, 0);
+
+    // The budget moves around what the textures need, from their tails
+    // and a few mips to most of what they request.
+    const uint64_t maxBudget = (uint64_t)numTextures * (1 << 20);
+    ResidencyManager residency(maxBudget / 2);
+    std::vector<Texture> textures(numTextures);
+    std::vector<int> slots;  // The texture of every id.
+    for (uint32_t t = 0; t < numTextures; ++t)
+    {
+        addTexture(&residency, &random, &textures[t]);
+        slots.push_back((int)t);
+    }
+
+    std::vector<ResidencyRequest> requests;
+    uint64_t numLoads = 0;
+    uint64_t numCancels = 0;
+    uint64_t numEvictions = 0;
+    uint64_t numDeferred = 0;
+    uint64_t numOverBudget = 0;
+    for (uint32_t f = 0; f < numFrames + 1000; ++f)
+    {
+        // The last frames change nothing, so the manager must settle.
+        bool settling = f >= numFrames;
+        if (!settling)
+        {
+            uint32_t numChanges = randomPCG32Bounded(&random, 4);
+            for (uint32_t k = 0; k < numChanges; ++k)
+            {
+                Texture& texture = textures[randomPCG32Bounded(&random, numTextures)];
+                residency.setRequestedMip(texture.id, randomPCG32Bounded(&random, texture.numMips + 2),
+                    randomPCG32Float(&random));
+            }
+            if (randomPCG32Bounded(&random, 64) == 0)
+            {
+                residency.setBudget(maxBudget / 16 + randomPCG32Bounded(&random, (uint32_t)(maxBudget / 1024)) * 1024);
+            }
+            if (randomPCG32Bounded(&random, 256) == 0)
+            {
+                // Its load in flight is dropped with it.
+                uint32_t t = randomPCG32Bounded(&random, numTextures);
+                slots[textures[t].id] = -1;
+                residency.remove(textures[t].id);
+                addTexture(&residency, &random, &textures[t]);
+                if ((size_t)textures[t].id == slots.size())
+                {
+                    slots.push_back((int)t);
+                }
+                slots[textures[t].id] = (int)t;
+            }
+        }
+
+        // The loads that are done, and a few that failed.
+        for (uint32_t t = 0; t < numTextures; ++t)
+        {
+            Texture& texture = textures[t];
+            if (texture.loadingMip < texture.numMips && texture.loadFrame + latency <= f)
+            {
+                if (!settling && randomPCG32Bounded(&random, 16) == 0)
+                {
+                    residency.onCancelled(texture.id);
+                    numCancels++;
+                }
+                else
+                {
+                    residency.onLoaded(texture.id, texture.loadingMip);
+                    texture.residentMip = texture.loadingMip;
+                    numLoads++;
+                }
+                texture.loadingMip = texture.numMips;
+            }
+        }
+
+        uint64_t residentBefore = residency.residentBytes();
+        uint64_t pendingBefore = residency.pendingBytes();
+        residency.update(&requests);
+
+        // The evictions come first, never touch the tail and the loads
+        // are the next mip of a texture that is not loading.
+        uint64_t projected = residentBefore;
+        uint64_t loadBytes = 0;
+        bool evicting = true;
+        for (size_t i = 0; i < requests.size(); ++i)
+        {
+            const ResidencyRequest& request = requests[i];
+            const Texture& texture = textures[slots[request.id]];
+            if (request.action == RESIDENCY_EVICT)
+            {
+                CHECK(evicting);
+                CHECK(request.mip > texture.residentMip && request.mip <= texture.tailMip);
+                projected -= textureBytes(texture, texture.residentMip) - textureBytes(texture, request.mip);
+            }
+            else
+            {
+                evicting = false;
+                CHECK(request.mip + 1 == texture.residentMip);
+                CHECK(request.mip >= residency.targetMip(request.id));
+                CHECK(texture.loadingMip == texture.numMips);
+                loadBytes += texture.mipBytes[request.mip];
+            }
+        }
+        CHECK(residency.pendingBytes() == pendingBefore + loadBytes);
+        // The loads fit once the evictions are done.
+        if (loadBytes > 0)
+        {
+            CHECK(projected + residency.pendingBytes() <= residency.budget());
+        }
+
+        for (size_t i = 0; i < requests.size(); ++i)
+        {
+            const ResidencyRequest& request = requests[i];
+            Texture& texture = textures[slots[request.id]];
+            if (request.action == RESIDENCY_LOAD)
+            {
+                texture.loadingMip = request.mip;
+                texture.loadFrame = f;
+            }
+            else if (texture.loadingMip < texture.numMips)
+            {
+                // The eviction is requested again next frame.
+                numDeferred++;
+            }
+            else
+            {
+                residency.onEvicted(request.id, request.mip);
+                texture.residentMip = request.mip;
+                numEvictions++;
+            }
+        }
+
+        // The manager agrees with the driver, and the tails are resident.
+        uint64_t residentBytes = 0;
+        uint64_t pendingBytes = 0;
+        uint64_t tailBytes = 0;
+        for (uint32_t t = 0; t < numTextures; ++t)
+        {
+            const Texture& texture = textures[t];
+            CHECK(residency.residentMip(texture.id) == texture.residentMip);
+            CHECK(texture.residentMip <= texture.tailMip);
+            residentBytes += textureBytes(texture, texture.residentMip);
+            tailBytes += textureBytes(texture, texture.tailMip);
+            if (texture.loadingMip < texture.numMips)
+            {
+                pendingBytes += texture.mipBytes[texture.loadingMip];
+            }
+        }
+        CHECK(residency.residentBytes() == residentBytes);
+        CHECK(residency.pendingBytes() == pendingBytes);
+        if (residentBytes > residency.budget() && residentBytes > tailBytes)
+        {
+            // Until the evictions catch up with a smaller budget.
+            numOverBudget++;
+        }
+    }
+
+    // Settled: every texture has its target, within the budget unless the
+    // tails alone are over it.
+    residency.update(&requests);
+    CHECK(requests.empty());
+    uint64_t tailBytes = 0;
+    for (uint32_t t = 0; t < numTextures; ++t)
+    {
+        CHECK(textures[t].residentMip == residency.targetMip(textures[t].id));
+        CHECK(textures[t].loadingMip == textures[t].numMips);
+        tailBytes += textureBytes(textures[t], textures[t].tailMip);
+    }
+    CHECK(residency.residentBytes() <= residency.budget() || residency.residentBytes() == tailBytes);
+    CHECK(residency.pendingBytes() == 0);
+
+    fprintf(stderr, "  %llu loads, %llu cancelled, %llu evictions, %llu deferred, %llu frames over the budget\n",
+        (unsigned long long)numLoads, (unsigned long long)numCancels, (unsigned long long)numEvictions,
+        (unsigned long long)numDeferred, (unsigned long long)numOverBudget);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t numFrames = 10000;
+    uint32_t latency = 3;
+    uint32_t numTextures = 32;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+        {
+            numFrames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-latency") == 0 && i + 1 < argc)
+        {
+            latency = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-textures") == 0 && i + 1 < argc)
+        {
+            numTextures = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+        {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (numTextures == 0 || numTextures > 1024 || latency > 100)
+    {
+        usage();
+        return 1;
+    }
+
+    testAdd();
+    testLoadUp();
+    testLodDown();
+    testBudget();
+    testEvictionOrder();
+    testMipTail();
+    testStress(numFrames, latency, numTextures, seed);
+
+    if (numFailed != 0)
+    {
+        fprintf(stderr, "%u checks failed.\n", numFailed);
+        return 1;
+    }
+    fprintf(stderr, "All checks passed.\n");
+    return 0;
+}
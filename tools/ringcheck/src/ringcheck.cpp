@@ -0,0 +1,408 @@
+// ringcheck.cpp
+//
+// Created at 2014/04/27
+//
+// Hongwei Li hongwei.li@amd.com
+// All rights reserved
+//
+// Check RingAllocator on the CPU alone. The cases go through allocate,
+// the skip at the end of the ring, RING_ALLOCATOR_FULL, endFrame, retire
+// and reset with known offsets. The stress run then drives the ring the
+// way ConstantAllocator does against a fake device whose fences complete
+// some frames late: every allocation is stamped with its frame, and the
+// device checks the stamps when it finishes the frame, so any space handed
+// out while the GPU could still read it is caught.
+//
+//   ringcheck
+//   ringcheck -frames 100000 -latency 3 -capacity 65536
+//
+
+#include <dxf/util/random.h>
+#include <dxf/util/ringallocator.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <vector>
+
+static void usage()
+{
+    fprintf(stderr,
+        "Usage: ringcheck [options]\n"
+        "  -frames <n>    The number of frames of the stress run (default 10000)\n"
+        "  -latency <n>   The frames the fake device lags behind (default 3)\n"
+        "  -capacity <n>  The size of the ring of the stress run in bytes (default 65536)\n"
+        "  -seed <n>      The seed of the allocation sizes (default 1)\n");
+}
+
+static uint32_t numFailed = 0;
+
+static void check(bool condition, const char* expression, int line)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "  line %d: %s failed\n", line, expression);
+        numFailed++;
+    }
+}
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+//
+// The cases
+//
+static void testAllocate()
+{
+    fprintf(stderr, "allocate\n");
+
+    RingAllocator ring(1024);
+    CHECK(ring.allocate(100, 16) == 0);
+    CHECK(ring.allocate(10, 64) == 128);
+    CHECK(ring.allocate(4, 4) == 140);
+    // The padding counts.
+    CHECK(ring.usedBytes() == 144);
+    CHECK(ring.frameBytes() == 144);
+
+    CHECK(ring.allocate(0, 16) == RING_ALLOCATOR_FULL);
+    CHECK(ring.allocate(2048, 16) == RING_ALLOCATOR_FULL);
+    CHECK(ring.usedBytes() == 144);
+
+    // The whole rest of the ring.
+    CHECK(ring.allocate(880, 16) == 144);
+    CHECK(ring.usedBytes() == 1024);
+    CHECK(ring.allocate(1, 1) == RING_ALLOCATOR_FULL);
+}
+
+static void testWrapSkip()
+{
+    fprintf(stderr, "wrap skip\n");
+
+    RingAllocator ring(1024);
+    CHECK(ring.allocate(600, 256) == 0);
+    ring.endFrame(1);
+    ring.retire(1);
+    CHECK(ring.usedBytes() == 0);
+
+    // 768 + 600 does not fit before the end; the 424 bytes from 600 on are
+    // skipped and held until the frame retires.
+    CHECK(ring.allocate(600, 256) == 0);
+    CHECK(ring.usedBytes() == 1024);
+    CHECK(ring.frameBytes() == 1024);
+    CHECK(ring.allocate(1, 1) == RING_ALLOCATOR_FULL);
+    ring.endFrame(2);
+    ring.retire(2);
+    CHECK(ring.usedBytes() == 0);
+
+    // An allocation that ends exactly at the end of the ring is no skip.
+    CHECK(ring.allocate(424, 8) == 600);
+    CHECK(ring.allocate(8, 8) == 0);
+    CHECK(ring.usedBytes() == 432);
+}
+
+static void testFull()
+{
+    fprintf(stderr, "full\n");
+
+    RingAllocator ring(1024);
+    CHECK(ring.allocate(512, 16) == 0);
+    ring.endFrame(1);
+    CHECK(ring.allocate(512, 16) == 512);
+    ring.endFrame(2);
+
+    // Both frames in flight hold the ring.
+    CHECK(ring.allocate(16, 16) == RING_ALLOCATOR_FULL);
+    ring.retire(0);
+    CHECK(ring.allocate(16, 16) == RING_ALLOCATOR_FULL);
+
+    // A failed allocation leaves the ring as it was.
+    ring.retire(1);
+    CHECK(ring.usedBytes() == 512);
+    CHECK(ring.allocate(512, 16) == 0);
+    CHECK(ring.allocate(16, 16) == RING_ALLOCATOR_FULL);
+}
+
+static void testEndFrame()
+{
+    fprintf(stderr, "end frame\n");
+
+    RingAllocator ring(1024);
+    // A frame without allocations has nothing to wait for.
+    ring.endFrame(1);
+    CHECK(ring.numFramesInFlight() == 0);
+
+    CHECK(ring.allocate(64, 16) == 0);
+    ring.endFrame(2);
+    CHECK(ring.numFramesInFlight() == 1);
+    CHECK(ring.oldestFence() == 2);
+    CHECK(ring.frameBytes() == 0);
+    CHECK(ring.usedBytes() == 64);
+
+    ring.endFrame(3);
+    CHECK(ring.numFramesInFlight() == 1);
+
+    CHECK(ring.allocate(64, 16) == 64);
+    ring.endFrame(4);
+    CHECK(ring.numFramesInFlight() == 2);
+    CHECK(ring.oldestFence() == 2);
+}
+
+static void testRetire()
+{
+    fprintf(stderr, "retire\n");
+
+    RingAllocator ring(1024);
+    for (uint64_t fence = 1; fence <= 3; ++fence)
+    {
+        CHECK(ring.allocate(100, 4) != RING_ALLOCATOR_FULL);
+        ring.endFrame(fence);
+    }
+    CHECK(ring.allocate(100, 4) == 300);
+    CHECK(ring.usedBytes() == 400);
+
+    ring.retire(0);
+    CHECK(ring.numFramesInFlight() == 3);
+
+    // The fences the frames were not closed under retire the ones before.
+    ring.retire(2);
+    CHECK(ring.numFramesInFlight() == 1);
+    CHECK(ring.oldestFence() == 3);
+    CHECK(ring.usedBytes() == 200);
+
+    ring.retire(10);
+    CHECK(ring.numFramesInFlight() == 0);
+    CHECK(ring.usedBytes() == 100);
+    CHECK(ring.frameBytes() == 100);
+
+    // reset() forgets the frames in flight but not the current one.
+    ring.endFrame(11);
+    CHECK(ring.allocate(100, 4) == 400);
+    ring.reset();
+    CHECK(ring.numFramesInFlight() == 0);
+    CHECK(ring.usedBytes() == 100);
+    CHECK(ring.allocate(100, 4) == 500);
+}
+
+//
+// The stress run
+//
+
+// An allocation as the GPU reads it.
+struct Read
+{
+    uint64_t offset;
+    uint64_t size;
+    uint8_t  stamp;
+};
+
+// The device executes the frames in order and finishes each one latency
+// frames after it was submitted, like the event queries polled by
+// ConstantAllocator::beginFrame(). wait() blocks until the oldest frame is
+// finished, as a GetData loop does.
+class FakeDevice
+{
+public:
+    FakeDevice(uint64_t capacity, uint32_t latency)
+        : m_memory(capacity, 0)
+        , m_latency(latency)
+        , m_numPresents(0)
+        , m_completedFence(0)
+        , m_numCorrupted(0)
+    {
+    }
+
+    uint8_t* memory() { return &m_memory[0]; }
+
+    void submit(uint64_t fence, const std::vector<Read>& reads)
+    {
+        Frame frame;
+        frame.fence = fence;
+        frame.present = m_numPresents;
+        frame.reads = reads;
+        m_frames.push_back(frame);
+    }
+
+    // One frame later.
+    void present()
+    {
+        m_numPresents++;
+        while (!m_frames.empty() && m_frames.front().present + m_latency <= m_numPresents)
+        {
+            finish();
+        }
+    }
+
+    void wait()
+    {
+        if (!m_frames.empty())
+        {
+            finish();
+        }
+    }
+
+    uint64_t completedFence() const { return m_completedFence; }
+    uint64_t numCorrupted() const { return m_numCorrupted; }
+
+private:
+    struct Frame
+    {
+        uint64_t          fence;
+        uint64_t          present;
+        std::vector<Read> reads;
+    };
+
+    // The GPU reads the frame: every byte must still be the stamp the CPU
+    // wrote.
+    void finish()
+    {
+        const Frame& frame = m_frames.front();
+        for (size_t i = 0; i < frame.reads.size(); ++i)
+        {
+            const Read& read = frame.reads[i];
+            for (uint64_t b = 0; b < read.size; ++b)
+            {
+                if (m_memory[read.offset + b] != read.stamp)
+                {
+                    m_numCorrupted++;
+                    break;
+                }
+            }
+        }
+        m_completedFence = frame.fence;
+        m_frames.pop_front();
+    }
+
+private:
+    std::vector<uint8_t> m_memory;
+    uint32_t             m_latency;
+    uint64_t             m_numPresents;
+    uint64_t             m_completedFence;
+    uint64_t             m_numCorrupted;
+    std::deque<Frame>    m_frames;
+};
+
+static void testStress(uint32_t numFrames, uint32_t latency, uint64_t capacity, uint32_t seed)
+{
+    fprintf(stderr, "stress, %u frames, latency %u, %u bytes\n", numFrames, latency, (uint32_t)capacity);
+
+    RandomPCG32 random;
+    randomPCG32Seed(&random, seed, 0);
+
+    FakeDevice device(capacity, latency);
+    RingAllocator ring(capacity);
+    uint64_t nextFence = 1;
+    uint64_t numAllocations = 0;
+    uint64_t numStalls = 0;
+    uint64_t numTooLarge = 0;
+    uint64_t maxUsed = 0;
+    for (uint32_t f = 0; f < numFrames; ++f)
+    {
+        ring.retire(device.completedFence());
+
+        // A frame takes a quarter of the ring on average and up to all of
+        // it, so that the frames in flight often fill it.
+        std::vector<Read> reads;
+        uint32_t numDraws = 1 + randomPCG32Bounded(&random, 32);
+        for (uint32_t d = 0; d < numDraws; ++d)
+        {
+            uint64_t size = 1 + randomPCG32Bounded(&random, (uint32_t)(capacity / 32));
+            uint64_t alignment = 1ull << randomPCG32Bounded(&random, 9);
+
+            uint64_t offset;
+            while ((offset = ring.allocate(size, alignment)) == RING_ALLOCATOR_FULL)
+            {
+                if (ring.numFramesInFlight() == 0)
+                {
+                    break;
+                }
+                device.wait();
+                ring.retire(device.completedFence());
+                numStalls++;
+            }
+            if (offset == RING_ALLOCATOR_FULL)
+            {
+                // The frame alone does not fit.
+                numTooLarge++;
+                continue;
+            }
+
+            CHECK(offset % alignment == 0);
+            CHECK(offset + size <= capacity);
+            CHECK(ring.usedBytes() <= capacity);
+            maxUsed = ring.usedBytes() > maxUsed? ring.usedBytes() : maxUsed;
+
+            Read read;
+            read.offset = offset;
+            read.size = size;
+            read.stamp = (uint8_t)(f % 255 + 1);
+            memset(device.memory() + offset, read.stamp, (size_t)size);
+            reads.push_back(read);
+            numAllocations++;
+        }
+
+        if (!reads.empty())
+        {
+            device.submit(nextFence, reads);
+            ring.endFrame(nextFence++);
+        }
+        device.present();
+    }
+
+    CHECK(device.numCorrupted() == 0);
+    fprintf(stderr, "  %llu allocations, %llu stalls, %llu too large, peak %.1f%% of the ring\n",
+        (unsigned long long)numAllocations, (unsigned long long)numStalls,
+        (unsigned long long)numTooLarge, 100.0 * maxUsed / capacity);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t numFrames = 10000;
+    uint32_t latency = 3;
+    uint64_t capacity = 65536;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+        {
+            numFrames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-latency") == 0 && i + 1 < argc)
+        {
+            latency = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-capacity") == 0 && i + 1 < argc)
+        {
+            capacity = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+        {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    // The alignments go up to 256 and must divide the capacity.
+    if (capacity < 1024 || capacity % 256 != 0)
+    {
+        fprintf(stderr, "The capacity must be a multiple of 256 of at least 1024.\n");
+        return 1;
+    }
+
+    testAllocate();
+    testWrapSkip();
+    testFull();
+    testEndFrame();
+    testRetire();
+    testStress(numFrames, latency, capacity, seed);
+
+    if (numFailed != 0)
+    {
+        fprintf(stderr, "%u checks failed.\n", numFailed);
+        return 1;
+    }
+    fprintf(stderr, "All checks passed.\n");
+    return 0;
+}
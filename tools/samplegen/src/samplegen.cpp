@@ -0,0 +1,546 @@
+// samplegen.cpp
+//
+// Created at 2014/04/18
+//
+// Hongwei Li hongwei.li@amd.com
+// All rights reserved
+//
+// Generate the sphere, hemisphere and ring sample sets offline and
+// write them as sample set files, which cachedSamples() reads back, or
+// as XYZ point clouds. The benchmark mode compares the speed and the
+// quality of the generators of dxf/util/sampling.h and SphereSampler for
+// picking the cheapest one that is good enough.
+//
+//   samplegen hemisphere 128 -xyz ../demos/hemisampling/media/models/points.xyz
+//   samplegen sphere 1024 -seed 7 -dir ../bin/media/samples
+//   samplegen benchmark 1024 -min 0.6 -energy 0.085
+//   samplegen kernel cosine 64 -hlsl ../demos/rao/media/shaders/kernel.hlsl
+//
+
+#include "sampler.h"
+
+#include <dxf/util/random.h>
+#include <dxf/util/sampling.h>
+#include <dxf/util/timer.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void usage()
+{
+    fprintf(stderr,
+        "Usage: samplegen <sphere|hemisphere|ring> <num> [options]\n"
+        "  -seed <n>     The seed of the generator (10001 for the sphere and hemisphere, 1001 for the ring)\n"
+        "  -dir <path>   Write the sample set file to the directory, named after the parameters (default .)\n"
+        "  -o <file>     Write the sample set file to this path instead\n"
+        "  -xyz <file>   Also write the samples as an XYZ point cloud\n"
+        "  -v            Log the energy of every iteration\n"
+        "  -csv <file>   Write the iteration, seconds, energy, swaps and active pairs of every\n"
+        "                iteration of the sphere sampler, for charting the energy against the time\n"
+        "       samplegen benchmark [num] [options]\n"
+        "  -min <d>      The target minimum distance relative to the hexagonal packing (default 0)\n"
+        "  -energy <g>   The target normalized energy, 0.0802 for the hexagonal lattice (default 1)\n"
+        "  -seed <n>     The seed of the random generators (default 1)\n"
+        "       samplegen kernel <uniform|cosine|powercosine> <num> [options]\n"
+        "  -exponent <e> The exponent of the power cosine (default 4)\n"
+        "  -seed <n>     The seed of the scrambling (default 1)\n"
+        "  -xyz <file>   Write the directions as an XYZ point cloud\n"
+        "  -hlsl <file>  Write the directions and weights as a float4 array\n");
+}
+
+//
+// The benchmark
+//
+struct Generated
+{
+    std::vector<float> points;
+    double             milliseconds;
+};
+
+struct Candidate
+{
+    const char* name;
+    double      milliseconds;
+    double      minDistance;
+    double      energy;
+};
+
+static double millisecondsSince(uint64_t start)
+{
+    return timerSecondsSince(start) * 1000.0;
+}
+
+// White noise, the baseline.
+static void randomSquare(uint32_t n, uint32_t seed, std::vector<float>* points)
+{
+    RandomPCG32 random;
+    randomPCG32Seed(&random, seed, 0);
+    points->resize(n * 2);
+    for (uint32_t i = 0; i < n * 2; ++i)
+    {
+        (*points)[i] = randomPCG32Float(&random);
+    }
+}
+
+static void jitteredSquare(uint32_t n, uint32_t seed, std::vector<float>* points)
+{
+    uint32_t nx = (uint32_t)(sqrt((double)n) + 0.5);
+    samplingJittered2D(nx, (n + nx - 1) / nx, 1.0f, seed, points);
+}
+
+// Poisson-disk sets for about n points; the radius is guessed from the
+// packing distance and corrected once by the count.
+static void poissonDisk(uint32_t n, uint32_t numComponents, uint32_t seed, std::vector<float>* points)
+{
+    float distance = 0.75f * samplingPackingDistance(n, numComponents);
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        if (numComponents == 2)
+        {
+            samplingPoissonDisk2D(distance, 30, seed, points);
+        }
+        else
+        {
+            samplingPoissonDiskSphere(distance, 30, seed, points);
+        }
+        uint32_t count = (uint32_t)(points->size() / numComponents);
+        distance *= sqrtf((float)count / (float)n);
+    }
+}
+
+static void report(const char* name, const std::vector<float>& points, uint32_t numComponents,
+    double milliseconds, uint32_t seed, std::vector<Candidate>* candidates)
+{
+    uint32_t n = (uint32_t)(points.size() / numComponents);
+    double minDistance = samplingMinDistance(&points[0], n, numComponents) / samplingPackingDistance(n, numComponents);
+    // 256 reference points per sample, as SphereSampler has.
+    uint32_t numReference = n * 256;
+    double energy = samplingNormalizedEnergy(samplingEnergy(&points[0], n, numComponents, numReference, seed),
+        n, numComponents, numReference);
+
+    if (numComponents == 2)
+    {
+        fprintf(stderr, "  %-13s %6u %10.3f %8.3f %10.6f %8.4f %8.3f\n", name, n, milliseconds, minDistance,
+            samplingL2Discrepancy2D(&points[0], n), energy, samplingLowFrequencyPower2D(&points[0], n));
+    }
+    else
+    {
+        fprintf(stderr, "  %-13s %6u %10.3f %8.3f %10.6f %8.4f\n", name, n, milliseconds, minDistance,
+            samplingCapDiscrepancySphere(&points[0], n), energy);
+    }
+
+    Candidate candidate = { name, milliseconds, minDistance, energy };
+    candidates->push_back(candidate);
+}
+
+static void pick(const std::vector<Candidate>& candidates, double targetMin, double targetEnergy)
+{
+    const Candidate* best = NULL;
+    for (size_t i = 0; i < candidates.size(); ++i)
+    {
+        const Candidate& c = candidates[i];
+        if (c.minDistance >= targetMin && c.energy <= targetEnergy &&
+            (best == NULL || c.milliseconds < best->milliseconds))
+        {
+            best = &c;
+        }
+    }
+    if (best != NULL)
+    {
+        fprintf(stderr, "  The cheapest one meeting the target: %s.\n", best->name);
+    }
+    else
+    {
+        fprintf(stderr, "  None meets the target.\n");
+    }
+}
+
+static bool writeProgress(const SphereSamplerProgress& progress, void* userData)
+{
+    fprintf((FILE*)userData, "%d,%.6f,%.6f,%u,%u\n", progress.iteration, progress.totalSeconds, progress.energy,
+        progress.numSwaps, progress.numActivePairs);
+    return true;
+}
+
+static int benchmark(int argc, char** argv)
+{
+    uint32_t n = 1024;
+    double targetMin = 0.0;
+    double targetEnergy = 1.0;
+    uint32_t seed = 1;
+    int i = 2;
+    if (i < argc && argv[i][0] != '-')
+    {
+        n = (uint32_t)atoi(argv[i++]);
+        if (n < 2)
+        {
+            fprintf(stderr, "Invalid number of samples %s.\n", argv[i - 1]);
+            return 1;
+        }
+    }
+    for (; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-min") == 0 && i + 1 < argc)
+        {
+            targetMin = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-energy") == 0 && i + 1 < argc)
+        {
+            targetEnergy = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+        {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s.\n", argv[i]);
+            usage();
+            return 1;
+        }
+    }
+
+    // The distances are relative to the hexagonal packing and the energy
+    // normalized, so the numbers do not depend on the count.
+    std::vector<Candidate> candidates;
+    std::vector<float> square;
+    std::vector<float> points;
+    uint64_t start;
+
+    fprintf(stderr, "Square, %u samples\n", n);
+    fprintf(stderr, "  %-13s %6s %10s %8s %10s %8s %8s\n", "generator", "n", "ms", "min", "L2 star", "energy", "low freq");
+
+    start = timerNow();
+    randomSquare(n, seed, &points);
+    report("random", points, 2, millisecondsSince(start), seed, &candidates);
+
+    start = timerNow();
+    jitteredSquare(n, seed, &points);
+    report("jittered", points, 2, millisecondsSince(start), seed, &candidates);
+
+    start = timerNow();
+    samplingSobol2D(n, seed, &points);
+    report("sobol", points, 2, millisecondsSince(start), seed, &candidates);
+
+    start = timerNow();
+    samplingHalton2D(n, seed, &points);
+    report("halton", points, 2, millisecondsSince(start), seed, &candidates);
+
+    start = timerNow();
+    poissonDisk(n, 2, seed, &points);
+    report("poisson", points, 2, millisecondsSince(start), seed, &candidates);
+
+    pick(candidates, targetMin, targetEnergy);
+    candidates.clear();
+
+    fprintf(stderr, "Sphere, %u samples\n", n);
+    fprintf(stderr, "  %-13s %6s %10s %8s %10s %8s\n", "generator", "n", "ms", "min", "cap", "energy");
+
+    start = timerNow();
+    randomSquare(n, seed, &square);
+    samplingSquareToSphere(&square[0], n, &points);
+    report("random", points, 3, millisecondsSince(start), seed, &candidates);
+
+    start = timerNow();
+    jitteredSquare(n, seed, &square);
+    samplingSquareToSphere(&square[0], (uint32_t)(square.size() / 2), &points);
+    report("jittered", points, 3, millisecondsSince(start), seed, &candidates);
+
+    start = timerNow();
+    samplingSobol2D(n, seed, &square);
+    samplingSquareToSphere(&square[0], n, &points);
+    report("sobol", points, 3, millisecondsSince(start), seed, &candidates);
+
+    start = timerNow();
+    samplingHalton2D(n, seed, &square);
+    samplingSquareToSphere(&square[0], n, &points);
+    report("halton", points, 3, millisecondsSince(start), seed, &candidates);
+
+    start = timerNow();
+    samplingFibonacciSphere(n, &points);
+    report("fibonacci", points, 3, millisecondsSince(start), seed, &candidates);
+
+    start = timerNow();
+    poissonDisk(n, 3, seed, &points);
+    report("poisson", points, 3, millisecondsSince(start), seed, &candidates);
+
+    // It takes minutes beyond that.
+    if (n <= 1024)
+    {
+        SampleSetKey key;
+        key.type = SAMPLESET_SPHERE;
+        key.numSamples = n;
+        key.capacity = SphereSampler::pointsPerSample();
+        key.seed = 10001;
+
+        start = timerNow();
+        generateSamples(key, false, &points);
+        double milliseconds = millisecondsSince(start);
+        // The centers are the means of the points of the samples.
+        for (uint32_t s = 0; s < n; ++s)
+        {
+            float* p = &points[s * 3];
+            float l = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+            p[0] /= l;
+            p[1] /= l;
+            p[2] /= l;
+        }
+        report("spheresampler", points, 3, milliseconds, seed, &candidates);
+    }
+
+    pick(candidates, targetMin, targetEnergy);
+
+    return 0;
+}
+
+//
+// Hemisphere kernels
+//
+static int kernel(int argc, char** argv)
+{
+    static const char* typeNames[] = { "uniform", "cosine", "powercosine" };
+
+    if (argc < 4)
+    {
+        usage();
+        return 1;
+    }
+    uint32_t type = 0;
+    while (type < 3 && strcmp(argv[2], typeNames[type]) != 0)
+    {
+        ++type;
+    }
+    if (type == 3)
+    {
+        fprintf(stderr, "Unknown kernel type %s.\n", argv[2]);
+        usage();
+        return 1;
+    }
+    int num = atoi(argv[3]);
+    if (num <= 0)
+    {
+        fprintf(stderr, "Invalid number of samples %s.\n", argv[3]);
+        return 1;
+    }
+
+    float exponent = 4.0f;
+    uint32_t seed = 1;
+    const char* xyz = NULL;
+    const char* hlsl = NULL;
+    for (int i = 4; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-exponent") == 0 && i + 1 < argc)
+        {
+            exponent = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+        {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-xyz") == 0 && i + 1 < argc)
+        {
+            xyz = argv[++i];
+        }
+        else if (strcmp(argv[i], "-hlsl") == 0 && i + 1 < argc)
+        {
+            hlsl = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s.\n", argv[i]);
+            usage();
+            return 1;
+        }
+    }
+    if (exponent < 0.0f)
+    {
+        fprintf(stderr, "Invalid exponent %f.\n", exponent);
+        return 1;
+    }
+
+    uint32_t n = (uint32_t)num;
+    std::vector<float> points;
+    samplingHemisphere(type, exponent, n, seed, &points);
+    std::vector<float> samples(n * 4);
+    samplingHemisphereKernel(&points[0], n, type, exponent, &samples[0]);
+
+    if (xyz != NULL)
+    {
+        SampleSetKey key;
+        key.type = SAMPLESET_HEMISPHERE;
+        key.numSamples = n;
+        key.capacity = 0;
+        key.seed = seed;
+        if (!sampleSetWriteXYZ(xyz, &key, &points[0]))
+        {
+            fprintf(stderr, "Failed to write %s.\n", xyz);
+            return 1;
+        }
+        fprintf(stderr, "Wrote %s.\n", xyz);
+    }
+
+    if (hlsl != NULL)
+    {
+        FILE* fp = fopen(hlsl, "w");
+        if (fp == NULL)
+        {
+            fprintf(stderr, "Failed to write %s.\n", hlsl);
+            return 1;
+        }
+        if (type == SAMPLING_HEMISPHERE_POWER_COSINE)
+        {
+            fprintf(fp, "// samplegen kernel %s %u -exponent %g -seed %u\n", typeNames[type], n, exponent, seed);
+        }
+        else
+        {
+            fprintf(fp, "// samplegen kernel %s %u -seed %u\n", typeNames[type], n, seed);
+        }
+        fprintf(fp, "// The directions around +y and their weights; any prefix of them is a\n"
+                    "// kernel. The occlusion of the first k is sum(w * V) / k.\n");
+        if (type == SAMPLING_HEMISPHERE_POWER_COSINE)
+        {
+            fprintf(fp, "// The weights are 1: it is the occlusion weighted by cos^%g, not by the\n"
+                        "// cosine.\n", exponent);
+        }
+        fprintf(fp, "static const uint NUM_KERNEL_SAMPLES = %u;\n", n);
+        fprintf(fp, "static const float4 KernelSamples[%u] =\n{\n", n);
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            const float* s = &samples[i * 4];
+            fprintf(fp, "    float4(%9.6f, %9.6f, %9.6f, %9.6f),\n", s[0], s[1], s[2], s[3]);
+        }
+        fprintf(fp, "};\n");
+        if (fclose(fp) != 0)
+        {
+            fprintf(stderr, "Failed to write %s.\n", hlsl);
+            return 1;
+        }
+        fprintf(stderr, "Wrote %s.\n", hlsl);
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "benchmark") == 0)
+    {
+        return benchmark(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "kernel") == 0)
+    {
+        return kernel(argc, argv);
+    }
+
+    if (argc < 3)
+    {
+        usage();
+        return 1;
+    }
+
+    SampleSetKey key;
+    key.type = sampleSetTypeFromName(argv[1]);
+    if (key.type == SAMPLESET_NUM_TYPES)
+    {
+        fprintf(stderr, "Unknown sample set type %s.\n", argv[1]);
+        usage();
+        return 1;
+    }
+    int num = atoi(argv[2]);
+    if (num <= 0)
+    {
+        fprintf(stderr, "Invalid number of samples %s.\n", argv[2]);
+        return 1;
+    }
+    key.numSamples = (uint32_t)num;
+    key.capacity = key.type == SAMPLESET_RING? 0 : SphereSampler::pointsPerSample();
+    key.seed = key.type == SAMPLESET_RING? 1001 : 10001;
+
+    const char* directory = ".";
+    const char* output = NULL;
+    const char* xyz = NULL;
+    const char* csv = NULL;
+    bool verbose = false;
+    for (int i = 3; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+        {
+            key.seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-dir") == 0 && i + 1 < argc)
+        {
+            directory = argv[++i];
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (strcmp(argv[i], "-xyz") == 0 && i + 1 < argc)
+        {
+            xyz = argv[++i];
+        }
+        else if (strcmp(argv[i], "-csv") == 0 && i + 1 < argc)
+        {
+            csv = argv[++i];
+        }
+        else if (strcmp(argv[i], "-v") == 0)
+        {
+            verbose = true;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s.\n", argv[i]);
+            usage();
+            return 1;
+        }
+    }
+
+    std::vector<float> samples;
+    if (csv != NULL)
+    {
+        FILE* fp = fopen(csv, "w");
+        if (fp == NULL)
+        {
+            fprintf(stderr, "Failed to write %s.\n", csv);
+            return 1;
+        }
+        fprintf(fp, "iteration,seconds,energy,swaps,active pairs\n");
+        generateSamples(key, verbose, &samples, writeProgress, fp);
+        fclose(fp);
+    }
+    else
+    {
+        generateSamples(key, verbose, &samples);
+    }
+
+    char path[1024];
+    if (output != NULL)
+    {
+        strncpy(path, output, sizeof(path) - 1);
+        path[sizeof(path) - 1] = 0;
+    }
+    else
+    {
+        sampleSetPath(directory, &key, path, sizeof(path));
+    }
+    if (!sampleSetWrite(path, &key, &samples[0]))
+    {
+        fprintf(stderr, "Failed to write %s.\n", path);
+        return 1;
+    }
+    fprintf(stderr, "Wrote %u %s samples to %s.\n", key.numSamples, argv[1], path);
+
+    if (xyz != NULL)
+    {
+        if (!sampleSetWriteXYZ(xyz, &key, &samples[0]))
+        {
+            fprintf(stderr, "Failed to write %s.\n", xyz);
+            return 1;
+        }
+        fprintf(stderr, "Wrote %s.\n", xyz);
+    }
+
+    return 0;
+}